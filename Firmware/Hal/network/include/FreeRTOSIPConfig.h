@@ -351,6 +351,13 @@ FTP and HTTP servers both execute in the standard server task. */
 #define ipconfigFTP_TX_WINSIZE				( 2 )
 #define ipconfigFTP_RX_BUFSIZE				( 8 * ipconfigTCP_MSS )
 #define ipconfigFTP_RX_WINSIZE				( 4 )
+/* Used for the FTP data connection instead when ftp_fast_mode is set.  The
+MSS is already the most a 1500 byte MTU allows, so it is the window that is
+made bigger. */
+#define ipconfigFTP_FAST_TX_BUFSIZE			( 16 * ipconfigTCP_MSS )
+#define ipconfigFTP_FAST_TX_WINSIZE			( 8 )
+#define ipconfigFTP_FAST_RX_BUFSIZE			( 32 * ipconfigTCP_MSS )
+#define ipconfigFTP_FAST_RX_WINSIZE			( 16 )
 #define ipconfigHTTP_TX_BUFSIZE				( 3 * ipconfigTCP_MSS )
 #define ipconfigHTTP_TX_WINSIZE				( 2 )
 #define ipconfigHTTP_RX_BUFSIZE				( 4 * ipconfigTCP_MSS )
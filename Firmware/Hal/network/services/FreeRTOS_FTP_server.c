@@ -49,6 +49,8 @@
 #include "FreeRTOS_TCP_server.h"
 #include "FreeRTOS_server_private.h"
 
+#include "ftp_writer.h"
+
 /* Remove the whole file if FTP is not supported. */
 #if ( ipconfigUSE_FTP == 1 )
 
@@ -142,8 +144,6 @@ static void prvTransferCloseDir( FTPClient_t * pxClient );
  */
 static BaseType_t prvGetTransferType( const char * pcType );
 
-#if ( ipconfigHAS_PRINTF != 0 )
-
 /*
  * For nice logging: write an amount (number of bytes), e.g. 3512200 as
  * "3.45 MB"
@@ -151,17 +151,11 @@ static BaseType_t prvGetTransferType( const char * pcType );
 static const char * pcMkSize( uint32_t ulAmount,
                               char * pcBuffer,
                               BaseType_t xBufferSize );
-#endif
-
-#if ( ipconfigHAS_PRINTF != 0 )
 
 /*
- * Calculate the average as bytes-per-second, when amount and milliseconds
- * are known.
+ * True while a file is being received, either through stdio or ftp_writer.
  */
-static uint32_t ulGetAverage( uint32_t ulAmount,
-                              TickType_t xDeltaMs );
-#endif
+static BaseType_t prvIsReceiving( const FTPClient_t * pxClient );
 
 /*
  * A port command looks like: PORT h1,h2,h3,h4,p1,p2. Parse it and translate it
@@ -366,7 +360,7 @@ BaseType_t xFTPClientWork( TCPClient_t * pxTCPClient )
 			} else if( pxClient->pxReadHandle != NULL ) {
 				/* Sending a file. */
 				xClientRc = prvRetrieveFileWork( pxClient );
-			} else if( pxClient->pxWriteHandle != NULL ) {
+			} else if( prvIsReceiving( pxClient ) ) {
 				/* Receiving a file. */
 				xClientRc = prvStoreFileWork( pxClient );
 			}
@@ -674,7 +668,7 @@ static BaseType_t prvProcessCommand( FTPClient_t * pxClient,
 
 			case ECMD_SIZE:
 
-				if( pxClient->pxWriteHandle != NULL ) {
+				if( prvIsReceiving( pxClient ) ) {
 					/* This SIZE query is probably about a file which is now being
 					 * received.  If so, return the value of pxClient->ulRecvBytes,
 					 * pcRestCommand points to 'pcCommandBuffer', make it free by
@@ -685,11 +679,11 @@ static BaseType_t prvProcessCommand( FTPClient_t * pxClient,
 					if( strcmp( pcNEW_DIR, pcRestCommand ) == 0 ) {
 						BaseType_t xCount;
 
-						for( xCount = 0; xCount < 3 && pxClient->pxWriteHandle; xCount++ ) {
+						for( xCount = 0; xCount < 3 && prvIsReceiving( pxClient ); xCount++ ) {
 							prvStoreFileWork( pxClient );
 						}
 
-						if( pxClient->pxWriteHandle != NULL ) {
+						if( prvIsReceiving( pxClient ) ) {
 							/* File being queried is still open, return number of
 							 * bytes received until now. */
 							snprintf( pcCOMMAND_BUFFER, sizeof( pcCOMMAND_BUFFER ), "213 %lu\r\n", pxClient->ulRecvBytes );
@@ -855,10 +849,19 @@ static BaseType_t prvTransferConnect( FTPClient_t * pxClient,
 		{
 			/* Fill in the buffer and window sizes that will be used by the
 			 * socket. */
-			xWinProps.lTxBufSize = ipconfigFTP_TX_BUFSIZE;
-			xWinProps.lTxWinSize = ipconfigFTP_TX_WINSIZE;
-			xWinProps.lRxBufSize = ipconfigFTP_RX_BUFSIZE;
-			xWinProps.lRxWinSize = ipconfigFTP_RX_WINSIZE;
+			if( ftp_writer_enabled() ) {
+				/* Fast mode, a large receive window keeps the data coming
+				 * while the sdcard is being written. */
+				xWinProps.lTxBufSize = ipconfigFTP_FAST_TX_BUFSIZE;
+				xWinProps.lTxWinSize = ipconfigFTP_FAST_TX_WINSIZE;
+				xWinProps.lRxBufSize = ipconfigFTP_FAST_RX_BUFSIZE;
+				xWinProps.lRxWinSize = ipconfigFTP_FAST_RX_WINSIZE;
+			} else {
+				xWinProps.lTxBufSize = ipconfigFTP_TX_BUFSIZE;
+				xWinProps.lTxWinSize = ipconfigFTP_TX_WINSIZE;
+				xWinProps.lRxBufSize = ipconfigFTP_RX_BUFSIZE;
+				xWinProps.lRxWinSize = ipconfigFTP_RX_WINSIZE;
+			}
 
 			/* Set the window and buffer sizes. */
 			FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_WIN_PROPERTIES, ( void * ) &xWinProps, sizeof( xWinProps ) );
@@ -1021,9 +1024,17 @@ static void prvTransferCloseSocket( FTPClient_t * pxClient )
 		}
 	}
 
-	if( ( pxClient->pxWriteHandle != NULL ) || ( pxClient->pxReadHandle != NULL ) ) {
+	if( prvIsReceiving( pxClient ) || ( pxClient->pxReadHandle != NULL ) ) {
 		BaseType_t xLength;
 		char pcStrBuf[ 32 ];
+		uint32_t ulMs;
+		uint32_t ulAverage;
+
+		/* The data has to be on the sdcard before the client is told it
+		 * was all received. */
+		if( ( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED ) && ( ftp_writer_flush() != 0 ) ) {
+			pxClient->bits1.bHadError = pdTRUE_UNSIGNED;
+		}
 
 		if( pxClient->bits1.bHadError == pdFALSE_UNSIGNED ) {
 			xLength = snprintf( pxClient->pcClientAck, sizeof( pxClient->pcClientAck ),
@@ -1036,20 +1047,22 @@ static void prvTransferCloseSocket( FTPClient_t * pxClient )
 		/* Tell on the command socket the data connection is now closed. */
 		prvSendReply( pxClient->xSocket, pxClient->pcClientAck, xLength );
 
-#if ( ipconfigHAS_PRINTF != 0 )
-		{
-			TickType_t xDelta;
-			uint32_t ulAverage;
-			xDelta = xTaskGetTickCount() - pxClient->xStartTime;
-			ulAverage = ulGetAverage( pxClient->ulRecvBytes, xDelta );
-
-			FreeRTOS_printf( ( "FTP: %s: '%s' %lu Bytes (%s/sec)\n",
-			                   pxClient->pxReadHandle ? "sent" : "recv",
-			                   pxClient->pcFileName,
-			                   pxClient->ulRecvBytes,
-			                   pcMkSize( ulAverage, pcStrBuf, sizeof( pcStrBuf ) ) ) );
+		/* Always logged so the transfer rate can be checked. */
+		ulMs = ( xTaskGetTickCount() - pxClient->xStartTime ) * portTICK_PERIOD_MS;
+		ulAverage = ( ulMs == 0ul ) ? 0ul : ( uint32_t ) ( ( ( uint64_t ) pxClient->ulRecvBytes * 1000ull ) / ulMs );
+
+		printf( "FTP: %s: '%s' %lu bytes in %lu.%03lu secs (%s/sec)",
+		        pxClient->pxReadHandle ? "sent" : "recv",
+		        pxClient->pcFileName,
+		        pxClient->ulRecvBytes,
+		        ulMs / 1000ul, ulMs % 1000ul,
+		        pcMkSize( ulAverage, pcStrBuf, sizeof( pcStrBuf ) ) );
+
+		if( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED ) {
+			printf( ", waited %lu ms for the sdcard", ftp_writer_wait_ms() );
 		}
-#endif /* if ( ipconfigHAS_PRINTF != 0 ) */
+
+		printf( "%s\n", pxClient->bits1.bHadError ? ", failed" : "" );
 	}
 
 	if( pxClient->xTransferSocket != FREERTOS_NO_SOCKET ) {
@@ -1074,9 +1087,14 @@ static void prvTransferCloseSocket( FTPClient_t * pxClient )
 
 static void prvTransferCloseFile( FTPClient_t * pxClient )
 {
-	if( pxClient->pxWriteHandle != NULL ) {
-		ff_fclose( pxClient->pxWriteHandle );
-		pxClient->pxWriteHandle = NULL;
+	if( prvIsReceiving( pxClient ) ) {
+		if( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED ) {
+			ftp_writer_close();
+			pxClient->bits1.bFastWrite = pdFALSE_UNSIGNED;
+		} else {
+			ff_fclose( pxClient->pxWriteHandle );
+			pxClient->pxWriteHandle = NULL;
+		}
 #if ( ipconfigFTP_HAS_RECEIVED_HOOK != 0 )
 		{
 			vApplicationFTPReceivedHook( pxClient->pcFileName, pxClient->ulRecvBytes, pxClient );
@@ -1139,7 +1157,6 @@ static BaseType_t prvGetTransferType( const char * pcType )
 }
 /*-----------------------------------------------------------*/
 
-#if ( ipconfigHAS_PRINTF != 0 )
 #define SIZE_1_GB	 ( 1024ul * 1024ul * 1024ul )
 #define SIZE_1_MB	 ( 1024ul * 1024ul )
 #define SIZE_1_KB	 ( 1024ul )
@@ -1171,40 +1188,12 @@ static const char * pcMkSize( uint32_t ulAmount,
 	return pcBuffer;
 }
 /*-----------------------------------------------------------*/
-#endif /* ipconfigHAS_PRINTF != 0 */
 
-#if ( ipconfigHAS_PRINTF != 0 )
-static uint32_t ulGetAverage( uint32_t ulAmount,
-                              TickType_t xDeltaMs )
+static BaseType_t prvIsReceiving( const FTPClient_t * pxClient )
 {
-	uint32_t ulAverage;
-
-	/* Get the average amount of bytes per seconds. Ideally this is
-	 * calculated by Multiplying with 1000 and dividing by milliseconds:
-	 *  ulAverage = ( 1000ul * ulAmount ) / xDeltaMs;
-	 * Now get a maximum precision, while avoiding an arithmetic overflow:
-	 */
-	if( xDeltaMs == 0ul ) {
-		/* Time is zero, there is no average  */
-		ulAverage = 0ul;
-	} else if( ulAmount >= ( ~0ul / 10ul ) ) {
-		/* More than 409 MB has been transferred, do not multiply. */
-		ulAverage = ( ulAmount / ( xDeltaMs / 1000ul ) );
-	} else if( ulAmount >= ( ~0ul / 100ul ) ) {
-		/* Between 409 and 41 MB has been transferred, can multiply by 10. */
-		ulAverage = ( ( ulAmount * 10ul ) / ( xDeltaMs / 100ul ) );
-	} else if( ulAmount >= ( ~0ul / 1000ul ) ) {
-		/* Between 4.1 MB and 41 has been transferred, can multiply by 100. */
-		ulAverage = ( ( ulAmount * 100ul ) / ( xDeltaMs / 10ul ) );
-	} else {
-		/* Less than 4.1 MB: can multiply by 1000. */
-		ulAverage = ( ( ulAmount * 1000ul ) / xDeltaMs );
-	}
-
-	return ulAverage;
+	return ( pxClient->pxWriteHandle != NULL ) || ( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED );
 }
 /*-----------------------------------------------------------*/
-#endif /* ipconfigHAS_PRINTF != 0 */
 
 static UBaseType_t prvParsePortData( const char * pcCommand,
                                      uint32_t * pulIPAddress )
@@ -1295,11 +1284,14 @@ static BaseType_t prvStoreFilePrep( FTPClient_t * pxClient,
 				pxNewHandle = NULL;
 			}
 		}
+	} else if( ftp_writer_open( pxClient->pcFileName ) ) {
+		/* Fast mode, written straight to FatFs by the writer task. */
+		pxClient->bits1.bFastWrite = pdTRUE_UNSIGNED;
 	} else {
 		pxNewHandle = ff_fopen( pxClient->pcFileName, "wb" );
 	}
 
-	if( pxNewHandle == NULL ) {
+	if( ( pxNewHandle == NULL ) && ( pxClient->bits1.bFastWrite == pdFALSE_UNSIGNED ) ) {
 		iErrorNo = stdioGET_ERRNO();
 
 		if( iErrorNo == pdFREERTOS_ERRNO_ENOSPC ) {
@@ -1341,12 +1333,53 @@ static BaseType_t prvStoreFilePrep( FTPClient_t * pxClient,
 }
 /*-----------------------------------------------------------*/
 
+/* Fast mode: the data is received straight into the cluster sized buffers
+ * of ftp_writer, which are written to the sdcard by its own task. */
+static BaseType_t prvStoreFileWorkFast( FTPClient_t * pxClient )
+{
+	BaseType_t xRc;
+
+	for( ; ; ) {
+		size_t uxSpace;
+		char * pcBuffer = ftp_writer_get( &uxSpace );
+
+		if( pcBuffer == NULL ) {
+			if( ftp_writer_failed() ) {
+				/* Writing to the sdcard failed. */
+				xRc = -1;
+				pxClient->bits1.bHadError = pdTRUE_UNSIGNED;
+			} else {
+				/* All the buffers are still being written, the data stays in
+				 * the socket and is read next time round. */
+				xRc = 0;
+			}
+			break;
+		}
+
+		xRc = FreeRTOS_recv( pxClient->xTransferSocket, ( void * ) pcBuffer, uxSpace, FREERTOS_MSG_DONTWAIT );
+
+		if( xRc <= 0 ) {
+			break;
+		}
+
+		pxClient->ulRecvBytes += xRc;
+		ftp_writer_commit( xRc );
+	}
+
+	return xRc;
+}
+/*-----------------------------------------------------------*/
+
 #if ( ipconfigFTP_ZERO_COPY_ALIGNED_WRITES == 0 )
 
 static BaseType_t prvStoreFileWork( FTPClient_t * pxClient )
 {
 	BaseType_t xRc, xWritten;
 
+	if( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED ) {
+		return prvStoreFileWorkFast( pxClient );
+	}
+
 	/* Read from the data socket until all has been read or until a negative value
 	 * is returned. */
 	for( ; ; ) {
@@ -1388,6 +1421,10 @@ static BaseType_t prvStoreFileWork( FTPClient_t * pxClient )
 {
 	BaseType_t xRc, xWritten;
 
+	if( pxClient->bits1.bFastWrite != pdFALSE_UNSIGNED ) {
+		return prvStoreFileWorkFast( pxClient );
+	}
+
 	/* Read from the data socket until all has been read or until a negative
 	 * value is returned. */
 	for( ; ; ) {
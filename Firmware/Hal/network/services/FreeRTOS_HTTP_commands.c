@@ -56,6 +56,9 @@ const char * webCodename( int aCode )
 		case WEB_NO_CONTENT: /* 204 */
 			return "No content";
 
+		case WEB_NOT_MODIFIED: /* 304 */
+			return "Not Modified";
+
 		case WEB_BAD_REQUEST: /*  = 400, */
 			return "Bad request";
 
@@ -30,6 +30,7 @@ enum
 {
 	WEB_REPLY_OK = 200,
 	WEB_NO_CONTENT = 204,
+	WEB_NOT_MODIFIED = 304,
 	WEB_BAD_REQUEST = 400,
 	WEB_UNAUTHORIZED = 401,
 	WEB_NOT_FOUND = 404,
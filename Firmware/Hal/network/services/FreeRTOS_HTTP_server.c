@@ -138,6 +138,8 @@ static void prvFileClose( HTTPClient_t * pxClient )
         ff_fclose( pxClient->pxFileHandle );
         pxClient->pxFileHandle = NULL;
     }
+    http_cache_release( &pxClient->xFile );
+    pxClient->bits.bSending = pdFALSE_UNSIGNED;
 }
 /*-----------------------------------------------------------*/
 
@@ -156,11 +158,12 @@ static BaseType_t prvSendReply( HTTPClient_t * pxClient,
                     "Transfer-Encoding: chunked\r\n"
 #endif
                     "Content-Type: %s\r\n"
-                    "Connection: keep-alive\r\n"
+                    "Connection: %s\r\n"
                     "%s\r\n",
                     ( int ) xCode,
                     webCodename( xCode ),
                     pxClient->pcContentsType[ 0 ] ? pxClient->pcContentsType : "text/html",
+                    pxClient->bits.bClose ? "close" : "keep-alive",
                     pxClient->pcExtraContents );
 
     pxClient->pcContentsType[ 0 ] = '\0';
@@ -187,9 +190,15 @@ static BaseType_t prvSendFile( HTTPClient_t * pxClient )
     if( pxClient->bits.bReplySent == pdFALSE_UNSIGNED ) {
         pxClient->bits.bReplySent = pdTRUE_UNSIGNED;
 
-        strcpy( pxClient->pcContentsType, pcGetContentsType( pxClient->pcCurrentFilename ) );
+        /* The browser checks with the ETag each time it is used so an updated file is always seen */
         snprintf( pxClient->pcExtraContents, sizeof( pxClient->pcExtraContents ),
-                  "Content-Length: %d\r\n", ( int ) pxClient->uxBytesLeft );
+                  "Content-Length: %d\r\n"
+                  "ETag: %s\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "%s",
+                  ( int ) pxClient->uxBytesLeft,
+                  pxClient->xFile.etag,
+                  pxClient->xFile.gzip ? "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n" : "" );
 
         // FIXME this presumes it is entirely sent, which is false
         xRc = prvSendReply( pxClient, WEB_REPLY_OK );
@@ -206,18 +215,25 @@ static BaseType_t prvSendFile( HTTPClient_t * pxClient )
             }
 
             if( uxCount > 0u ) {
-                if( uxCount > sizeof( pcFILE_BUFFER ) ) {
-                    uxCount = sizeof( pcFILE_BUFFER );
-                }
+                if( pxClient->xFile.data != NULL ) {
+                    /* It is in RAM so is sent from there */
+                    xRc = FreeRTOS_send( pxClient->xSocket, &pxClient->xFile.data[ pxClient->uxSendOffset ], uxCount, 0 );
 
-                ff_fread( pcFILE_BUFFER, 1, uxCount, pxClient->pxFileHandle );
-                pxClient->uxBytesLeft -= uxCount;
+                } else {
+                    if( uxCount > sizeof( pcFILE_BUFFER ) ) {
+                        uxCount = sizeof( pcFILE_BUFFER );
+                    }
 
-                xRc = FreeRTOS_send( pxClient->xSocket, pcFILE_BUFFER, uxCount, 0 );
+                    ff_fread( pcFILE_BUFFER, 1, uxCount, pxClient->pxFileHandle );
+                    xRc = FreeRTOS_send( pxClient->xSocket, pcFILE_BUFFER, uxCount, 0 );
+                }
 
                 if( xRc < 0 ) {
                     break;
                 }
+
+                pxClient->uxBytesLeft -= uxCount;
+                pxClient->uxSendOffset += uxCount;
             }
         } while( uxCount > 0u );
     }
@@ -226,6 +242,8 @@ static BaseType_t prvSendFile( HTTPClient_t * pxClient )
         /* Writing is ready, no need for further 'eSELECT_WRITE' events. */
         FreeRTOS_FD_CLR( pxClient->xSocket, pxClient->pxParent->xSocketSet, eSELECT_WRITE );
         prvFileClose( pxClient );
+        /* Ready for the next request on this connection */
+        FreeRTOS_FD_SET( pxClient->xSocket, pxClient->pxParent->xSocketSet, eSELECT_READ );
     } else {
         /* Wake up the TCP task as soon as this socket may be written to. */
         FreeRTOS_FD_SET( pxClient->xSocket, pxClient->pxParent->xSocketSet, eSELECT_WRITE );
@@ -242,6 +260,8 @@ extern int parse_request_get_method(void *request);
 extern const char *parse_request_get_url(void *request);
 extern const char *parse_request_get_header(const char *hdr, void *request);
 extern const int parse_request_get_headers(const char *hdrs[], int len, void *request);
+extern int parse_request_keep_alive(void *request);
+extern void parse_request_reset(void *request);
 
 static BaseType_t prvHandleFileRequest(HTTPClient_t *pxClient)
 {
@@ -251,26 +271,56 @@ static BaseType_t prvHandleFileRequest(HTTPClient_t *pxClient)
     if(parse_request_get_method(pxClient->request) == 1) { // GET
         const char *url = parse_request_get_url(pxClient->request);
 
-        if(strcmp(url, "/") == 0) {
+        if(strcmp(url, "/") == 0 || strncmp(url, "/?", 2) == 0) {
             url = "/index.html";
         }
 
-        snprintf( pxClient->pcCurrentFilename, sizeof( pxClient->pcCurrentFilename ), "%s%s%s",
+        // any query is not part of the file name
+        snprintf( pxClient->pcCurrentFilename, sizeof( pxClient->pcCurrentFilename ), "%s%.*s",
                   pxClient->pcRootDir,
-                  "",
+                  ( int ) strcspn( url, "?" ),
                   url );
 
-        pxClient->pxFileHandle = ff_fopen( pxClient->pcCurrentFilename, "rb" );
+        // use the precompressed file.gz if there is one and the browser can take it
+        const char *pcEncodings = parse_request_get_header("Accept-Encoding", pxClient->request);
+        int xGzip = pcEncodings != NULL && strstr(pcEncodings, "gzip") != NULL;
+        int xFound = http_cache_get( pxClient->pcCurrentFilename, xGzip, &pxClient->xFile );
+
+        strcpy( pxClient->pcContentsType, pcGetContentsType( pxClient->pcCurrentFilename ) );
+
+        if( xFound && pxClient->xFile.data == NULL ) {
+            // not cached so it is read from the file as it is sent
+            if( pxClient->xFile.gzip ) {
+                strncat( pxClient->pcCurrentFilename, ".gz", sizeof( pxClient->pcCurrentFilename ) - strlen( pxClient->pcCurrentFilename ) - 1 );
+            }
+            pxClient->pxFileHandle = ff_fopen( pxClient->pcCurrentFilename, "rb" );
+            xFound = pxClient->pxFileHandle != NULL;
+        }
+
+        FreeRTOS_printf( ( "Open file '%s': %s %s\n", pxClient->pcCurrentFilename,
+                           xFound ? "Ok" : "Failed", pxClient->xFile.data != NULL ? "cached" : "" ) );
 
-        FreeRTOS_printf( ( "Open file '%s': %s-(%d) %s\n", pxClient->pcCurrentFilename,
-                           pxClient->pxFileHandle != NULL ? "Ok" : "Failed", stdioGET_ERRNO(), strerror( stdioGET_ERRNO() ) ) );
+        const char *pcMatch = parse_request_get_header("If-None-Match", pxClient->request);
 
-        if( pxClient->pxFileHandle == NULL ) {
+        if( !xFound ) {
+            prvFileClose( pxClient );
+            pxClient->pcContentsType[ 0 ] = '\0';
             strcpy( pxClient->pcExtraContents, "Content-Length: 0\r\n" );
             /* "404 File not found". */
             xRc = prvSendReply( pxClient, WEB_NOT_FOUND );
+
+        } else if( pcMatch != NULL && strcmp( pcMatch, pxClient->xFile.etag ) == 0 ) {
+            // the browser already has it
+            snprintf( pxClient->pcExtraContents, sizeof( pxClient->pcExtraContents ), "ETag: %s\r\n", pxClient->xFile.etag );
+            prvFileClose( pxClient );
+            xRc = prvSendReply( pxClient, WEB_NOT_MODIFIED );
+
         } else {
-            pxClient->uxBytesLeft = ( size_t ) getFileSize(pxClient->pxFileHandle);
+            pxClient->uxBytesLeft = pxClient->xFile.size;
+            pxClient->uxSendOffset = 0;
+            pxClient->bits.bSending = pdTRUE_UNSIGNED;
+            // the next request is not read until this has been sent
+            FreeRTOS_FD_CLR( pxClient->xSocket, pxClient->pxParent->xSocketSet, eSELECT_READ );
             xRc = prvSendFile( pxClient );
         }
 
@@ -395,7 +445,12 @@ BaseType_t xHTTPClientWork( TCPClient_t * pxTCPClient )
         return websocket_work(pxClient);
     }
 
-    if( pxClient->pxFileHandle != NULL ) {
+    if( pxClient->bits.bSending ) {
+        if((FreeRTOS_FD_ISSET(pxClient->xSocket, pxClient->pxParent->xSocketSet) & eSELECT_EXCEPT) != 0) {
+            // it went away part way through
+            return -1;
+        }
+
         if((FreeRTOS_FD_ISSET(pxClient->xSocket, pxClient->pxParent->xSocketSet) & eSELECT_WRITE) != 0) {
             // continue sending file
             xRc= prvSendFile( pxClient );
@@ -404,6 +459,17 @@ BaseType_t xHTTPClientWork( TCPClient_t * pxTCPClient )
                 return xRc; // if it got an error we can stop here
             }
         }
+
+        if( pxClient->bits.bSending ) {
+            // wait for it to be sent before reading the next request
+            return 0;
+        }
+
+        if( pxClient->bits.bClose ) {
+            // the client did not want the connection kept open, the FIN goes after the rest of the reply
+            FreeRTOS_shutdown( pxClient->xSocket, FREERTOS_SHUT_RDWR );
+        }
+        return 0;
     }
 
     // check if the socket has a read
@@ -426,10 +492,16 @@ BaseType_t xHTTPClientWork( TCPClient_t * pxTCPClient )
         if(needmore == 1) {
             // we have the request and headers
             pxClient->bits.ulFlags = 0; // clear flags
+            pxClient->bits.bClose = !parse_request_keep_alive(pxClient->request);
             FreeRTOS_printf( ("xHTTPClientWork: file request\n") );
             xRc = prvHandleFileRequest(pxClient);
-            parse_request_release(pxClient->request);
-            pxClient->request = NULL;
+            // the parser is kept for the next request on this connection, browsers do not pipeline requests
+            // so anything after this one in the buffer is dropped
+            parse_request_reset(pxClient->request);
+            if(xRc >= 0 && pxClient->bits.bClose && !pxClient->bits.bSending) {
+                // the whole reply has been queued, the FIN goes after it
+                FreeRTOS_shutdown( pxClient->xSocket, FREERTOS_SHUT_RDWR );
+            }
 
         } else if(needmore >= 2) {
             // we have a web socket request
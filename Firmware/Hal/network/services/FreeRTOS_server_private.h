@@ -34,6 +34,7 @@
 
 /* FreeRTOS+FAT */
 #include "ff_stdio.h"
+#include "http_cache.h"
 
 /* Each HTTP server has 1, at most 2 sockets */
 #define HTTP_SOCKET_COUNT    2
@@ -92,10 +93,14 @@ struct xHTTP_CLIENT
 	char pcContentsType[40];  /* Space for the msg: "text/javascript" */
 	char pcExtraContents[256]; /* Space for the websocket headers */
     void *request;
+    http_file_t xFile; /* The file being sent, if it is cached its data is sent straight from RAM */
+    size_t uxSendOffset;
 	union {
 		struct {
 			uint32_t bReplySent:1;
             uint32_t bWebSocket:1;
+            uint32_t bSending:1; /* A file is being sent, the next request is not read until it is done */
+            uint32_t bClose:1; /* Close the connection once the reply is sent */
 		};
 		uint32_t ulFlags;
 	} bits;
@@ -151,7 +156,8 @@ struct xFTP_CLIENT
 				bDirHasEntry : 1,     /* pdTRUE if ff_findfirst() was successful. */
 				bClientConnected : 1, /* pdTRUE after connect() or accept() has succeeded. */
 				bEmptyFile : 1,       /* pdTRUE if a connection-without-data was received. */
-				bHadError : 1;        /* pdTRUE if a transfer got aborted because of an error. */
+				bHadError : 1,        /* pdTRUE if a transfer got aborted because of an error. */
+				bFastWrite : 1;       /* pdTRUE if the file being received is written by ftp_writer. */
 		};
 		uint32_t ulConnFlags;
 	}
@@ -0,0 +1,201 @@
+#include "ftp_writer.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include "ff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    char *data;
+    uint32_t len;
+} wbuf_t;
+
+static QueueHandle_t free_queue;
+// buffers to be written, a NULL buffer marks where a flush is waiting
+static QueueHandle_t write_queue;
+static SemaphoreHandle_t flushed_sem;
+static uint32_t nbuffers;
+static uint32_t buffer_size;
+static char *buffers[FTP_WRITER_MAX_BUFFERS];
+// the buffer the server is filling
+static wbuf_t current;
+static FIL fil;
+static int in_use;
+static volatile int write_error;
+static uint32_t wait_ms;
+
+static void writer_task(void *arg)
+{
+    wbuf_t b;
+    for(;;) {
+        xQueueReceive(write_queue, &b, portMAX_DELAY);
+        if(b.data == NULL) {
+            // everything queued before it has been written
+            xSemaphoreGive(flushed_sem);
+            continue;
+        }
+
+        // once one fails the rest are thrown away
+        if(!write_error) {
+            UINT n;
+            FRESULT res = f_write(&fil, b.data, b.len, &n);
+            if(res != FR_OK || n != b.len) {
+                printf("ERROR: ftp_writer: write failed: %d, wrote %u of %lu\n", res, n, b.len);
+                write_error = 1;
+            }
+        }
+
+        xQueueSend(free_queue, &b, portMAX_DELAY);
+    }
+}
+
+int ftp_writer_init(uint32_t n)
+{
+    if(n < 2) n = 2;
+    if(n > FTP_WRITER_MAX_BUFFERS) n = FTP_WRITER_MAX_BUFFERS;
+
+    if(write_queue == NULL) {
+        free_queue = xQueueCreate(FTP_WRITER_MAX_BUFFERS, sizeof(wbuf_t));
+        write_queue = xQueueCreate(FTP_WRITER_MAX_BUFFERS + 1, sizeof(wbuf_t));
+        flushed_sem = xSemaphoreCreateBinary();
+        if(free_queue == NULL || write_queue == NULL || flushed_sem == NULL) {
+            printf("ERROR: ftp_writer: could not create the queues\n");
+            return 0;
+        }
+        // same priority as the server task, it spends most of its time waiting on the sdcard DMA
+        // f_write needs as much stack as the other tasks that use FatFs
+        if(xTaskCreate(writer_task, "FTPWriter", 1024, NULL, (tskIDLE_PRIORITY + 1UL), NULL) != pdPASS) {
+            printf("ERROR: ftp_writer: could not create the task\n");
+            return 0;
+        }
+    }
+
+    nbuffers = n;
+    return 1;
+}
+
+int ftp_writer_enabled(void)
+{
+    return nbuffers > 0;
+}
+
+static void free_buffers(void)
+{
+    for (uint32_t i = 0; i < nbuffers; ++i) {
+        free(buffers[i]);
+        buffers[i] = NULL;
+    }
+}
+
+int ftp_writer_open(const char *fn)
+{
+    if(nbuffers == 0 || in_use) return 0;
+
+    if(f_open(&fil, fn, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return 0;
+
+    // a whole number of clusters, or part of a very big one, so each write starts on a cluster
+    uint32_t cluster = fil.obj.fs->csize * FF_MAX_SS;
+    buffer_size = cluster;
+    while(buffer_size < FTP_WRITER_MIN_BUFFER) buffer_size *= 2;
+    if(buffer_size > FTP_WRITER_MAX_BUFFER) buffer_size = FTP_WRITER_MAX_BUFFER;
+
+    // the heap is in AXI SRAM which the sdcard DMA can get to, and malloc aligns it
+    xQueueReset(free_queue);
+    for (uint32_t i = 0; i < nbuffers; ++i) {
+        buffers[i] = malloc(buffer_size);
+        if(buffers[i] == NULL) {
+            printf("WARNING: ftp_writer: not enough memory for %lu buffers of %lu bytes\n", nbuffers, buffer_size);
+            free_buffers();
+            f_close(&fil);
+            return 0;
+        }
+        wbuf_t b = {buffers[i], 0};
+        xQueueSend(free_queue, &b, 0);
+    }
+
+    current.data = NULL;
+    write_error = 0;
+    wait_ms = 0;
+    in_use = 1;
+    return 1;
+}
+
+char *ftp_writer_get(size_t *space)
+{
+    if(write_error) return NULL;
+
+    if(current.data == NULL) {
+        // only waits a little as the server task also looks after the other clients, the data is left
+        // in the socket when they are all being written which holds off the sender through the TCP window
+        TickType_t t = xTaskGetTickCount();
+        BaseType_t got = xQueueReceive(free_queue, &current, pdMS_TO_TICKS(FTP_WRITER_GET_WAIT_MS));
+        wait_ms += (xTaskGetTickCount() - t) * portTICK_PERIOD_MS;
+        if(got != pdTRUE) {
+            current.data = NULL;
+            *space = 0;
+            return NULL;
+        }
+        current.len = 0;
+    }
+
+    *space = buffer_size - current.len;
+    return current.data + current.len;
+}
+
+void ftp_writer_commit(size_t n)
+{
+    current.len += n;
+    if(current.len >= buffer_size) {
+        // there is always room as there are only nbuffers
+        xQueueSend(write_queue, &current, portMAX_DELAY);
+        current.data = NULL;
+    }
+}
+
+int ftp_writer_flush(void)
+{
+    if(!in_use) return 0;
+
+    if(current.data != NULL) {
+        xQueueSend(current.len > 0 ? write_queue : free_queue, &current, portMAX_DELAY);
+        current.data = NULL;
+    }
+
+    wbuf_t marker = {NULL, 0};
+    xQueueSend(write_queue, &marker, portMAX_DELAY);
+    xSemaphoreTake(flushed_sem, portMAX_DELAY);
+
+    // updates the directory entry so the file is complete even if it is not closed
+    if(!write_error && f_sync(&fil) != FR_OK) {
+        printf("ERROR: ftp_writer: sync failed\n");
+        write_error = 1;
+    }
+
+    return write_error ? -1 : 0;
+}
+
+int ftp_writer_close(void)
+{
+    if(!in_use) return 0;
+
+    int ret = ftp_writer_flush();
+    if(f_close(&fil) != FR_OK) ret = -1;
+    free_buffers();
+    in_use = 0;
+    return ret;
+}
+
+int ftp_writer_failed(void)
+{
+    return write_error;
+}
+
+uint32_t ftp_writer_wait_ms(void)
+{
+    return wait_ms;
+}
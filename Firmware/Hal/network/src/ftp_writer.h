@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes the file being received by the FTP server straight to FatFs from its own task, so one
+// buffer is being written to the sdcard while the next one is being received.
+// The buffers are whole clusters (or a part of a big one) so FatFs writes them directly to the card
+// as multi block writes. Only one file at a time is written this way, others use stdio as before.
+
+#define FTP_WRITER_MAX_BUFFERS 8
+#define FTP_WRITER_MIN_BUFFER (16 * 1024)
+#define FTP_WRITER_MAX_BUFFER (32 * 1024)
+// how long ftp_writer_get waits for a buffer to be written before giving up
+#define FTP_WRITER_GET_WAIT_MS 10
+
+// starts the writer task with nbuffers, returns 0 if it could not be started
+int ftp_writer_init(uint32_t nbuffers);
+// true if ftp_writer_init was called, the FTP server uses its large TCP windows then
+int ftp_writer_enabled(void);
+
+// creates fn, returns 0 if the writer is busy or not enabled, or the file or buffers could not be got
+int ftp_writer_open(const char *fn);
+// returns where to put the next received data and how much will fit, it waits a little if all the
+// buffers are still being written. NULL if none got free or a write failed, ftp_writer_failed() says which.
+char *ftp_writer_get(size_t *space);
+// n bytes were put where ftp_writer_get said, the buffer is queued to be written once it is full
+void ftp_writer_commit(size_t n);
+// waits for everything to be written, returns 0 if it all got to the sdcard
+int ftp_writer_flush(void);
+// flushes and closes the file, returns 0 if it all got to the sdcard
+int ftp_writer_close(void);
+// true once a write to the sdcard has failed for the current file
+int ftp_writer_failed(void);
+// how long the receiver had to wait for a free buffer for the current or last file
+uint32_t ftp_writer_wait_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
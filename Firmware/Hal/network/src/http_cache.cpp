@@ -0,0 +1,169 @@
+#include "http_cache.h"
+
+#include "ff.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <string>
+
+// The web UI files are kept in RAM so they are not read from the sdcard on every request.
+// Only the http server task uses it so there is no locking.
+struct cache_entry_t {
+    std::string path;
+    bool accept_gzip;
+    bool gzip;
+    uint32_t size;
+    WORD fdate;
+    WORD ftime;
+    char etag[32];
+    char *data;
+    uint32_t refs;
+    // it was removed while in use so is deleted when released
+    bool stale;
+    TickType_t checked;
+};
+
+// most recently used first
+static std::list<cache_entry_t*> entries;
+static uint32_t cache_used = 0;
+
+static void delete_entry(cache_entry_t *e)
+{
+    cache_used -= e->size;
+    free(e->data);
+    delete e;
+}
+
+static std::list<cache_entry_t*>::iterator remove_entry(std::list<cache_entry_t*>::iterator i)
+{
+    cache_entry_t *e = *i;
+    if(e->refs == 0) {
+        delete_entry(e);
+    } else {
+        e->stale = true;
+    }
+    return entries.erase(i);
+}
+
+// finds the file that would be sent for path
+static bool find_file(const char *path, bool accept_gzip, FILINFO& fno, bool& gzip, char *fn, size_t fnlen)
+{
+    if(accept_gzip) {
+        snprintf(fn, fnlen, "%s.gz", path);
+        if(f_stat(fn, &fno) == FR_OK) {
+            gzip = true;
+            return true;
+        }
+    }
+
+    gzip = false;
+    snprintf(fn, fnlen, "%s", path);
+    return f_stat(fn, &fno) == FR_OK;
+}
+
+// makes room by removing the least recently used files that are not in use
+static bool make_room(uint32_t size)
+{
+    auto i = entries.end();
+    while(cache_used + size > HTTP_CACHE_SIZE && i != entries.begin()) {
+        --i;
+        if((*i)->refs == 0) {
+            i = remove_entry(i);
+        }
+    }
+    return cache_used + size <= HTTP_CACHE_SIZE;
+}
+
+static void set_file(http_file_t *file, const cache_entry_t *e)
+{
+    file->data = e->data;
+    file->size = e->size;
+    file->gzip = e->gzip;
+    strcpy(file->etag, e->etag);
+}
+
+int http_cache_get(const char *path, int accept_gzip, http_file_t *file)
+{
+    TickType_t now = xTaskGetTickCount();
+    FILINFO fno;
+    bool gzip;
+    char fn[FF_MAX_LFN + 8];
+
+    for (auto i = entries.begin(); i != entries.end(); ++i) {
+        cache_entry_t *e = *i;
+        if(e->accept_gzip != (accept_gzip != 0) || e->path != path) continue;
+
+        if(now - e->checked >= pdMS_TO_TICKS(HTTP_CACHE_CHECK_MS)) {
+            if(!find_file(path, accept_gzip, fno, gzip, fn, sizeof(fn)) || gzip != e->gzip ||
+               fno.fsize != e->size || fno.fdate != e->fdate || fno.ftime != e->ftime) {
+                // it has changed so read it again
+                remove_entry(i);
+                break;
+            }
+            e->checked = now;
+        }
+
+        entries.splice(entries.begin(), entries, i);
+        ++e->refs;
+        set_file(file, e);
+        file->handle = e;
+        return 1;
+    }
+
+    if(!find_file(path, accept_gzip, fno, gzip, fn, sizeof(fn))) return 0;
+
+    cache_entry_t *e = new cache_entry_t;
+    if(e == nullptr) return 0;
+    e->path = path;
+    e->accept_gzip = (accept_gzip != 0);
+    e->gzip = gzip;
+    e->size = fno.fsize;
+    e->fdate = fno.fdate;
+    e->ftime = fno.ftime;
+    snprintf(e->etag, sizeof(e->etag), "\"%lx-%04x%04x%s\"", (unsigned long)fno.fsize, fno.fdate, fno.ftime, gzip ? "-gz" : "");
+    e->data = nullptr;
+    e->refs = 0;
+    e->stale = false;
+    e->checked = now;
+
+    // unless it can be kept in RAM it is read from the file
+    set_file(file, e);
+    file->handle = nullptr;
+
+    if(e->size <= HTTP_CACHE_MAX_FILE && make_room(e->size)) {
+        e->data = (char *)malloc(e->size > 0 ? e->size : 1);
+        FIL fp;
+        if(e->data != nullptr && f_open(&fp, fn, FA_READ) == FR_OK) {
+            UINT n = 0;
+            FRESULT res = f_read(&fp, e->data, e->size, &n);
+            f_close(&fp);
+            if(res == FR_OK && n == e->size) {
+                cache_used += e->size;
+                e->refs = 1;
+                entries.push_front(e);
+                file->data = e->data;
+                file->handle = e;
+                return 1;
+            }
+        }
+        free(e->data);
+    }
+
+    delete e;
+    return 1;
+}
+
+void http_cache_release(http_file_t *file)
+{
+    cache_entry_t *e = (cache_entry_t *)file->handle;
+    if(e == nullptr) return;
+    file->handle = nullptr;
+    file->data = nullptr;
+    if(e->refs > 0) --e->refs;
+    if(e->stale && e->refs == 0) delete_entry(e);
+}
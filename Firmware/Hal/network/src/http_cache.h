@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the total size of the files kept in RAM and the largest one that will be kept
+#define HTTP_CACHE_SIZE (64 * 1024)
+#define HTTP_CACHE_MAX_FILE (24 * 1024)
+// how often a cached file is checked against the sdcard
+#define HTTP_CACHE_CHECK_MS 5000
+
+typedef struct {
+    // the contents if it is in RAM otherwise NULL and it is read from the file
+    const char *data;
+    uint32_t size;
+    // the precompressed .gz file is being used
+    uint8_t gzip;
+    char etag[32];
+    // the cache entry, it can not be removed until it is released
+    void *handle;
+} http_file_t;
+
+// Finds the file for path, using path.gz if accept_gzip is set and there is one.
+// returns 0 if the file does not exist
+int http_cache_get(const char *path, int accept_gzip, http_file_t *file);
+// must be called when finished with the file from http_cache_get
+void http_cache_release(http_file_t *file);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,22 +1,35 @@
 
 #include <cstdint>
-#include <malloc.h>
 #include <cstdio>
 #include <cstring>
-#include <map>
-#include <string>
+#include <strings.h>
 
 #include "llhttp.h"
 
+// The request is parsed into fixed size buffers so nothing is allocated per request,
+// one is created per connection and reset for each request on a keep-alive connection
+#define MAX_URL_LEN 256
+#define MAX_HEADERS 24
+#define HEADER_SPACE 1536
+
 typedef struct _request {
-    std::map<std::string, std::string> headers;
-    uint8_t method;
-    std::string url;
-    std::string last_hdr;
-    std::string hdr_value;
-    std::string body;
-    llhttp_t *parser;
-    bool done{false};
+    llhttp_t parser;
+    llhttp_settings_t settings;
+    char url[MAX_URL_LEN];
+    uint16_t url_len;
+    // header names and values are stored nul terminated one after the other in hdrs
+    char hdrs[HEADER_SPACE];
+    uint16_t hdrs_len;
+    struct {
+        uint16_t name;
+        uint16_t value;
+    } index[MAX_HEADERS];
+    uint8_t nhdrs;
+    // 0 between headers, 1 in a header name, 2 in a header value
+    uint8_t hdr_state;
+    // the current header did not fit so is being skipped
+    bool hdr_skip;
+    bool done;
 } Request_t;
 
 static int handle_on_message_complete(llhttp_t  *llh)
@@ -24,28 +37,62 @@ static int handle_on_message_complete(llhttp_t  *llh)
     Request_t *req = (Request_t*)llh->data;
     req->done = true;
     //printf("on_message_complete: %p - %p\n", req, llh);
-    return HPE_OK;
+    // stop here so the parser is left at the end of this request, an upgrade pauses itself
+    return llh->upgrade ? HPE_OK : HPE_PAUSED;
 }
 
 static int handle_on_url(llhttp_t *llh, const char *at, size_t length)
 {
     Request_t *req = (Request_t*)llh->data;
-    req->url.append(at, length);
-    req->method = llh->method;
+    if(req->url_len + length >= sizeof(req->url)) {
+        // too long, it will be a parse error
+        return HPE_USER;
+    }
+    memcpy(&req->url[req->url_len], at, length);
+    req->url_len += length;
+    req->url[req->url_len] = '\0';
     return HPE_OK;
 }
 
+// adds to the current header, a header that does not fit is skipped
+static void append_header(Request_t *req, const char *at, size_t length)
+{
+    if(req->hdr_skip) return;
+    // leave room for the nul
+    if(req->hdrs_len + length + 1 >= sizeof(req->hdrs)) {
+        req->hdr_skip = true;
+        return;
+    }
+    memcpy(&req->hdrs[req->hdrs_len], at, length);
+    req->hdrs_len += length;
+}
+
 static int handle_on_header_field(llhttp_t *llh, const char *at, size_t length)
 {
     Request_t *req = (Request_t*)llh->data;
-    req->last_hdr.append(at, length);
+    if(req->hdr_state != 1) {
+        // start of a new header
+        req->hdr_state = 1;
+        req->hdr_skip = (req->nhdrs >= MAX_HEADERS);
+        if(!req->hdr_skip) req->index[req->nhdrs].name = req->hdrs_len;
+    }
+    append_header(req, at, length);
     return HPE_OK;
 }
 
+// ends the name and starts the value
+static void start_value(Request_t *req)
+{
+    req->hdr_state = 2;
+    append_header(req, "", 1);
+    if(!req->hdr_skip) req->index[req->nhdrs].value = req->hdrs_len;
+}
+
 static int handle_on_header_value(llhttp_t *llh, const char *at, size_t length)
 {
     Request_t *req = (Request_t*)llh->data;
-    req->hdr_value.append(at, length);
+    if(req->hdr_state != 2) start_value(req);
+    append_header(req, at, length);
     return HPE_OK;
 }
 
@@ -53,25 +100,38 @@ static int handle_on_header_value_complete(llhttp_t *llh)
 {
     Request_t *req = (Request_t*)llh->data;
 
-    if(!req->last_hdr.empty()) {
-        req->headers[req->last_hdr] = req->hdr_value;
-        //printf("on_header_value_complete: %s: %s\n", req->last_hdr.c_str(), req->hdr_value.c_str());
-        req->last_hdr.clear();
-        req->hdr_value.clear();
-
-    } else {
+    if(req->hdr_state == 0) {
         //printf("ERROR: request_parser: got header value with no header field\n");
         return HPE_INVALID_HEADER_TOKEN;
     }
+
+    // an empty value does not call on_header_value
+    if(req->hdr_state != 2) start_value(req);
+    append_header(req, "", 1);
+
+    if(req->hdr_skip) {
+        // drop what there was of it
+        if(req->nhdrs < MAX_HEADERS) req->hdrs_len = req->index[req->nhdrs].name;
+        //printf("WARNING: request_parser: header did not fit\n");
+    } else {
+        //printf("on_header_value_complete: %s: %s\n", &req->hdrs[req->index[req->nhdrs].name], &req->hdrs[req->index[req->nhdrs].value]);
+        ++req->nhdrs;
+    }
+
+    req->hdr_state = 0;
+    req->hdr_skip = false;
     return HPE_OK;
 }
 
-static int handle_on_body(llhttp_t *llh, const char *at, size_t length)
+static void init_request(Request_t *p_request)
 {
-    //printf("on_body: at %p, len %u\n", at, length);
-    Request_t *req = (Request_t*)llh->data;
-    req->body.assign(at, length);
-    return HPE_OK;
+    p_request->url_len = 0;
+    p_request->url[0] = '\0';
+    p_request->hdrs_len = 0;
+    p_request->nhdrs = 0;
+    p_request->hdr_state = 0;
+    p_request->hdr_skip = false;
+    p_request->done = false;
 }
 
 extern "C" void *parse_request_create()
@@ -80,28 +140,19 @@ extern "C" void *parse_request_create()
     //printf("request_parser: create: %p\n", p_request);
 
     if(p_request != nullptr) {
-        llhttp_t *parser = new llhttp_t;
-        llhttp_settings_t *settings = new llhttp_settings_t;
-        if(parser != nullptr && settings != nullptr) {
-            /* Initialize user callbacks and settings */
-            llhttp_settings_init(settings);
-
-            /* Set user callback */
-            settings->on_message_complete = handle_on_message_complete;
-            settings->on_url = handle_on_url;
-            settings->on_header_value = handle_on_header_value;
-            settings->on_header_value_complete = handle_on_header_value_complete;
-            settings->on_header_field = handle_on_header_field;
-            settings->on_body = handle_on_body;
-
-            llhttp_init(parser, HTTP_REQUEST, settings);
-            parser->data = p_request;
-            p_request->parser = parser;
-
-        }else{
-            delete p_request;
-            p_request= nullptr;
-        }
+        /* Initialize user callbacks and settings */
+        llhttp_settings_init(&p_request->settings);
+
+        /* Set user callback */
+        p_request->settings.on_message_complete = handle_on_message_complete;
+        p_request->settings.on_url = handle_on_url;
+        p_request->settings.on_header_value = handle_on_header_value;
+        p_request->settings.on_header_value_complete = handle_on_header_value_complete;
+        p_request->settings.on_header_field = handle_on_header_field;
+
+        llhttp_init(&p_request->parser, HTTP_REQUEST, &p_request->settings);
+        p_request->parser.data = p_request;
+        init_request(p_request);
     }
 
     return p_request;
@@ -111,30 +162,35 @@ extern "C" int parse_request_release(Request_t *p_request)
 {
     // release
     //printf("request_parser: release: %p\n", p_request);
-    delete (llhttp_settings_t*)p_request->parser->settings;
-    delete p_request->parser;
     delete p_request;
     return 1;
 }
 
+// gets it ready for the next request on the same connection
+extern "C" void parse_request_reset(Request_t *p_request)
+{
+    llhttp_reset(&p_request->parser);
+    init_request(p_request);
+}
+
 /*
     returns  0 if more data needed
-             1 if completed ok
+             1 if completed ok, anything after the request in buf is not parsed
              2-n if completed but was a UPGRADE request, and data offset-2 is returned
             -1 if there was a parse error
 */
 extern "C" int parse_request(const char *buf, uint32_t len, Request_t *p_request)
 {
-    enum llhttp_errno err = llhttp_execute(p_request->parser, buf, len);
-    if (err == HPE_OK) {
+    enum llhttp_errno err = llhttp_execute(&p_request->parser, buf, len);
+    if (err == HPE_OK || (err == HPE_PAUSED && p_request->done)) {
         /* Successfully parsed! */
         return p_request->done ? 1 : 0;
     } else if (err == HPE_PAUSED_UPGRADE) {
-        uint32_t offset= p_request->parser->error_pos - buf;
-        //printf("parse: UPGRADE: %d, error_pos: %p, offset: %lu\n", p_request->parser->upgrade, p_request->parser->error_pos,            offset);
+        uint32_t offset= p_request->parser.error_pos - buf;
+        //printf("parse: UPGRADE: %d, error_pos: %p, offset: %lu\n", p_request->parser.upgrade, p_request->parser.error_pos,            offset);
         return (int)(2+offset);
     } else {
-        //printf("Parse error: %s %s\n", llhttp_errno_name(err), p_request->parser->reason);
+        //printf("Parse error: %s %s\n", llhttp_errno_name(err), p_request->parser.reason);
         return -err;
     }
 }
@@ -142,39 +198,49 @@ extern "C" int parse_request(const char *buf, uint32_t len, Request_t *p_request
 extern "C" int parse_request_get_method(void *request)
 {
     Request_t *req = static_cast<Request_t*>(request);
-    if(req != nullptr && req->parser != nullptr) {
-        return req->parser->method;
+    if(req != nullptr) {
+        return req->parser.method;
     }
     return -1;
 }
 
+// true if the connection should be kept open after the reply, allows for HTTP/1.0 and Connection: close
+extern "C" int parse_request_keep_alive(void *request)
+{
+    Request_t *req = static_cast<Request_t*>(request);
+    return req != nullptr && llhttp_should_keep_alive(&req->parser);
+}
+
 extern "C" const char *parse_request_get_url(void *request)
 {
     Request_t *req = static_cast<Request_t*>(request);
     if(req != nullptr) {
-        return req->url.c_str();
+        return req->url;
     }
     return nullptr;
 }
 
+// header names are not case sensitive
 extern "C" const char *parse_request_get_header(const char *hdr, void *request)
 {
     Request_t *req = static_cast<Request_t*>(request);
     if(req != nullptr) {
-        auto h = req->headers.find(hdr);
-        if(h != req->headers.end()) {
-            return h->second.c_str();
+        for (int i = 0; i < req->nhdrs; ++i) {
+            if(strcasecmp(hdr, &req->hdrs[req->index[i].name]) == 0) {
+                return &req->hdrs[req->index[i].value];
+            }
         }
     }
     return nullptr;
 }
+
 extern "C" const int parse_request_get_headers(const char *hdrs[], int len, void *request)
 {
     Request_t *req = static_cast<Request_t*>(request);
     int n = 0;
     if(req != nullptr) {
-        for(auto& h : req->headers) {
-            hdrs[n++] = h.first.c_str();
+        for (int i = 0; i < req->nhdrs && n < len; ++i) {
+            hdrs[n++] = &req->hdrs[req->index[i].name];
         }
     }
     return n;
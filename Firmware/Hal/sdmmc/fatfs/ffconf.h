@@ -262,9 +262,9 @@
 /      lock control is independent of re-entrancy. */
 
 
-#define FF_FS_REENTRANT	0
-#define FF_FS_TIMEOUT	1000
-#define FF_SYNC_t		HANDLE
+#define FF_FS_REENTRANT	1
+#define FF_FS_TIMEOUT	pdMS_TO_TICKS(5000)
+#define FF_SYNC_t		SemaphoreHandle_t
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -283,6 +283,9 @@
 /  included somewhere in the scope of ff.h. */
 
 /* #include <windows.h>	// O/S definitions  */
+/* several tasks use the sdcard, eg the FTP writer task writes while the FTP server task reads directories */
+#include "FreeRTOS.h"
+#include "semphr.h"
 
 
 
@@ -0,0 +1,137 @@
+#include "sd_cache.h"
+
+#include <string.h>
+
+static void flush(sd_cache_t *c)
+{
+    for (uint32_t i = 0; i < c->nlines; ++i) {
+        c->lines[i].valid = 0;
+    }
+    c->seq_next = 0xFFFFFFFFUL;
+}
+
+void sd_cache_init(sd_cache_t *c, uint8_t *buf, uint32_t n, uint32_t ls, sd_cache_read_fn fn)
+{
+    memset(c, 0, sizeof(sd_cache_t));
+    if(n > SD_CACHE_MAX_LINES) n = SD_CACHE_MAX_LINES;
+    c->nlines = n;
+    c->max_line_sectors = ls;
+    c->line_sectors = ls;
+    c->card_sectors = 0xFFFFFFFFUL;
+    c->read_fn = fn;
+    for (uint32_t i = 0; i < n; ++i) {
+        c->lines[i].data = &buf[i * ls * SD_CACHE_SECTOR_SIZE];
+    }
+    flush(c);
+    c->enabled = (n > 0 && ls > 1);
+}
+
+void sd_cache_set_geometry(sd_cache_t *c, uint32_t start, uint32_t cluster_sectors, uint32_t sectors)
+{
+    c->data_start = start;
+    if(sectors != 0) c->card_sectors = sectors;
+    // a line is a whole cluster if it fits otherwise part of one
+    c->line_sectors = cluster_sectors > 0 && cluster_sectors < c->max_line_sectors ? cluster_sectors : c->max_line_sectors;
+    flush(c);
+}
+
+void sd_cache_enable(sd_cache_t *c, int flag)
+{
+    flush(c);
+    c->enabled = flag && c->nlines > 0 && c->max_line_sectors > 1;
+}
+
+int sd_cache_is_enabled(sd_cache_t *c)
+{
+    return c->enabled;
+}
+
+static sd_cache_line_t *find(sd_cache_t *c, uint32_t start)
+{
+    for (uint32_t i = 0; i < c->nlines; ++i) {
+        if(c->lines[i].valid && c->lines[i].start == start) return &c->lines[i];
+    }
+    return NULL;
+}
+
+// the least recently used line, or an empty one
+static sd_cache_line_t *victim(sd_cache_t *c)
+{
+    sd_cache_line_t *v = &c->lines[0];
+    for (uint32_t i = 0; i < c->nlines; ++i) {
+        if(!c->lines[i].valid) return &c->lines[i];
+        if(c->lines[i].used < v->used) v = &c->lines[i];
+    }
+    return v;
+}
+
+int sd_cache_read(sd_cache_t *c, uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    if(!c->enabled || sector < c->data_start || count >= c->line_sectors) {
+        if(c->enabled && sector >= c->data_start) ++c->stats.bypassed;
+        return c->read_fn(buf, sector, count);
+    }
+
+    // only read ahead when the reads follow on from each other, otherwise it would just be slower
+    int sequential = (sector == c->seq_next);
+    c->seq_next = sector + count;
+
+    while(count > 0) {
+        uint32_t start = c->data_start + ((sector - c->data_start) / c->line_sectors) * c->line_sectors;
+        sd_cache_line_t *l = find(c, start);
+        if(l == NULL) {
+            ++c->stats.misses;
+            if(!sequential) return c->read_fn(buf, sector, count);
+
+            // read the whole line in one go
+            uint32_t n = c->line_sectors;
+            if(start + n > c->card_sectors) n = c->card_sectors - start;
+            l = victim(c);
+            l->valid = 0;
+            ++c->stats.fills;
+            int ret = c->read_fn(l->data, start, n);
+            if(ret != 0) return ret;
+            l->start = start;
+            l->n = n;
+            l->valid = 1;
+
+        } else {
+            ++c->stats.hits;
+        }
+
+        l->used = ++c->use_count;
+        uint32_t off = sector - start;
+        if(off >= l->n) {
+            // past the end of the card, let the card report the error
+            return c->read_fn(buf, sector, count);
+        }
+        uint32_t n = l->n - off;
+        if(n > count) n = count;
+        memcpy(buf, &l->data[off * SD_CACHE_SECTOR_SIZE], n * SD_CACHE_SECTOR_SIZE);
+        buf += n * SD_CACHE_SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+void sd_cache_invalidate(sd_cache_t *c, uint32_t sector, uint32_t count)
+{
+    for (uint32_t i = 0; i < c->nlines; ++i) {
+        sd_cache_line_t *l = &c->lines[i];
+        if(l->valid && sector < l->start + l->n && l->start < sector + count) {
+            l->valid = 0;
+        }
+    }
+}
+
+void sd_cache_get_stats(sd_cache_t *c, sd_cache_stats_t *s)
+{
+    *s = c->stats;
+}
+
+void sd_cache_clear_stats(sd_cache_t *c)
+{
+    memset(&c->stats, 0, sizeof(c->stats));
+}
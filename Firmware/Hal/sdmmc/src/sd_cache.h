@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Read ahead cache for the sdcard, sits between FatFs and the DMA block reads.
+ * When reads in the data area are sequential the whole cluster (or up to the line size) is read in one multi block
+ * read and following reads are served from that. Random reads and reads of a line or more go straight to the card,
+ * and the FAT and directory areas before the data area are never cached as FatFs buffers those itself.
+ * It has no hardware dependencies, the buffer and the function that reads the card are passed in, so it can be tested
+ * on the host.
+ */
+
+#define SD_CACHE_SECTOR_SIZE 512
+#define SD_CACHE_MAX_LINES 4
+
+// reads count sectors into buf, which is aligned for DMA, returns 0 if ok
+typedef int (*sd_cache_read_fn)(uint8_t *buf, uint32_t sector, uint32_t count);
+
+typedef struct {
+    uint32_t hits;      // reads served from the cache
+    uint32_t misses;    // reads that had to go to the card
+    uint32_t fills;     // lines read from the card
+    uint32_t bypassed;  // reads of a line or more that went straight to the card
+} sd_cache_stats_t;
+
+typedef struct {
+    uint8_t *data;
+    uint32_t start;
+    uint32_t n;
+    uint32_t used;
+    int valid;
+} sd_cache_line_t;
+
+typedef struct {
+    sd_cache_line_t lines[SD_CACHE_MAX_LINES];
+    uint32_t nlines;
+    uint32_t max_line_sectors;
+    uint32_t line_sectors;
+    uint32_t data_start;
+    uint32_t card_sectors;
+    uint32_t seq_next;
+    uint32_t use_count;
+    int enabled;
+    sd_cache_read_fn read_fn;
+    sd_cache_stats_t stats;
+} sd_cache_t;
+
+// the cache the sdcard driver uses
+extern sd_cache_t sd_cache;
+
+// buf must hold nlines * line_sectors sectors and be 32 byte aligned
+void sd_cache_init(sd_cache_t *c, uint8_t *buf, uint32_t nlines, uint32_t line_sectors, sd_cache_read_fn fn);
+// set when the card is mounted so the lines line up with the clusters, flushes the cache. card_sectors of 0 keeps
+// the size already set
+void sd_cache_set_geometry(sd_cache_t *c, uint32_t data_start, uint32_t cluster_sectors, uint32_t card_sectors);
+void sd_cache_enable(sd_cache_t *c, int flag);
+int sd_cache_is_enabled(sd_cache_t *c);
+int sd_cache_read(sd_cache_t *c, uint8_t *buf, uint32_t sector, uint32_t count);
+// called when sectors are written so stale data is not read back
+void sd_cache_invalidate(sd_cache_t *c, uint32_t sector, uint32_t count);
+void sd_cache_get_stats(sd_cache_t *c, sd_cache_stats_t *stats);
+void sd_cache_clear_stats(sd_cache_t *c);
+
+#ifdef __cplusplus
+}
+#endif
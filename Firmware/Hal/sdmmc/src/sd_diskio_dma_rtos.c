@@ -20,6 +20,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "ff_gen_drv.h"
 #include "stm32h7xx_sd.h"
+#include "sd_cache.h"
 
 #include "FreeRTOS.h"
 #include "queue.h"
@@ -67,6 +68,15 @@ extern const Diskio_drvTypeDef  SD_Driver;
 
 #define ENABLE_SD_DMA_CACHE_MAINTENANCE 1
 
+/*
+ * The read ahead cache, a line is a cluster upto this size. It has to be in AXI SRAM as the SDMMC1 IDMA can not
+ * reach the D2 SRAMs.
+ */
+#define SD_CACHE_LINES          2
+#define SD_CACHE_LINE_SECTORS   32
+static uint8_t sd_cache_buf[SD_CACHE_LINES * SD_CACHE_LINE_SECTORS * SD_CACHE_SECTOR_SIZE] __attribute__((aligned(32)));
+sd_cache_t sd_cache;
+
 /* Private variables ---------------------------------------------------------*/
 /* Disk status */
 static volatile DSTATUS Stat = STA_NOINIT;
@@ -74,6 +84,7 @@ static QueueHandle_t SDQueueID;
 
 /* Private function prototypes -----------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun);
+static int SD_read_blocks(uint8_t *buff, uint32_t sector, uint32_t count);
 DSTATUS SD_initialize (BYTE);
 DSTATUS SD_status (BYTE);
 DRESULT SD_read (BYTE, BYTE*, DWORD, UINT);
@@ -128,6 +139,12 @@ DSTATUS SD_initialize(BYTE lun)
 
     if (Stat != STA_NOINIT) {
         SDQueueID = xQueueCreate(QUEUE_SIZE, sizeof(uint16_t));
+
+        // the geometry is set once it is mounted, until then it caches in lines of the maximum size
+        BSP_SD_CardInfo CardInfo;
+        BSP_SD_GetCardInfo(0, &CardInfo);
+        sd_cache_init(&sd_cache, sd_cache_buf, SD_CACHE_LINES, SD_CACHE_LINE_SECTORS, SD_read_blocks);
+        sd_cache_set_geometry(&sd_cache, 0, SD_CACHE_LINE_SECTORS, CardInfo.LogBlockNbr);
     }
 
     return Stat;
@@ -152,6 +169,13 @@ DSTATUS SD_status(BYTE lun)
   * @retval DRESULT: Operation result
   */
 DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+    // goes through the read ahead cache which calls SD_read_blocks for what it does not have
+    return sd_cache_read(&sd_cache, buff, sector, count) == 0 ? RES_OK : RES_ERROR;
+}
+
+// reads the sectors from the card with one multi block DMA read
+static int SD_read_blocks(uint8_t *buff, uint32_t sector, uint32_t count)
 {
     DRESULT res = RES_ERROR;
     uint16_t event;
@@ -168,7 +192,7 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
         cbRead = count * FF_MAX_SS;
         aligned_buffer = (uint32_t *)malloc(cbRead);
         if (aligned_buffer == NULL) {
-            return RES_ERROR;
+            return -1;
         }
     }
 
@@ -209,7 +233,7 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
         free(aligned_buffer);
     }
 
-    return res;
+    return res == RES_OK ? 0 : -1;
 }
 
 /**
@@ -229,6 +253,9 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
     uint32_t *aligned_buffer = (uint32_t*)buff;
     int32_t cbWrite = 0;
 
+    // anything cached for these sectors is now stale
+    sd_cache_invalidate(&sd_cache, sector, count);
+
     // DMA needs to be on aligned 32bit boundaries
     if(((uint32_t)buff & 0x03) != 0) {
         // unaligned buffer is not ok
@@ -16,13 +16,19 @@
 #include "stm32h7xx_hal.h"
 #include "Hal_pin.h"
 #include "StringUtils.h"
+#include "IsrProfile.h"
+#include "benchmark_timer.h"
 
 Adc *Adc::instances[Adc::num_channels];
 std::set<uint16_t> Adc::allocated_channels;
 bool Adc::running;
+uint16_t Adc::oversample= 8;
+
+// cycle counts for the DMA sample ISR, shown with the isr command
+static IsrProfile adc_profile("adc_sample");
 
 // make sure it is aligned on 32byte boundary for cache coherency, need to allocate potentially max size
-// num_samples (8/32) samples per num_channels (8) channels
+// num_samples (8) samples per num_channels (7) channels
 // We add 32 bytes just to make sure nothing else could share this area as we invalidate the cache after DMA
 ALIGN_32BYTES(static __IO uint16_t aADCxConvertedData[(Adc::num_samples * Adc::num_channels) + 32]);
 
@@ -133,7 +139,16 @@ static uint32_t adc_rank_lut[] = {
 
 static ADC_HandleTypeDef AdcHandle;
 
-//#define ADC_OVERSAMPLE
+bool Adc::set_oversample(uint16_t ratio)
+{
+    if(ratio == 0 || ratio > 1024 || (ratio & (ratio - 1)) != 0) {
+        printf("ERROR: ADC oversample must be a power of 2 up to 1024: %u\n", ratio);
+        return false;
+    }
+    oversample = ratio;
+    return true;
+}
+
 bool Adc::post_config_setup()
 {
     printf("DEBUG: ADC post config setup\n");
@@ -162,13 +177,17 @@ bool Adc::post_config_setup()
     AdcHandle.Init.ExternalTrigConvEdge     = ADC_EXTERNALTRIGCONVEDGE_NONE; /* Parameter discarded because software trigger chosen */
     AdcHandle.Init.ConversionDataManagement = ADC_CONVERSIONDATA_DMA_CIRCULAR; /* ADC DMA circular requested */
     AdcHandle.Init.Overrun                  = ADC_OVR_DATA_OVERWRITTEN;      /* DR register is overwritten with the last conversion result in case of overrun */
-    #ifndef ADC_OVERSAMPLE
-    AdcHandle.Init.OversamplingMode         = DISABLE;                       /* No oversampling */
-    #else
-    AdcHandle.Init.OversamplingMode            = ENABLE;                    /* oversampling */
-    AdcHandle.Init.Oversampling.Ratio          = 3; // ADC3_OVERSAMPLING_RATIO_4; /* Oversampling ratio  x4*/
-    AdcHandle.Init.Oversampling.RightBitShift  = ADC_RIGHTBITSHIFT_2;       /* Right shift of the oversampled summation */
-    #endif
+    if(oversample <= 1) {
+        AdcHandle.Init.OversamplingMode     = DISABLE;                       /* No oversampling */
+    } else {
+        // the hardware sums oversample conversions and shifts it back to 16 bits, so each sample in the buffer is an average
+        uint32_t shift = __builtin_ctz(oversample);
+        AdcHandle.Init.OversamplingMode                   = ENABLE;
+        AdcHandle.Init.Oversampling.Ratio                 = oversample;
+        AdcHandle.Init.Oversampling.RightBitShift         = shift << ADC_CFGR2_OVSS_Pos;
+        AdcHandle.Init.Oversampling.TriggeredMode         = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+        AdcHandle.Init.Oversampling.OversamplingStopReset = ADC_REGOVERSAMPLING_CONTINUED_MODE;
+    }
 
     /* Initialize ADC peripheral according to the passed parameters */
     if (HAL_ADC_Init(&AdcHandle) != HAL_OK) {
@@ -199,8 +218,9 @@ bool Adc::post_config_setup()
         }
     }
 
-    // num_samples (32) samples per channel
+    // num_samples (8) samples per channel
     adc_data_size = nc * num_samples; // actual data size
+    printf("DEBUG: ADC %d channels, oversampled x%u\n", nc, oversample);
 
     return true;
 }
@@ -230,67 +250,6 @@ bool Adc::stop()
     return true;
 }
 
-//#define IIF_FILTER
-//#define MEDIAN
-#ifdef MEDIAN
-static void split(uint16_t data[], unsigned int n, uint16_t x, unsigned int& i, unsigned int& j)
-{
-    do {
-        while (data[i] < x) i++;
-        while (x < data[j]) j--;
-
-        if (i <= j) {
-            uint16_t ii = data[i];
-            data[i] = data[j];
-            data[j] = ii;
-            i++; j--;
-        }
-    } while (i <= j);
-}
-
-// C.A.R. Hoare's Quick Median
-static unsigned int quick_median(uint16_t data[], unsigned int n)
-{
-    unsigned int l = 0, r = n - 1, k = n / 2;
-    while (l < r) {
-        uint16_t x = data[k];
-        unsigned int i = l, j = r;
-        split(data, n, x, i, j);
-        if (j < k) l = i;
-        if (k < i) r = j;
-    }
-    return k;
-}
-#elif defined(IIF_FILTER)
-#define DSP_EMA_I32_ALPHA(x) ( (uint16_t)(x * 65535) )
-static int32_t dsp_ema_i32(uint16_t in, int32_t average, uint16_t alpha)
-{
-    if(alpha == 65535) return in;
-    int64_t tmp0;
-    tmp0 = (int64_t)in * (alpha + 1) + average * (65536 - alpha);
-    return (int32_t)((tmp0 + 32768) / 65536);
-}
-static uint32_t average(uint16_t *buf, int n)
-{
-    static int32_t average = 0;
-    uint16_t adc_value;
-    for (int i = 0; i < n; ++i) {
-        adc_value = buf[i];
-        average = dsp_ema_i32(adc_value, average, DSP_EMA_I32_ALPHA(0.1));
-    }
-    return average;
-}
-#else
-static uint32_t average(uint16_t *buf, int n)
-{
-    float acc = 0.0F;
-    for (int i = 0; i < n; ++i) {
-        acc += buf[i];
-    }
-    return roundf(acc / n);
-}
-#endif
-
 //#define ADC_TIMEIT
 #ifdef ADC_TIMEIT
 #include "benchmark_timer.h"
@@ -301,68 +260,55 @@ uint32_t adc_get_time()
 }
 #endif
 
-// This will take 154 us per sample with current settings
-// for 8 samples on a channel this is 1.2ms per channel
-// for 32 samples on a channel this is 4.8ms per channel
-// with 2 channels this gets called about every 1.2ms/4.8ms (or 2.4ms/9.6ms for complete read)
+// This will take 154 us per conversion with current settings, times the oversample ratio per sample
+// with x8 oversampling it is 1.2ms per sample, so with 4 samples in each half of the buffer this is 4.9ms per channel
+// with 2 channels this gets called about every 9.8ms, each half is filtered as it completes so there is a new value at this rate
+// The samples are filtered where they are in the DMA buffer so nothing is copied and there is no buffer to lock
 // If half is true then only the first half has been captured
 void Adc::sample_isr(bool half)
 {
     if(!running) return;
 
-    // I think this means we have 8/32 samples from each channel interleaved
+    uint32_t prof_st = benchmark_timer_start();
+
+    // num_samples from each channel interleaved, only half the array is ready
     int n = allocated_channels.size();
     int o = 0;
     int ns2 = num_samples / 2;
-    uint16_t dataADC[ns2];
     int off = half ? 0 : ns2;
     for(uint16_t c : allocated_channels) {
         Adc *adc = getInstance(c);
-        if(adc == nullptr || !adc->valid) continue; // not setup
-        // pick it out of the array, only half the array is ready
-        for(int i = 0; i < ns2; ++i) {
-            dataADC[i] = aADCxConvertedData[((i + off) * n) + o];
+        if(adc != nullptr && adc->valid) {
+            adc->filter.add(&aADCxConvertedData[(off * n) + o], ns2, n);
         }
-        memcpy(adc->sample_buffer + off, dataADC, sizeof(dataADC));
         ++o;
     }
 
-    if(!half) {
 #ifdef ADC_TIMEIT
-        // 2461us between calls
+    if(!half) {
         elt = benchmark_timer_elapsed(st);
         st = benchmark_timer_start();
-#endif
-        // calculate average/median for each buffer, avoids having to lock the buffer
-        for(uint16_t c : allocated_channels) {
-            Adc *adc = getInstance(c);
-            if(adc == nullptr || !adc->valid) continue; // not setup
-#ifdef MEDIAN
-            adc->last_sample = adc->sample_buffer[quick_median(adc->sample_buffer, num_samples)];
-#else
-            adc->last_sample = average(adc->sample_buffer, num_samples);
-#endif
-        }
     }
+#endif
+
+    adc_profile.record(benchmark_timer_elapsed(prof_st));
 }
 
 // gets called 20 times a second (every 50ms) from an ISR or timer
 uint32_t Adc::read()
 {
-    // returns the average/median value of the last 8 samples
-    return last_sample;
+    // returns the filtered value of the last half buffer
+    return filter.get();
 }
 
 uint16_t Adc::read_raw()
 {
-    // just return the ADC on the pin
-    return last_sample;
+    return filter.get();
 }
 
 float Adc::read_voltage()
 {
-    // just return the ADC on the pin
-    uint16_t adc = last_sample;
+    uint16_t adc = filter.get();
     float v = 3.3F * ((float)adc / get_max_value());
     return v;
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <set>
 
+#include "AdcFilter.h"
+
 class Pin;
 
 class Adc
@@ -19,6 +21,8 @@ public:
     static bool start();
     static bool stop();
     static void on_tick(void);
+    // hardware oversampling ratio (power of 2 up to 1024), must be set before post_config_setup()
+    static bool set_oversample(uint16_t ratio);
 
     // specific to each instance
     uint32_t read();
@@ -27,6 +31,7 @@ public:
     int get_channel() const { return channel; }
     uint32_t get_errors() const { return not_ready_error; }
     bool is_valid() const { return valid; }
+    void set_filter(AdcFilter::TYPE t, float alpha) { filter.set_type(t); filter.set_alpha(alpha); }
     std::string to_string() const;
 
     static int get_max_value() { return 65535;} // 16bit samples
@@ -34,18 +39,19 @@ public:
     static void sample_isr(bool);
     static std::set<uint16_t> allocated_channels;
     static const int num_channels= 7;
-    static const int num_samples= 32; // was 8 but we get better filtering with 32
+    // samples per channel in the DMA buffer, each one is already the average of oversample conversions
+    static const int num_samples= 8;
 
 private:
     static Adc* instances[num_channels];
     static bool running;
+    static uint16_t oversample;
 
     std::string name;
     bool valid{false};
     uint16_t channel;
     uint32_t not_ready_error{0};
-    // buffer storing the last num_samples readings for each channel instance
-    uint16_t sample_buffer[num_samples]{0};
-    uint32_t last_sample{0};
+    // filters each half of the DMA buffer as it completes
+    AdcFilter filter;
 };
 
@@ -0,0 +1,80 @@
+#include "AdcFilter.h"
+
+#include <string.h>
+
+void AdcFilter::set_alpha(float a)
+{
+    if(a <= 0) a = 0.001F;
+    else if(a > 1) a = 1;
+    alpha = a * 65535;
+    primed = false;
+}
+
+// C.A.R. Hoare's Quick Median, reorders data
+uint16_t AdcFilter::median(uint16_t *data, int n)
+{
+    int l = 0, r = n - 1, k = n / 2;
+    while (l < r) {
+        uint16_t x = data[k];
+        int i = l, j = r;
+        do {
+            while (data[i] < x) i++;
+            while (x < data[j]) j--;
+            if (i <= j) {
+                uint16_t t = data[i];
+                data[i] = data[j];
+                data[j] = t;
+                i++; j--;
+            }
+        } while (i <= j);
+        if (j < k) l = i;
+        if (k < i) r = j;
+    }
+    return data[k];
+}
+
+void AdcFilter::add(const volatile uint16_t *buf, int n, int stride)
+{
+    if(n > max_block) n = max_block;
+    if(n <= 0) return;
+
+    if(type == MEDIAN) {
+        uint16_t data[max_block];
+        for (int i = 0; i < n; ++i) {
+            data[i] = buf[i * stride];
+        }
+        value = median(data, n);
+        return;
+    }
+
+    uint32_t sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += buf[i * stride];
+    }
+    uint32_t avg = (sum + n / 2) / n;
+
+    if(type == IIR) {
+        // 64 bits as a full scale 16 bit reading does not fit in 16.16 signed
+        int64_t in = (int64_t)avg << 16;
+        if(!primed) {
+            // start from the first block rather than ramping up from 0
+            state = in;
+            primed = true;
+        } else {
+            state += ((in - state) * alpha) >> 16;
+        }
+        value = (state + 0x8000) >> 16;
+
+    } else {
+        value = avg;
+    }
+}
+
+bool AdcFilter::type_from_string(const char *s, TYPE& t)
+{
+    if(strcmp(s, "average") == 0) t = AVERAGE;
+    else if(strcmp(s, "median") == 0) t = MEDIAN;
+    else if(strcmp(s, "iir") == 0) t = IIR;
+    else return false;
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+// Filters the samples of one ADC channel, a block at a time as each half of the DMA buffer completes.
+// The samples are interleaved with the other channels in the DMA buffer so every stride'th sample is used.
+// It has no hardware dependencies so it can be tested on the host.
+class AdcFilter
+{
+public:
+    enum TYPE {
+        AVERAGE,    // average of the block
+        MEDIAN,     // median of the block, rejects spikes
+        IIR         // average of the block then a low pass filter across blocks
+    };
+
+    static const int max_block = 32;
+
+    AdcFilter() {}
+    void set_type(TYPE t) { type = t; primed = false; }
+    TYPE get_type() const { return type; }
+    // weight of each new block for the IIR filter 0-1
+    void set_alpha(float a);
+
+    // NOTE called from the DMA ISR
+    void add(const volatile uint16_t *buf, int n, int stride);
+    uint16_t get() const { return value; }
+
+    // parses average, median or iir, returns false if not one of them
+    static bool type_from_string(const char *s, TYPE& t);
+    static uint16_t median(uint16_t *data, int n);
+
+private:
+    uint16_t value{0};
+    uint16_t alpha{6554}; // 0.1
+    int64_t state{0};    // 48.16 fixed point
+    TYPE type{AVERAGE};
+    bool primed{false};
+};
@@ -0,0 +1,91 @@
+#include "DmaRing.h"
+
+#include <string.h>
+
+uint32_t DmaRxRing::update(uint32_t pos)
+{
+    // the position is the same as the size at the end of the buffer
+    pos &= (size - 1);
+    uint32_t n = (pos - wpos) & (size - 1);
+    wpos = pos;
+    received += n;
+    return n;
+}
+
+uint32_t DmaRxRing::peek(uint8_t*& p)
+{
+    uint32_t avail = received - consumed;
+    if(avail > size) {
+        // the DMA has gone round past the reader, what is left is not complete so skip to the newest data
+        overruns += avail;
+        consumed += avail;
+        return 0;
+    }
+    if(avail == 0) return 0;
+
+    uint32_t start = consumed & (size - 1);
+    uint32_t n = size - start;
+    if(n > avail) n = avail;
+    p = &buf[start];
+    return n;
+}
+
+bool DmaRxRing::consume(uint32_t n)
+{
+    // if the DMA is now more than a buffer ahead of the start of these they were overwritten while in use
+    bool ok = (received - consumed) <= size;
+    consumed += n;
+    if(!ok) overruns += n;
+    return ok;
+}
+
+uint32_t DmaTxRing::reserve(uint32_t n, uint8_t*& p1, uint32_t& n1, uint8_t*& p2, uint32_t& n2)
+{
+    uint32_t free = size - (head - tail);
+    if(n > free) n = free;
+
+    uint32_t start = head & (size - 1);
+    n1 = size - start;
+    if(n1 > n) n1 = n;
+    p1 = &buf[start];
+    p2 = buf;
+    n2 = n - n1;
+    return n;
+}
+
+void DmaTxRing::commit(uint32_t n)
+{
+    // only move the head once the data is there
+    head += n;
+}
+
+uint32_t DmaTxRing::put(const uint8_t *src, uint32_t n)
+{
+    uint8_t *p1, *p2;
+    uint32_t n1, n2;
+    n = reserve(n, p1, n1, p2, n2);
+    memcpy(p1, src, n1);
+    memcpy(p2, &src[n1], n2);
+    commit(n);
+    return n;
+}
+
+uint32_t DmaTxRing::start(uint8_t*& p)
+{
+    if(inflight != 0) return 0;
+    uint32_t avail = head - tail;
+    if(avail == 0) return 0;
+
+    uint32_t s = tail & (size - 1);
+    uint32_t n = size - s;
+    if(n > avail) n = avail;
+    inflight = n;
+    p = &buf[s];
+    return n;
+}
+
+void DmaTxRing::done()
+{
+    tail += inflight;
+    inflight = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+// Index management for the ring buffers a UART uses with DMA, the buffers themselves are supplied by the caller as
+// they need to be somewhere the DMA can reach. Both keep free running byte counts so full and empty are never
+// ambiguous, which means the size must be a power of 2.
+// The cache maintenance is left to the caller so they have no hardware dependencies and can be tested on the host.
+
+// The receive side, the DMA writes into the buffer in circular mode and the reader uses the data where it is.
+// update() is called from the ISR with the position the DMA has got to, it must be called at least every half buffer
+// which the half and full transfer interrupts ensure. If the reader falls more than a buffer behind the data has
+// been overwritten, that is counted as an overrun and the reader skips to the newest data.
+class DmaRxRing
+{
+public:
+    DmaRxRing(uint8_t *b, uint32_t s) : buf(b), size(s) {}
+
+    // called from the ISR, returns the number of new bytes
+    uint32_t update(uint32_t pos);
+    // the contiguous bytes available to read, 0 if there are none
+    uint32_t peek(uint8_t*& p);
+    // releases the bytes after they have been used, returns false if the DMA overwrote them while they were in use
+    bool consume(uint32_t n);
+
+    uint32_t available() const { return received - consumed; }
+    uint32_t get_overruns() const { return overruns; }
+
+private:
+    uint8_t *buf;
+    uint32_t size;
+    volatile uint32_t received{0};
+    uint32_t consumed{0};
+    uint32_t wpos{0};
+    uint32_t overruns{0};
+};
+
+// The transmit side, the writer copies into the buffer and the DMA sends it from there a contiguous block at a time.
+// The writer reserves space, copies into it and cleans the cache, then commits it, so start() never sees bytes the
+// DMA could read before they are in RAM.
+// start() and done() are called with the DMA interrupt masked or from it so they never run at the same time.
+class DmaTxRing
+{
+public:
+    DmaTxRing(uint8_t *b, uint32_t s) : buf(b), size(s) {}
+
+    // reserves upto n bytes of the free space, in two parts if it goes round the end, returns the total reserved
+    uint32_t reserve(uint32_t n, uint8_t*& p1, uint32_t& n1, uint8_t*& p2, uint32_t& n2);
+    // the first n reserved bytes have been written and can be sent
+    void commit(uint32_t n);
+    // reserves, copies and commits as much as will fit, for a buffer that needs no cache maintenance
+    uint32_t put(const uint8_t *src, uint32_t n);
+    // the next block to send, 0 if there is nothing to send or a block is already being sent
+    uint32_t start(uint8_t*& p);
+    // the block being sent has gone
+    void done();
+
+    bool is_busy() const { return inflight != 0; }
+    uint32_t space() const { return size - (head - tail); }
+
+private:
+    uint8_t *buf;
+    uint32_t size;
+    volatile uint32_t head{0};
+    volatile uint32_t tail{0};
+    volatile uint32_t inflight{0};
+};
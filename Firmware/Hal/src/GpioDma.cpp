@@ -0,0 +1,156 @@
+#include "GpioDma.h"
+#include "SigmaDeltaPattern.h"
+
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+
+#include <cstdio>
+
+#define GPIODMA_TIM                 TIM5
+#define GPIODMA_TIM_CLK_ENABLE()    __HAL_RCC_TIM5_CLK_ENABLE()
+#define GPIODMA_DMA_CLK_ENABLE()    __HAL_RCC_DMA2_CLK_ENABLE()
+
+// one stream and timer compare channel per port
+static DMA_Stream_TypeDef * const streams[GpioDma::max_ports] = { DMA2_Stream0, DMA2_Stream1, DMA2_Stream2, DMA2_Stream3 };
+static const uint32_t requests[GpioDma::max_ports] = { DMA_REQUEST_TIM5_CH1, DMA_REQUEST_TIM5_CH2, DMA_REQUEST_TIM5_CH3, DMA_REQUEST_TIM5_CH4 };
+static const uint32_t channels[GpioDma::max_ports] = { TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3, TIM_CHANNEL_4 };
+static const uint32_t dma_sources[GpioDma::max_ports] = { TIM_DMA_CC1, TIM_DMA_CC2, TIM_DMA_CC3, TIM_DMA_CC4 };
+
+// the rows are padded to a multiple of the cache line, DMA2 cannot get to DTCM so put them in SRAM_1
+static uint32_t patterns[GpioDma::max_ports][256] __attribute__((section (".sram_1_bss"), aligned(32)));
+
+static TIM_HandleTypeDef htim;
+static DMA_HandleTypeDef hdma[GpioDma::max_ports];
+
+char GpioDma::ports[max_ports];
+bool GpioDma::running = false;
+
+static GPIO_TypeDef *port_to_gpio(char port)
+{
+    // the ports are evenly spaced from GPIOA
+    return (GPIO_TypeDef *)(GPIOA_BASE + (port - 'A') * (GPIOB_BASE - GPIOA_BASE));
+}
+
+int GpioDma::find_port(char port)
+{
+    for (int i = 0; i < max_ports; ++i) {
+        if(ports[i] == port) return i;
+    }
+    return -1;
+}
+
+bool GpioDma::attach(char port, uint8_t pin)
+{
+    if(find_port(port) >= 0) return true;
+
+    // can't add a stream once they are running
+    if(running) return false;
+
+    for (int i = 0; i < max_ports; ++i) {
+        if(ports[i] == 0) {
+            ports[i] = port;
+            // leaves all the pins on the port alone until they are set
+            for (int j = 0; j < pattern_length; ++j) {
+                patterns[i][j] = 0;
+            }
+            return true;
+        }
+    }
+
+    printf("WARNING: GpioDma: no streams left for P%c%d\n", port, pin);
+    return false;
+}
+
+void GpioDma::detach(char port, uint8_t pin)
+{
+    int i = find_port(port);
+    if(i < 0) return;
+
+    uint32_t keep = ~((1UL << pin) | (1UL << (pin + 16)));
+    UBaseType_t s = portSET_INTERRUPT_MASK_FROM_ISR();
+    for (int j = 0; j < pattern_length; ++j) {
+        patterns[i][j] &= keep;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(s);
+    SCB_CleanDCache_by_Addr(patterns[i], sizeof(patterns[i]));
+}
+
+void GpioDma::set(char port, uint8_t pin, int value, int max)
+{
+    int i = find_port(port);
+    if(i < 0) return;
+
+    // other outputs on the same port share the buffer so they must not update it at the same time
+    UBaseType_t s = portSET_INTERRUPT_MASK_FROM_ISR();
+    SigmaDeltaPattern::fill(patterns[i], pattern_length, 1 << pin, value, max);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(s);
+    SCB_CleanDCache_by_Addr(patterns[i], sizeof(patterns[i]));
+}
+
+bool GpioDma::start(uint32_t frequency)
+{
+    if(running) return true;
+    if(ports[0] == 0) return false; // nothing attached
+
+    GPIODMA_TIM_CLK_ENABLE();
+    GPIODMA_DMA_CLK_ENABLE();
+
+    // 1MHz counter clock, the timer clock is twice the APB clock
+    htim.Instance = GPIODMA_TIM;
+    htim.Init.Prescaler = (SystemCoreClock / (2 * 1000000)) - 1;
+    htim.Init.Period = (1000000 / frequency) - 1;
+    htim.Init.ClockDivision = 0;
+    htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim.Init.RepetitionCounter = 0;
+    if(HAL_TIM_OC_Init(&htim) != HAL_OK) {
+        printf("ERROR: GpioDma failed to init timer\n");
+        return false;
+    }
+
+    for (int i = 0; i < max_ports; ++i) {
+        if(ports[i] == 0) break;
+
+        DMA_HandleTypeDef& h = hdma[i];
+        h.Instance                 = streams[i];
+        h.Init.Request             = requests[i];
+        h.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+        h.Init.PeriphInc           = DMA_PINC_DISABLE;
+        h.Init.MemInc              = DMA_MINC_ENABLE;
+        h.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+        h.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+        h.Init.Mode                = DMA_CIRCULAR;
+        h.Init.Priority            = DMA_PRIORITY_LOW;
+        h.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+        if(HAL_DMA_Init(&h) != HAL_OK) {
+            printf("ERROR: GpioDma failed to init DMA for port %c\n", ports[i]);
+            return false;
+        }
+
+        SCB_CleanDCache_by_Addr(patterns[i], sizeof(patterns[i]));
+        // no interrupts are needed it just goes round and round
+        if(HAL_DMA_Start(&h, (uint32_t)patterns[i], (uint32_t)&port_to_gpio(ports[i])->BSRR, pattern_length) != HAL_OK) {
+            printf("ERROR: GpioDma failed to start DMA for port %c\n", ports[i]);
+            return false;
+        }
+
+        // the compare channel only generates the DMA request, stagger them so they do not all hit the bus at once
+        TIM_OC_InitTypeDef oc{0};
+        oc.OCMode = TIM_OCMODE_TIMING;
+        oc.Pulse = i;
+        if(HAL_TIM_OC_ConfigChannel(&htim, &oc, channels[i]) != HAL_OK) {
+            printf("ERROR: GpioDma failed to config timer channel for port %c\n", ports[i]);
+            return false;
+        }
+        __HAL_TIM_ENABLE_DMA(&htim, dma_sources[i]);
+
+        printf("DEBUG: GpioDma: port %c on DMA2 stream %d\n", ports[i], i);
+    }
+
+    if(HAL_TIM_Base_Start(&htim) != HAL_OK) {
+        printf("ERROR: GpioDma failed to start timer\n");
+        return false;
+    }
+
+    running = true;
+    return true;
+}
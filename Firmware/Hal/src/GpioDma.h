@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// Drives GPIO outputs from precomputed patterns with no CPU involvement.
+// Each port in use has a circular buffer of BSRR words which a DMA stream writes to the port, one word each time the
+// timer ticks, so all the outputs on a port share a stream. The patterns are regenerated when an output changes.
+// TIM5 paces the streams, each port uses one of its compare channels as the DMA request so it is limited to 4 ports.
+class GpioDma
+{
+public:
+    static const int max_ports = 4;
+    static const int pattern_length = 255;
+
+    // adds the pin, returns false if there is no stream left for its port
+    static bool attach(char port, uint8_t pin);
+    // stops the pin being driven, it stays at its current level
+    static void detach(char port, uint8_t pin);
+    // sets the pin on for value/max of the pattern, may be called from an ISR
+    static void set(char port, uint8_t pin, int value, int max);
+
+    // frequency is the rate the patterns are stepped through in Hz
+    static bool start(uint32_t frequency);
+    static bool is_running() { return running; }
+
+private:
+    static int find_port(char port);
+    static char ports[max_ports];
+    static bool running;
+};
@@ -82,6 +82,7 @@ void Pwm::set(float v)
     else if(v > 1) v = 1;
 
     value = v;
+    raw = false;
 
     uint32_t tc;
     switch(channel) {
@@ -96,6 +97,33 @@ void Pwm::set(float v)
     // _htim->Instance->CCR[1234] = pulse;
 }
 
+// no float maths here so it can be called from the step ISR
+void Pwm::set_pulse(uint32_t p)
+{
+    if(!valid) return;
+
+    if(p > instances[timr].period) p = instances[timr].period;
+
+    pulse = p;
+    raw = true;
+
+    uint32_t tc;
+    switch(channel) {
+        case 0: tc =  TIM_CHANNEL_1; break;
+        case 1: tc =  TIM_CHANNEL_2; break;
+        case 2: tc =  TIM_CHANNEL_3; break;
+        case 3: tc =  TIM_CHANNEL_4; break;
+        default: return;
+    }
+    __HAL_TIM_SET_COMPARE((TIM_HandleTypeDef*)instances[timr]._htim, tc, p);
+}
+
+float Pwm::get() const
+{
+    if(raw) return instances[timr].period == 0 ? 0 : (float)pulse / instances[timr].period;
+    return value;
+}
+
 // set duty cycle such that the pulse width is the number of given microseconds
 // returns duty cycle
 float Pwm::set_microseconds(float v)
@@ -116,6 +144,7 @@ void Pwm:: set_frequency(uint32_t freq)
 {
     if(!valid) return;
 
+    float v = get(); // duty cycle at the current period
     uint32_t clkhz = freq * 1000;
     uint32_t uhPrescalerValue = (uint32_t)(SystemCoreClock / (2 * clkhz)) - 1;
     uint32_t period_value = (uint32_t)((clkhz / freq) - 1); // Period Value
@@ -128,7 +157,7 @@ void Pwm:: set_frequency(uint32_t freq)
     instances[timr].frequency= freq;
     instances[timr].period= period_value;
     // we also need to reset the pulse width
-    set(value);
+    set(v);
 }
 
 // define TIM1 PWM channels
@@ -169,6 +198,28 @@ void Pwm:: set_frequency(uint32_t freq)
 #define PWM2_GPIO_AF_CHANNEL3          GPIO_AF3_TIM8
 #define PWM2_GPIO_AF_CHANNEL4          GPIO_AF3_TIM8
 
+// the pin each channel is on, these must match the PWMx_GPIO_PORT_CHANNELx and PWMx_GPIO_PIN_CHANNELx above
+static const struct { char port; uint8_t pin; } channel_pins[2][4] = {
+    {{'E', 9}, {'E', 11}, {'E', 13}, {'E', 14}},
+    {{'I', 5}, {'I', 6}, {'I', 7}, {'I', 2}}
+};
+
+// static
+std::string Pwm::lookup(char port, uint8_t pin)
+{
+    for (int t = 0; t < 2; ++t) {
+        if(instances[t]._htim == nullptr) continue;
+        for (int ch = 0; ch < 4; ++ch) {
+            if(channel_pins[t][ch].port == port && channel_pins[t][ch].pin == pin && !allocated[t][ch]) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "PWM%d_%d", t + 1, ch + 1);
+                return buf;
+            }
+        }
+    }
+    return "";
+}
+
 // static
 bool Pwm::setup(int timr, uint32_t freq)
 {
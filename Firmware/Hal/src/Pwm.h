@@ -12,14 +12,19 @@ public:
 	bool is_valid() const { return valid; }
 	// set duty cycle 0-1
 	void set(float v);
+	// set the compare value directly, 0 to get_period(), for callers that precompute it outside of an ISR
+	void set_pulse(uint32_t pulse);
     float set_microseconds(float v);
-	float get() const { return value; }
+	float get() const;
+	uint32_t get_period() const { return instances[timr].period; }
 	uint32_t get_frequency() const { return instances[timr].frequency; }
     void set_frequency(uint32_t freq);
 
 	static bool post_config_setup();
 	static bool setup(int timr, uint32_t frequency);
 	static bool is_allocated(int i, int j) { return allocated[i][j]; }
+	// name of the free PWM channel on the given pin if its timer has been setup, empty if there is none
+	static std::string lookup(char port, uint8_t pin);
 	using instance_t = struct { void *_htim; uint32_t period; uint32_t frequency; };
 
 private:
@@ -28,5 +33,7 @@ private:
 	uint8_t channel, timr;
 	std::string name;
 	float value{0};
+	uint32_t pulse{0};
 	bool valid{false};
+	bool raw{false}; // set when the last value was set by set_pulse()
 };
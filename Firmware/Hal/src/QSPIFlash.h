@@ -0,0 +1,18 @@
+#pragma once
+
+#include "KVStore.h"
+#include "qspi.h"
+
+// A region of the qspi flash that a KVStore is kept in
+class QSPIFlash : public KVFlash
+{
+public:
+    QSPIFlash(uint32_t base) : base(base) {}
+
+    bool read(uint32_t addr, void *buf, uint32_t len) { return qspi_read(base + addr, buf, len); }
+    bool program(uint32_t addr, const void *buf, uint32_t len) { return qspi_write(base + addr, buf, len); }
+    bool erase(uint32_t addr) { return qspi_erase_sector(base + addr); }
+
+private:
+    uint32_t base;
+};
@@ -0,0 +1,31 @@
+#include "SigmaDeltaPattern.h"
+
+void SigmaDeltaPattern::fill(uint32_t *bsrr, int n, uint16_t pins, int value, int max)
+{
+    if(max <= 0) return;
+    if(value < 0) value = 0;
+    else if(value > max) value = max;
+
+    uint32_t set = pins;
+    uint32_t reset = (uint32_t)pins << 16;
+    uint32_t keep = ~(set | reset);
+
+    // first order sigma-delta, starting half way so the on times are centered rather than bunched at the start,
+    // when n == max there are exactly value on words so it repeats cleanly
+    int acc = max / 2;
+    for (int i = 0; i < n; ++i) {
+        acc += value;
+        bool on = acc >= max;
+        if(on) acc -= max;
+        bsrr[i] = (bsrr[i] & keep) | (on ? set : reset);
+    }
+}
+
+int SigmaDeltaPattern::count(const uint32_t *bsrr, int n, uint16_t pins)
+{
+    int cnt = 0;
+    for (int i = 0; i < n; ++i) {
+        if((bsrr[i] & pins) == pins) ++cnt;
+    }
+    return cnt;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Generates the pattern a sigma-delta output follows as a buffer of GPIO BSRR words, which DMA writes to the port one
+// word per tick. value/max of the words set the pins and the rest reset them, spread as evenly as possible.
+// Only the set and reset bits for the given pins are changed so all the outputs on one port can share a buffer.
+// It has no hardware dependencies so it can be tested on the host.
+class SigmaDeltaPattern
+{
+public:
+    static void fill(uint32_t *bsrr, int n, uint16_t pins, int value, int max);
+    // number of words that set the given pins
+    static int count(const uint32_t *bsrr, int n, uint16_t pins);
+};
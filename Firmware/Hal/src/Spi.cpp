@@ -1,4 +1,5 @@
 #include "Spi.h"
+#include "SpiQueue.h"
 #include "Hal_pin.h"
 
 #include "stm32h7xx_hal.h"
@@ -25,6 +26,15 @@
 #define SPI1x_RELEASE_RESET()             __HAL_RCC_SPI1_RELEASE_RESET()
 #define SPI1x_IRQn                        SPI1_IRQn
 #define SPI1x_IRQHandler                  SPI1_IRQHandler
+#define SPI1x_DMA_TX_STREAM               DMA1_Stream3
+#define SPI1x_DMA_RX_STREAM               DMA1_Stream2
+#define SPI1x_DMA_TX_REQUEST              DMA_REQUEST_SPI1_TX
+#define SPI1x_DMA_RX_REQUEST              DMA_REQUEST_SPI1_RX
+#define SPI1x_DMA_CLK_ENABLE()            __HAL_RCC_DMA1_CLK_ENABLE()
+#define SPI1x_DMA_TX_IRQn                 DMA1_Stream3_IRQn
+#define SPI1x_DMA_RX_IRQn                 DMA1_Stream2_IRQn
+#define SPI1x_DMA_TX_IRQHandler           DMA1_Stream3_IRQHandler
+#define SPI1x_DMA_RX_IRQHandler           DMA1_Stream2_IRQHandler
 
 /* Definition SPI1 Pins */
 #define SPI1x_SCK_PIN                     GPIO_PIN_5
@@ -47,6 +57,8 @@
 #define SPI2x_MOSI_GPIO_CLK_ENABLE()      __HAL_RCC_GPIOB_CLK_ENABLE()
 #define SPI2x_IRQn                        SPI2_IRQn
 #define SPI2x_IRQHandler                  SPI2_IRQHandler
+#define SPI2x_DMA_TX_REQUEST              DMA_REQUEST_SPI2_TX
+#define SPI2x_DMA_RX_REQUEST              DMA_REQUEST_SPI2_RX
 
 #define SPI2x_FORCE_RESET()               __HAL_RCC_SPI2_FORCE_RESET()
 #define SPI2x_RELEASE_RESET()             __HAL_RCC_SPI2_RELEASE_RESET()
@@ -74,6 +86,8 @@
 #define SPI2x_MOSI_GPIO_CLK_ENABLE()      __HAL_RCC_GPIOE_CLK_ENABLE()
 #define SPI2x_IRQn                        SPI4_IRQn
 #define SPI2x_IRQHandler                  SPI4_IRQHandler
+#define SPI2x_DMA_TX_REQUEST              DMA_REQUEST_SPI4_TX
+#define SPI2x_DMA_RX_REQUEST              DMA_REQUEST_SPI4_RX
 
 #define SPI2x_FORCE_RESET()               __HAL_RCC_SPI4_FORCE_RESET()
 #define SPI2x_RELEASE_RESET()             __HAL_RCC_SPI4_RELEASE_RESET()
@@ -90,6 +104,22 @@
 #define SPI2x_MOSI_AF                     GPIO_AF5_SPI4
 #endif
 
+// common to both SPI2 and SPI4
+#define SPI2x_DMA_TX_STREAM               DMA2_Stream6
+#define SPI2x_DMA_RX_STREAM               DMA2_Stream5
+#define SPI2x_DMA_CLK_ENABLE()            __HAL_RCC_DMA2_CLK_ENABLE()
+#define SPI2x_DMA_TX_IRQn                 DMA2_Stream6_IRQn
+#define SPI2x_DMA_RX_IRQn                 DMA2_Stream5_IRQn
+#define SPI2x_DMA_TX_IRQHandler           DMA2_Stream6_IRQHandler
+#define SPI2x_DMA_RX_IRQHandler           DMA2_Stream5_IRQHandler
+
+// DMA cannot get to DTCM so async transfers go through these
+#define ASYNC_BUF_SIZE 32
+static uint8_t async_txbuf[2][ASYNC_BUF_SIZE] __attribute__((section (".sram_1_bss"), aligned(32)));
+static uint8_t async_rxbuf[2][ASYNC_BUF_SIZE] __attribute__((section (".sram_1_bss"), aligned(32)));
+static DMA_HandleTypeDef hdma_tx[2];
+static DMA_HandleTypeDef hdma_rx[2];
+
 SPI *SPI::spi_channel[2];
 // static
 SPI *SPI::getInstance(int channel)
@@ -249,6 +279,7 @@ bool SPI::init(int bits, int mode, int frequency)
 
 SPI::~SPI()
 {
+    delete queue;
     vSemaphoreDelete(mutex);
     if(_valid) {
         HAL_SPI_DeInit((SPI_HandleTypeDef*)_hspi);
@@ -258,8 +289,19 @@ SPI::~SPI()
 
 bool SPI::begin_transaction(uint32_t tmoms)
 {
+    TickType_t start= xTaskGetTickCount();
     uint32_t t= pdMS_TO_TICKS(tmoms);
-    return xSemaphoreTake(mutex, t) == pdTRUE;
+    if(xSemaphoreTake(mutex, t) != pdTRUE) return false;
+
+    // an async batch runs on from the ISR after run_queue() has released the mutex, so wait for it to finish
+    while(queue != nullptr && queue->is_running()) {
+        if(xTaskGetTickCount() - start >= t) {
+            xSemaphoreGive(mutex);
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
 }
 
 void SPI::end_transaction()
@@ -292,6 +334,109 @@ bool SPI::write_read(void *wvalue, void *rvalue, uint32_t n)
     return true;
 }
 
+// the DMA is only setup when async transfers are used, it must be linked to the handle we keep not the one passed
+// to HAL_SPI_Init() so it can't be done in the MSP init
+bool SPI::setup_dma()
+{
+    if(!_valid) return false;
+
+    SPI_HandleTypeDef *hspi = (SPI_HandleTypeDef*)_hspi;
+    DMA_HandleTypeDef& tx = hdma_tx[_channel];
+    DMA_HandleTypeDef& rx = hdma_rx[_channel];
+    IRQn_Type tx_irq, rx_irq, spi_irq;
+
+    if(_channel == 0) {
+        SPI1x_DMA_CLK_ENABLE();
+        tx.Instance = SPI1x_DMA_TX_STREAM;
+        tx.Init.Request = SPI1x_DMA_TX_REQUEST;
+        rx.Instance = SPI1x_DMA_RX_STREAM;
+        rx.Init.Request = SPI1x_DMA_RX_REQUEST;
+        tx_irq = SPI1x_DMA_TX_IRQn;
+        rx_irq = SPI1x_DMA_RX_IRQn;
+        spi_irq = SPI1x_IRQn;
+    } else {
+        SPI2x_DMA_CLK_ENABLE();
+        tx.Instance = SPI2x_DMA_TX_STREAM;
+        tx.Init.Request = SPI2x_DMA_TX_REQUEST;
+        rx.Instance = SPI2x_DMA_RX_STREAM;
+        rx.Init.Request = SPI2x_DMA_RX_REQUEST;
+        tx_irq = SPI2x_DMA_TX_IRQn;
+        rx_irq = SPI2x_DMA_RX_IRQn;
+        spi_irq = SPI2x_IRQn;
+    }
+
+    for(DMA_HandleTypeDef *h : {&tx, &rx}) {
+        h->Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+        h->Init.PeriphInc           = DMA_PINC_DISABLE;
+        h->Init.MemInc              = DMA_MINC_ENABLE;
+        h->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        h->Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        h->Init.Mode                = DMA_NORMAL;
+        h->Init.Priority            = DMA_PRIORITY_LOW;
+    }
+    tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+
+    if(HAL_DMA_Init(&tx) != HAL_OK || HAL_DMA_Init(&rx) != HAL_OK) {
+        printf("ERROR: SPI channel %d, DMA init failed\n", _channel);
+        return false;
+    }
+    __HAL_LINKDMA(hspi, hdmatx, tx);
+    __HAL_LINKDMA(hspi, hdmarx, rx);
+
+    // the end of the transfer is signalled by the SPI interrupt, the DMA ones handle errors
+    NVIC_SetPriority(tx_irq, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(tx_irq);
+    NVIC_SetPriority(rx_irq, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(rx_irq);
+    NVIC_SetPriority(spi_irq, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(spi_irq);
+
+    return true;
+}
+
+SpiQueue *SPI::get_queue()
+{
+    if(queue == nullptr && setup_dma()) {
+        queue = new SpiQueue([this](const uint8_t *tx, uint8_t *rx, uint32_t n) { return write_read_async(tx, rx, n); });
+    }
+    return queue;
+}
+
+bool SPI::write_read_async(const void *wvalue, void *rvalue, uint32_t n)
+{
+    if(n > ASYNC_BUF_SIZE || queue == nullptr) return false;
+
+    memcpy(async_txbuf[_channel], wvalue, n);
+    SCB_CleanDCache_by_Addr((uint32_t*)async_txbuf[_channel], ASYNC_BUF_SIZE);
+    async_rx = rvalue;
+    async_n = n;
+    return HAL_SPI_TransmitReceive_DMA((SPI_HandleTypeDef*)_hspi, async_txbuf[_channel], async_rxbuf[_channel], n) == HAL_OK;
+}
+
+void SPI::async_complete(bool ok)
+{
+    if(ok) {
+        SCB_InvalidateDCache_by_Addr((uint32_t*)async_rxbuf[_channel], ASYNC_BUF_SIZE);
+        memcpy(async_rx, async_rxbuf[_channel], async_n);
+    }
+    queue->complete(ok);
+}
+
+bool SPI::run_queue()
+{
+    if(queue == nullptr || queue->is_running()) return false;
+
+    // don't wait for the bus, just skip this time if it is in use
+    if(!begin_transaction(0)) return false;
+
+    // the mutex can't be given from the ISR, so it is only held while the batch is started,
+    // begin_transaction() then waits for the batch to finish before anyone else uses the bus
+    bool ok = queue->run(nullptr);
+    end_transaction();
+    return ok;
+}
+
 /**
   * @brief SPI MSP Initialization
   *        This function configures the hardware resources used in this example:
@@ -436,7 +581,8 @@ extern "C" void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi)
   */
 extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 {
-    // wTransferState = TRANSFER_COMPLETE;
+    SPI *spi = SPI::spi_channel[hspi->Instance == SPI1x ? 0 : 1];
+    if(spi != nullptr) spi->async_complete(true);
 }
 
 /**
@@ -448,7 +594,8 @@ extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
   */
 extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
 {
-    // wTransferState = TRANSFER_ERROR;
+    SPI *spi = SPI::spi_channel[hspi->Instance == SPI1x ? 0 : 1];
+    if(spi != nullptr) spi->async_complete(false);
 }
 
 /**
@@ -465,3 +612,23 @@ extern "C" void SPI2x_IRQHandler(void)
 {
     HAL_SPI_IRQHandler((SPI_HandleTypeDef*)SPI::spi_channel[1]->get_hspi());
 }
+
+extern "C" void SPI1x_DMA_TX_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_tx[0]);
+}
+
+extern "C" void SPI1x_DMA_RX_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_rx[0]);
+}
+
+extern "C" void SPI2x_DMA_TX_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_tx[1]);
+}
+
+extern "C" void SPI2x_DMA_RX_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_rx[1]);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
 
+class SpiQueue;
+
 class SPI
 {
 
@@ -32,14 +34,27 @@ public:
     void end_transaction();
     int get_channel() const { return _channel; }
 
+    // starts a transfer by DMA and returns, the queue is told when it completes, n is at most 32
+    bool write_read_async(const void *wvalue, void *rvalue, uint32_t n);
+    // the transactions run as a batch by run_queue(), setting up the DMA the first time
+    SpiQueue *get_queue();
+    // runs the queue if the bus is free, begin_transaction() waits until the batch has finished
+    bool run_queue();
+    // called from the ISR
+    void async_complete(bool ok);
+
     static int get_n_channels() { return 2; }
 	static SPI *spi_channel[2];
 
 private:
 	SPI(int channel);
 	virtual ~SPI();
+	bool setup_dma();
 	void *_hspi;
     void *mutex;
+    SpiQueue *queue{nullptr};
+    void *async_rx{nullptr};
+    uint32_t async_n{0};
 	bool _valid;
 	int _channel;
 	int _bits;
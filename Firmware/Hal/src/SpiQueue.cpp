@@ -0,0 +1,60 @@
+#include "SpiQueue.h"
+
+int SpiQueue::add(prepare_t p, select_t s, done_t d)
+{
+    if(running) return -1;
+    transactions.push_back({p, s, d, {0}, {0}, 0});
+    return transactions.size() - 1;
+}
+
+bool SpiQueue::run(finished_t f)
+{
+    if(running) return false;
+
+    bool any = false;
+    for(auto& t : transactions) {
+        t.n = t.prepare(t.tx);
+        if(t.n > max_len) t.n = max_len;
+        if(t.n > 0) any = true;
+    }
+    if(!any) return false;
+
+    finished = f;
+    current = -1;
+    running = true;
+    next();
+    return true;
+}
+
+void SpiQueue::complete(bool ok)
+{
+    if(!running) return;
+
+    auto& t = transactions[current];
+    if(t.select) t.select(false);
+    if(!ok) ++errors;
+    if(t.done) t.done(t.rx, ok);
+    next();
+}
+
+// start the next transaction that has something to send, or finish the batch
+void SpiQueue::next()
+{
+    while(++current < (int)transactions.size()) {
+        auto& t = transactions[current];
+        if(t.n == 0) continue;
+
+        if(t.select) t.select(true);
+        // NOTE the transfer may complete before this returns so nothing can be touched after a successful start
+        if(start(t.tx, t.rx, t.n)) return;
+
+        // it did not start so finish it here and carry on with the next
+        if(t.select) t.select(false);
+        ++errors;
+        if(t.done) t.done(t.rx, false);
+    }
+
+    ++batches;
+    running = false;
+    if(finished) finished();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <functional>
+
+// A list of SPI transactions that are run back to back as a batch, each one selects its device, transfers then
+// deselects it. The next transaction is started from the completion of the previous one, which is normally the DMA
+// interrupt, so once a batch has been started it runs without any task involvement.
+// The transactions are added once at setup and the batch is run periodically, eg to poll the status of all the drivers.
+// The transfer itself is done by the start function given to the constructor, which must call complete() when it
+// finishes, so it has no hardware dependencies and can be tested on the host with a mock SPI.
+class SpiQueue
+{
+public:
+    static const int max_len = 4;
+
+    // fills in the data to send and returns the length, 0 skips it this time, called from run()
+    using prepare_t = std::function<uint32_t(uint8_t *tx)>;
+    // selects or deselects the device, called from the ISR
+    using select_t = std::function<void(bool)>;
+    // the data read back, called from the ISR
+    using done_t = std::function<void(const uint8_t *rx, bool ok)>;
+    // starts a transfer of n bytes, returns false if it could not be started
+    using start_t = std::function<bool(const uint8_t *tx, uint8_t *rx, uint32_t n)>;
+    // called when the whole batch has finished
+    using finished_t = std::function<void(void)>;
+
+    SpiQueue(start_t s) : start(s) {}
+
+    // returns the index of the transaction or -1 if the batch is running
+    int add(prepare_t p, select_t s, done_t d);
+    // starts the batch, returns false if it is already running or there is nothing to send
+    bool run(finished_t f);
+    // called when the current transfer has finished, normally from the ISR
+    void complete(bool ok);
+
+    bool is_running() const { return running; }
+    size_t size() const { return transactions.size(); }
+    uint32_t get_errors() const { return errors; }
+    uint32_t get_batches() const { return batches; }
+
+private:
+    void next();
+
+    using transaction_t = struct {
+        prepare_t prepare;
+        select_t select;
+        done_t done;
+        uint8_t tx[max_len];
+        uint8_t rx[max_len];
+        uint32_t n;
+    };
+
+    std::vector<transaction_t> transactions;
+    start_t start;
+    finished_t finished;
+    int current{-1};
+    uint32_t errors{0};
+    uint32_t batches{0};
+    volatile bool running{false};
+};
@@ -10,8 +10,10 @@
 #include <cstring>
 
 #include "FreeRTOS.h"
-#include "stream_buffer.h"
+#include "task.h"
+#include "semphr.h"
 #include "Hal_pin.h"
+#include "DmaRing.h"
 
 UART *UART::uart_channel[2];
 // static
@@ -49,8 +51,10 @@ UART::~UART()
     if(_valid) {
         HAL_UART_DeInit((UART_HandleTypeDef*)_huart);
         free(_huart);
-        if(rx_rb != nullptr) vStreamBufferDelete(rx_rb);
-        if(tx_rb != nullptr) vStreamBufferDelete(tx_rb);
+        delete rx_ring;
+        delete tx_ring;
+        vSemaphoreDelete((SemaphoreHandle_t)rx_sem);
+        vSemaphoreDelete((SemaphoreHandle_t)tx_sem);
     }
 }
 
@@ -144,9 +148,28 @@ UART::~UART()
 #define USART2x_IRQHandler                UART4_IRQHandler
 #endif
 
-#define RX_BUFFER_SIZE   (32*4) // 128
+// The DMA buffers are used directly as the ring buffers, RX is big enough to hold 40ms at 921600 baud so the reader
+// can be busy for that long without losing anything. They must be a power of 2 and a multiple of 32 bytes in size.
+#define RX_BUFFER_SIZE   4096
+#define TX_BUFFER_SIZE   2048
 // cache aligned
 static uint8_t RXBuffer[2][RX_BUFFER_SIZE] __attribute__((section (".sram_1_bss"), aligned(32))); // put in SRAM_1
+static uint8_t TXBuffer[2][TX_BUFFER_SIZE] __attribute__((section (".sram_1_bss"), aligned(32)));
+
+// the cache operations work on whole 32 byte lines so round the range out to those, the buffers are aligned so it
+// never goes outside them
+static void invalidate_cache(uint8_t *p, uint32_t n)
+{
+    uint32_t a = (uint32_t)p & ~31UL;
+    SCB_InvalidateDCache_by_Addr((uint32_t*)a, (((uint32_t)p + n - a) + 31) & ~31UL);
+}
+
+static void clean_cache(uint8_t *p, uint32_t n)
+{
+    if(n == 0) return;
+    uint32_t a = (uint32_t)p & ~31UL;
+    SCB_CleanDCache_by_Addr((uint32_t*)a, (((uint32_t)p + n - a) + 31) & ~31UL);
+}
 
 bool UART::init(settings_t set)
 {
@@ -178,9 +201,11 @@ bool UART::init(settings_t set)
     memcpy(_huart, &UartHandle, sizeof(UART_HandleTypeDef));
     _valid = true;
 
-    // create ring buffers
-    rx_rb = xStreamBufferCreate(1024, 1);;
-    tx_rb = xStreamBufferCreate(1024, 1);;
+    // the rings work on the DMA buffers directly
+    rx_ring = new DmaRxRing(RXBuffer[_channel], RX_BUFFER_SIZE);
+    tx_ring = new DmaTxRing(TXBuffer[_channel], TX_BUFFER_SIZE);
+    rx_sem = xSemaphoreCreateBinary();
+    tx_sem = xSemaphoreCreateBinary();
 
     /* Initializes Rx sequence using Reception To Idle event API.
       As DMA channel associated to UART Rx is configured as Circular,
@@ -198,11 +223,14 @@ bool UART::init(settings_t set)
         // failed
         printf("ERROR: UART HAL_UARTEx_ReceiveToIdle_DMA failed\n");
         free(_huart);
-        vStreamBufferDelete(rx_rb);
-        vStreamBufferDelete(tx_rb);
+        delete rx_ring;
+        delete tx_ring;
+        vSemaphoreDelete((SemaphoreHandle_t)rx_sem);
+        vSemaphoreDelete((SemaphoreHandle_t)tx_sem);
         _huart= nullptr;
-        rx_rb= nullptr;
-        tx_rb= nullptr;
+        rx_ring= nullptr;
+        tx_ring= nullptr;
+        _valid= false;
         return false;
     }
 
@@ -395,10 +423,6 @@ extern "C" void USART2x_IRQHandler(void)
     HAL_UART_IRQHandler((UART_HandleTypeDef*)UART::uart_channel[1]->get_huart());
 }
 
-// we need a cache aligned buffer to transmit from preferably in SRAM_1 .sram_1_bss
-#define TX_BUFFER_SIZE (32*4) // 128
-static uint8_t TXBuffer[2][TX_BUFFER_SIZE] __attribute__((section (".sram_1_bss"), aligned(32)));
-
 /**
   * @brief  Tx Transfer completed callback
   * @param  huart: UART handle.
@@ -417,79 +441,69 @@ extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 // ISR
 void UART::tx_cplt_callback()
 {
-    // start again if there is data to be sent
-    // transfer as much as we can to DMA buffer, do cache management and start DMA
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE; // Initialised to pdFALSE.
-    size_t cnt = xStreamBufferReceiveFromISR(tx_rb, TXBuffer[_channel], TX_BUFFER_SIZE, &xHigherPriorityTaskWoken);
-    tx_dma_current_len= cnt;
-    //printf("Sending %d\n", cnt);
-    if(cnt > 0) {
-        // make sure cache is flushed to RAM so the DMA can read the correct data
-        // NOTE this relies on the buffer being 32 byte aligned and a multiple of 32 bytes in size
-        SCB_CleanDCache_by_Addr((uint32_t*)TXBuffer[_channel], TX_BUFFER_SIZE);
-
-        // start write
-        if(HAL_UART_Transmit_DMA((UART_HandleTypeDef*)_huart, TXBuffer[_channel], cnt) != HAL_OK) {
-            /* Transfer error in transmission process */
-            printf("ERROR: UART HAL_UART_Transmit_DMA failed\n");
-        }
-        // HACK ALERT, there is a bug in the HAL that causes the normal operation to be unreliable
-        // and higher priority interrupts can delay this in UART_DMATransmitCplt() where it no longer works.
-        // this hack seems to work, and fix the issue. symptoms are that HAL_UART_TxCpltCallback does not get called.
-        SET_BIT(((UART_HandleTypeDef*)_huart)->Instance->CR1, USART_CR1_TCIE);
-    }
+    // the block has gone so send the next one if there is one, and wake up any writer waiting for space
+    tx_ring->done();
+    start_tx();
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR((SemaphoreHandle_t)tx_sem, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+// starts sending the next block from the ring if it is not already sending one
+// called from the TX ISR or with it masked
+void UART::start_tx()
+{
+    uint8_t *p;
+    uint32_t n = tx_ring->start(p);
+    if(n == 0) return;
+
+    if(HAL_UART_Transmit_DMA((UART_HandleTypeDef*)_huart, p, n) != HAL_OK) {
+        // drop it so we do not get stuck
+        tx_dropped += n;
+        tx_ring->done();
+        return;
+    }
+    // HACK ALERT, there is a bug in the HAL that causes the normal operation to be unreliable
+    // and higher priority interrupts can delay this in UART_DMATransmitCplt() where it no longer works.
+    // this hack seems to work, and fix the issue. symptoms are that HAL_UART_TxCpltCallback does not get called.
+    SET_BIT(((UART_HandleTypeDef*)_huart)->Instance->CR1, USART_CR1_TCIE);
+}
+
 size_t UART::write(uint8_t *buf, uint16_t len, uint32_t timeout)
 {
     size_t cnt = 0;
-    // this needs to be protected from tx ISR concurrent access, so just disable the TX interrupt
-    //HAL_NVIC_DisableIRQ(_channel == 0 ? USART1x_DMA_TX_IRQn : USART2x_DMA_TX_IRQn);
-    HAL_NVIC_DisableIRQ(_channel == 0 ? USART1x_IRQn : USART2x_IRQn);
-    uint16_t cur_len= tx_dma_current_len;
-    HAL_NVIC_EnableIRQ(_channel == 0 ? USART1x_IRQn : USART2x_IRQn);
-    //HAL_NVIC_EnableIRQ(_channel == 0 ? USART1x_DMA_TX_IRQn : USART2x_DMA_TX_IRQn);
-
-    if(len > 1024) len= 1024; // limit to max size of streambuffer
-
-    if(cur_len == 0) {
-        if(!xStreamBufferIsEmpty(tx_rb)) { printf("WARNING: Stream buffer is not empty\n"); }
-
-        // TX DMA is not running so we cannot get interrupted by it
-        // copy as much of buffer as we can to TXBuffer, and rest to txStreamBuffer
-        uint16_t n = len > TX_BUFFER_SIZE ? TX_BUFFER_SIZE : len;
-        memcpy(TXBuffer[_channel], buf, n);
-        cnt = n;
-        if(n < len) {
-            // copy the rest to the stream buffer and block for timeout
-            cnt += xStreamBufferSend(tx_rb, &buf[n], len - n, timeout);
+    TimeOut_t to;
+    TickType_t wait = timeout;
+    vTaskSetTimeOutState(&to);
+
+    while(cnt < len) {
+        // copy as much as will fit into the ring, the DMA sends it from there
+        uint8_t *p1, *p2;
+        uint32_t n1, n2;
+        uint32_t n = tx_ring->reserve(len - cnt, p1, n1, p2, n2);
+        if(n > 0) {
+            memcpy(p1, &buf[cnt], n1);
+            memcpy(p2, &buf[cnt + n1], n2);
+            // make sure cache is flushed to RAM before the DMA can see it, the TX ISR may start it as soon as it is committed
+            clean_cache(p1, n1);
+            clean_cache(p2, n2);
+            tx_ring->commit(n);
+            cnt += n;
+
+            // start it if it is not already running, the TX interrupt must not run while we do this
+            taskENTER_CRITICAL();
+            start_tx();
+            taskEXIT_CRITICAL();
         }
 
-        UART_HandleTypeDef *huart = (UART_HandleTypeDef*)_huart;
-        // clean cache so DMA can see what we wrote
-        SCB_CleanDCache_by_Addr((uint32_t*)TXBuffer[_channel], TX_BUFFER_SIZE);
-        tx_dma_current_len= n;
-        // then start DMA
-        if(HAL_UART_Transmit_DMA(huart, TXBuffer[_channel], n) != HAL_OK) {
-            // failed
-            printf("ERROR: UART HAL_UART_Transmit_DMA failed\n");
-            cnt = 0;
+        if(cnt < len) {
+            // wait for a block to be sent to make some room
+            if(xTaskCheckForTimeOut(&to, &wait) == pdTRUE) break;
+            xSemaphoreTake((SemaphoreHandle_t)tx_sem, wait);
         }
-        // HACK ALERT, there is a bug in the HAL that causes the normal operation to be unreliable
-        // and higher priority interrupts can delay this in UART_DMATransmitCplt() where it no longer works.
-        // this hack seems to work, and fix the issue. symptoms are that HAL_UART_TxCpltCallback does not get called.
-        SET_BIT(huart->Instance->CR1, USART_CR1_TCIE);
-
-        //printf("Wrote direct\n");
-
-    } else {
-        // copy as much of buffer as we can to txStreamBuffer
-        // it will be picked up when current tx completes
-        cnt = xStreamBufferSend(tx_rb, buf, len, timeout);
-        //printf("Wrote to streambuffer\n");
     }
 
+    if(cnt < len) tx_dropped += len - cnt;
     return cnt;
 }
 
@@ -514,45 +528,45 @@ extern "C" void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t s
 // ISR
 void UART::rx_event_callback(uint16_t size)
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE; // Initialised to pdFALSE.
-    /* Check if number of received data in reception buffer has changed */
-    if (size != old_pos) {
-        // invalidate the cache so we can read the data the DMA put into it
-        // NOTE this relies on the buffer being 32 byte aligned and a multiple of 32 bytes in size
-        SCB_InvalidateDCache_by_Addr((uint32_t*)RXBuffer[_channel], RX_BUFFER_SIZE);
-        /* Check if position of index in reception buffer has simply be increased
-           or if end of buffer has been reached */
-        if (size > old_pos) {
-            /* Current position is higher than previous one */
-            uint16_t uwNbReceivedChars = size - old_pos;
-            /* Copy received data into ring buffer for evacuation */
-            size_t n = xStreamBufferSendFromISR(rx_rb, &RXBuffer[_channel][old_pos], uwNbReceivedChars, &xHigherPriorityTaskWoken);
-            if(n != uwNbReceivedChars) { overflow += uwNbReceivedChars; }
-
-        } else {
-            /* Current position is lower than previous one : end of buffer has been reached */
-            /* First copy data from current position till end of buffer */
-            uint16_t uwNbReceivedChars = RX_BUFFER_SIZE - old_pos;
-            /* Copy received data into ring buffer for evacuation */
-            size_t n = xStreamBufferSendFromISR(rx_rb, &RXBuffer[_channel][old_pos], uwNbReceivedChars, &xHigherPriorityTaskWoken);
-            if(n != uwNbReceivedChars) { overflow += uwNbReceivedChars; }
-
-            /* Check and continue with beginning of buffer */
-            if (size > 0) {
-                n = xStreamBufferSendFromISR(rx_rb, RXBuffer[_channel], size, &xHigherPriorityTaskWoken);
-                if(n != size) { overflow += size; }
-            }
-        }
+    // size is the position the DMA has written upto in the buffer, the data is left there until the reader has used it
+    if(rx_ring->update(size) > 0) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xSemaphoreGiveFromISR((SemaphoreHandle_t)rx_sem, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
     }
-    /* Update old_pos as new reference of position in User Rx buffer that
-       indicates position to which data have been processed */
-    old_pos = size;
-    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+size_t UART::get_rx(uint8_t*& p, uint32_t timeout)
+{
+    uint32_t n = rx_ring->peek(p);
+    // the semaphore may have been left over from data that has already been read, so check again when it is taken
+    while(n == 0 && xSemaphoreTake((SemaphoreHandle_t)rx_sem, timeout) == pdTRUE) {
+        n = rx_ring->peek(p);
+    }
+
+    // the DMA has written to memory so make sure we do not read stale data from the cache
+    if(n > 0) invalidate_cache(p, n);
+    return n;
+}
+
+bool UART::release_rx(size_t n)
+{
+    return rx_ring->consume(n);
+}
+
+uint32_t UART::get_rx_overruns() const
+{
+    return rx_ring == nullptr ? 0 : rx_ring->get_overruns();
 }
 
 size_t UART::read(uint8_t *buf, uint16_t len, uint32_t timeout)
 {
     // read upto len bytes or timeout if none
-    size_t cnt= xStreamBufferReceive(rx_rb, buf, len, timeout);
-    return cnt;
+    uint8_t *p;
+    size_t n = get_rx(p, timeout);
+    if(n > len) n = len;
+    memcpy(buf, p, n);
+    // they were overwritten while being copied, it is counted as an overrun
+    if(!release_rx(n)) return 0;
+    return n;
 }
@@ -3,6 +3,9 @@
 #include <cstdint>
 #include <cstddef>
 
+class DmaRxRing;
+class DmaTxRing;
+
 class UART
 {
 public:
@@ -18,6 +21,15 @@ public:
 
 	size_t write(uint8_t *buf, uint16_t len, uint32_t timeout=0xFFFFFFFF); // portMAX_DELAY
     size_t read(uint8_t *buf, uint16_t len, uint32_t timeout=0xFFFFFFFF);
+    // zero copy read, waits upto timeout for data and sets p to where it is in the DMA buffer, returns how many bytes
+    // there are. release_rx() must be called once they have been used
+    size_t get_rx(uint8_t*& p, uint32_t timeout=0xFFFFFFFF);
+    // returns false if the DMA overwrote them before they were released, so what was read from there is not valid
+    bool release_rx(size_t n);
+    // bytes lost because the reader fell more than the DMA buffer behind
+    uint32_t get_rx_overruns() const;
+    // bytes that could not be written before the timeout
+    uint32_t get_tx_dropped() const { return tx_dropped; }
 	bool valid() const { return _valid; }
 	void *get_huart() const { return _huart; }
     int get_channel() const { return _channel; }
@@ -29,14 +41,15 @@ public:
 private:
 	UART(int channel);
 	virtual ~UART();
+    void start_tx();
 
 	void *_huart{nullptr};
-    void *tx_rb{nullptr};
-    void *rx_rb{nullptr};
+    DmaRxRing *rx_ring{nullptr};
+    DmaTxRing *tx_ring{nullptr};
+    void *rx_sem{nullptr};
+    void *tx_sem{nullptr};
 	int _channel;
     settings_t settings;
-    uint32_t overflow{0};
+    uint32_t tx_dropped{0};
 	bool _valid{false};
-    uint8_t old_pos{0};
-    volatile uint16_t tx_dma_current_len{0};
 };
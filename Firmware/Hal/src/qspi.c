@@ -5,9 +5,11 @@
 #include "ff.h"
 
 #include "Hal_pin.h"
+#include "qspi.h"
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #define QSPI_CLK_ENABLE()          __HAL_RCC_QSPI_CLK_ENABLE()
 #define QSPI_CLK_DISABLE()         __HAL_RCC_QSPI_CLK_DISABLE()
@@ -160,8 +162,14 @@
 #define DUMMY_CLOCK_CYCLES_READ_DTR          6
 #define DUMMY_CLOCK_CYCLES_READ_QUAD_DTR     8
 
+/* Worst case times for the program and erase to complete */
+#define PAGE_PROG_TIMEOUT_MS                 10
+#define SECTOR_ERASE_TIMEOUT_MS              3000
+
 static QSPI_HandleTypeDef QSPIHandle;
 static volatile uint8_t CmdCplt, TxCplt, StatusMatch;
+static bool mapped = false;
+static volatile int map_holds = 0;
 
 /**
   * @brief QSPI MSP Initialization
@@ -469,6 +477,11 @@ bool qspi_init()
     return false;
 #endif
 
+    if(mapped && map_holds > 0) {
+        printf("ERROR: qspi_init: qspi is in use memory mapped\n");
+        return false;
+    }
+
     /* Initialize QuadSPI ------------------------------------------------------ */
     QSPIHandle.Instance = QUADSPI;
     HAL_QSPI_DeInit(&QSPIHandle);
@@ -482,6 +495,7 @@ bool qspi_init()
     QSPIHandle.Init.FlashID            = QSPI_FLASH_ID_1;
     QSPIHandle.Init.DualFlash          = QSPI_DUALFLASH_DISABLE;
 
+    mapped = false;
     if (HAL_QSPI_Init(&QSPIHandle) != HAL_OK) {
         printf("ERROR: qspi_init: Init failed\n");
         return false;
@@ -493,6 +507,8 @@ bool qspi_init()
 // map the qspi to memory at 0x90000000
 bool qspi_mount()
 {
+    if(mapped) return true;
+
     if(!qspi_init()) {
         printf("ERROR: qspi_init failed\n");
         return false;
@@ -523,6 +539,153 @@ bool qspi_mount()
         return false;
     }
 
+    mapped = true;
+    return true;
+}
+
+// wait for a program or erase to finish, giving up the cpu while it waits
+static bool QSPI_WaitMemReady(uint32_t timeout_ms, TickType_t poll)
+{
+    StatusMatch = 0;
+    if(!QSPI_AutoPollingMemReady(&QSPIHandle)) {
+        return false;
+    }
+
+    TickType_t st = xTaskGetTickCount();
+    while(StatusMatch == 0) {
+        if(xTaskGetTickCount() - st > pdMS_TO_TICKS(timeout_ms)) {
+            HAL_QSPI_Abort(&QSPIHandle);
+            return false;
+        }
+        vTaskDelay(poll);
+    }
+
+    return true;
+}
+
+// commands can not be sent while it is memory mapped so reset it to leave that mode
+static bool QSPI_Indirect()
+{
+    if(mapped || QSPIHandle.Instance == NULL) {
+        return qspi_init();
+    }
+    return true;
+}
+
+static void QSPI_SetupCommand(QSPI_CommandTypeDef *sCommand)
+{
+    sCommand->InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    sCommand->AddressSize       = QSPI_ADDRESS_24_BITS;
+    sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand->DdrMode           = QSPI_DDR_MODE_DISABLE;
+    sCommand->DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand->SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    sCommand->AddressMode       = QSPI_ADDRESS_1_LINE;
+    sCommand->DummyCycles       = 0;
+}
+
+// the mapped memory is cached so drop anything that was cached from the flash that was changed
+static void QSPI_InvalidateMapped(uint32_t addr, uint32_t len)
+{
+    uint32_t start = (QSPI_MAPPED_BASE + addr) & ~0x1FUL;
+    uint32_t end = (QSPI_MAPPED_BASE + addr + len + 0x1F) & ~0x1FUL;
+    SCB_InvalidateDCache_by_Addr((uint32_t *)start, end - start);
+}
+
+void qspi_hold_mapped(bool flg)
+{
+    // the player and the command thread can both change it
+    taskENTER_CRITICAL();
+    if(flg) {
+        ++map_holds;
+    } else if(map_holds > 0) {
+        --map_holds;
+    }
+    taskEXIT_CRITICAL();
+}
+
+// reads through the memory mapped flash
+bool qspi_read(uint32_t addr, void *buf, uint32_t len)
+{
+    if(addr + len > QSPI_USABLE_SIZE) return false;
+    if(!mapped && !qspi_mount()) return false;
+    memcpy(buf, (const void *)(QSPI_MAPPED_BASE + addr), len);
+    return true;
+}
+
+// programs the data a page at a time, the flash must have been erased
+bool qspi_write(uint32_t addr, const void *buf, uint32_t len)
+{
+    if(addr + len > QSPI_USABLE_SIZE) return false;
+    if(!QSPI_Indirect()) return false;
+
+    QSPI_CommandTypeDef sCommand;
+    QSPI_SetupCommand(&sCommand);
+    sCommand.Instruction = QUAD_IN_FAST_PROG_CMD;
+    sCommand.DataMode    = QSPI_DATA_4_LINES;
+
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t a = addr;
+    uint32_t left = len;
+    while(left > 0) {
+        // a program can not cross a page boundary
+        uint32_t n = QSPI_PAGE_SIZE - (a % QSPI_PAGE_SIZE);
+        if(n > left) n = left;
+
+        if(!QSPI_WriteEnable(&QSPIHandle)) {
+            printf("ERROR: qspi_write: write enable failed\n");
+            return false;
+        }
+
+        sCommand.Address = a;
+        sCommand.NbData  = n;
+        if (HAL_QSPI_Command(&QSPIHandle, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK ||
+            HAL_QSPI_Transmit(&QSPIHandle, (uint8_t *)p, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+            printf("ERROR: qspi_write: program failed at %08lX\n", a);
+            return false;
+        }
+
+        if(!QSPI_WaitMemReady(PAGE_PROG_TIMEOUT_MS, 0)) {
+            printf("ERROR: qspi_write: timeout at %08lX\n", a);
+            return false;
+        }
+
+        a += n;
+        p += n;
+        left -= n;
+    }
+
+    QSPI_InvalidateMapped(addr, len);
+    return true;
+}
+
+// erases the 64K sector that starts at addr
+bool qspi_erase_sector(uint32_t addr)
+{
+    if(addr % QSPI_SECTOR_SIZE != 0 || addr >= QSPI_USABLE_SIZE) return false;
+    if(!QSPI_Indirect()) return false;
+
+    if(!QSPI_WriteEnable(&QSPIHandle)) {
+        printf("ERROR: qspi_erase_sector: write enable failed\n");
+        return false;
+    }
+
+    QSPI_CommandTypeDef sCommand;
+    QSPI_SetupCommand(&sCommand);
+    sCommand.Instruction = SECTOR_ERASE_CMD;
+    sCommand.Address     = addr;
+    sCommand.DataMode    = QSPI_DATA_NONE;
+    if (HAL_QSPI_Command(&QSPIHandle, &sCommand, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        printf("ERROR: qspi_erase_sector: erase failed at %08lX\n", addr);
+        return false;
+    }
+
+    if(!QSPI_WaitMemReady(SECTOR_ERASE_TIMEOUT_MS, 1)) {
+        printf("ERROR: qspi_erase_sector: timeout at %08lX\n", addr);
+        return false;
+    }
+
+    QSPI_InvalidateMapped(addr, QSPI_SECTOR_SIZE);
     return true;
 }
 
@@ -551,6 +714,11 @@ bool qspi_flash(const char* fn)
     __IO uint32_t qspi_addr = 0;
     __IO uint8_t step = 0;
     uint32_t max_size = f_size(&fp);
+    if(max_size > QSPI_JOB_START) {
+        printf("ERROR: qspi_flash: %s is too big, it would overwrite the job cache\n", fn);
+        f_close(&fp);
+        return false;
+    }
     __IO uint32_t size = 0;
     __IO int erase_size = max_size;
     __IO bool eraseing = true;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// where the qspi flash appears when it is memory mapped
+#define QSPI_MAPPED_BASE 0x90000000UL
+// the erase size
+#define QSPI_SECTOR_SIZE (64 * 1024)
+// it uses 24 bit addresses so only the first 16MB can be reached
+#define QSPI_USABLE_SIZE (16 * 1024 * 1024)
+
+// Layout of the flash
+// qspi flash writes files from the start, upto the job cache
+// the job cache, a job copied from the sdcard by the cache command
+#define QSPI_JOB_START (4 * 1024 * 1024)
+#define QSPI_JOB_SIZE (QSPI_KV_START - QSPI_JOB_START)
+// the key/value store in the last sectors
+#define QSPI_KV_SECTORS 4
+#define QSPI_KV_START (QSPI_USABLE_SIZE - (QSPI_KV_SECTORS * QSPI_SECTOR_SIZE))
+
+bool qspi_init();
+// map the qspi to memory at QSPI_MAPPED_BASE
+bool qspi_mount();
+bool qspi_flash(const char *fn);
+
+// these leave memory mapped mode while they run, reads map it again
+bool qspi_read(uint32_t addr, void *buf, uint32_t len);
+bool qspi_write(uint32_t addr, const void *buf, uint32_t len);
+bool qspi_erase_sector(uint32_t addr);
+// while held it stays memory mapped, anything that would leave that mode fails, used while running from the mapped flash
+void qspi_hold_mapped(bool flg);
+
+#ifdef __cplusplus
+}
+#endif
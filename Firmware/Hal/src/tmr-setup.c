@@ -4,6 +4,7 @@
 #include "FreeRTOS.h"
 
 #include "stm32h7xx.h"
+#include "tmr-setup.h"
 
 // TODO move ramfunc define to a utils.h
 #define _ramfunc_ __attribute__ ((section(".ramfunctions"),long_call,noinline))
@@ -45,7 +46,7 @@ int steptimer_setup(uint32_t frequency, uint32_t delay, void *step_handler, void
     StepTimHandle.Instance = STEP_TIM;
 
     // Set STEP_TIM peripheral clock rate
-    uint32_t timerFreq = 20000000; // 20MHz
+    uint32_t timerFreq = STEP_TIMER_CLOCK; // 20MHz
     printf("DEBUG: STEP_TIM input clock rate= %lu\n", timerFreq);
 
     /* Compute the prescaler value to have STEP_TIM counter clock equal to 20MHz */
@@ -197,6 +198,18 @@ _ramfunc_ void unsteptimer_start()
     //UnStepTickerTimHandle.Instance->CR1 &= ~(TIM_CR1_UDIS);
 }
 
+// called from within STEP_TIM ISR so must be in SRAM
+// the new period takes effect immediately, so the next tick is one new period from the last one
+_ramfunc_ void steptimer_set_period(uint32_t period)
+{
+    TIM_HandleTypeDef *htim = &StepTimHandle;
+    __HAL_TIM_SET_AUTORELOAD(htim, period - 1);
+    // if we are already past the new period the counter would run on until it wraps
+    if(__HAL_TIM_GET_COUNTER(htim) >= period - 1) {
+        __HAL_TIM_SET_COUNTER(htim, 0);
+    }
+}
+
 _ramfunc_ void FASTTICK_TIM_IRQHandler(void)
 {
     HAL_TIM_IRQHandler(&FastTickTimHandle);
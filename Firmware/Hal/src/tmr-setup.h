@@ -3,9 +3,14 @@
 extern "C" {
 #endif
 
+// the step timer counts at this rate, step tick periods are multiples of it
+#define STEP_TIMER_CLOCK 20000000 // 20MHz
+
 // Setup where frequency is in Hz, delay is in microseconds
 int steptimer_setup(uint32_t frequency, uint32_t delay, void *mr0handler, void *mr1handler);
 void unsteptimer_start();
+// change the step tick period (in STEP_TIMER_CLOCK ticks) while running
+void steptimer_set_period(uint32_t period);
 void steptimer_stop();
 
 // setup where frequency is in Hz
@@ -3,6 +3,7 @@
 
 #include "stm32h7xx_sd.h"
 #include "MemoryPool.h"
+#include "sd_cache.h"
 
 #define FLASH_BLK_NBR 100
 #define FLASH_BLK_SIZ 512
@@ -175,6 +176,8 @@ int8_t STORAGE_Write(uint8_t lun, uint8_t * buf, uint32_t blk_addr, uint16_t blk
     uint32_t size = blk_len * blocksize;
     if (BSP_SD_IsDetected(0) != SD_NOT_PRESENT) {
         sd_write_ready = 0;
+        // the host is writing behind FatFs's back so any of these sectors in the read cache are now stale
+        sd_cache_invalidate(&sd_cache, blk_addr, blk_len);
         memcpy(aligned_buffer, buf, size);
         // make sure cache is flushed to RAM so the DMA can read the correct data
         SCB_CleanDCache_by_Addr((uint32_t*)aligned_buffer, size);
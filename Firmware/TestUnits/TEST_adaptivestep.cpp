@@ -0,0 +1,146 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "Block.h"
+#include "Planner.h"
+#include "StepTicker.h"
+#include "tmr-setup.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdio.h>
+
+// this runs the same per motor tick algorithm as StepTicker::step_tick() for motor 0 and
+// returns the time in seconds of each step
+static std::vector<float> simulate_ticks(Block& b)
+{
+    std::vector<float> times;
+    Block::tickinfo_t ti = b.tick_info[0];
+    uint32_t current_tick = 0;
+    while(ti.steps_to_move > 0 && current_tick < 100000000) {
+        ti.steps_per_tick += ti.acceleration_change;
+
+        if(current_tick == ti.next_accel_event) {
+            if(current_tick == b.accelerate_until) {
+                ti.acceleration_change = 0;
+                if(b.decelerate_after < b.total_move_ticks) {
+                    ti.next_accel_event = b.decelerate_after;
+                    if(current_tick != b.decelerate_after) {
+                        ti.steps_per_tick = ti.plateau_rate;
+                    }
+                }
+            }
+
+            if(current_tick == b.decelerate_after) {
+                ti.acceleration_change = ti.deceleration_change;
+            }
+        }
+
+        if(ti.steps_per_tick <= 0) {
+            ti.counter = STEPTICKER_FPSCALE;
+            ti.steps_per_tick = 0;
+        }
+
+        ti.counter += ti.steps_per_tick;
+        if(ti.counter >= STEPTICKER_FPSCALE) {
+            ti.counter -= STEPTICKER_FPSCALE;
+            ++ti.step_count;
+            times.push_back(current_tick / b.tick_frequency);
+            if(ti.step_count == ti.steps_to_move) ti.steps_to_move = 0;
+        }
+
+        ++current_tick;
+    }
+
+    return times;
+}
+
+// setup a single axis move of the given steps and plan it
+static void plan_block(Block& b, uint32_t steps, float mm, float speed, float accel, float entry, float exit)
+{
+    b.clear();
+    b.steps[0] = steps;
+    b.steps_event_count = steps;
+    b.millimeters = mm;
+    b.nominal_speed = speed;
+    b.nominal_rate = steps * speed / mm;
+    b.acceleration = accel;
+    Planner::getInstance()->calculate_trapezoid(&b, entry, exit);
+}
+
+// adaptive mode can only be changed while the step ticker is stopped, so stop it if an earlier test or
+// the firmware started it and start it again afterwards
+static bool stop_ticker(StepTicker *st)
+{
+    bool was_started = st->is_started();
+    if(was_started) st->stop();
+    return was_started;
+}
+
+static void restart_ticker(StepTicker *st, bool was_started)
+{
+    TEST_ASSERT_TRUE(st->set_adaptive(false, 0));
+    if(was_started) st->start();
+}
+
+REGISTER_TEST(AdaptiveStep, tick_period)
+{
+    // 100KHz is a period of 200, 1KHz is 20000
+    TEST_ASSERT_EQUAL_INT(20000, StepTicker::calc_tick_period(0, 200, 20000));
+    TEST_ASSERT_EQUAL_INT(20000, StepTicker::calc_tick_period(10, 200, 20000));
+    // 1000 steps/sec is ticked at 8KHz
+    TEST_ASSERT_EQUAL_INT(2500, StepTicker::calc_tick_period(1000, 200, 20000));
+    // faster than the base frequency allows is capped at the base frequency
+    TEST_ASSERT_EQUAL_INT(200, StepTicker::calc_tick_period(100000, 200, 20000));
+}
+
+REGISTER_TEST(AdaptiveStep, timing_equivalence)
+{
+    StepTicker *st = StepTicker::getInstance();
+    bool was_started = stop_ticker(st);
+    float base_frequency = st->get_frequency();
+    Block::init(1);
+
+    // steps, mm, speed mm/sec, accel mm/sec², entry, exit
+    const float moves[][6] {
+        {400, 4, 4, 100, 0, 0},
+        {2000, 20, 10, 200, 0, 0},
+        {1000, 10, 5, 50, 2, 1},
+        {5000, 10, 20, 1000, 0, 0},
+    };
+
+    for(auto& m : moves) {
+        Block fixed;
+        TEST_ASSERT_TRUE(st->set_adaptive(false, 0));
+        plan_block(fixed, m[0], m[1], m[2], m[3], m[4], m[5]);
+        TEST_ASSERT_EQUAL_FLOAT(base_frequency, fixed.tick_frequency);
+        std::vector<float> ref = simulate_ticks(fixed);
+
+        Block adaptive;
+        TEST_ASSERT_TRUE(st->set_adaptive(true, 1000));
+        plan_block(adaptive, m[0], m[1], m[2], m[3], m[4], m[5]);
+        float f = adaptive.tick_frequency;
+        TEST_ASSERT_TRUE(f < base_frequency);
+        TEST_ASSERT_EQUAL_FLOAT((float)STEP_TIMER_CLOCK / adaptive.tick_period, f);
+        std::vector<float> times = simulate_ticks(adaptive);
+
+        printf("%lu steps: ticked at %f Hz, %lu ticks vs %lu ticks, time %f vs %f secs\n",
+               (uint32_t)m[0], f, adaptive.total_move_ticks, fixed.total_move_ticks, times.back(), ref.back());
+
+        // same steps issued
+        TEST_ASSERT_EQUAL_INT(m[0], ref.size());
+        TEST_ASSERT_EQUAL_INT(ref.size(), times.size());
+
+        // the total move time is the same within 2%
+        TEST_ASSERT_FLOAT_WITHIN(ref.back() * 0.02F, ref.back(), times.back());
+
+        // each step happens at the same time within two ticks, or within half a step period at low rates
+        for (size_t i = 1; i < ref.size(); ++i) {
+            float interval = std::max(ref[i] - ref[i - 1], 2.0F / f);
+            TEST_ASSERT_FLOAT_WITHIN(interval / 2, ref[i], times[i]);
+        }
+    }
+
+    restart_ticker(st, was_started);
+}
@@ -0,0 +1,111 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "AdcFilter.h"
+
+#include <stdint.h>
+
+// a DMA buffer with 3 channels interleaved, 8 samples each
+static uint16_t buf[8 * 3];
+
+static void fill(int ch, const uint16_t *v)
+{
+    for (int i = 0; i < 8; ++i) {
+        buf[i * 3 + ch] = v[i];
+    }
+}
+
+REGISTER_TEST(AdcFilter, average_and_median)
+{
+    const uint16_t v0[8] = {1000, 1002, 998, 1000, 1001, 999, 1000, 1000};
+    const uint16_t v1[8] = {2000, 2000, 2000, 65535, 2000, 2000, 0, 2000}; // two spikes
+    fill(0, v0);
+    fill(1, v1);
+
+    AdcFilter f0, f1, m1;
+    m1.set_type(AdcFilter::MEDIAN);
+    f0.add(buf, 8, 3);
+    f1.add(buf + 1, 8, 3);
+    m1.add(buf + 1, 8, 3);
+
+    TEST_ASSERT_EQUAL_INT(1000, f0.get());
+    // the average is thrown by the spikes, the median is not
+    TEST_ASSERT_TRUE(f1.get() > 2000 + 5000);
+    TEST_ASSERT_EQUAL_INT(2000, m1.get());
+
+    // the data is not changed by the median
+    TEST_ASSERT_EQUAL_INT(65535, buf[3 * 3 + 1]);
+
+    uint16_t odd[5] = {5, 1, 4, 2, 3};
+    TEST_ASSERT_EQUAL_INT(3, AdcFilter::median(odd, 5));
+}
+
+REGISTER_TEST(AdcFilter, iir)
+{
+    AdcFilter f;
+    f.set_type(AdcFilter::IIR);
+    f.set_alpha(0.5F);
+
+    const uint16_t a[8] = {1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000};
+    const uint16_t b[8] = {3000, 3000, 3000, 3000, 3000, 3000, 3000, 3000};
+
+    // starts at the first block
+    fill(2, a);
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_EQUAL_INT(1000, f.get());
+
+    // then moves half way each block
+    fill(2, b);
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_EQUAL_INT(2000, f.get());
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_EQUAL_INT(2500, f.get());
+    for (int i = 0; i < 20; ++i) f.add(buf + 2, 8, 3);
+    TEST_ASSERT_EQUAL_INT(3000, f.get());
+
+    AdcFilter::TYPE t;
+    TEST_ASSERT_TRUE(AdcFilter::type_from_string("median", t));
+    TEST_ASSERT_EQUAL_INT(AdcFilter::MEDIAN, t);
+    TEST_ASSERT_FALSE(AdcFilter::type_from_string("mean", t));
+}
+
+REGISTER_TEST(AdcFilter, iir_full_scale)
+{
+    AdcFilter f;
+    f.set_type(AdcFilter::IIR);
+    f.set_alpha(0.5F);
+
+    const uint16_t low[8] = {1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000};
+    const uint16_t high[8] = {60000, 60000, 60000, 60000, 60000, 60000, 60000, 60000};
+
+    fill(2, low);
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_EQUAL_INT(1000, f.get());
+
+    // readings over 32767 must not wrap
+    fill(2, high);
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_INT_WITHIN(2, 30500, f.get());
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_INT_WITHIN(2, 45250, f.get());
+    uint16_t last = f.get();
+    for (int i = 0; i < 20; ++i) {
+        f.add(buf + 2, 8, 3);
+        TEST_ASSERT_TRUE(f.get() >= last);
+        last = f.get();
+    }
+    TEST_ASSERT_INT_WITHIN(1, 60000, f.get());
+
+    // and back down
+    fill(2, low);
+    f.add(buf + 2, 8, 3);
+    TEST_ASSERT_INT_WITHIN(2, 30500, f.get());
+    for (int i = 0; i < 20; ++i) f.add(buf + 2, 8, 3);
+    TEST_ASSERT_INT_WITHIN(1, 1000, f.get());
+
+    // full scale settles at full scale
+    const uint16_t max[8] = {65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535};
+    fill(2, max);
+    for (int i = 0; i < 30; ++i) f.add(buf + 2, 8, 3);
+    TEST_ASSERT_INT_WITHIN(1, 65535, f.get());
+}
@@ -1,5 +1,6 @@
 #include "../Unity/src/unity.h"
 #include <sstream>
+#include <cstring>
 
 #include "ConfigReader.h"
 #include "ConfigWriter.h"
@@ -315,6 +316,37 @@ REGISTER_TEST(ConfigTest, write_remove_nonexistant_key)
     TEST_ASSERT_TRUE(oss.str() == iss.str());
 }
 
+REGISTER_TEST(ConfigTest, overrides)
+{
+    std::stringstream ss1(str);
+    ConfigReader cr(ss1);
+
+    ConfigReader::set_override([](const char *section, ConfigReader::section_map_t& config) {
+        if(strcmp(section, "dummy") == 0) {
+            config["enable"] = "true";
+            config["extra"] = "42";
+        } else if(strcmp(section, "switch") == 0) {
+            config["fan.enable"] = "false";
+            config["new.enable"] = "true";
+        }
+    });
+
+    ConfigReader::section_map_t m;
+    TEST_ASSERT_TRUE(cr.get_section("dummy", m));
+    TEST_ASSERT_EQUAL_INT(2, m.size());
+    TEST_ASSERT_TRUE(cr.get_bool(m, "enable", false));
+    TEST_ASSERT_EQUAL_INT(42, cr.get_int(m, "extra", 0));
+
+    ConfigReader::sub_section_map_t ssmap;
+    TEST_ASSERT_TRUE(cr.get_sub_sections("switch", ssmap));
+    TEST_ASSERT_EQUAL_INT(4, ssmap.size());
+    TEST_ASSERT_FALSE(cr.get_bool(ssmap["fan"], "enable", true));
+    TEST_ASSERT_EQUAL_STRING("M106", ssmap["fan"]["input_on_command"].c_str());
+    TEST_ASSERT_TRUE(cr.get_bool(ssmap["new"], "enable", false));
+
+    ConfigReader::set_override(nullptr);
+}
+
 #if 0
 extern "C" bool setup_sdmmc();
 #include <fstream>
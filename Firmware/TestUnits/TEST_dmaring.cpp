@@ -0,0 +1,133 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "DmaRing.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// emulates a circular DMA writing n bytes into the buffer, returns the new position
+static uint32_t dma_write(uint8_t *buf, uint32_t size, uint32_t pos, uint8_t& v, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        buf[pos] = v++;
+        if(++pos == size) pos = 0;
+    }
+    return pos;
+}
+
+REGISTER_TEST(DmaRing, rx_wrap_and_overrun)
+{
+    uint8_t buf[16];
+    DmaRxRing rx(buf, sizeof(buf));
+    uint8_t v = 0, expect = 0;
+    uint32_t pos = 0;
+    uint8_t *p;
+
+    TEST_ASSERT_EQUAL_INT(0, rx.peek(p));
+
+    // idle after 5, then half transfer at 8
+    pos = dma_write(buf, 16, pos, v, 5);
+    TEST_ASSERT_EQUAL_INT(5, rx.update(pos));
+    pos = dma_write(buf, 16, pos, v, 3);
+    TEST_ASSERT_EQUAL_INT(3, rx.update(pos));
+    uint32_t n = rx.peek(p);
+    TEST_ASSERT_EQUAL_INT(8, n);
+    TEST_ASSERT_TRUE(p == buf);
+    for (uint32_t i = 0; i < n; ++i) TEST_ASSERT_EQUAL_INT(expect++, p[i]);
+    TEST_ASSERT_TRUE(rx.consume(n));
+
+    // goes past the end, the full transfer reports the size as the position, then it is read in two parts
+    pos = dma_write(buf, 16, pos, v, 8);
+    TEST_ASSERT_EQUAL_INT(8, rx.update(16));
+    pos = dma_write(buf, 16, pos, v, 4);
+    TEST_ASSERT_EQUAL_INT(4, rx.update(pos));
+    TEST_ASSERT_EQUAL_INT(12, rx.available());
+    n = rx.peek(p);
+    TEST_ASSERT_EQUAL_INT(8, n);
+    for (uint32_t i = 0; i < n; ++i) TEST_ASSERT_EQUAL_INT(expect++, p[i]);
+    TEST_ASSERT_TRUE(rx.consume(n));
+    n = rx.peek(p);
+    TEST_ASSERT_EQUAL_INT(4, n);
+    TEST_ASSERT_TRUE(p == buf);
+    for (uint32_t i = 0; i < n; ++i) TEST_ASSERT_EQUAL_INT(expect++, p[i]);
+
+    // the DMA overwrites these while they are still in use
+    for (int i = 0; i < 3; ++i) {
+        pos = dma_write(buf, 16, pos, v, 8);
+        rx.update(pos);
+    }
+    TEST_ASSERT_FALSE(rx.consume(n));
+    TEST_ASSERT_EQUAL_INT(4, rx.get_overruns());
+    // and the rest is a buffer behind so it is skipped
+    TEST_ASSERT_EQUAL_INT(0, rx.peek(p));
+    TEST_ASSERT_EQUAL_INT(4 + 24, rx.get_overruns());
+    TEST_ASSERT_EQUAL_INT(0, rx.available());
+
+    // carries on with new data
+    expect = v;
+    pos = dma_write(buf, 16, pos, v, 2);
+    rx.update(pos);
+    n = rx.peek(p);
+    TEST_ASSERT_EQUAL_INT(2, n);
+    TEST_ASSERT_EQUAL_INT(expect, p[0]);
+}
+
+REGISTER_TEST(DmaRing, tx_blocks)
+{
+    uint8_t buf[16];
+    DmaTxRing tx(buf, sizeof(buf));
+    const uint8_t *msg = (const uint8_t *)"0123456789abcdefghijklmnop";
+    uint8_t *p;
+
+    TEST_ASSERT_EQUAL_INT(0, tx.start(p));
+    TEST_ASSERT_EQUAL_INT(10, tx.put(msg, 10));
+    TEST_ASSERT_EQUAL_INT(10, tx.start(p));
+    TEST_ASSERT_TRUE(tx.is_busy());
+    TEST_ASSERT_EQUAL_INT(0, memcmp(p, msg, 10));
+
+    // only one block at a time
+    TEST_ASSERT_EQUAL_INT(6, tx.put(&msg[10], 10));
+    TEST_ASSERT_EQUAL_INT(0, tx.space());
+    TEST_ASSERT_EQUAL_INT(0, tx.start(p));
+
+    tx.done();
+    TEST_ASSERT_EQUAL_INT(10, tx.space());
+    // reserved space is not sent until it is committed
+    uint8_t *p1, *p2;
+    uint32_t n1, n2;
+    TEST_ASSERT_EQUAL_INT(4, tx.reserve(4, p1, n1, p2, n2));
+    TEST_ASSERT_TRUE(p1 == buf);
+    TEST_ASSERT_EQUAL_INT(4, n1);
+    TEST_ASSERT_EQUAL_INT(0, n2);
+    memcpy(p1, &msg[16], 4);
+    TEST_ASSERT_EQUAL_INT(10, tx.space());
+    tx.commit(4);
+    TEST_ASSERT_EQUAL_INT(6, tx.space());
+
+    TEST_ASSERT_EQUAL_INT(6, tx.start(p));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(p, &msg[10], 6));
+    tx.done();
+    TEST_ASSERT_EQUAL_INT(4, tx.start(p));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(p, &msg[16], 4));
+    tx.done();
+    TEST_ASSERT_FALSE(tx.is_busy());
+    TEST_ASSERT_EQUAL_INT(16, tx.space());
+    TEST_ASSERT_EQUAL_INT(0, tx.start(p));
+
+    // a reserve that wraps, limited to the space
+    TEST_ASSERT_EQUAL_INT(16, tx.reserve(20, p1, n1, p2, n2));
+    TEST_ASSERT_EQUAL_INT(12, n1);
+    TEST_ASSERT_EQUAL_INT(4, n2);
+    TEST_ASSERT_TRUE(p2 == buf);
+    TEST_ASSERT_EQUAL_INT(0, tx.start(p));
+
+    // a put that wraps
+    TEST_ASSERT_EQUAL_INT(14, tx.put(msg, 14));
+    TEST_ASSERT_EQUAL_INT(12, tx.start(p));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(p, msg, 12));
+    tx.done();
+    TEST_ASSERT_EQUAL_INT(2, tx.start(p));
+    TEST_ASSERT_TRUE(p == buf);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(p, &msg[12], 2));
+}
@@ -2,6 +2,7 @@
 #include "TestRegistry.h"
 
 #include "FastTicker.h"
+#include "IsrProfile.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -9,6 +10,8 @@
 
 #include "stm32h7xx.h" // for HAL_Delay()
 
+#include <string.h>
+
 static volatile int timer_cnt20hz= 0;
 static volatile int timer_cnt2khz= 0;
 static volatile int timer_cnt10khz= 0;
@@ -87,3 +90,47 @@ REGISTER_TEST(FastTicker, test_2khz_and_10khz)
 
     FastTicker::deleteInstance();
 }
+
+static volatile uint32_t tick_no= 0;
+static volatile uint32_t last_tick[3];
+static void count_ticks(void) { ++tick_no; }
+static void callback_a(void) { last_tick[0]= tick_no; }
+static void callback_b(void) { last_tick[1]= tick_no; }
+static void callback_c(void) { last_tick[2]= tick_no; }
+
+REGISTER_TEST(FastTicker, test_staggered)
+{
+    FastTicker *flt= FastTicker::getInstance();
+
+    // counts ticks and runs first on every tick
+    TEST_ASSERT_TRUE(flt->attach(10000, count_ticks, "tick_count", FastTicker::PRIO_HIGH) >= 0);
+    // three 1KHz callbacks should all land on different ticks
+    int n0= flt->attach(1000, callback_a, "callback_a");
+    int n1= flt->attach(1000, callback_b, "callback_b");
+    int n2= flt->attach(1000, callback_c, "callback_c", FastTicker::PRIO_LOW);
+    TEST_ASSERT_TRUE(n0 >= 0 && n1 >= 0 && n2 >= 0);
+
+    TEST_ASSERT_TRUE(flt->start());
+    HAL_Delay(100);
+    TEST_ASSERT_TRUE(flt->stop());
+
+    printf("ticks %lu, last ticks %lu %lu %lu, deferred %lu\n", tick_no, last_tick[0], last_tick[1], last_tick[2], flt->get_deferred());
+    TEST_ASSERT_INT_WITHIN(20, 1000, tick_no);
+    TEST_ASSERT_TRUE(last_tick[0] % 10 != last_tick[1] % 10);
+    TEST_ASSERT_TRUE(last_tick[0] % 10 != last_tick[2] % 10);
+    TEST_ASSERT_TRUE(last_tick[1] % 10 != last_tick[2] % 10);
+    // nothing takes long enough to be deferred
+    TEST_ASSERT_EQUAL_INT(0, flt->get_deferred());
+
+    // each callback is timed on its own
+    int found= 0;
+    for(IsrProfile *p = IsrProfile::first(); p != nullptr; p = p->next()) {
+        if(strcmp(p->get_name(), "callback_a") == 0 || strcmp(p->get_name(), "callback_c") == 0) {
+            TEST_ASSERT_INT_WITHIN(2, 100, p->get_count());
+            ++found;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(2, found);
+
+    FastTicker::deleteInstance();
+}
@@ -0,0 +1,98 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "HeightMap.h"
+
+#include <stdio.h>
+#include <math.h>
+
+// a tilted bed
+static float plane(float x, float y)
+{
+    return 0.1F + 0.01F * x - 0.02F * y;
+}
+
+// a bowl shaped bed, lowest in the middle
+static float bowl(float x, float y)
+{
+    return 0.0001F * ((x - 50) * (x - 50) + (y - 40) * (y - 40));
+}
+
+// samples taken every step mm along a serpentine path of lines in X no more than line_spacing apart in Y,
+// the same path as CartGridStrategy::doScan()
+static void scan(HeightMap& map, float (*bed)(float, float), float x_size, float y_size, float line_spacing, float step)
+{
+    int lines = (int)ceilf(y_size / line_spacing) + 1;
+    line_spacing = y_size / (lines - 1);
+    int n = (int)(x_size / step + 0.5F);
+    for (int l = 0; l < lines; ++l) {
+        float y = line_spacing * l;
+        for (int i = 0; i <= n; ++i) {
+            float x = (l % 2) ? x_size - step * i : step * i;
+            map.add_sample(x, y, bed(x, y));
+        }
+    }
+}
+
+REGISTER_TEST(HeightMap, plane_one_line_per_row)
+{
+    HeightMap map;
+    TEST_ASSERT_TRUE(map.init(0, 0, 100, 80, 1));
+    TEST_ASSERT_EQUAL_INT(101, map.get_x_bins());
+    TEST_ASSERT_EQUAL_INT(81, map.get_y_bins());
+
+    // 5x5 grid, scan lines through each row of grid points
+    scan(map, plane, 100, 80, 20, 0.1F);
+    TEST_ASSERT_EQUAL_INT(5 * 1001, map.get_sample_count());
+
+    float grid[5 * 5];
+    TEST_ASSERT_EQUAL_INT(0, map.resample(grid, 5, 5, 15));
+    for (int y = 0; y < 5; ++y) {
+        for (int x = 0; x < 5; ++x) {
+            // including the corners, which only have samples to one side
+            TEST_ASSERT_FLOAT_WITHIN(0.005F, plane(x * 25.0F, y * 20.0F), grid[x + y * 5]);
+        }
+    }
+}
+
+REGISTER_TEST(HeightMap, dense_lines)
+{
+    HeightMap map;
+    TEST_ASSERT_TRUE(map.init(0, 0, 100, 80, 2));
+
+    // lines about 3mm apart so most do not go through the grid points
+    scan(map, bowl, 100, 80, 3, 0.2F);
+
+    float grid[7 * 5];
+    TEST_ASSERT_EQUAL_INT(0, map.resample(grid, 7, 5, 4));
+    for (int y = 0; y < 5; ++y) {
+        for (int x = 0; x < 7; ++x) {
+            TEST_ASSERT_FLOAT_WITHIN(0.005F, bowl(x * 100.0F / 6, y * 20.0F), grid[x + y * 7]);
+        }
+    }
+}
+
+REGISTER_TEST(HeightMap, missing_and_outside)
+{
+    HeightMap map;
+    TEST_ASSERT_TRUE(map.init(0, 0, 100, 80, 1));
+
+    // only the first row is scanned, samples off the bed are ignored
+    for (int i = -50; i <= 150; ++i) {
+        map.add_sample(i, 0, 1.0F);
+    }
+    map.add_sample(50, -10, 1.0F);
+    map.add_sample(50, 100, 1.0F);
+    TEST_ASSERT_EQUAL_INT(101, map.get_sample_count());
+
+    float grid[3 * 3];
+    TEST_ASSERT_EQUAL_INT(6, map.resample(grid, 3, 3, 5));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 1.0F, grid[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 1.0F, grid[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 1.0F, grid[2]);
+    TEST_ASSERT_TRUE(grid[4] != grid[4]); // NAN
+
+    map.clear();
+    TEST_ASSERT_EQUAL_INT(0, map.get_sample_count());
+    TEST_ASSERT_FALSE(map.init(0, 0, 0, 80, 1));
+}
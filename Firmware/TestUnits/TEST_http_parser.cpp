@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <cstring>
+#include <string>
 
 #include "TestRegistry.h"
 
@@ -12,6 +13,8 @@ extern "C" int parse_request(const char *buf, uint32_t len, void *request);
 extern "C" int parse_request_get_method(void *request);
 extern "C" const char *parse_request_get_url(void *request);
 extern "C" const char *parse_request_get_header(const char *hdr, void *request);
+extern "C" void parse_request_reset(void *request);
+extern "C" int parse_request_keep_alive(void *request);
 
 REGISTER_TEST(HTTPparserTest, basic)
 {
@@ -120,3 +123,56 @@ this is data";
     // free up resources]
     TEST_ASSERT_EQUAL_INT(1, parse_request_release(request));
 }
+
+REGISTER_TEST(HTTPparserTest, keep_alive)
+{
+    void *request = parse_request_create();
+    TEST_ASSERT_NOT_NULL(request);
+
+    // a second request follows in the same buffer, it is left for later
+    const char* req = "GET /index.html HTTP/1.1\r\nAccept-Encoding: gzip, deflate\r\nIf-None-Match: \"1234\"\r\n\r\nGET /functions.js HTTP/1.1\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT(1, parse_request(req, strlen(req), request));
+    TEST_ASSERT_EQUAL_STRING("/index.html", parse_request_get_url(request));
+    // header names are not case sensitive
+    TEST_ASSERT_EQUAL_STRING("gzip, deflate", parse_request_get_header("accept-encoding", request));
+    TEST_ASSERT_EQUAL_STRING("\"1234\"", parse_request_get_header("If-None-Match", request));
+    TEST_ASSERT_TRUE(parse_request_keep_alive(request));
+
+    // the same parser is used for the next request on the connection
+    parse_request_reset(request);
+    const char* req2 = "GET /functions.js HTTP/1.1\r\nConnection: close\r\nX-Empty:\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT(1, parse_request(req2, strlen(req2), request));
+    TEST_ASSERT_EQUAL_STRING("/functions.js", parse_request_get_url(request));
+    TEST_ASSERT_NULL(parse_request_get_header("Accept-Encoding", request));
+    TEST_ASSERT_EQUAL_STRING("", parse_request_get_header("X-Empty", request));
+    TEST_ASSERT_FALSE(parse_request_keep_alive(request));
+
+    // HTTP/1.0 closes unless asked not to
+    parse_request_reset(request);
+    const char* req3 = "GET / HTTP/1.0\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT(1, parse_request(req3, strlen(req3), request));
+    TEST_ASSERT_FALSE(parse_request_keep_alive(request));
+
+    TEST_ASSERT_EQUAL_INT(1, parse_request_release(request));
+}
+
+REGISTER_TEST(HTTPparserTest, header_limits)
+{
+    void *request = parse_request_create();
+    TEST_ASSERT_NOT_NULL(request);
+
+    // a header too big to keep is dropped but the rest are still there
+    std::string big(2000, 'x');
+    std::string req = "GET /test HTTP/1.1\r\nTEST1: 1234\r\nCookie: " + big + "\r\nTEST2: 5678\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT(1, parse_request(req.c_str(), req.size(), request));
+    TEST_ASSERT_EQUAL_STRING("1234", parse_request_get_header("TEST1", request));
+    TEST_ASSERT_NULL(parse_request_get_header("Cookie", request));
+    TEST_ASSERT_EQUAL_STRING("5678", parse_request_get_header("TEST2", request));
+
+    // a url that is too long is an error
+    parse_request_reset(request);
+    std::string req2 = "GET /" + big + " HTTP/1.1\r\n\r\n";
+    TEST_ASSERT_TRUE(parse_request(req2.c_str(), req2.size(), request) < 0);
+
+    TEST_ASSERT_EQUAL_INT(1, parse_request_release(request));
+}
@@ -0,0 +1,79 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "IsrProfile.h"
+
+// must be static as it links itself into the global list of profiles
+static IsrProfile test_profile("test_isr");
+
+REGISTER_TEST(IsrProfile, stats)
+{
+    test_profile.set_period(0);
+    test_profile.reset();
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_count());
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_min());
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_max());
+
+    test_profile.record(100);
+    test_profile.record(300);
+    test_profile.record(200);
+
+    TEST_ASSERT_EQUAL_INT(3, test_profile.get_count());
+    TEST_ASSERT_EQUAL_INT(100, test_profile.get_min());
+    TEST_ASSERT_EQUAL_INT(300, test_profile.get_max());
+    TEST_ASSERT_EQUAL_FLOAT(200.0F, test_profile.get_mean());
+    // not periodic so no histogram or overruns
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_overruns());
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, test_profile.get_max_load());
+    for (int i = 0; i <= IsrProfile::num_buckets; ++i) {
+        TEST_ASSERT_EQUAL_INT(0, test_profile.get_bucket(i));
+    }
+}
+
+REGISTER_TEST(IsrProfile, histogram_and_overruns)
+{
+    test_profile.set_period(1000);
+    test_profile.reset();
+
+    test_profile.record(0);    // bucket 0
+    test_profile.record(99);   // bucket 0
+    test_profile.record(100);  // bucket 1
+    test_profile.record(550);  // bucket 5
+    test_profile.record(999);  // bucket 9
+    test_profile.record(1000); // overrun
+    test_profile.record(5000); // overrun
+
+    TEST_ASSERT_EQUAL_INT(7, test_profile.get_count());
+    TEST_ASSERT_EQUAL_INT(2, test_profile.get_bucket(0));
+    TEST_ASSERT_EQUAL_INT(1, test_profile.get_bucket(1));
+    TEST_ASSERT_EQUAL_INT(1, test_profile.get_bucket(5));
+    TEST_ASSERT_EQUAL_INT(1, test_profile.get_bucket(9));
+    TEST_ASSERT_EQUAL_INT(2, test_profile.get_bucket(IsrProfile::num_buckets));
+    TEST_ASSERT_EQUAL_INT(2, test_profile.get_overruns());
+    TEST_ASSERT_EQUAL_FLOAT(500.0F, test_profile.get_max_load());
+
+    // out of range buckets are always empty
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_bucket(-1));
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_bucket(IsrProfile::num_buckets + 1));
+}
+
+REGISTER_TEST(IsrProfile, reset_all)
+{
+    test_profile.set_period(1000);
+    test_profile.record(1500);
+    TEST_ASSERT_TRUE(test_profile.get_count() > 0);
+
+    // make sure we are in the list of all profiles
+    bool found = false;
+    for(IsrProfile *p = IsrProfile::first(); p != nullptr; p = p->next()) {
+        if(p == &test_profile) found = true;
+    }
+    TEST_ASSERT_TRUE(found);
+
+    IsrProfile::reset_all();
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_count());
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_overruns());
+    TEST_ASSERT_EQUAL_INT(0, test_profile.get_bucket(IsrProfile::num_buckets));
+    // period is kept
+    TEST_ASSERT_EQUAL_INT(1000, test_profile.get_period());
+}
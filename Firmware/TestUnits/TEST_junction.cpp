@@ -0,0 +1,75 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "Planner.h"
+#include "ConfigReader.h"
+
+#include <sstream>
+#include <stdio.h>
+
+const static char vector_config[]= "\
+[planner]\n\
+junction_deviation = 0.05\n\
+minimum_planner_speed = 1\n\
+full_vector_junction = true\n\
+centripetal_acceleration = 400\n\
+";
+
+const static char default_config[]= "\
+[planner]\n\
+junction_deviation = 0.05\n\
+";
+
+static void configure_planner(const char *config)
+{
+    std::stringstream ss(config);
+    ConfigReader cr(ss);
+    TEST_ASSERT_TRUE(Planner::getInstance()->configure(cr));
+}
+
+REGISTER_TEST(Junction, arc_speed_limit)
+{
+    Planner *p = Planner::getInstance();
+
+    configure_planner(default_config);
+    TEST_ASSERT_FALSE(p->is_full_vector_junction());
+    // disabled so no limit
+    TEST_ASSERT_TRUE(p->arc_speed_limit(10) > 1e30F);
+
+    configure_planner(vector_config);
+    TEST_ASSERT_TRUE(p->is_full_vector_junction());
+    // v = sqrt(a * r)
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 20.0F, p->arc_speed_limit(1));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 200.0F, p->arc_speed_limit(100));
+    // not an arc
+    TEST_ASSERT_TRUE(p->arc_speed_limit(0) > 1e30F);
+
+    configure_planner(default_config);
+}
+
+REGISTER_TEST(Junction, vector_junction_speed)
+{
+    Planner *p = Planner::getInstance();
+    configure_planner(vector_config);
+
+    // vectors are per actuator, unused ones are zero
+    float x[k_max_actuators]{0};
+    float minus_x[k_max_actuators]{0};
+    float x_scaled[k_max_actuators]{0};
+    float none[k_max_actuators]{0};
+    x[0] = 1;
+    minus_x[0] = -1;
+    x_scaled[0] = 2.5F; // same direction, the vectors are normalized
+
+    // straight through is limited by the slower of the nominal speeds
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 50.0F, p->junction_speed(x, x, 100, 50, 0.05F));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 30.0F, p->junction_speed(x, x_scaled, 30, 50, 0.05F));
+
+    // full reversal uses the minimum planner speed
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 1.0F, p->junction_speed(x, minus_x, 100, 100, 0.05F));
+
+    // no movement uses the minimum planner speed
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 1.0F, p->junction_speed(none, x, 100, 100, 0.05F));
+
+    configure_planner(default_config);
+}
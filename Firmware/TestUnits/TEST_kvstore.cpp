@@ -0,0 +1,191 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "KVStore.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// RAM backed NOR flash, programming can only clear bits.
+// It can be made to lose power after a number of bytes have been programmed.
+class RamFlash : public KVFlash
+{
+public:
+    RamFlash(uint32_t bs, uint32_t n) : block_size(bs), mem(bs * n, 0xFF), erases(n, 0) {}
+
+    bool read(uint32_t addr, void *buf, uint32_t len)
+    {
+        if(addr + len > mem.size()) return false;
+        memcpy(buf, &mem[addr], len);
+        return true;
+    }
+
+    bool program(uint32_t addr, const void *buf, uint32_t len)
+    {
+        if(addr + len > mem.size()) return false;
+        const uint8_t *p = (const uint8_t *)buf;
+        for (uint32_t i = 0; i < len; ++i) {
+            if(power_left == 0) return false;
+            if(power_left > 0) --power_left;
+            mem[addr + i] &= p[i];
+        }
+        return true;
+    }
+
+    bool erase(uint32_t addr)
+    {
+        if(addr % block_size != 0 || addr >= mem.size()) return false;
+        memset(&mem[addr], 0xFF, block_size);
+        ++erases[addr / block_size];
+        return true;
+    }
+
+    uint32_t block_size;
+    std::vector<uint8_t> mem;
+    std::vector<uint32_t> erases;
+    int power_left{-1};
+};
+
+REGISTER_TEST(KVStore, put_get_remove)
+{
+    RamFlash flash(1024, 4);
+    KVStore kv(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv.mount());
+    TEST_ASSERT_EQUAL_INT(0, kv.get_key_count());
+    TEST_ASSERT_EQUAL_INT(3, kv.get_free_blocks());
+
+    TEST_ASSERT_TRUE(kv.put("alpha", "one"));
+    TEST_ASSERT_TRUE(kv.put("beta", "two"));
+    TEST_ASSERT_TRUE(kv.put("alpha", "three"));
+
+    std::string v;
+    TEST_ASSERT_TRUE(kv.get("alpha", v));
+    TEST_ASSERT_EQUAL_STRING("three", v.c_str());
+    char buf[8];
+    TEST_ASSERT_EQUAL_INT(3, kv.get("beta", buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf, "two", 3));
+    TEST_ASSERT_EQUAL_INT(-1, kv.get("gamma", buf, sizeof(buf)));
+
+    TEST_ASSERT_TRUE(kv.remove("beta"));
+    TEST_ASSERT_FALSE(kv.exists("beta"));
+    TEST_ASSERT_FALSE(kv.remove("beta"));
+    TEST_ASSERT_EQUAL_INT(1, kv.get_key_count());
+
+    // it all comes back after a remount
+    KVStore kv2(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv2.mount());
+    TEST_ASSERT_EQUAL_INT(1, kv2.get_key_count());
+    TEST_ASSERT_TRUE(kv2.get("alpha", v));
+    TEST_ASSERT_EQUAL_STRING("three", v.c_str());
+    TEST_ASSERT_FALSE(kv2.exists("beta"));
+
+    // too big for a block
+    std::string big(1024, 'x');
+    TEST_ASSERT_FALSE(kv2.put("big", big));
+    TEST_ASSERT_TRUE(kv2.put("big", big.substr(0, kv2.get_max_value_size("big"))));
+}
+
+REGISTER_TEST(KVStore, wear_and_compaction)
+{
+    RamFlash flash(1024, 4);
+    KVStore kv(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv.mount());
+
+    // a value that never changes has to survive its block being reclaimed
+    TEST_ASSERT_TRUE(kv.put("fixed", "stays"));
+
+    char val[100];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(val, sizeof(val), "value %d", i);
+        std::string s(val);
+        s.resize(60, '.');
+        TEST_ASSERT_TRUE(kv.put(i % 2 ? "odd" : "even", s));
+    }
+
+    std::string v;
+    TEST_ASSERT_TRUE(kv.get("fixed", v));
+    TEST_ASSERT_EQUAL_STRING("stays", v.c_str());
+    TEST_ASSERT_TRUE(kv.get("odd", v));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(v.c_str(), "value 999.", 10));
+    TEST_ASSERT_EQUAL_INT(1, kv.get_free_blocks());
+
+    // the erases are spread evenly
+    uint32_t mn = 0xFFFFFFFF, mx = 0;
+    for(auto e : flash.erases) {
+        if(e < mn) mn = e;
+        if(e > mx) mx = e;
+    }
+    TEST_ASSERT_TRUE(mn > 10);
+    TEST_ASSERT_TRUE(mx - mn <= 2);
+
+    KVStore kv2(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv2.mount());
+    TEST_ASSERT_EQUAL_INT(3, kv2.get_key_count());
+    TEST_ASSERT_TRUE(kv2.get("even", v));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(v.c_str(), "value 998.", 10));
+    TEST_ASSERT_TRUE(kv2.get("fixed", v));
+    TEST_ASSERT_EQUAL_STRING("stays", v.c_str());
+}
+
+REGISTER_TEST(KVStore, power_loss_keeps_old_value)
+{
+    RamFlash flash(1024, 4);
+    KVStore kv(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv.mount());
+    TEST_ASSERT_TRUE(kv.put("key", "old value"));
+
+    // dies part way through the value
+    flash.power_left = 14;
+    TEST_ASSERT_FALSE(kv.put("key", "new value"));
+    flash.power_left = -1;
+
+    KVStore kv2(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv2.mount());
+    std::string v;
+    TEST_ASSERT_TRUE(kv2.get("key", v));
+    TEST_ASSERT_EQUAL_STRING("old value", v.c_str());
+
+    // writes carry on in a new block after the damaged record
+    TEST_ASSERT_EQUAL_INT(3, kv2.get_free_blocks());
+    TEST_ASSERT_TRUE(kv2.put("key", "new value"));
+    TEST_ASSERT_EQUAL_INT(2, kv2.get_free_blocks());
+
+    KVStore kv3(flash, 1024, 4);
+    TEST_ASSERT_TRUE(kv3.mount());
+    TEST_ASSERT_TRUE(kv3.get("key", v));
+    TEST_ASSERT_EQUAL_STRING("new value", v.c_str());
+}
+
+REGISTER_TEST(KVStore, full)
+{
+    RamFlash flash(256, 2);
+    KVStore kv(flash, 256, 2);
+    TEST_ASSERT_TRUE(kv.mount());
+
+    std::string s(100, 'a');
+    TEST_ASSERT_TRUE(kv.put("a", s));
+    TEST_ASSERT_TRUE(kv.put("b", s));
+    // no room for a third live value, but the others are still fine
+    TEST_ASSERT_FALSE(kv.put("c", s));
+    std::string v;
+    TEST_ASSERT_TRUE(kv.get("a", v));
+    TEST_ASSERT_EQUAL_INT(100, v.size());
+    // once one is removed its space is reclaimed
+    TEST_ASSERT_TRUE(kv.remove("a"));
+    TEST_ASSERT_TRUE(kv.put("c", std::string(100, 'c')));
+    TEST_ASSERT_TRUE(kv.get("c", v));
+    TEST_ASSERT_EQUAL_INT('c', v[0]);
+    TEST_ASSERT_TRUE(kv.get("b", v));
+    TEST_ASSERT_EQUAL_INT('a', v[0]);
+    TEST_ASSERT_FALSE(kv.exists("a"));
+
+    // and a garbage block is erased on mount
+    memset(&flash.mem[0], 0x55, 16);
+    memset(&flash.mem[256], 0x55, 16);
+    KVStore kv2(flash, 256, 2);
+    TEST_ASSERT_TRUE(kv2.mount());
+    TEST_ASSERT_EQUAL_INT(0, kv2.get_key_count());
+    TEST_ASSERT_TRUE(kv2.put("a", s));
+}
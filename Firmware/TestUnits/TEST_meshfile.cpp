@@ -0,0 +1,87 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "MeshFile.h"
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <stdio.h>
+
+REGISTER_TEST(MeshFile, crc32)
+{
+    // the standard check value
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, meshfile::crc32(0, "123456789", 9));
+    // can be done in pieces
+    uint32_t crc = meshfile::crc32(0, "1234", 4);
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, meshfile::crc32(crc, "56789", 5));
+}
+
+// a mesh as it would be in a file or memory mapped from qspi
+static std::vector<uint8_t> make_mesh(uint16_t nx, uint16_t ny)
+{
+    std::vector<float> grid(nx * ny);
+    for (size_t i = 0; i < grid.size(); ++i) {
+        grid[i] = i * 0.001F;
+    }
+
+    MeshHeader hdr;
+    meshfile::init_header(hdr, MESH_TYPE_CARTESIAN, nx, ny, 0, 0, 200, 150);
+    hdr.crc = meshfile::calc_crc(hdr, grid.data());
+
+    std::vector<uint8_t> mem(sizeof(hdr) + grid.size() * sizeof(float));
+    memcpy(mem.data(), &hdr, sizeof(hdr));
+    memcpy(mem.data() + sizeof(hdr), grid.data(), grid.size() * sizeof(float));
+    return mem;
+}
+
+REGISTER_TEST(MeshFile, check_in_memory)
+{
+    // a big mesh
+    std::vector<uint8_t> mem = make_mesh(100, 80);
+
+    MeshHeader hdr;
+    const float *grid = meshfile::check(mem.data(), mem.size(), hdr);
+    TEST_ASSERT_NOT_NULL(grid);
+    TEST_ASSERT_EQUAL_INT(100, hdr.x_points);
+    TEST_ASSERT_EQUAL_INT(80, hdr.y_points);
+    TEST_ASSERT_EQUAL_INT(MESH_TYPE_CARTESIAN, hdr.type);
+    TEST_ASSERT_EQUAL_FLOAT(200, hdr.x_size);
+    TEST_ASSERT_EQUAL_FLOAT(150, hdr.y_size);
+    TEST_ASSERT_EQUAL_FLOAT(0.001F * 1234, grid[1234]);
+
+    // truncated
+    TEST_ASSERT_NULL(meshfile::check(mem.data(), mem.size() - 1, hdr));
+
+    // corrupted data
+    mem[sizeof(MeshHeader) + 100] ^= 0x01;
+    TEST_ASSERT_NULL(meshfile::check(mem.data(), mem.size(), hdr));
+    mem[sizeof(MeshHeader) + 100] ^= 0x01;
+    TEST_ASSERT_NOT_NULL(meshfile::check(mem.data(), mem.size(), hdr));
+
+    // corrupted header
+    mem[offsetof(MeshHeader, x_size)] ^= 0x01;
+    TEST_ASSERT_NULL(meshfile::check(mem.data(), mem.size(), hdr));
+    mem[offsetof(MeshHeader, x_size)] ^= 0x01;
+
+    // not a mesh, eg erased flash
+    std::vector<uint8_t> erased(1024, 0xFF);
+    TEST_ASSERT_NULL(meshfile::check(erased.data(), erased.size(), hdr));
+}
+
+REGISTER_TEST(MeshFile, header_larger_than_buffer)
+{
+    std::vector<uint8_t> mem = make_mesh(10, 10);
+    MeshHeader hdr;
+
+    // the biggest dimensions a header can have must be rejected without the crc reading past the end
+    MeshHeader *h = (MeshHeader *)mem.data();
+    h->x_points = 0xFFFF;
+    h->y_points = 0xFFFF;
+    TEST_ASSERT_NULL(meshfile::check(mem.data(), mem.size(), hdr));
+
+    // only the header
+    mem = make_mesh(10, 10);
+    TEST_ASSERT_NULL(meshfile::check(mem.data(), sizeof(MeshHeader), hdr));
+    TEST_ASSERT_EQUAL_INT(sizeof(MeshHeader) + 100 * sizeof(float), meshfile::size(100));
+}
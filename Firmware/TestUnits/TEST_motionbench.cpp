@@ -0,0 +1,104 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "Block.h"
+#include "Planner.h"
+#include "Conveyor.h"
+#include "StepTicker.h"
+#include "StepperMotor.h"
+#include "IsrProfile.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "stm32h7xx.h"
+
+#include <string.h>
+
+// Times the real StepTicker::step_tick() ISR while it runs moves with 1 to k_max_actuators motors stepping.
+// The motors are on unconnected pins so nothing moves, the cycle counts come from the step_tick profile
+// the isr command shows. Build with axis=n to compare different compiled in actuator counts.
+
+static StepperMotor *motors[k_max_actuators];
+
+static IsrProfile *find_profile(const char *name)
+{
+    for(IsrProfile *p = IsrProfile::first(); p != nullptr; p = p->next()) {
+        if(strcmp(p->get_name(), name) == 0) return p;
+    }
+    return nullptr;
+}
+
+// queue a move of steps on the first n motors at 100 steps/mm
+static void queue_move(Planner *planner, uint32_t n, uint32_t steps, float speed, float accel)
+{
+    Block *b = planner->get_queue_head();
+    b->clear();
+    for (uint32_t m = 0; m < n; ++m) {
+        b->steps[m] = steps;
+    }
+    b->steps_event_count = steps;
+    b->millimeters = steps / 100.0F;
+    b->nominal_speed = speed;
+    b->nominal_rate = steps * speed / b->millimeters;
+    b->acceleration = accel;
+    b->primary_motor = 0;
+    planner->calculate_trapezoid(b, 0, 0);
+    b->ready();
+    TEST_ASSERT_TRUE(planner->queue_head());
+}
+
+REGISTER_TEST(MotionBench, step_tick)
+{
+    StepTicker *st = StepTicker::getInstance();
+    Planner *planner = Planner::getInstance();
+    IsrProfile *profile = find_profile("step_tick");
+    TEST_ASSERT_NOT_NULL(profile);
+
+    bool was_started = st->is_started();
+    if(was_started) st->stop();
+
+    if(motors[0] == nullptr) {
+        TEST_ASSERT_TRUE(planner->initialize(k_max_actuators));
+        for (size_t m = 0; m < k_max_actuators; ++m) {
+            Pin step("nc"), dir("nc"), en("nc");
+            motors[m] = new StepperMotor(step, dir, en);
+            motors[m]->set_motor_id(st->register_actuator(motors[m]));
+        }
+    }
+
+    printf("Block is %u bytes with %u actuators compiled in, step tick period %lu cycles\n",
+           sizeof(Block), k_max_actuators, SystemCoreClock / (uint32_t)st->get_frequency());
+
+    for (uint32_t n = 1; n <= k_max_actuators; ++n) {
+        int32_t start = motors[0]->get_current_step();
+        // two moves of 2000 steps at 20000 steps/sec
+        queue_move(planner, n, 2000, 200, 2000);
+        queue_move(planner, n, 2000, 200, 2000);
+
+        profile->reset();
+        Conveyor::getInstance()->force_queue();
+        TEST_ASSERT_TRUE(st->start());
+
+        TickType_t t = xTaskGetTickCount();
+        while(!planner->is_queue_empty() && xTaskGetTickCount() - t < pdMS_TO_TICKS(2000)) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        st->stop();
+
+        // snapshot as the last ticks may still be landing
+        __disable_irq();
+        IsrProfile snap = *profile;
+        __enable_irq();
+
+        printf("%lu motors stepping: step_tick mean %1.1f, max %lu cycles over %lu ticks, overruns %lu\n",
+               n, snap.get_mean(), snap.get_max(), snap.get_count(), snap.get_overruns());
+
+        TEST_ASSERT_TRUE(planner->is_queue_empty());
+        TEST_ASSERT_EQUAL_INT(4000, motors[0]->get_current_step() - start);
+        TEST_ASSERT_TRUE(snap.get_count() > 0);
+        TEST_ASSERT_EQUAL_INT(0, snap.get_overruns());
+    }
+
+    if(was_started) st->start();
+}
@@ -0,0 +1,56 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "ProbeSamples.h"
+
+REGISTER_TEST(ProbeSamples, agree)
+{
+    ProbeSamples s;
+
+    // one sample is never enough on its own
+    s.add(5.000F);
+    TEST_ASSERT_FALSE(s.is_done(0.005F));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 5.0F, s.result(0.005F));
+
+    // two that agree stop early
+    s.add(5.004F);
+    TEST_ASSERT_TRUE(s.is_done(0.005F));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 5.002F, s.result(0.005F));
+    TEST_ASSERT_EQUAL_INT(2, s.inliers(0.005F));
+
+    // two that do not
+    s.clear();
+    s.add(5.000F);
+    s.add(5.020F);
+    TEST_ASSERT_FALSE(s.is_done(0.005F));
+}
+
+REGISTER_TEST(ProbeSamples, outlier)
+{
+    ProbeSamples s;
+    s.add(5.000F);
+    s.add(5.100F); // a bad touch, eg debris or a bounce
+    TEST_ASSERT_FALSE(s.is_done(0.005F));
+    s.add(5.003F);
+    TEST_ASSERT_TRUE(s.is_done(0.005F));
+
+    // the outlier is rejected
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 5.003F, s.median());
+    TEST_ASSERT_EQUAL_INT(2, s.inliers(0.005F));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 5.0015F, s.result(0.005F));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.00212F, s.deviation(0.005F));
+}
+
+REGISTER_TEST(ProbeSamples, full)
+{
+    ProbeSamples s;
+    for (int i = 0; i < ProbeSamples::max_samples; ++i) {
+        TEST_ASSERT_TRUE(s.add(i * 0.01F));
+    }
+    TEST_ASSERT_FALSE(s.add(1.0F));
+    TEST_ASSERT_EQUAL_INT(ProbeSamples::max_samples, s.size());
+
+    // never agreed so the result is the mean around the median
+    TEST_ASSERT_FALSE(s.is_done(0.001F));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.075F, s.median());
+}
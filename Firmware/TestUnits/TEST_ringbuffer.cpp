@@ -0,0 +1,243 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "RingBuffer.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+REGISTER_TEST(RingBuffer, push_pop_wrap)
+{
+    RingBuffer<int, 8> rb;
+    TEST_ASSERT_TRUE(rb.is_ok());
+    TEST_ASSERT_EQUAL_INT(8, rb.get_capacity());
+    TEST_ASSERT_TRUE(rb.empty());
+
+    // all the slots can be used
+    for (int i = 0; i < 8; ++i) {
+        TEST_ASSERT_FALSE(rb.full());
+        rb.push_back(i);
+    }
+    TEST_ASSERT_TRUE(rb.full());
+    TEST_ASSERT_FALSE(rb.push(99));
+    TEST_ASSERT_EQUAL_INT(8, rb.get_size());
+    TEST_ASSERT_EQUAL_INT(0, rb.get_free());
+
+    TEST_ASSERT_EQUAL_INT(0, rb.peek_front());
+    TEST_ASSERT_EQUAL_INT(0, rb.pop_front());
+    TEST_ASSERT_EQUAL_INT(7, rb.get_size());
+
+    // go round many times so the counts are well past the size
+    int next_in = 8, next_out = 1;
+    for (int i = 0; i < 1000; ++i) {
+        TEST_ASSERT_TRUE(rb.push(next_in++));
+        int v;
+        TEST_ASSERT_TRUE(rb.pop(v));
+        TEST_ASSERT_EQUAL_INT(next_out++, v);
+    }
+    TEST_ASSERT_EQUAL_INT(7, rb.get_size());
+
+    rb.flush();
+    TEST_ASSERT_TRUE(rb.empty());
+    int v;
+    TEST_ASSERT_FALSE(rb.pop(v));
+}
+
+REGISTER_TEST(RingBuffer, allocate_and_bulk)
+{
+    char buf[100];
+    RingBuffer<char> rb;
+    TEST_ASSERT_FALSE(rb.is_ok());
+    TEST_ASSERT_FALSE(rb.push('x'));
+
+    // rounded down to a power of two
+    TEST_ASSERT_TRUE(rb.allocate(buf, sizeof(buf)));
+    TEST_ASSERT_TRUE(rb.is_ok());
+    TEST_ASSERT_EQUAL_INT(64, rb.get_capacity());
+
+    char src[100], dst[100];
+    for (int i = 0; i < 100; ++i) src[i] = i;
+
+    // only what fits is added
+    TEST_ASSERT_EQUAL_INT(64, rb.push(src, 100));
+    TEST_ASSERT_TRUE(rb.full());
+    TEST_ASSERT_EQUAL_INT(40, rb.pop(dst, 40));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(dst, src, 40));
+
+    // this one goes round the end
+    TEST_ASSERT_EQUAL_INT(36, rb.push(&src[64], 36));
+    TEST_ASSERT_EQUAL_INT(60, rb.get_size());
+    TEST_ASSERT_EQUAL_INT(60, rb.pop(dst, 100));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(dst, &src[40], 60));
+    TEST_ASSERT_EQUAL_INT(0, rb.pop(dst, 100));
+
+    rb.deallocate();
+    TEST_ASSERT_FALSE(rb.is_ok());
+}
+
+REGISTER_TEST(RingBuffer, static_storage)
+{
+    StaticRingBuffer<uint16_t, 4> rb;
+    TEST_ASSERT_TRUE(sizeof(rb) >= 4 * sizeof(uint16_t));
+    TEST_ASSERT_EQUAL_INT(4, rb.get_capacity());
+    uint16_t in[4] = {10, 20, 30, 40};
+    TEST_ASSERT_EQUAL_INT(4, rb.push(in, 4));
+    TEST_ASSERT_EQUAL_INT(10, rb.pop_front());
+    TEST_ASSERT_TRUE(rb.push(50));
+    uint16_t out[4];
+    TEST_ASSERT_EQUAL_INT(4, rb.pop(out, 4));
+    TEST_ASSERT_EQUAL_INT(20, out[0]);
+    TEST_ASSERT_EQUAL_INT(50, out[3]);
+}
+
+REGISTER_TEST(RingBuffer, mpsc_single_thread)
+{
+    MPSCRingBuffer<uint32_t, 4> rb;
+    uint32_t v;
+    TEST_ASSERT_TRUE(rb.empty());
+    TEST_ASSERT_FALSE(rb.pop(v));
+    for (uint32_t i = 0; i < 4; ++i) TEST_ASSERT_TRUE(rb.push(i));
+    TEST_ASSERT_TRUE(rb.full());
+    TEST_ASSERT_FALSE(rb.push(4));
+    for (uint32_t i = 0; i < 100; ++i) {
+        TEST_ASSERT_TRUE(rb.pop(v));
+        TEST_ASSERT_EQUAL_INT(i, v);
+        TEST_ASSERT_TRUE(rb.push(i + 4));
+    }
+    TEST_ASSERT_EQUAL_INT(4, rb.get_size());
+}
+
+// The stress tests run the producers as tasks at the same priority as the test, so they are switched on every tick
+// part way through a push or pop. Whoever finds the ring full or empty yields to the other side.
+
+#define SPSC_COUNT 200000
+static RingBuffer<uint32_t, 64> *spsc_rb;
+static std::atomic<bool> spsc_done;
+
+static void spsc_producer(void *)
+{
+    uint32_t buf[13];
+    uint32_t next = 0;
+    while(next < SPSC_COUNT) {
+        // mix single and bulk pushes of odd sizes so they go round the end at different places
+        if((next & 7) == 0) {
+            if(spsc_rb->push(next)) ++next;
+            else taskYIELD();
+            continue;
+        }
+        uint32_t n = 1 + next % 13;
+        if(n > SPSC_COUNT - next) n = SPSC_COUNT - next;
+        for (uint32_t i = 0; i < n; ++i) buf[i] = next + i;
+        uint32_t done = spsc_rb->push(buf, n);
+        next += done;
+        if(done < n) taskYIELD();
+    }
+    spsc_done = true;
+    vTaskDelete(NULL);
+}
+
+REGISTER_TEST(RingBuffer, spsc_threads)
+{
+    spsc_rb = new RingBuffer<uint32_t, 64>;
+    spsc_done = false;
+    TaskHandle_t producer;
+    TEST_ASSERT_TRUE(xTaskCreate(spsc_producer, "producer", 256, NULL, uxTaskPriorityGet(NULL), &producer) == pdPASS);
+
+    uint32_t expect = 0;
+    uint32_t buf[17];
+    bool ok = true;
+    TickType_t start = xTaskGetTickCount();
+    while(expect < SPSC_COUNT && xTaskGetTickCount() - start < pdMS_TO_TICKS(10000)) {
+        uint32_t n;
+        if(expect & 1) {
+            n = spsc_rb->pop(buf, 1 + expect % 17);
+        } else {
+            n = spsc_rb->pop(buf[0]) ? 1 : 0;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            if(buf[i] != expect++) ok = false;
+        }
+        if(n == 0) taskYIELD();
+    }
+
+    // if it timed out the producer may be stuck on a full ring, so stop it rather than wait for it forever,
+    // either way it is finished with the ring before the asserts can return
+    start = xTaskGetTickCount();
+    while(!spsc_done && xTaskGetTickCount() - start < pdMS_TO_TICKS(1000)) taskYIELD();
+    bool finished = spsc_done;
+    if(!finished) vTaskDelete(producer);
+    bool empty = spsc_rb->empty();
+    delete spsc_rb;
+
+    TEST_ASSERT_TRUE(finished);
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_EQUAL_INT(SPSC_COUNT, expect);
+    TEST_ASSERT_TRUE(empty);
+}
+
+#define MPSC_PRODUCERS 3
+#define MPSC_COUNT 50000
+static MPSCRingBuffer<uint32_t, 16> *mpsc_rb;
+static std::atomic<int> mpsc_done;
+static std::atomic<bool> mpsc_finished[MPSC_PRODUCERS];
+
+static void mpsc_producer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < MPSC_COUNT; ++i) {
+        while(!mpsc_rb->push((id << 24) | i)) taskYIELD();
+    }
+    mpsc_finished[id] = true;
+    ++mpsc_done;
+    vTaskDelete(NULL);
+}
+
+REGISTER_TEST(RingBuffer, mpsc_threads)
+{
+    mpsc_rb = new MPSCRingBuffer<uint32_t, 16>;
+    mpsc_done = 0;
+    TaskHandle_t producers[MPSC_PRODUCERS];
+    for (uintptr_t i = 0; i < MPSC_PRODUCERS; ++i) {
+        mpsc_finished[i] = false;
+        TEST_ASSERT_TRUE(xTaskCreate(mpsc_producer, "producer", 256, (void *)i, uxTaskPriorityGet(NULL), &producers[i]) == pdPASS);
+    }
+
+    // each producer's values must come out in the order it pushed them
+    uint32_t expect[MPSC_PRODUCERS] = {0};
+    uint32_t total = 0;
+    bool ok = true;
+    TickType_t start = xTaskGetTickCount();
+    while(total < MPSC_PRODUCERS * MPSC_COUNT && xTaskGetTickCount() - start < pdMS_TO_TICKS(10000)) {
+        uint32_t v;
+        if(!mpsc_rb->pop(v)) {
+            taskYIELD();
+            continue;
+        }
+        uint32_t id = v >> 24;
+        if(id >= MPSC_PRODUCERS || (v & 0x00FFFFFF) != expect[id]) {
+            ok = false;
+        } else {
+            ++expect[id];
+        }
+        ++total;
+    }
+
+    // as above, stop any producers that are stuck before the ring goes away
+    start = xTaskGetTickCount();
+    while(mpsc_done < MPSC_PRODUCERS && xTaskGetTickCount() - start < pdMS_TO_TICKS(1000)) taskYIELD();
+    bool finished = mpsc_done == MPSC_PRODUCERS;
+    for (int i = 0; i < MPSC_PRODUCERS; ++i) {
+        if(!mpsc_finished[i]) vTaskDelete(producers[i]);
+    }
+    bool empty = mpsc_rb->empty();
+    delete mpsc_rb;
+
+    TEST_ASSERT_TRUE(finished);
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_EQUAL_INT(MPSC_PRODUCERS * MPSC_COUNT, total);
+    TEST_ASSERT_TRUE(empty);
+}
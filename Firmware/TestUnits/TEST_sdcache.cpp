@@ -0,0 +1,120 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "sd_cache.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// a fake card where every byte of a sector is the low byte of the sector number
+static uint32_t reads, read_sectors;
+static int fake_read(uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    ++reads;
+    read_sectors += count;
+    for (uint32_t i = 0; i < count; ++i) {
+        memset(&buf[i * SD_CACHE_SECTOR_SIZE], (uint8_t)(sector + i), SD_CACHE_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+static bool check(const uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    for (uint32_t i = 0; i < count * SD_CACHE_SECTOR_SIZE; ++i) {
+        if(buf[i] != (uint8_t)(sector + i / SD_CACHE_SECTOR_SIZE)) return false;
+    }
+    return true;
+}
+
+static uint8_t cache_buf[2 * 8 * SD_CACHE_SECTOR_SIZE];
+static uint8_t buf[8 * SD_CACHE_SECTOR_SIZE];
+// a separate instance so the one the sdcard uses is left alone
+static sd_cache_t cache;
+
+static void setup()
+{
+    reads = read_sectors = 0;
+    sd_cache_init(&cache, cache_buf, 2, 8, fake_read);
+    // data area starts at 100, clusters of 4 sectors, card of 199 sectors
+    sd_cache_set_geometry(&cache, 100, 4, 199);
+    sd_cache_clear_stats(&cache);
+}
+
+REGISTER_TEST(SDCache, sequential_reads_fill_clusters)
+{
+    setup();
+    sd_cache_stats_t s;
+
+    // the first read is not known to be sequential so goes direct
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 101, 1));
+    TEST_ASSERT_TRUE(check(buf, 101, 1));
+    TEST_ASSERT_EQUAL_INT(1, reads);
+
+    // this follows on so the whole cluster is read
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 102, 1));
+    TEST_ASSERT_TRUE(check(buf, 102, 1));
+    TEST_ASSERT_EQUAL_INT(2, reads);
+    TEST_ASSERT_EQUAL_INT(5, read_sectors);
+
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 103, 1));
+    TEST_ASSERT_TRUE(check(buf, 103, 1));
+    TEST_ASSERT_EQUAL_INT(2, reads);
+
+    // crosses into the next cluster
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 104, 2));
+    TEST_ASSERT_TRUE(check(buf, 104, 2));
+    TEST_ASSERT_EQUAL_INT(3, reads);
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 106, 2));
+    TEST_ASSERT_TRUE(check(buf, 106, 2));
+    TEST_ASSERT_EQUAL_INT(3, reads);
+
+    sd_cache_get_stats(&cache, &s);
+    TEST_ASSERT_EQUAL_INT(2, s.hits);
+    TEST_ASSERT_EQUAL_INT(3, s.misses);
+    TEST_ASSERT_EQUAL_INT(2, s.fills);
+
+    // going back to a cached cluster is a hit even though it is not sequential
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 102, 1));
+    TEST_ASSERT_TRUE(check(buf, 102, 1));
+    TEST_ASSERT_EQUAL_INT(3, reads);
+}
+
+REGISTER_TEST(SDCache, bypass_and_invalidate)
+{
+    setup();
+    sd_cache_stats_t s;
+
+    // the FAT area is never cached
+    sd_cache_read(&cache, buf, 10, 1);
+    sd_cache_read(&cache, buf, 11, 1);
+    TEST_ASSERT_EQUAL_INT(2, read_sectors);
+
+    // a whole cluster or more goes direct
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 108, 4));
+    TEST_ASSERT_TRUE(check(buf, 108, 4));
+    sd_cache_get_stats(&cache, &s);
+    TEST_ASSERT_EQUAL_INT(1, s.bypassed);
+    TEST_ASSERT_EQUAL_INT(0, s.fills);
+
+    // sequential after that so fills, then a write to it invalidates the line
+    sd_cache_read(&cache, buf, 112, 1);
+    TEST_ASSERT_EQUAL_INT(4, reads);
+    sd_cache_invalidate(&cache, 113, 1);
+    sd_cache_read(&cache, buf, 113, 1);
+    TEST_ASSERT_EQUAL_INT(5, reads);
+
+    // the last cluster is cut short at the end of the card
+    sd_cache_read(&cache, buf, 197, 1);
+    reads = read_sectors = 0;
+    TEST_ASSERT_EQUAL_INT(0, sd_cache_read(&cache, buf, 198, 1));
+    TEST_ASSERT_EQUAL_INT(1, reads);
+    TEST_ASSERT_EQUAL_INT(3, read_sectors);
+    TEST_ASSERT_TRUE(check(buf, 198, 1));
+
+    // disabled it always goes direct
+    sd_cache_enable(&cache, 0);
+    reads = 0;
+    sd_cache_read(&cache, buf, 197, 1);
+    sd_cache_read(&cache, buf, 197, 1);
+    TEST_ASSERT_EQUAL_INT(2, reads);
+}
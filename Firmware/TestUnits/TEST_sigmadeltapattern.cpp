@@ -0,0 +1,72 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "SigmaDeltaPattern.h"
+
+#include <stdint.h>
+
+static uint32_t buf[255];
+
+REGISTER_TEST(SigmaDeltaPattern, duty_and_spread)
+{
+    const uint16_t pin = 1 << 3;
+    for (int v = 0; v <= 255; ++v) {
+        SigmaDeltaPattern::fill(buf, 255, pin, v, 255);
+        // exact duty over the whole pattern
+        TEST_ASSERT_EQUAL_INT(v, SigmaDeltaPattern::count(buf, 255, pin));
+
+        // every word either sets or resets the pin
+        for (int i = 0; i < 255; ++i) {
+            TEST_ASSERT_TRUE(((buf[i] & pin) != 0) != ((buf[i] & (pin << 16)) != 0));
+        }
+
+        // the on words are spread evenly, the gaps between them differ by at most one
+        if(v > 0 && v < 255) {
+            int mx = 0, mn = 255, last = -1, first = -1;
+            for (int i = 0; i < 255; ++i) {
+                if(buf[i] & pin) {
+                    if(last >= 0) {
+                        int g = i - last;
+                        if(g > mx) mx = g;
+                        if(g < mn) mn = g;
+                    } else {
+                        first = i;
+                    }
+                    last = i;
+                }
+            }
+            // include the gap that wraps around
+            int g = first + 255 - last;
+            if(g > mx) mx = g;
+            if(g < mn) mn = g;
+            TEST_ASSERT_TRUE(mx - mn <= 1);
+        }
+    }
+}
+
+REGISTER_TEST(SigmaDeltaPattern, shared_port)
+{
+    const uint16_t a = 1 << 0, b = 1 << 15;
+    for (int i = 0; i < 255; ++i) buf[i] = 0;
+
+    SigmaDeltaPattern::fill(buf, 255, a, 64, 255);
+    SigmaDeltaPattern::fill(buf, 255, b, 200, 255);
+    TEST_ASSERT_EQUAL_INT(64, SigmaDeltaPattern::count(buf, 255, a));
+    TEST_ASSERT_EQUAL_INT(200, SigmaDeltaPattern::count(buf, 255, b));
+
+    // changing one does not touch the other
+    SigmaDeltaPattern::fill(buf, 255, a, 255, 255);
+    TEST_ASSERT_EQUAL_INT(255, SigmaDeltaPattern::count(buf, 255, a));
+    TEST_ASSERT_EQUAL_INT(200, SigmaDeltaPattern::count(buf, 255, b));
+
+    // pins that are not used are left alone
+    for (int i = 0; i < 255; ++i) {
+        TEST_ASSERT_EQUAL_INT(0, buf[i] & ~((a | b) | ((a | b) << 16)));
+    }
+
+    // out of range is clamped
+    SigmaDeltaPattern::fill(buf, 255, a, -5, 255);
+    TEST_ASSERT_EQUAL_INT(0, SigmaDeltaPattern::count(buf, 255, a));
+    SigmaDeltaPattern::fill(buf, 255, a, 1, 1);
+    TEST_ASSERT_EQUAL_INT(255, SigmaDeltaPattern::count(buf, 255, a));
+}
@@ -0,0 +1,52 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "Block.h"
+#include "Planner.h"
+#include "StepTicker.h"
+
+// setup a single axis move of the given steps and plan it
+static void plan_block(Block& b, uint32_t steps, float mm, float speed, float accel, float entry, float exit)
+{
+    b.clear();
+    b.steps[0] = steps;
+    b.steps_event_count = steps;
+    b.millimeters = mm;
+    b.nominal_speed = speed;
+    b.nominal_rate = steps * speed / mm;
+    b.acceleration = accel;
+    Planner::getInstance()->calculate_trapezoid(&b, entry, exit);
+}
+
+// same as StepTicker::update_speed(), the speed as a fraction of the nominal speed in 16.16 fixed point
+static uint32_t speed_ratio(const Block& b, int64_t steps_per_tick)
+{
+    return ((uint64_t)(steps_per_tick >> 32) * b.speed_ratio_scale) >> 30;
+}
+
+REGISTER_TEST(SpeedRatio, primary_motor_speed)
+{
+    // adaptive mode can only be changed while the step ticker is stopped
+    StepTicker *st = StepTicker::getInstance();
+    bool was_started = st->is_started();
+    if(was_started) st->stop();
+    Block::init(1);
+
+    for(bool adaptive : {false, true}) {
+        TEST_ASSERT_TRUE(st->set_adaptive(adaptive, 1000));
+
+        // entry at 2mm/sec, nominal 10mm/sec
+        Block b;
+        plan_block(b, 2000, 20, 10, 200, 2, 0);
+        TEST_ASSERT_TRUE(b.speed_ratio_scale > 0);
+        TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.2F, speed_ratio(b, b.tick_info[0].steps_per_tick) / 65536.0F);
+        TEST_ASSERT_FLOAT_WITHIN(0.001F, 1.0F, speed_ratio(b, b.tick_info[0].plateau_rate) / 65536.0F);
+
+        // a slow move still has enough resolution
+        plan_block(b, 100, 10, 0.5F, 10, 0.1F, 0);
+        TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.2F, speed_ratio(b, b.tick_info[0].steps_per_tick) / 65536.0F);
+    }
+
+    TEST_ASSERT_TRUE(st->set_adaptive(false, 0));
+    if(was_started) st->start();
+}
@@ -0,0 +1,128 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "SpiQueue.h"
+
+#include <stdint.h>
+#include <string>
+
+// a mock SPI that returns each byte sent plus one, either completing at once like a blocking transfer or leaving it
+// pending until told to finish like the DMA interrupt would
+class MockSpi
+{
+public:
+    SpiQueue q{[this](const uint8_t *tx, uint8_t *rx, uint32_t n) { return start(tx, rx, n); }};
+    bool immediate{true};
+    bool fail_start{false};
+    bool pending{false};
+    uint8_t *prx{nullptr};
+    std::string log;
+
+    bool start(const uint8_t *tx, uint8_t *rx, uint32_t n)
+    {
+        if(fail_start) return false;
+        for (uint32_t i = 0; i < n; ++i) {
+            rx[i] = tx[i] + 1;
+        }
+        log += 'T';
+        if(immediate) {
+            q.complete(true);
+        } else {
+            pending = true;
+        }
+        return true;
+    }
+
+    void finish(bool ok)
+    {
+        pending = false;
+        q.complete(ok);
+    }
+};
+
+static uint32_t status[3];
+static int finished;
+
+static void add_drivers(MockSpi& spi)
+{
+    for (int i = 0; i < 3; ++i) {
+        status[i] = 0;
+        int n = spi.q.add(
+            [i](uint8_t *tx) { tx[0] = i; tx[1] = 0x10; tx[2] = 0x20; return i == 1 ? 0U : 3U; }, // second one has nothing to send
+            [&spi, i](bool sel) { spi.log += sel ? ('A' + i) : ('a' + i); },
+            [i](const uint8_t *rx, bool ok) { status[i] = ok ? (rx[0] << 16) | (rx[1] << 8) | rx[2] : 0xFFFFFFFF; });
+        TEST_ASSERT_EQUAL_INT(i, n);
+    }
+}
+
+REGISTER_TEST(SpiQueue, batch_immediate)
+{
+    MockSpi spi;
+    add_drivers(spi);
+    finished = 0;
+
+    TEST_ASSERT_TRUE(spi.q.run([]() { ++finished; }));
+    TEST_ASSERT_FALSE(spi.q.is_running());
+    TEST_ASSERT_EQUAL_INT(1, finished);
+    // each one is selected around its own transfer, and the one with nothing to send is skipped
+    TEST_ASSERT_EQUAL_STRING("ATaCTc", spi.log.c_str());
+    TEST_ASSERT_EQUAL_INT(0x011121, status[0]);
+    TEST_ASSERT_EQUAL_INT(0, status[1]);
+    TEST_ASSERT_EQUAL_INT(0x031121, status[2]);
+    TEST_ASSERT_EQUAL_INT(1, spi.q.get_batches());
+    TEST_ASSERT_EQUAL_INT(0, spi.q.get_errors());
+}
+
+REGISTER_TEST(SpiQueue, batch_deferred)
+{
+    MockSpi spi;
+    spi.immediate = false;
+    add_drivers(spi);
+    finished = 0;
+
+    TEST_ASSERT_TRUE(spi.q.run([]() { ++finished; }));
+    TEST_ASSERT_TRUE(spi.q.is_running());
+    TEST_ASSERT_TRUE(spi.pending);
+    TEST_ASSERT_EQUAL_STRING("AT", spi.log.c_str());
+
+    // can't run again or add while it is running
+    TEST_ASSERT_FALSE(spi.q.run(nullptr));
+    TEST_ASSERT_EQUAL_INT(-1, spi.q.add(nullptr, nullptr, nullptr));
+
+    // the interrupt for the first starts the next
+    spi.finish(true);
+    TEST_ASSERT_EQUAL_STRING("ATaCT", spi.log.c_str());
+    TEST_ASSERT_EQUAL_INT(0, finished);
+
+    // an error is passed on and counted
+    spi.finish(false);
+    TEST_ASSERT_EQUAL_STRING("ATaCTc", spi.log.c_str());
+    TEST_ASSERT_EQUAL_INT(1, finished);
+    TEST_ASSERT_FALSE(spi.q.is_running());
+    TEST_ASSERT_EQUAL_INT(0x011121, status[0]);
+    TEST_ASSERT_EQUAL_INT(0xFFFFFFFF, status[2]);
+    TEST_ASSERT_EQUAL_INT(1, spi.q.get_errors());
+
+    // a stray completion is ignored
+    spi.finish(true);
+    TEST_ASSERT_EQUAL_INT(1, finished);
+}
+
+REGISTER_TEST(SpiQueue, start_fails)
+{
+    MockSpi spi;
+    spi.fail_start = true;
+    add_drivers(spi);
+    finished = 0;
+
+    // it still finishes and deselects everything
+    TEST_ASSERT_TRUE(spi.q.run([]() { ++finished; }));
+    TEST_ASSERT_EQUAL_INT(1, finished);
+    TEST_ASSERT_FALSE(spi.q.is_running());
+    TEST_ASSERT_EQUAL_STRING("AaCc", spi.log.c_str());
+    TEST_ASSERT_EQUAL_INT(2, spi.q.get_errors());
+
+    // nothing to send
+    SpiQueue empty([](const uint8_t *, uint8_t *, uint32_t) { return true; });
+    TEST_ASSERT_FALSE(empty.run(nullptr));
+}
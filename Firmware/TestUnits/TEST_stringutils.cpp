@@ -67,3 +67,31 @@ REGISTER_TEST(UtilsTest,shift_parameter_with_quotes)
 }
 
 
+
+REGISTER_TEST(UtilsTest,base64_decode)
+{
+    uint8_t buf[8];
+
+    // "Man" encodes to TWFu
+    int n= stringutils::base64_decode("TWFu", buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(3, n);
+    TEST_ASSERT_EQUAL_INT('M', buf[0]);
+    TEST_ASSERT_EQUAL_INT('a', buf[1]);
+    TEST_ASSERT_EQUAL_INT('n', buf[2]);
+
+    // padding
+    n= stringutils::base64_decode("AP8=", buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(2, n);
+    TEST_ASSERT_EQUAL_INT(0x00, buf[0]);
+    TEST_ASSERT_EQUAL_INT(0xFF, buf[1]);
+
+    n= stringutils::base64_decode("/w==", buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(1, n);
+    TEST_ASSERT_EQUAL_INT(0xFF, buf[0]);
+
+    // invalid character
+    TEST_ASSERT_EQUAL_INT(-1, stringutils::base64_decode("TW*u", buf, sizeof(buf)));
+
+    // too big for the buffer
+    TEST_ASSERT_EQUAL_INT(-1, stringutils::base64_decode("TWFuTWFuTWFu", buf, sizeof(buf)));
+}
@@ -0,0 +1,113 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "ThermalModel.h"
+
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// a hotend as the simulated plant, a 40W heater in a small block
+static ThermalModel::params_t hotend = {40, 15, 0.12F, 0.1F, 4, 25};
+
+// pseudo random sensor noise of +/- 0.1°C
+static float noise()
+{
+    static uint32_t seed = 1234;
+    seed = seed * 1103515245 + 12345;
+    return ((int)((seed >> 16) % 201) - 100) / 1000.0F;
+}
+
+REGISTER_TEST(ThermalModel, fit_heatup)
+{
+    ThermalModel plant;
+    plant.set_params(hotend);
+
+    // full power heat up to 220°C recorded 4 times a second, simulated 20 times a second
+    std::vector<float> temps;
+    float tb = 25, ts = 25;
+    for (int i = 0; ts < 220; ++i) {
+        if(i % 5 == 0) temps.push_back(ts + noise());
+        plant.step(tb, ts, 1.0F, 0.05F);
+    }
+
+    ThermalModel::params_t p;
+    TEST_ASSERT_TRUE(ThermalModel::fit_heatup(temps.data(), temps.size(), 0.25F, 40, p));
+    printf("fitted C %f, H %f, L %f, Ta %f\n", p.heat_capacity, p.ambient_loss, p.sensor_lag, p.ambient_temp);
+    TEST_ASSERT_FLOAT_WITHIN(15 * 0.1F, 15, p.heat_capacity);
+    TEST_ASSERT_FLOAT_WITHIN(0.12F * 0.25F, 0.12F, p.ambient_loss);
+    TEST_ASSERT_FLOAT_WITHIN(4 * 0.5F, 4, p.sensor_lag);
+    TEST_ASSERT_FLOAT_WITHIN(0.2F, 25, p.ambient_temp);
+
+    // holding at 200°C needs 21W
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.12F, ThermalModel::steady_loss(hotend, 21.0F / 40, 200));
+
+    // not enough data
+    TEST_ASSERT_FALSE(ThermalModel::fit_heatup(temps.data(), 5, 0.25F, 40, p));
+}
+
+// runs the controller against the plant for secs seconds, returns the maximum temperature seen after the target was first reached
+static float run(ThermalModel& plant, ThermalModel& ctl, float& tb, float& ts, float target, float secs, float& reached)
+{
+    float max_temp = 0;
+    reached = -1;
+    for (int i = 0; i < secs * 20; ++i) {
+        float u = ctl.control(ts + noise(), target, 0.05F);
+        plant.step(tb, ts, u, 0.05F);
+        if(reached < 0 && ts >= target - 1) reached = i * 0.05F;
+        if(reached >= 0 && ts > max_temp) max_temp = ts;
+    }
+    return max_temp;
+}
+
+REGISTER_TEST(ThermalModel, heatup_without_overshoot)
+{
+    ThermalModel plant;
+    plant.set_params(hotend);
+
+    // the controller model is a bit out as a fitted one would be
+    ThermalModel ctl;
+    ThermalModel::params_t p = hotend;
+    p.heat_capacity *= 1.05F;
+    p.ambient_loss *= 0.9F;
+    p.sensor_lag *= 0.8F;
+    ctl.set_params(p);
+    ctl.reset(25);
+
+    float tb = 25, ts = 25, reached;
+    float max_temp = run(plant, ctl, tb, ts, 200, 180, reached);
+    printf("reached 199°C in %1.1f secs, max %1.2f°C, final %1.2f°C\n", reached, max_temp, ts);
+
+    // full power alone takes about 100 seconds to get there
+    TEST_ASSERT_TRUE(reached > 0 && reached < 110);
+    TEST_ASSERT_TRUE(max_temp < 200.5F);
+    // the ambient adaption removes the steady state error
+    TEST_ASSERT_FLOAT_WITHIN(0.2F, 200, ts);
+}
+
+REGISTER_TEST(ThermalModel, fan_feed_forward)
+{
+    ThermalModel plant;
+    plant.set_params(hotend);
+    ThermalModel ctl;
+    ctl.set_params(hotend);
+    ctl.reset(25);
+
+    float tb = 25, ts = 25, reached;
+    run(plant, ctl, tb, ts, 200, 180, reached);
+    TEST_ASSERT_FLOAT_WITHIN(0.2F, 200, ts);
+
+    // fan goes on full, which needs another 17.5W
+    plant.set_fan(1);
+    ctl.set_fan(1);
+    float min_temp = 1000;
+    for (int i = 0; i < 60 * 20; ++i) {
+        float u = ctl.control(ts + noise(), 200, 0.05F);
+        plant.step(tb, ts, u, 0.05F);
+        if(ts < min_temp) min_temp = ts;
+    }
+    printf("with fan min %1.2f°C, final %1.2f°C\n", min_temp, ts);
+    TEST_ASSERT_TRUE(min_temp > 199);
+    TEST_ASSERT_FLOAT_WITHIN(0.2F, 200, ts);
+}
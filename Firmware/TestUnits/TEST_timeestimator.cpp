@@ -0,0 +1,115 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "TimeEstimator.h"
+#include "ConfigReader.h"
+
+#include <sstream>
+#include <stdio.h>
+
+const static char estimator_config[]= "\
+[motion control]\n\
+default_feed_rate = 600\n\
+default_seek_rate = 600\n\
+default_acceleration = 100\n\
+[planner]\n\
+junction_deviation = 0.05\n\
+";
+
+static void setup(TimeEstimator& te)
+{
+    std::stringstream ss(estimator_config);
+    ConfigReader cr(ss);
+    TEST_ASSERT_TRUE(te.configure(cr));
+    te.set_index_resolution(0);
+}
+
+REGISTER_TEST(TimeEstimator, single_move)
+{
+    TimeEstimator te;
+    setup(te);
+
+    // 10mm/sec over 100mm with 100mm/sec² takes 0.1 secs to get to speed and 0.1 secs to stop
+    // so it is 10 secs at speed plus 0.1 secs lost accelerating
+    TEST_ASSERT_TRUE(te.add_line("G1 X100", 8));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 10.1F, te.finish());
+    TEST_ASSERT_EQUAL_INT(1, te.get_move_count());
+
+    // too short to reach the nominal speed, a triangle profile 2 * sqrt(d/a)
+    te.reset();
+    TEST_ASSERT_TRUE(te.add_line("G1 X0.25", 9));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.1F, te.finish());
+}
+
+REGISTER_TEST(TimeEstimator, junctions_and_dwell)
+{
+    TimeEstimator te;
+    setup(te);
+
+    // two colinear moves do not stop in between
+    te.add_line("G1 X50", 7);
+    te.add_line("G1 X100", 15);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 10.1F, te.finish());
+
+    // a 90° corner slows down so takes longer
+    te.reset();
+    te.add_line("G1 X50", 7);
+    te.add_line("G1 Y50", 14);
+    float t = te.finish();
+    TEST_ASSERT_TRUE(t > 10.1F);
+    TEST_ASSERT_TRUE(t < 10.2F);
+
+    // dwell stops and then waits, reprap mode P is milliseconds
+    te.reset();
+    te.add_line("G1 X100", 8);
+    te.add_line("G4 P500", 16);
+    te.add_line("G4 S1", 22);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 11.6F, te.finish());
+
+    // comments and console commands take no time
+    te.reset();
+    te.add_line("; comment", 10);
+    te.add_line("M117 hello", 21);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.0F, te.finish());
+}
+
+REGISTER_TEST(TimeEstimator, arc_speed_limit)
+{
+    TimeEstimator te;
+    setup(te);
+
+    // half a circle of radius 1, pi mm at 10mm/sec
+    te.add_line("G2 X2 I1", 9);
+    float t = te.finish();
+    TEST_ASSERT_TRUE(t > 0.314F);
+    TEST_ASSERT_TRUE(t < 0.5F);
+
+    // same planner settings as the firmware, the centripetal acceleration limits it to sqrt(25 * 1) = 5mm/sec
+    te.reset();
+    te.full_vector_junction = true;
+    te.centripetal_acceleration = 25;
+    te.add_line("G2 X2 I1", 9);
+    TEST_ASSERT_TRUE(te.finish() > 0.628F);
+}
+
+REGISTER_TEST(TimeEstimator, index)
+{
+    TimeEstimator te;
+    setup(te);
+
+    te.add_line("G1 X100", 8);
+    te.add_line("G4 S2", 14);
+    te.add_line("G1 X0", 20);
+    float total = te.finish();
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 22.2F, total);
+
+    const TimeEstimator::index_t& idx = te.get_index();
+    TEST_ASSERT_TRUE(idx.size() >= 3);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 10.1F, TimeEstimator::lookup(idx, 8));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 12.1F, TimeEstimator::lookup(idx, 14));
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, total, TimeEstimator::lookup(idx, 20));
+    // halfway through the first line
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 5.05F, TimeEstimator::lookup(idx, 4));
+    // past the end
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, total, TimeEstimator::lookup(idx, 100));
+}
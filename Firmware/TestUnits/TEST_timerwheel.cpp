@@ -0,0 +1,72 @@
+#include "../Unity/src/unity.h"
+#include "TestRegistry.h"
+
+#include "TimerWheel.h"
+
+#include <stdint.h>
+
+static int cnt10, cnt50, cnt1000, cnt50b;
+
+REGISTER_TEST(TimerWheel, merged_wakeups)
+{
+    TimerWheel wheel;
+    cnt10 = cnt50 = cnt1000 = cnt50b = 0;
+    wheel.add(10, []() { ++cnt10; });
+    wheel.add(50, []() { ++cnt50; });
+    wheel.add(1000, []() { ++cnt1000; });
+    int id = wheel.add(50, []() { ++cnt50b; });
+    // the two 50's share a slot
+    TEST_ASSERT_EQUAL_INT(3, wheel.get_slot_count());
+
+    // run for 5 seconds, starting near the wrap around of the counter, waking up only when told to
+    uint32_t now = UINT32_MAX - 2000;
+    uint32_t end = now + 5000;
+    int wakeups = 0;
+    uint32_t delay = wheel.start(now);
+    TEST_ASSERT_EQUAL_INT(10, delay);
+    while((int32_t)(end - (now + delay)) >= 0) {
+        now += delay;
+        delay = wheel.run(now);
+        ++wakeups;
+    }
+
+    TEST_ASSERT_EQUAL_INT(500, cnt10);
+    TEST_ASSERT_EQUAL_INT(100, cnt50);
+    TEST_ASSERT_EQUAL_INT(100, cnt50b);
+    TEST_ASSERT_EQUAL_INT(5, cnt1000);
+    // the 50 and 1000 always land on a 10 so there is no extra wakeup for them
+    TEST_ASSERT_EQUAL_INT(500, wakeups);
+
+    wheel.remove(id);
+    now += delay;
+    wheel.run(now);
+    TEST_ASSERT_EQUAL_INT(100, cnt50b);
+}
+
+REGISTER_TEST(TimerWheel, unaligned_and_late)
+{
+    TimerWheel wheel;
+    cnt10 = cnt50 = 0;
+    wheel.add(20, []() { ++cnt10; });
+    wheel.add(50, []() { ++cnt50; });
+
+    uint32_t now = 0;
+    int wakeups = 0;
+    uint32_t delay = wheel.start(now);
+    while(now + delay <= 1000) {
+        now += delay;
+        delay = wheel.run(now);
+        ++wakeups;
+    }
+    TEST_ASSERT_EQUAL_INT(50, cnt10);
+    TEST_ASSERT_EQUAL_INT(20, cnt50);
+    // wakes at every multiple of 20 and 50, the ones on 100 are shared
+    TEST_ASSERT_EQUAL_INT(60, wakeups);
+
+    // running late calls each once and stays aligned
+    now += delay + 130;
+    delay = wheel.run(now);
+    TEST_ASSERT_EQUAL_INT(51, cnt10);
+    TEST_ASSERT_EQUAL_INT(21, cnt50);
+    TEST_ASSERT_TRUE((now + delay) % 20 == 0 || (now + delay) % 50 == 0);
+}
@@ -20,10 +20,12 @@
 #include "GCodeProcessor.h"
 #include "Consoles.h"
 #include "BaseSolution.h"
+#include "KVStore.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 #include "ff.h"
+#include "sd_cache.h"
 #include "benchmark_timer.h"
 #include "semphr.h"
 
@@ -75,6 +77,7 @@ bool CommandShell::initialize()
     THEDISPATCHER->add_handler( "date", std::bind( &CommandShell::date_cmd, this, _1, _2) );
 
     THEDISPATCHER->add_handler( "mem", std::bind( &CommandShell::mem_cmd, this, _1, _2) );
+    THEDISPATCHER->add_handler( "isr", std::bind( &CommandShell::isr_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "switch", std::bind( &CommandShell::switch_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "gpio", std::bind( &CommandShell::gpio_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "modules", std::bind( &CommandShell::modules_cmd, this, _1, _2) );
@@ -92,6 +95,7 @@ bool CommandShell::initialize()
     THEDISPATCHER->add_handler( "ed", std::bind( &CommandShell::edit_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "dfu", std::bind( &CommandShell::dfu_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "qspi", std::bind( &CommandShell::qspi_cmd, this, _1, _2) );
+    THEDISPATCHER->add_handler( "kv", std::bind( &CommandShell::kv_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "flash", std::bind( &CommandShell::flash_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "msc", std::bind( &CommandShell::msc_cmd, this, _1, _2) );
     THEDISPATCHER->add_handler( "echo", std::bind( &CommandShell::echo_cmd, this, _1, _2) );
@@ -318,11 +322,18 @@ bool CommandShell::mv_cmd(std::string& params, OutputStream& os)
 
 bool CommandShell::cp_cmd(std::string& params, OutputStream& os)
 {
-    HELP("copy a file: from to");
+    HELP("copy a file: [-b|-n] from [to], -b times it and shows the sdcard cache stats, -n does the same with the cache off, without to it only reads the file");
     std::string fn1 = stringutils::shift_parameter( params );
+    bool bench = false;
+    bool nocache = false;
+    if(fn1 == "-b" || fn1 == "-n") {
+        bench = true;
+        nocache = (fn1 == "-n");
+        fn1 = stringutils::shift_parameter( params );
+    }
     std::string fn2 = stringutils::shift_parameter( params );
 
-    if(fn1.empty() || fn2.empty()) {
+    if(fn1.empty() || (fn2.empty() && !bench)) {
         os.puts("from and to files required\n");
         return true;
     }
@@ -338,24 +349,40 @@ bool CommandShell::cp_cmd(std::string& params, OutputStream& os)
         return true;
     }
 
-    fsout.open(fn2, std::fstream::out | std::fstream::binary | std::fstream::trunc);
-    if(!fsout.is_open()) {
-        os.printf("Could not open File %s for write\n", fn2.c_str());
-        return true;
+    if(!fn2.empty()) {
+        fsout.open(fn2, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+        if(!fsout.is_open()) {
+            os.printf("Could not open File %s for write\n", fn2.c_str());
+            return true;
+        }
+    }
+
+    // the state the copy ran with is the one reported, the one from before is put back afterwards
+    bool cache_was_enabled = sd_cache_is_enabled(&sd_cache);
+    if(bench) {
+        sd_cache_clear_stats(&sd_cache);
+        if(nocache) sd_cache_enable(&sd_cache, false);
     }
+    bool cache_enabled = sd_cache_is_enabled(&sd_cache);
+    uint32_t st = xTaskGetTickCount();
+    uint32_t total = 0;
 
     // allocate from heap rather than the limited stack
-    char *buffer = (char *)malloc(4096);
+    const size_t bufsize = 4096;
+    char *buffer = (char *)malloc(bufsize);
     if(buffer != nullptr) {
         /* Copy source to destination */
         while (!fsin.eof()) {
-            fsin.read(buffer, sizeof(buffer));
+            fsin.read(buffer, bufsize);
             int br = fsin.gcount();
             if(br > 0) {
-                fsout.write(buffer, br);
-                if(!fsout.good()) {
-                    os.printf("Write failed to File %s\n", fn2.c_str());
-                    break;
+                total += br;
+                if(fsout.is_open()) {
+                    fsout.write(buffer, br);
+                    if(!fsout.good()) {
+                        os.printf("Write failed to File %s\n", fn2.c_str());
+                        break;
+                    }
                 }
             }
             if(os.get_stop_request()) {
@@ -372,7 +399,17 @@ bool CommandShell::cp_cmd(std::string& params, OutputStream& os)
 
     /* Close open files */
     fsin.close();
-    fsout.close();
+    if(fsout.is_open()) fsout.close();
+
+    if(bench) {
+        uint32_t ms = (xTaskGetTickCount() - st) * 1000 / configTICK_RATE_HZ;
+        if(nocache) sd_cache_enable(&sd_cache, cache_was_enabled);
+        sd_cache_stats_t stats;
+        sd_cache_get_stats(&sd_cache, &stats);
+        os.printf("%lu bytes in %lu ms, %lu KB/s\n", total, ms, ms == 0 ? 0 : (uint32_t)(((uint64_t)total * 1000) / 1024 / ms));
+        os.printf("sd cache %s: hits %lu, misses %lu, fills %lu, bypassed %lu\n", cache_enabled ? "enabled" : "disabled",
+                  stats.hits, stats.misses, stats.fills, stats.bypassed);
+    }
 
     return true;
 }
@@ -443,6 +480,41 @@ bool CommandShell::mem_cmd(std::string& params, OutputStream& os)
     return true;
 }
 
+#include "IsrProfile.h"
+bool CommandShell::isr_cmd(std::string& params, OutputStream& os)
+{
+    HELP("show ISR cycle counts: isr [-v] [-r], -v shows histogram, -r resets counts");
+
+    bool histogram = false;
+    bool reset = false;
+    while(!params.empty()) {
+        std::string s = stringutils::shift_parameter( params );
+        if(s == "-v") histogram = true;
+        else if(s == "-r") reset = true;
+    }
+
+    float cycles_per_us = SystemCoreClock / 1000000.0F;
+    for(IsrProfile *p = IsrProfile::first(); p != nullptr; p = p->next()) {
+        // take a consistent snapshot as the ISRs may update it while we print
+        __disable_irq();
+        IsrProfile snap = *p;
+        __enable_irq();
+        snap.dump(os, cycles_per_us, histogram);
+    }
+    os.printf("missed unsteps: %lu\n", StepTicker::getInstance()->get_missed_unsteps());
+    os.printf("deferred fast ticks: %lu\n", FastTicker::getInstance()->get_deferred());
+
+    if(reset) {
+        __disable_irq();
+        IsrProfile::reset_all();
+        __enable_irq();
+        os.printf("ISR profiles reset\n");
+    }
+
+    os.set_no_response();
+    return true;
+}
+
 #if 0
 bool CommandShell::mount_cmd(std::string& params, OutputStream& os)
 {
@@ -1931,6 +2003,70 @@ bool CommandShell::qspi_cmd(std::string& params, OutputStream& os)
     return true;
 }
 
+bool CommandShell::kv_cmd(std::string& params, OutputStream& os)
+{
+    HELP("qspi key/value store - [list] | [get key] | [set key value] | [rm key] | [format], config:section.key overrides config.ini");
+
+    if(kvstore == nullptr) {
+        os.printf("no key/value store\n");
+        return true;
+    }
+
+    std::string cmd = stringutils::shift_parameter(params);
+    if(cmd.empty() || cmd == "list") {
+        kvstore->for_each([&os](const std::string& key, uint32_t len) {
+            os.printf("%s: %lu bytes\n", key.c_str(), len);
+            return true;
+        });
+        os.printf("%lu keys, %lu bytes free in current block, %lu free blocks\n", kvstore->get_key_count(), kvstore->get_head_free(), kvstore->get_free_blocks());
+        return true;
+    }
+
+    if(cmd == "format") {
+        if(kvstore->format()) {
+            os.printf("key/value store formatted\n");
+        } else {
+            os.printf("format failed\n");
+        }
+        return true;
+    }
+
+    std::string key = stringutils::shift_parameter(params);
+    if(key.empty()) {
+        os.printf("key required\n");
+        return true;
+    }
+
+    if(cmd == "get") {
+        std::string v;
+        if(kvstore->get(key.c_str(), v)) {
+            os.printf("%s\n", v.c_str());
+        } else {
+            os.printf("%s not found\n", key.c_str());
+        }
+
+    } else if(cmd == "set") {
+        // the value is the rest of the line
+        if(kvstore->put(key.c_str(), params)) {
+            os.printf("%s set\n", key.c_str());
+        } else {
+            os.printf("failed to set %s\n", key.c_str());
+        }
+
+    } else if(cmd == "rm") {
+        if(kvstore->remove(key.c_str())) {
+            os.printf("%s deleted\n", key.c_str());
+        } else {
+            os.printf("%s not found\n", key.c_str());
+        }
+
+    } else {
+        os.printf("Unknown kv command\n");
+    }
+
+    return true;
+}
+
 #include "usb_device.h"
 extern "C" int config_msc_enable;
 extern Pin *msc_led;
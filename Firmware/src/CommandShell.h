@@ -33,6 +33,7 @@ private:
     bool config_set_cmd(std::string& params, OutputStream& os);
     bool config_get_cmd(std::string& params, OutputStream& os);
     bool mem_cmd(std::string& params, OutputStream& os);
+    bool isr_cmd(std::string& params, OutputStream& os);
     //bool mount_cmd(std::string& params, OutputStream& os);
     bool cat_cmd(std::string& params, OutputStream& os);
     bool md5sum_cmd(std::string& params, OutputStream& os);
@@ -55,6 +56,7 @@ private:
     bool break_cmd(std::string& params, OutputStream& os);
     bool reset_cmd(std::string& params, OutputStream& os);
     bool qspi_cmd(std::string& params, OutputStream& os);
+    bool kv_cmd(std::string& params, OutputStream& os);
     bool jog_cmd(std::string& params, OutputStream& os);
     bool edit_cmd(std::string& params, OutputStream& os);
     bool msc_cmd(std::string& params, OutputStream& os);
@@ -4,6 +4,8 @@
 #include <cstring>
 #include <cstdlib>
 
+ConfigReader::override_fn_t ConfigReader::override_fn;
+
 // match the line for a section header
 bool ConfigReader::match_section(const char *line, std::string& section_name)
 {
@@ -109,6 +111,8 @@ bool ConfigReader::get_section(const char *section, section_map_t& config)
         }
     }
 
+    if(override_fn) override_fn(section, config);
+
     return in_section || !config.empty();
 }
 
@@ -153,6 +157,19 @@ bool ConfigReader::get_sub_sections(const char *section, sub_section_map_t& conf
             }
         }
     }
+
+    if(override_fn) {
+        // the overrides are key1.key2 so split them the same way
+        section_map_t m;
+        override_fn(section, m);
+        for(auto& i : m) {
+            auto n = i.first.find('.');
+            if(n != std::string::npos) {
+                config[i.first.substr(0, n)][i.first.substr(n + 1)] = i.second;
+            }
+        }
+    }
+
     return !config.empty();
 }
 
@@ -4,6 +4,7 @@
 #include <map>
 #include <set>
 #include <istream>
+#include <functional>
 
 class ConfigWriter;
 
@@ -23,6 +24,10 @@ public:
 
     const std::string& get_current_section() const { return current_section; }
 
+    // called with each section that is read so values kept elsewhere can override the ones in the file
+    using override_fn_t = std::function<void(const char *section, section_map_t& config)>;
+    static void set_override(override_fn_t fn) { override_fn = fn; }
+
     const char *get_string(const section_map_t&, const char *key, const char *def="") const;
     float get_float(const section_map_t&, const char *key, float def=0.0F);
     int get_int(const section_map_t&, const char *key, int def=0);
@@ -37,6 +42,7 @@ private:
 
     std::istream& is;
     std::string current_section;
+    static override_fn_t override_fn;
 
     friend ConfigWriter;
 };
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <malloc.h>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 #include "benchmark_timer.h"
@@ -18,6 +19,7 @@
 #include "Dispatcher.h"
 #include "GCode.h"
 #include "GCodeProcessor.h"
+#include "KVStore.h"
 #include "main.h"
 #include "MessageQueue.h"
 #include "Module.h"
@@ -44,34 +46,52 @@ struct query_t {
     OutputStream *query_os;
     char *query_line;
 };
-static RingBuffer<struct query_t, 8> queries; // thread safe FIFO
+static MPSCRingBuffer<struct query_t, 8> queries; // each console thread adds to it, the command thread empties it
 
 static FILE *upload_fp = nullptr;
 static bool loaded_configuration = false;
 bool config_override = false;
 
-// load configuration from override file
+static bool load_config_override(OutputStream& os, std::istream& is)
+{
+    std::string s;
+    OutputStream nullos;
+    // foreach line dispatch it
+    while (std::getline(is, s)) {
+        if(s[0] == ';') continue;
+        // Parse the Gcode
+        GCodeProcessor::GCodes_t gcodes;
+        gp.parse(s.c_str(), gcodes);
+        // dispatch it
+        for(auto& i : gcodes) {
+            if(i.get_code() >= 500 && i.get_code() <= 503) continue; // avoid recursion death
+            if(!THEDISPATCHER->dispatch(i, nullos)) {
+                os.printf("WARNING: load_config_override: this line was not handled: %s\n", s.c_str());
+            }
+        }
+    }
+    loaded_configuration = true;
+    return true;
+}
+
+// where the config override is loaded from
+const char *get_config_override_location()
+{
+    return kvstore != nullptr && kvstore->exists(DEFAULT_OVERRIDE_KEY) ? "qspi" : DEFAULT_OVERRIDE_FILE;
+}
+
+// load configuration from override file, the default one is read from the key/value store if it has been saved there
 bool load_config_override(OutputStream& os, const char *fn)
 {
+    std::string str;
+    if(strcmp(fn, DEFAULT_OVERRIDE_FILE) == 0 && kvstore != nullptr && kvstore->get(DEFAULT_OVERRIDE_KEY, str)) {
+        std::istringstream iss(str);
+        return load_config_override(os, iss);
+    }
+
     std::fstream fsin(fn, std::fstream::in);
     if(fsin.is_open()) {
-        std::string s;
-        OutputStream nullos;
-        // foreach line dispatch it
-        while (std::getline(fsin, s)) {
-            if(s[0] == ';') continue;
-            // Parse the Gcode
-            GCodeProcessor::GCodes_t gcodes;
-            gp.parse(s.c_str(), gcodes);
-            // dispatch it
-            for(auto& i : gcodes) {
-                if(i.get_code() >= 500 && i.get_code() <= 503) continue; // avoid recursion death
-                if(!THEDISPATCHER->dispatch(i, nullos)) {
-                    os.printf("WARNING: load_config_override: this line was not handled: %s\n", s.c_str());
-                }
-            }
-        }
-        loaded_configuration = true;
+        load_config_override(os, fsin);
         fsin.close();
 
     } else {
@@ -82,6 +102,25 @@ bool load_config_override(OutputStream& os, const char *fn)
     return true;
 }
 
+// saves the M500 output to the key/value store, or the file if there is no store
+static bool save_config_override(OutputStream& os, const std::string& str)
+{
+    if(kvstore != nullptr) {
+        if(kvstore->put(DEFAULT_OVERRIDE_KEY, str)) return true;
+        os.printf("ERROR: saving to qspi\n");
+        return false;
+    }
+
+    std::fstream fsout(DEFAULT_OVERRIDE_FILE, std::fstream::out | std::fstream::trunc);
+    if(!fsout.is_open()) {
+        os.printf("ERROR: opening file: %s\n", DEFAULT_OVERRIDE_FILE);
+        return false;
+    }
+    fsout << str;
+    fsout.close();
+    return true;
+}
+
 // can be called by modules when in command thread context
 bool dispatch_line(OutputStream& os, const char *ln)
 {
@@ -92,7 +131,9 @@ bool dispatch_line(OutputStream& os, const char *ln)
     // map some special M codes to commands as they violate the gcode spec and pass a string parameter
     // M23, M32, M117, M30 => m23, m32, m117, rm and handle as a command
     // also M28
+    // G7 raster lines carry base64 pixel data so are also handled as a command, g7
     if(line.rfind("M23 ", 0) == 0) line[0] = 'm';
+    else if(line.rfind("G7 ", 0) == 0) line[0] = 'g';
     else if(line.rfind("M30 ", 0) == 0) line.replace(0, 3, "rm");   // make into an rm command
     else if(line.rfind("M32 ", 0) == 0) line[0] = 'm';
     else if(line.rfind("M117 ", 0) == 0) line[0] = 'm';
@@ -195,32 +236,28 @@ bool dispatch_line(OutputStream& os, const char *ln)
         if(i.has_m() || i.has_g()) {
             // potentially handle M500 - M503 here
             OutputStream *pos = &os;
-            std::fstream *fsout = nullptr;
+            std::ostringstream *sout = nullptr;
             bool m500 = false;
 
             if(i.has_m() && (i.get_code() >= 500 && i.get_code() <= 503)) {
                 if(i.get_code() == 500) {
-                    // we have M500 so redirect os to a config-override file
-                    fsout = new std::fstream(DEFAULT_OVERRIDE_FILE, std::fstream::out | std::fstream::trunc);
-                    if(!fsout->is_open()) {
-                        os.printf("ERROR: opening file: %s\n", DEFAULT_OVERRIDE_FILE);
-                        delete fsout;
-                        return true;
-                    }
-                    pos = new OutputStream(fsout);
+                    // we have M500 so redirect os to a string which is then saved
+                    sout = new std::ostringstream();
+                    pos = new OutputStream(sout);
                     m500 = true;
 
                 } else if(i.get_code() == 501) {
                     if(load_config_override(os)) {
-                        os.printf("configuration override %s loaded\nok\n", DEFAULT_OVERRIDE_FILE);
+                        os.printf("configuration override %s loaded\nok\n", get_config_override_location());
                     } else {
-                        os.printf("failed to load configuration override %s\nok\n", DEFAULT_OVERRIDE_FILE);
+                        os.printf("failed to load configuration override %s\nok\n", get_config_override_location());
                     }
                     return true;
 
                 } else if(i.get_code() == 502) {
+                    if(kvstore != nullptr) kvstore->remove(DEFAULT_OVERRIDE_KEY);
                     remove(DEFAULT_OVERRIDE_FILE);
-                    os.printf("configuration override file deleted\nok\n");
+                    os.printf("configuration override deleted\nok\n");
                     return true;
 
                 } else if(i.get_code() == 503) {
@@ -242,13 +279,17 @@ bool dispatch_line(OutputStream& os, const char *ln)
             // clean up after M500
             if(m500) {
                 m500 = false;
-                fsout->close();
-                delete fsout;
-                delete pos; // this would be the file output stream
+                delete pos; // this would be the string output stream
+                bool saved = save_config_override(os, sout->str());
+                delete sout;
+                if(!saved) {
+                    os.printf("Settings were not stored\nok\n");
+                    return true;
+                }
                 if(!config_override) {
-                    os.printf("WARNING: override will NOT be loaded on boot\n", DEFAULT_OVERRIDE_FILE);
+                    os.printf("WARNING: override will NOT be loaded on boot\n");
                 }
-                os.printf("Settings Stored to %s\nok\n", DEFAULT_OVERRIDE_FILE);
+                os.printf("Settings Stored to %s\nok\n", get_config_override_location());
             }
 
         } else {
@@ -295,9 +336,7 @@ bool process_command_buffer(size_t n, char *rx_buf, OutputStream *os, char *line
             }
 
         } else if(line[cnt] == '?') {
-            if(!queries.full()) {
-                queries.push_back({os, nullptr});
-            }
+            queries.push({os, nullptr});
 
         } else if(discard) {
             // we discard long lines until we get the newline
@@ -321,9 +360,10 @@ bool process_command_buffer(size_t n, char *rx_buf, OutputStream *os, char *line
                     }
                     os->puts("ok\n");
 
-                } else if(!queries.full()) {
+                } else {
                     // Handle $I and $S as instant queries
-                    queries.push_back({os, strdup(line)});
+                    char *q = strdup(line);
+                    if(!queries.push({os, q})) free(q);
                 }
 
             } else {
@@ -491,15 +531,43 @@ static void uart_console_comms(void *)
 
     const TickType_t waitms = pdMS_TO_TICKS(300);
 
-    char rx_buf[256];
     char line[MAX_LINE_LENGTH];
     size_t cnt = 0;
     bool discard = false;
+    uint32_t overruns = 0;
     while(!abort_comms) {
         // this will block until a character is available or timeout
-        size_t n = uart->read((uint8_t*)rx_buf, sizeof(rx_buf), waitms);
-        if(n > 0) {
-            process_command_buffer(n, rx_buf, &os, line, cnt, discard);
+        uint8_t *p;
+        size_t n = uart->get_rx(p, waitms);
+
+        if(uart->get_rx_overruns() != overruns) {
+            printf("WARNING: UART console overrun, %lu bytes lost\n", uart->get_rx_overruns() - overruns);
+            overruns = uart->get_rx_overruns();
+            // part of the line being parsed is missing so drop it rather than run what is left
+            cnt = 0;
+            discard = true;
+        }
+        if(n == 0) continue;
+
+        // the data is parsed where the DMA put it, get_rx() has invalidated the cache for it. The DMA keeps receiving
+        // into the ring while we are blocked waiting for the command thread and could go round onto it, so only upto
+        // the end of the first line is parsed at a time and those bytes are released before the line is sent
+        char *rx = (char *)p;
+        char *nl = (char *)memchr(rx, '\n', n);
+        if(nl != nullptr) n = nl - rx + 1;
+        process_command_buffer(nl != nullptr ? n - 1 : n, rx, &os, line, cnt, discard);
+        if(!uart->release_rx(n)) {
+            // they were overwritten while being parsed, if the newline was in them the line is already over
+            printf("WARNING: UART console overrun, %u bytes lost\n", (unsigned)n);
+            overruns = uart->get_rx_overruns();
+            cnt = 0;
+            discard = (nl == nullptr);
+            continue;
+        }
+
+        if(nl != nullptr) {
+            char eol = '\n';
+            process_command_buffer(1, &eol, &os, line, cnt, discard);
         }
     }
     output_streams.erase(&os);
@@ -533,8 +601,8 @@ static void handle_query(bool need_done)
     // test commands for instance or a long line when the queue is full or G4 etc
     // so long as safe_sleep() is called then this will still be processed
     // also dispatch any instant queries we have recieved
-    while(!queries.empty()) {
-        struct query_t q = queries.pop_front();
+    struct query_t q;
+    while(queries.pop(q)) {
         if(q.query_line == nullptr) { // it is a ? query
             std::string r;
             Robot::getInstance()->get_query_string(r);
@@ -4,6 +4,8 @@ class OutputStream;
 class ConfigReader;
 
 #define DEFAULT_OVERRIDE_FILE "/sd/config-override"
+// the key the config override is saved as in the qspi key/value store, which is used instead of the file if there is one
+#define DEFAULT_OVERRIDE_KEY "config-override"
 
 // TODO may move to Dispatcher
 bool dispatch_line(OutputStream& os, const char *line);
@@ -11,6 +13,7 @@ bool process_command_buffer(size_t n, char *rxBuf, OutputStream *os, char *line,
 bool configure_consoles(ConfigReader& cr);
 bool start_consoles();
 bool load_config_override(OutputStream& os, const char *fn=DEFAULT_OVERRIDE_FILE);
+const char *get_config_override_location();
 void command_handler();
 
 // print string to all connected consoles
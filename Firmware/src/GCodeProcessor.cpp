@@ -33,7 +33,7 @@ std::tuple<uint16_t, uint16_t> GCodeProcessor::parse_code(const char *&p)
 //static
 GCode GCodeProcessor::group1;
 
-GCodeProcessor::GCodeProcessor()
+GCodeProcessor::GCodeProcessor(bool shared_modal) : modal(shared_modal ? group1 : local_group1)
 {
     line_no = -1;
 }
@@ -146,8 +146,8 @@ bool GCodeProcessor::parse(const char *line, GCodes_t& gcodes)
                 if(c == 'G' || c == 'M') {
                     gc.set_command(c, std::get<0>(code), std::get<1>(code));
                     if(c == 'G' && std::get<0>(code) <= 3) {
-                        group1.clear();
-                        group1.set_command(c, std::get<0>(code), std::get<1>(code));
+                        modal.clear();
+                        modal.set_command(c, std::get<0>(code), std::get<1>(code));
                     }
 
                 } else if(c == 'T') {
@@ -164,7 +164,7 @@ bool GCodeProcessor::parse(const char *line, GCodes_t& gcodes)
             } else {
                 // parameter word with no command word so use modal command word
                 // group1, copies G code and subcode for this line
-                gc.set_command('G', group1.get_code(), group1.get_subcode());
+                gc.set_command('G', modal.get_code(), modal.get_subcode());
                 // fall through to process parameter word
             }
         }
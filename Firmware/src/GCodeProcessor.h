@@ -8,7 +8,8 @@
 class GCodeProcessor
 {
 public:
-	GCodeProcessor();
+	// shared_modal false keeps the modal state private, for parsing gcode that is not being executed
+	GCodeProcessor(bool shared_modal= true);
 	~GCodeProcessor();
 
 	using GCodes_t = std::vector<GCode>;
@@ -21,5 +22,7 @@ public:
 private:
 	// modal settings
 	static GCode group1;
+	GCode local_group1;
+	GCode& modal;
 	int line_no;
 };
@@ -1,10 +1,14 @@
 #include "FastTicker.h"
 #include "tmr-setup.h"
+#include "IsrProfile.h"
+#include "benchmark_timer.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 // timers are specified in Hz and periods in microseconds
 #define BASE_FREQUENCY 1000000
@@ -13,8 +17,12 @@
 FastTicker *FastTicker::instance;
 bool FastTicker::started= false;
 
+// cycle counts for the fast tick ISR, shown with the isr command
+static IsrProfile fasttick_profile("fast_tick");
+
 // This module uses a Timer to periodically call registered callbacks
 // Modules register with a function ( callback ) and a frequency, and we then call that function at the given frequency.
+// Callbacks are staggered so as few as possible land on the same tick, and when they do they run in priority order.
 // We use TMR1 for this
 
 FastTicker *FastTicker::getInstance()
@@ -46,7 +54,9 @@ FastTicker::~FastTicker()
 
 _ramfunc_ static void timer_handler()
 {
+    uint32_t st = benchmark_timer_start();
     FastTicker::getInstance()->tick();
+    fasttick_profile.record(benchmark_timer_elapsed(st));
 }
 
 // called once to start the timer
@@ -62,7 +72,9 @@ bool FastTicker::start()
             printf("ERROR: FastTicker cannot be set > %dHz\n", MAX_FREQUENCY);
             return false;
         }
+        rebalance();
         fasttick_setup(max_frequency, (void *)timer_handler);
+        fasttick_profile.set_period(SystemCoreClock / max_frequency);
 
     }else{
         printf("WARNING: FastTicker already started\n");
@@ -82,10 +94,59 @@ bool FastTicker::stop()
     return true;
 }
 
-int FastTicker::attach(uint32_t frequency, std::function<void(void)> cb)
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while(b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+uint32_t FastTicker::get_phase(int n) const
+{
+    int c = callbacks[n].countdown;
+    return c <= 0 ? 0 : (c + interval - 1) / interval;
+}
+
+// find the tick (1 to period) to first call a callback on so it lands on the same tick as the fewest of
+// the first n callbacks in order. Two callbacks every k1 and k2 ticks land on the same tick if their phases
+// are the same modulo gcd(k1, k2)
+uint32_t FastTicker::choose_phase(uint32_t period, int n) const
+{
+    uint32_t k = std::max<uint32_t>(1, period / interval);
+    uint32_t best = 1, best_cost = UINT32_MAX;
+    for (uint32_t o = 1; o <= k && best_cost > 0; ++o) {
+        uint32_t cost = 0;
+        for (int i = 0; i < n; ++i) {
+            const callback_t& c = callbacks[order[i]];
+            if(!c.fnc) continue;
+            uint32_t g = gcd(k, std::max<uint32_t>(1, c.period / interval));
+            if(o % g == get_phase(order[i]) % g) ++cost;
+        }
+        if(cost < best_cost) {
+            best_cost = cost;
+            best = o;
+        }
+    }
+
+    return best;
+}
+
+// stagger all the callbacks, highest priority first as they get the first choice
+void FastTicker::rebalance()
+{
+    if(interval == 0) return;
+    for (size_t i = 0; i < order.size(); ++i) {
+        callback_t& c = callbacks[order[i]];
+        c.countdown = choose_phase(c.period, i) * interval;
+    }
+}
+
+int FastTicker::attach(uint32_t frequency, std::function<void(void)> cb, const char *name, PRIORITY pri)
 {
     uint32_t period = BASE_FREQUENCY / frequency;
-    int countdown = period;
 
     if(frequency > max_frequency) {
         // reset frequency to a higher value
@@ -96,12 +157,35 @@ int FastTicker::attach(uint32_t frequency, std::function<void(void)> cb)
         max_frequency = frequency;
     }
 
+    // every callback is timed so a slow one can be picked out, unnamed ones are shown by their index
+    if(name == nullptr) {
+        char buf[20];
+        snprintf(buf, sizeof(buf), "fast_tick_%u", (unsigned)callbacks.size());
+        name = strdup(buf);
+    }
+    // never deleted as it is linked into the list the isr command shows
+    IsrProfile *profile = new IsrProfile(name);
+    // the load is shown as a fraction of a tick
+    profile->set_period(SystemCoreClock / max_frequency);
+
+    // keep the order by priority, then by frequency so the most frequent get the first choice of phase
+    callback_t c{(int)period, period, cb, profile, pri};
+    int n = callbacks.size();
+    auto pos = std::find_if(order.begin(), order.end(), [this, &c](uint8_t i) {
+        const callback_t& o = callbacks[i];
+        return o.priority > c.priority || (o.priority == c.priority && o.period > c.period);
+    });
+
+    // once running the others are left where they are and this one fits around them
+    if(started) c.countdown = choose_phase(period, order.size()) * interval;
+
     taskENTER_CRITICAL();
-    callbacks.push_back(std::make_tuple(countdown, period, cb));
+    callbacks.push_back(c);
+    order.insert(pos, n);
     taskEXIT_CRITICAL();
 
     // return the index it is in
-    return callbacks.size()-1;
+    return n;
 }
 
 void FastTicker::detach(int n)
@@ -109,7 +193,7 @@ void FastTicker::detach(int n)
     // TODO need to remove it but that would change all the indexes
     // For now we just zero the callback
     taskENTER_CRITICAL();
-    std::get<2>(callbacks[n])= nullptr;
+    callbacks[n].fnc = nullptr;
     taskEXIT_CRITICAL();
 }
 
@@ -118,6 +202,8 @@ bool FastTicker::set_frequency( int frequency )
 {
     if(frequency > MAX_FREQUENCY) return false;
     this->interval = BASE_FREQUENCY / frequency; // microsecond period
+    // low priority callbacks wait if a tick has already taken half its period
+    this->budget = SystemCoreClock / frequency / 2;
 
     if(started) {
         // change frequency of timer callback
@@ -125,6 +211,11 @@ bool FastTicker::set_frequency( int frequency )
             printf("ERROR: FastTicker failed to set frequency\n");
             return false;
         }
+        fasttick_profile.set_period(SystemCoreClock / frequency);
+    }
+
+    for(auto& c : callbacks) {
+        c.profile->set_period(SystemCoreClock / frequency);
     }
 
     return true;
@@ -133,16 +224,28 @@ bool FastTicker::set_frequency( int frequency )
 // This is an ISR
 _ramfunc_ void FastTicker::tick()
 {
-    // Call all callbacks that need to be called
-    for(auto& i : callbacks) {
-        int& countdown= std::get<0>(i);
-        countdown -= this->interval;
-        if (countdown <= 0) {
-            countdown += std::get<1>(i);
-            auto& fnc= std::get<2>(i); // get the callback
-            if(fnc) {
-                fnc();
+    uint32_t st = benchmark_timer_start();
+
+    // Call all callbacks that need to be called, highest priority first
+    for(uint8_t n : order) {
+        callback_t& c = callbacks[n];
+        c.countdown -= this->interval;
+        if (c.countdown <= 0) {
+            if(!c.fnc) {
+                c.countdown += c.period;
+                continue;
             }
+
+            // a low priority callback stays due until a tick has time for it, but it is not put off for more than its period
+            if(c.priority == PRIO_LOW && c.countdown > -(int)c.period && benchmark_timer_elapsed(st) > budget) {
+                ++deferred;
+                continue;
+            }
+
+            c.countdown += c.period;
+            uint32_t cst = benchmark_timer_start();
+            c.fnc();
+            c.profile->record(benchmark_timer_elapsed(cst));
         }
     }
 }
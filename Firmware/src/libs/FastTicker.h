@@ -1,10 +1,11 @@
 #pragma once
 
 #include <vector>
-#include <tuple>
 #include <functional>
 #include <cstdint>
 
+class IsrProfile;
+
 class FastTicker
 {
     public:
@@ -20,11 +21,18 @@ class FastTicker
         bool start();
         bool stop();
 
-        // call back frequency in Hz
-        int attach(uint32_t frequency, std::function<void(void)> cb);
+        // order callbacks are run in when they are due on the same tick, low priority ones are deferred to the next tick
+        // if the tick has already taken more than its budget
+        enum PRIORITY { PRIO_HIGH, PRIO_NORMAL, PRIO_LOW };
+
+        // call back frequency in Hz, the time each callback takes is profiled and shown with the isr command under name, or fast_tick_<index> if none is given
+        int attach(uint32_t frequency, std::function<void(void)> cb, const char *name= nullptr, PRIORITY pri= PRIO_NORMAL);
         void detach(int n);
         void tick();
         bool is_running() const { return started; }
+        // the tick the callback is next due on, used to check they are staggered
+        uint32_t get_phase(int n) const;
+        uint32_t get_deferred() const { return deferred; }
         // this is an advisory and is not enforced, in Hz
         static uint32_t get_min_frequency() { return 1000; }
 
@@ -36,9 +44,22 @@ class FastTicker
         // set frequency of timer in Hz
         bool set_frequency( int frequency );
 
-        using callback_t = std::tuple<int, uint32_t, std::function<void(void)>>;
+        uint32_t choose_phase(uint32_t period, int n) const;
+        void rebalance();
+
+        using callback_t = struct {
+            int countdown;
+            uint32_t period;
+            std::function<void(void)> fnc;
+            IsrProfile *profile;
+            PRIORITY priority;
+        };
         std::vector<callback_t> callbacks;
+        // indexes into callbacks in priority order
+        std::vector<uint8_t> order;
         uint32_t max_frequency{0};
         uint32_t interval{0}; // period in us between calls
+        uint32_t budget{0}; // cycles a tick can take before low priority callbacks are deferred
+        uint32_t deferred{0};
         static bool started;
 };
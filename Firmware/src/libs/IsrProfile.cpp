@@ -0,0 +1,65 @@
+#include "IsrProfile.h"
+#include "OutputStream.h"
+
+IsrProfile *IsrProfile::head = nullptr;
+
+IsrProfile::IsrProfile(const char *nm) : name(nm)
+{
+    // these are static instances so add to the front of the list, not thread safe but called before main
+    next_profile = head;
+    head = this;
+}
+
+void IsrProfile::set_period(uint32_t cycles)
+{
+    period = cycles;
+}
+
+// caller must make sure the ISR being profiled can not run while this is called
+void IsrProfile::reset()
+{
+    count = 0;
+    sum = 0;
+    min_cycles = UINT32_MAX;
+    max_cycles = 0;
+    overruns = 0;
+    for (int i = 0; i <= num_buckets; ++i) {
+        histogram[i] = 0;
+    }
+}
+
+void IsrProfile::reset_all()
+{
+    for(IsrProfile *p = head; p != nullptr; p = p->next_profile) {
+        p->reset();
+    }
+}
+
+void IsrProfile::dump(OutputStream& os, float cycles_per_us, bool show_histogram) const
+{
+    os.printf("%s: count: %lu, min: %lu, mean: %1.1f, max: %lu cycles", name, count, get_min(), get_mean(), max_cycles);
+    if(cycles_per_us > 0) {
+        os.printf(" (max %1.3f us)", max_cycles / cycles_per_us);
+    }
+    if(period > 0) {
+        os.printf(", period: %lu cycles, worst load: %1.1f%%, overruns: %lu", period, get_max_load(), overruns);
+    }
+    os.printf("\n");
+
+    if(!show_histogram || period == 0 || count == 0) return;
+
+    for (int i = 0; i <= num_buckets; ++i) {
+        if(i < num_buckets) {
+            os.printf("  %3d%%-%3d%%: ", i * 100 / num_buckets, (i + 1) * 100 / num_buckets);
+        } else {
+            os.printf("   overrun: ");
+        }
+        // scale bar to 40 chars max
+        int bar = (int)(((uint64_t)histogram[i] * 40) / count);
+        if(bar == 0 && histogram[i] > 0) bar = 1;
+        for (int j = 0; j < bar; ++j) {
+            os.printf("*");
+        }
+        os.printf(" %lu\n", histogram[i]);
+    }
+}
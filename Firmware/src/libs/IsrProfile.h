@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+class OutputStream;
+
+// Keeps cycle count statistics for an ISR, min/mean/max, a histogram of the
+// time taken as a fraction of the ISR period and a count of overruns past that period.
+// record() is called from the ISR with the number of CPU cycles the ISR took,
+// it does no hardware access itself so it can be tested on its own.
+// All instances link themselves into a list so they can be dumped by the isr command.
+class IsrProfile
+{
+public:
+    IsrProfile(const char *name);
+
+    static const int num_buckets = 10; // each bucket is 10% of the period, plus one for overruns
+
+    // period in cycles, 0 means the ISR is not periodic and only min/mean/max are kept
+    void set_period(uint32_t cycles);
+    uint32_t get_period() const { return period; }
+
+    // called from the ISR so must be kept fast
+    void record(uint32_t cycles)
+    {
+        ++count;
+        sum += cycles;
+        if(cycles < min_cycles) min_cycles = cycles;
+        if(cycles > max_cycles) max_cycles = cycles;
+        if(period > 0) {
+            uint32_t b = (uint32_t)(((uint64_t)cycles * num_buckets) / period);
+            if(b >= num_buckets) {
+                ++overruns;
+                b = num_buckets;
+            }
+            ++histogram[b];
+        }
+    }
+
+    void reset();
+
+    const char *get_name() const { return name; }
+    uint32_t get_count() const { return count; }
+    uint32_t get_min() const { return count == 0 ? 0 : min_cycles; }
+    uint32_t get_max() const { return max_cycles; }
+    float get_mean() const { return count == 0 ? 0.0F : (float)sum / count; }
+    uint32_t get_overruns() const { return overruns; }
+    // bucket num_buckets is the overrun bucket
+    uint32_t get_bucket(int n) const { return (n >= 0 && n <= num_buckets) ? histogram[n] : 0; }
+    // percentage of the period used by the worst case, 0 if not periodic
+    float get_max_load() const { return period == 0 ? 0.0F : (100.0F * max_cycles) / period; }
+
+    void dump(OutputStream& os, float cycles_per_us, bool show_histogram) const;
+
+    // the linked list of all profiles
+    static IsrProfile *first() { return head; }
+    IsrProfile *next() const { return next_profile; }
+    static void reset_all();
+
+private:
+    static IsrProfile *head;
+    IsrProfile *next_profile;
+
+    const char *name;
+    uint32_t period{0};
+    volatile uint32_t count{0};
+    uint64_t sum{0};
+    uint32_t min_cycles{UINT32_MAX};
+    uint32_t max_cycles{0};
+    uint32_t overruns{0};
+    uint32_t histogram[num_buckets + 1]{0};
+};
@@ -0,0 +1,316 @@
+#include "KVStore.h"
+
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#define KV_MAGIC 0x3153564BUL // "KVS1"
+
+// record types, erased flash reads as 0xFF which is the end of the records in a block
+#define REC_PUT 0x01
+#define REC_DEL 0x02
+
+static uint32_t crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while(len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// the crc covers the type and lengths and the key and value that follow the header
+uint32_t KVStore::calc_crc(const rec_hdr_t& hdr, uint32_t addr)
+{
+    uint32_t crc = crc32(0, &hdr, offsetof(rec_hdr_t, crc));
+    uint32_t n = hdr.key_len + hdr.value_len;
+    addr += sizeof(rec_hdr_t);
+    uint8_t buf[64];
+    while(n > 0) {
+        uint32_t l = std::min(n, (uint32_t)sizeof(buf));
+        if(!flash.read(addr, buf, l)) return ~hdr.crc;
+        crc = crc32(crc, buf, l);
+        addr += l;
+        n -= l;
+    }
+    return crc;
+}
+
+bool KVStore::mount()
+{
+    mounted = false;
+    used.clear();
+    index.clear();
+    head_seq = 0;
+
+    // find the blocks in use and put them in the order they were written
+    std::vector<std::pair<uint32_t, uint32_t>> blocks;
+    for (uint32_t b = 0; b < nblocks; ++b) {
+        blk_hdr_t h;
+        if(!flash.read(b * block_size, &h, sizeof(h))) return false;
+        if(h.magic == KV_MAGIC && h.nseq == ~h.seq) {
+            blocks.push_back({h.seq, b});
+
+        } else if(h.magic != 0xFFFFFFFFUL || h.seq != 0xFFFFFFFFUL || h.nseq != 0xFFFFFFFFUL) {
+            // an erase or a header write did not finish, it has nothing we can use
+            if(!flash.erase(b * block_size)) return false;
+        }
+    }
+
+    if(blocks.empty()) return format();
+
+    std::sort(blocks.begin(), blocks.end());
+    for(auto& i : blocks) {
+        used.push_back(i.second);
+    }
+    head_seq = blocks.back().first;
+
+    // replay the records oldest first so the index ends up with the newest of each
+    for(auto b : used) {
+        if(!scan_block(b)) return false;
+    }
+
+    mounted = true;
+    return true;
+}
+
+bool KVStore::scan_block(uint32_t blk)
+{
+    uint32_t addr = blk * block_size + sizeof(blk_hdr_t);
+    uint32_t end = (blk + 1) * block_size;
+    while(addr + sizeof(rec_hdr_t) <= end) {
+        rec_hdr_t h;
+        if(!flash.read(addr, &h, sizeof(h))) return false;
+        if(h.type == 0xFF && h.key_len == 0xFF && h.value_len == 0xFFFF && h.crc == 0xFFFFFFFFUL) break;
+
+        uint32_t sz = rec_size(h.key_len, h.value_len);
+        if((h.type != REC_PUT && h.type != REC_DEL) || h.key_len == 0 || addr + sz > end || calc_crc(h, addr) != h.crc) {
+            // partly written, nothing after it can be trusted so the block is treated as full
+            addr = end;
+            break;
+        }
+
+        char key[256];
+        if(!flash.read(addr + sizeof(rec_hdr_t), key, h.key_len)) return false;
+        key[h.key_len] = '\0';
+        if(h.type == REC_PUT) {
+            index[key] = addr;
+        } else {
+            index.erase(key);
+        }
+        addr += sz;
+    }
+
+    write_addr = addr;
+    return true;
+}
+
+bool KVStore::format()
+{
+    mounted = false;
+    used.clear();
+    index.clear();
+    head_seq = 0;
+    for (uint32_t b = 0; b < nblocks; ++b) {
+        if(!flash.erase(b * block_size)) return false;
+    }
+
+    if(!open_block()) return false;
+    mounted = true;
+    return true;
+}
+
+// starts writing to the next free block after the newest one
+bool KVStore::open_block()
+{
+    uint32_t start = used.empty() ? 0 : used.back() + 1;
+    uint32_t blk = nblocks;
+    for (uint32_t i = 0; i < nblocks; ++i) {
+        uint32_t b = (start + i) % nblocks;
+        if(std::find(used.begin(), used.end(), b) == used.end()) {
+            blk = b;
+            break;
+        }
+    }
+    if(blk == nblocks) return false;
+
+    // it should have been erased when it was freed, but make sure
+    uint8_t buf[64];
+    for (uint32_t a = 0; a < block_size; a += sizeof(buf)) {
+        if(!flash.read(blk * block_size + a, buf, sizeof(buf))) return false;
+        bool blank = true;
+        for (auto c : buf) {
+            if(c != 0xFF) { blank = false; break; }
+        }
+        if(!blank) {
+            if(!flash.erase(blk * block_size)) return false;
+            break;
+        }
+    }
+
+    ++head_seq;
+    blk_hdr_t h{KV_MAGIC, head_seq, ~head_seq, 0xFFFFFFFFUL};
+    if(!flash.program(blk * block_size, &h, sizeof(h))) return false;
+    used.push_back(blk);
+    write_addr = blk * block_size + sizeof(h);
+    return true;
+}
+
+// copies the live records in the oldest block to the newest and erases it
+bool KVStore::compact_oldest()
+{
+    if(used.empty()) return false;
+    uint32_t old = used.front();
+    if(old == used.back()) {
+        // it can not be copied into itself
+        if(get_free_blocks() == 0 || !open_block()) return false;
+    }
+
+    uint32_t base = old * block_size;
+    uint32_t end = base + block_size;
+    std::vector<std::pair<uint32_t, std::string>> live;
+    for(auto& i : index) {
+        if(i.second >= base && i.second < end) live.push_back({i.second, i.first});
+    }
+    std::sort(live.begin(), live.end());
+
+    for(auto& i : live) {
+        rec_hdr_t h;
+        if(!flash.read(i.first, &h, sizeof(h))) return false;
+        uint32_t sz = rec_size(h.key_len, h.value_len);
+        if(write_addr + sz > (used.back() + 1) * block_size) {
+            if(get_free_blocks() == 0 || !open_block()) return false;
+        }
+
+        uint8_t buf[64];
+        for (uint32_t o = 0; o < sz; o += sizeof(buf)) {
+            uint32_t l = std::min(sz - o, (uint32_t)sizeof(buf));
+            if(!flash.read(i.first + o, buf, l)) return false;
+            if(!flash.program(write_addr + o, buf, l)) return false;
+        }
+        index[i.second] = write_addr;
+        write_addr += sz;
+    }
+
+    // anything else in it is an old value or a delete of a key that is in no older block
+    if(!flash.erase(base)) return false;
+    used.erase(used.begin());
+    return true;
+}
+
+bool KVStore::make_room(uint32_t size)
+{
+    for (uint32_t i = 0; i <= nblocks; ++i) {
+        if(!used.empty() && write_addr + size <= (used.back() + 1) * block_size) return true;
+
+        // keep the last free block for compacting
+        if(get_free_blocks() > 1) {
+            if(!open_block()) return false;
+            continue;
+        }
+
+        // there is no point compacting if the live records would not leave room for it
+        if(live_size() + size > (nblocks - 1) * (block_size - sizeof(blk_hdr_t))) return false;
+        if(!compact_oldest()) return false;
+    }
+
+    // everything in it is live
+    return false;
+}
+
+// the space the current values take up
+uint32_t KVStore::live_size() const
+{
+    uint32_t n = 0;
+    for(auto& i : index) {
+        rec_hdr_t h;
+        if(!flash.read(i.second, &h, sizeof(h))) continue;
+        n += rec_size(h.key_len, h.value_len);
+    }
+    return n;
+}
+
+bool KVStore::append(uint8_t type, const char *key, const void *data, uint32_t len)
+{
+    if(!mounted) return false;
+    uint32_t key_len = strlen(key);
+    if(key_len == 0 || key_len > 255 || len > 0xFFFF) return false;
+    uint32_t sz = rec_size(key_len, len);
+    if(sz > block_size - sizeof(blk_hdr_t)) return false;
+    if(!make_room(sz)) return false;
+
+    // the header goes first so if the rest does not get written the crc will not match
+    rec_hdr_t h{type, (uint8_t)key_len, (uint16_t)len, 0};
+    h.crc = crc32(crc32(crc32(0, &h, offsetof(rec_hdr_t, crc)), key, key_len), data, len);
+    if(!flash.program(write_addr, &h, sizeof(h))) return false;
+    if(!flash.program(write_addr + sizeof(h), key, key_len)) return false;
+    if(len > 0 && !flash.program(write_addr + sizeof(h) + key_len, data, len)) return false;
+
+    if(type == REC_PUT) {
+        index[key] = write_addr;
+    } else {
+        index.erase(key);
+    }
+    write_addr += sz;
+    return true;
+}
+
+bool KVStore::put(const char *key, const void *data, uint32_t len)
+{
+    return append(REC_PUT, key, data, len);
+}
+
+bool KVStore::remove(const char *key)
+{
+    if(!exists(key)) return false;
+    return append(REC_DEL, key, nullptr, 0);
+}
+
+int KVStore::get(const char *key, void *buf, uint32_t len)
+{
+    auto i = index.find(key);
+    if(i == index.end()) return -1;
+
+    rec_hdr_t h;
+    if(!flash.read(i->second, &h, sizeof(h))) return -1;
+    uint32_t n = std::min(len, (uint32_t)h.value_len);
+    if(n > 0 && !flash.read(i->second + sizeof(h) + h.key_len, buf, n)) return -1;
+    return h.value_len;
+}
+
+bool KVStore::get(const char *key, std::string& value)
+{
+    auto i = index.find(key);
+    if(i == index.end()) return false;
+
+    rec_hdr_t h;
+    if(!flash.read(i->second, &h, sizeof(h))) return false;
+    value.resize(h.value_len);
+    if(h.value_len == 0) return true;
+    return flash.read(i->second + sizeof(h) + h.key_len, &value[0], h.value_len);
+}
+
+void KVStore::for_each(std::function<bool(const std::string& key, uint32_t len)> fnc) const
+{
+    for(auto& i : index) {
+        rec_hdr_t h;
+        if(!flash.read(i.second, &h, sizeof(h))) return;
+        if(!fnc(i.first, h.value_len)) return;
+    }
+}
+
+uint32_t KVStore::get_head_free() const
+{
+    if(used.empty()) return 0;
+    return (used.back() + 1) * block_size - write_addr;
+}
+
+uint32_t KVStore::get_max_value_size(const char *key) const
+{
+    uint32_t n = block_size - sizeof(blk_hdr_t) - sizeof(rec_hdr_t) - strlen(key);
+    return std::min(n, (uint32_t)0xFFFF);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// The flash the store is kept in, addresses are relative to the start of the store.
+// Programming can only clear bits, erase sets a whole block back to 0xFF.
+class KVFlash
+{
+public:
+    virtual ~KVFlash() {}
+    virtual bool read(uint32_t addr, void *buf, uint32_t len) = 0;
+    virtual bool program(uint32_t addr, const void *buf, uint32_t len) = 0;
+    // erases the block that starts at addr
+    virtual bool erase(uint32_t addr) = 0;
+};
+
+// A log structured key/value store in NOR flash.
+// Each block starts with a header holding a sequence number, records are appended to the newest block and an update
+// is just a newer record for the same key, so nothing is ever rewritten in place. Each record has a crc so one that
+// was only partly written when the power went is ignored and the previous value is used, which makes updates atomic.
+// Blocks are used in turn so the erases are spread over all of them. When the last free block is needed the oldest
+// block has its live records copied to the newest and is then erased.
+// A RAM index of key to record address is built when it is mounted so lookups do not search the flash.
+// It has no hardware dependencies, the flash is passed in, so it can be tested on the host.
+class KVStore
+{
+public:
+    // nblocks of block_size, there must be at least 2
+    KVStore(KVFlash& f, uint32_t block_size, uint32_t nblocks) : flash(f), block_size(block_size), nblocks(nblocks) {}
+
+    // scans the flash and builds the index, a blank or unreadable store is formatted
+    bool mount();
+    bool format();
+    bool is_mounted() const { return mounted; }
+
+    bool put(const char *key, const void *data, uint32_t len);
+    bool put(const char *key, const std::string& value) { return put(key, value.data(), value.size()); }
+    // returns the size of the value or -1 if not found, copies at most len bytes of it into buf
+    int get(const char *key, void *buf, uint32_t len);
+    bool get(const char *key, std::string& value);
+    bool exists(const char *key) const { return index.find(key) != index.end(); }
+    bool remove(const char *key);
+    // calls fnc with each key and the size of its value, stops if it returns false
+    void for_each(std::function<bool(const std::string& key, uint32_t len)> fnc) const;
+
+    uint32_t get_key_count() const { return index.size(); }
+    uint32_t get_free_blocks() const { return nblocks - used.size(); }
+    // bytes still available in the newest block
+    uint32_t get_head_free() const;
+    uint32_t get_max_value_size(const char *key) const;
+
+private:
+    struct rec_hdr_t {
+        uint8_t type;
+        uint8_t key_len;
+        uint16_t value_len;
+        uint32_t crc;
+    };
+    struct blk_hdr_t {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t nseq;  // ~seq so a partly written header is seen as invalid
+        uint32_t spare;
+    };
+
+    static uint32_t rec_size(uint32_t key_len, uint32_t value_len) { return (sizeof(rec_hdr_t) + key_len + value_len + 3) & ~3; }
+    uint32_t calc_crc(const rec_hdr_t& hdr, uint32_t addr);
+    bool append(uint8_t type, const char *key, const void *data, uint32_t len);
+    bool make_room(uint32_t size);
+    uint32_t live_size() const;
+    bool open_block();
+    bool compact_oldest();
+    bool scan_block(uint32_t blk);
+
+    KVFlash& flash;
+    uint32_t block_size;
+    uint32_t nblocks;
+
+    // the in use blocks, oldest first
+    std::vector<uint32_t> used;
+    uint32_t head_seq{0};
+    uint32_t write_addr{0};
+    std::unordered_map<std::string, uint32_t> index;
+    bool mounted{false};
+};
@@ -42,6 +42,18 @@ bool send_message_queue(const char *pline, OutputStream *pos, bool wait)
     return r == pdTRUE;
 }
 
+bool send_message_queue_len(const char *pline, size_t len, OutputStream *pos, bool wait)
+{
+    comms_msg_t msg_buffer;
+    if(len >= MAX_LINE_LENGTH) len = MAX_LINE_LENGTH - 1;
+    memcpy(msg_buffer.pline, pline, len);
+    msg_buffer.pline[len] = '\0';
+    msg_buffer.pos= pos;
+    TickType_t waitms = wait ? portMAX_DELAY : 0;
+    BaseType_t r= xQueueSend( queue_handle, ( void * )&msg_buffer, waitms);
+    return r == pdTRUE;
+}
+
 bool send_message_queue(const char *pline, void *pos)
 {
 	return send_message_queue(pline, (OutputStream*)pos);
@@ -9,6 +9,8 @@ class OutputStream;
 using comms_msg_t = struct {char pline[MAX_LINE_LENGTH]; OutputStream *pos; };
 extern "C" {
 bool send_message_queue(const char *pline, OutputStream *pos, bool wait=true);
+// sends len characters of pline which need not be nul terminated, eg a line in memory mapped flash
+bool send_message_queue_len(const char *pline, size_t len, OutputStream *pos, bool wait=true);
 bool receive_message_queue(char **ppline, OutputStream **ppos);
 int get_message_queue_space();
 #else
@@ -1,58 +1,199 @@
 //
-//  Simple fixed size ring buffer.
+//  Fixed size lock free ring buffers.
 //  Manage objects by value.
-//  Thread safe for single Producer and single Consumer.
-//  By Dennis Lang http://home.comcast.net/~lang.dennis/code/ring/ring.html
-//  Slightly modified for naming
+//  The size is a power of two so the index is masked rather than using modulo, the head and tail are free running
+//  counts so all the slots can be used and they are only ever written by one side.
+//
+//  RingBuffer<kind, length>        single producer single consumer, buffer is malloced, or given with allocate() if length is 0
+//  StaticRingBuffer<kind, length>  single producer single consumer, buffer is inside the object
+//  MPSCRingBuffer<kind, length>    any number of producers and a single consumer, buffer is inside the object
+//
+//  The producer and consumer can be different threads or an ISR and a thread. The producer writes the object then does
+//  a release store of head, the consumer does an acquire load of head before reading it, so the object is always
+//  complete when the consumer sees it. The same goes for tail, so a slot is not written until it has been read.
 
 #pragma once
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
 
-template <class kind, size_t length=0>
-class RingBuffer
+// head and tail are kept on separate cache lines so the two sides do not keep taking the line from each other
+#ifndef RING_CACHE_LINE
+#if defined(__arm__)
+#define RING_CACHE_LINE 32
+#else
+#define RING_CACHE_LINE 64
+#endif
+#endif
+
+template <class kind>
+class RingBufferBase
 {
     public:
-        /**
-         * @brief   Initialize ringbuffer
-         * @param   Nothing
-         * @return  Nothing
-         * @note    The module is initialized with head and tail indexes
-         * pointed to the first element
-         */
-        RingBuffer()
-        {
-            size = length;
-            tail = 0;
-            head = 0;
-            if(length != 0) {
-                buffer = (kind*) malloc(sizeof(kind) * size);
-            }else{
-                buffer= nullptr;
-            }
+        bool is_ok() const { return buffer != nullptr && capacity > 0; }
+
+        // the number of objects it can hold
+        size_t get_capacity() const { return capacity; }
+
+        bool empty() const
+        {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
         }
 
-        /**
-         * @brief   Deinitialize ringbuffer
-         * @param   Nothing
-         * @return  Nothing
-         * @note    Deallocates the buffer from memory
-         */
+        bool full() const
+        {
+            return get_size() >= capacity;
+        }
+
+        // the number of objects in it
+        size_t get_size() const
+        {
+            // tail first as head can only get further ahead of it
+            size_t t = tail.load(std::memory_order_acquire);
+            return head.load(std::memory_order_acquire) - t;
+        }
+
+        // the number of objects that can be added
+        size_t get_free() const
+        {
+            return capacity - get_size();
+        }
+
+        // producer only, must not be full
+        void push_back(const kind& object)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            buffer[h & mask] = object;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        // producer only, false if it is full
+        bool push(const kind& object)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h - tail.load(std::memory_order_acquire) >= capacity) return false;
+            buffer[h & mask] = object;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // producer only, adds as many of the n objects as there is room for, returns how many
+        size_t push(const kind *src, size_t n)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t space = capacity - (h - tail.load(std::memory_order_acquire));
+            if(n > space) n = space;
+            // upto the end of the buffer then from the start
+            size_t i = h & mask;
+            size_t n1 = capacity - i < n ? capacity - i : n;
+            copy(&buffer[i], src, n1);
+            copy(buffer, src + n1, n - n1);
+            head.store(h + n, std::memory_order_release);
+            return n;
+        }
+
+        // consumer only, must not be empty
+        kind pop_front()
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            kind object = buffer[t & mask];
+            tail.store(t + 1, std::memory_order_release);
+            return object;
+        }
+
+        // consumer only, false if it is empty
+        bool pop(kind& object)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if(head.load(std::memory_order_acquire) == t) return false;
+            object = buffer[t & mask];
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer only, removes upto n objects, returns how many
+        size_t pop(kind *dst, size_t n)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t avail = head.load(std::memory_order_acquire) - t;
+            if(n > avail) n = avail;
+            size_t i = t & mask;
+            size_t n1 = capacity - i < n ? capacity - i : n;
+            copy(dst, &buffer[i], n1);
+            copy(dst + n1, buffer, n - n1);
+            tail.store(t + n, std::memory_order_release);
+            return n;
+        }
+
+        // consumer only, the oldest object without removing it, must not be empty
+        kind peek_front() const
+        {
+            return buffer[tail.load(std::memory_order_relaxed) & mask];
+        }
+
+        // consumer only, empties it
+        void flush()
+        {
+            tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+    protected:
+        RingBufferBase(kind *buf, size_t n) : head(0), tail(0) { set_buffer(buf, n); }
+
+        // n is rounded down to a power of two
+        void set_buffer(kind *buf, size_t n)
+        {
+            size_t c = 1;
+            while(c * 2 <= n && c * 2 != 0) c *= 2;
+            buffer = buf;
+            capacity = (buf != nullptr && n > 0) ? c : 0;
+            mask = capacity > 0 ? capacity - 1 : 0;
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        static void copy(kind *d, const kind *s, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i) d[i] = s[i];
+        }
+
+        kind *buffer;
+        size_t capacity;
+        size_t mask;
+
+    private:
+        char pad0[RING_CACHE_LINE];
+        std::atomic<size_t> head;   // count of objects added, only written by the producer
+        char pad1[RING_CACHE_LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;   // count of objects removed, only written by the consumer
+        char pad2[RING_CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+template <class kind, size_t length=0>
+class RingBuffer : public RingBufferBase<kind>
+{
+    static_assert((length & (length - 1)) == 0, "RingBuffer length must be a power of two");
+
+    public:
+        RingBuffer() : RingBufferBase<kind>(length != 0 ? (kind*)malloc(sizeof(kind) * length) : nullptr, length) {}
+
         ~RingBuffer()
         {
-            if(length != 0 && buffer != nullptr) {
-                free(buffer);
+            if(length != 0 && this->buffer != nullptr) {
+                free(this->buffer);
             }
         }
 
         /**
          * manual allocation of buffer by client, who is also responsible for deallocation
+         * only n rounded down to a power of two objects are used
          */
         bool allocate(void *buf, size_t n)
         {
             if(length == 0) {
-                size= n;
-                buffer= (char *)buf;
+                this->set_buffer((kind *)buf, n);
                 return true;
             }
 
@@ -62,97 +203,108 @@ class RingBuffer
         void deallocate()
         {
             if(length == 0) {
-                size= 0;
-                buffer= nullptr;
+                this->set_buffer(nullptr, 0);
             }
         }
+};
 
-        bool is_ok() const { return buffer != nullptr && size > 0; }
+template <class kind, size_t length>
+class StaticRingBuffer : public RingBufferBase<kind>
+{
+    static_assert(length > 0 && (length & (length - 1)) == 0, "StaticRingBuffer length must be a power of two");
 
-        /**
-         * @brief   Get next index of the reference index
-         * @param   Reference index
-         * @return  Right index of the reference index
-         * @note    If reference index is the last of the buffer, returns first index instead
-         */
-        size_t next(size_t n) const
-        {
-            return (n + 1) % size;
-        }
+    public:
+        StaticRingBuffer() : RingBufferBase<kind>(storage, length) {}
 
-        /**
-         * @brief   Check if the buffer is empty
-         * @param   Nothing
-         * @return  True if the buffer is empty
-         * @return  False if the buffer is not empty
-         */
-        bool empty() const
-        {
-            return (tail == head);
-        }
+    private:
+        kind storage[length];
+};
 
-        /**
-         * @brief   Check if the buffer is full
-         * @param   Nothing
-         * @return  True if the buffer is full
-         * @return  False if the buffer is not full
-         */
-        bool full() const
+// Each slot has a sequence number which says whether it is free for the producer that claimed it or has an object
+// ready for the consumer. Producers claim a slot by advancing head with a compare and swap, so one that is interrupted
+// part way through a push never holds up the others, the consumer just does not see that slot until it is done.
+template <class kind, size_t length>
+class MPSCRingBuffer
+{
+    static_assert(length > 0 && (length & (length - 1)) == 0, "MPSCRingBuffer length must be a power of two");
+
+    public:
+        MPSCRingBuffer() : head(0), tail(0)
         {
-            return (next(head) == tail);
+            for (size_t i = 0; i < length; ++i) {
+                slots[i].seq.store(i, std::memory_order_relaxed);
+            }
         }
 
-        /**
-         * @brief   Get actual size of the buffer
-         * @param   Nothing
-         * @return  The number of elements between the head and tail indexes
-         */
-        size_t get_size() const
+        size_t get_capacity() const { return length; }
+
+        // any producer, false if it is full
+        bool push(const kind& object)
         {
-            return (tail > head ? size : 0) + head - tail;
+            size_t pos = head.load(std::memory_order_relaxed);
+            slot_t *s;
+            for (;;) {
+                s = &slots[pos & (length - 1)];
+                intptr_t dif = (intptr_t)s->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+                if(dif == 0) {
+                    // free, try and claim it, on failure pos is updated to the current head
+                    if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if(dif < 0) {
+                    // still has the object from length pushes ago
+                    return false;
+                } else {
+                    // another producer got it first
+                    pos = head.load(std::memory_order_relaxed);
+                }
+            }
+
+            s->data = object;
+            s->seq.store(pos + 1, std::memory_order_release);
+            return true;
         }
 
-        /**
-         * @brief   Store object to the head position
-         * @param   New kind object to be stored in the buffer
-         * @return  Nothing
-         */
-        void push_back(const kind object)
+        // consumer only, false if it is empty or the oldest one is still being pushed
+        bool pop(kind& object)
         {
-            buffer[head] = object;
-            head = next(head);
+            size_t pos = tail.load(std::memory_order_relaxed);
+            slot_t *s = &slots[pos & (length - 1)];
+            if(s->seq.load(std::memory_order_acquire) != pos + 1) return false;
+            object = s->data;
+            // free for the push that is length ahead
+            s->seq.store(pos + length, std::memory_order_release);
+            tail.store(pos + 1, std::memory_order_release);
+            return true;
         }
 
-        /**
-         * @brief   Get object from the tail position
-         * @param   Nothing
-         * @return  Object obtained from the tail position
-         */
-        kind pop_front()
+        // consumer only
+        bool empty() const
         {
-            kind object = buffer[tail];
-            tail = next(tail);
-            return object;
+            size_t pos = tail.load(std::memory_order_relaxed);
+            return slots[pos & (length - 1)].seq.load(std::memory_order_acquire) != pos + 1;
         }
 
-        /**
-         * @brief   Get object from the tail position don't remove it
-         * @param   Nothing
-         * @return  Object obtained from the tail position
-         */
-        kind peek_front()
+        // only a hint with several producers
+        bool full() const
         {
-            return buffer[tail];
+            return get_size() >= length;
         }
 
-        void flush()
+        size_t get_size() const
         {
-            tail= head;
+            size_t t = tail.load(std::memory_order_acquire);
+            return head.load(std::memory_order_acquire) - t;
         }
 
     private:
-        kind *buffer;
-        size_t tail;   //Pointer to the oldest object
-        size_t head;   //Pointer to the newest object
-        size_t size;   //Fixed size of the buffer
+        struct slot_t {
+            std::atomic<size_t> seq;
+            kind data;
+        };
+
+        slot_t slots[length];
+        char pad0[RING_CACHE_LINE];
+        std::atomic<size_t> head;   // count of slots claimed by the producers
+        char pad1[RING_CACHE_LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;   // count of objects removed, only written by the consumer
+        char pad2[RING_CACHE_LINE - sizeof(std::atomic<size_t>)];
 };
@@ -1,15 +1,23 @@
 #include "SigmaDeltaPwm.h"
 
 #include "FastTicker.h"
+#include "GpioDma.h"
+#include "Pwm.h"
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include <cstring>
+
 #define confine(value, min, max) (((value) < (min))?(min):(((value) > (max))?(max):(value)))
 
 #define PID_PWM_MAX 256
 
 std::set<SigmaDeltaPwm*> SigmaDeltaPwm::instances;
 int SigmaDeltaPwm::fastticker= -1;
+SigmaDeltaPwm::MODE SigmaDeltaPwm::mode= SigmaDeltaPwm::SOFTWARE;
+
+// the rate the sigma-delta is stepped at whichever way it is done
+#define SIGMADELTA_FREQUENCY 2000
 
 SigmaDeltaPwm::SigmaDeltaPwm(const char *pin_name)
 {
@@ -18,17 +26,29 @@ SigmaDeltaPwm::SigmaDeltaPwm(const char *pin_name)
     _sd_direction = false;
     _sd_accumulator = 0;
     if(from_string(pin_name) && as_output()) {
+        if(mode == HARDWARE) {
+            std::string pn= Pwm::lookup(get_gpioport(), get_gpiopin());
+            if(!pn.empty()) {
+                hwpwm= new Pwm(pn.c_str());
+                if(hwpwm->is_valid()) {
+                    // the PWM setup takes over the pin
+                    Pin::set_allocated(get_gpioport(), get_gpiopin(), false);
+                    printf("DEBUG: SigmaDeltaPwm: %s using %s\n", pin_name, pn.c_str());
+                    return;
+                }
+                delete hwpwm;
+                hwpwm= nullptr;
+            }
+        }
+
+        if(mode != SOFTWARE) {
+            dma= GpioDma::attach(get_gpioport(), get_gpiopin());
+        }
+
         taskENTER_CRITICAL();
         instances.insert(this);
         taskEXIT_CRITICAL();
-        if(fastticker == -1) {
-            // first one create the one ticker
-            // use fast ticker as it is ISR based and will preempt tasks
-            fastticker= FastTicker::getInstance()->attach(2000, SigmaDeltaPwm::global_tick);
-            if(fastticker < 0) {
-                printf("ERROR: SigmaDeltaPwm: ERROR SigmaDelta FastTicker was not set\n");
-            }
-        }
+        if(!dma) attach_ticker();
 
     }else{
         printf("ERROR: SigmaDeltaPwm: ERROR invalid pin %s\n", pin_name);
@@ -40,17 +60,87 @@ SigmaDeltaPwm::~SigmaDeltaPwm()
     taskENTER_CRITICAL();
     instances.erase(this);
     taskEXIT_CRITICAL();
+    if(hwpwm != nullptr) {
+        delete hwpwm;
+    } else if(dma) {
+        GpioDma::detach(get_gpioport(), get_gpiopin());
+    }
+}
+
+// static
+bool SigmaDeltaPwm::attach_ticker()
+{
+    if(fastticker == -1) {
+        // first one create the one ticker
+        // use fast ticker as it is ISR based and will preempt tasks
+        fastticker= FastTicker::getInstance()->attach(SIGMADELTA_FREQUENCY, SigmaDeltaPwm::global_tick, "sigma_delta", FastTicker::PRIO_HIGH);
+        if(fastticker < 0) {
+            printf("ERROR: SigmaDeltaPwm: ERROR SigmaDelta FastTicker was not set\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// static
+bool SigmaDeltaPwm::mode_from_string(const char *s, MODE& m)
+{
+    if(strcmp(s, "software") == 0) m = SOFTWARE;
+    else if(strcmp(s, "dma") == 0) m = DMA;
+    else if(strcmp(s, "hardware") == 0) m = HARDWARE;
+    else return false;
+    return true;
 }
 
+// static
+bool SigmaDeltaPwm::post_config_setup()
+{
+    bool any= false;
+    for(auto s : instances) {
+        if(s->dma) any= true;
+    }
+    if(!any) return true;
+
+    if(GpioDma::start(SIGMADELTA_FREQUENCY)) return true;
+
+    printf("WARNING: SigmaDeltaPwm: DMA failed to start, using software\n");
+    taskENTER_CRITICAL();
+    for(auto s : instances) {
+        s->dma= false;
+    }
+    taskEXIT_CRITICAL();
+    return attach_ticker();
+}
+
+// pass the current setting on to the hardware, the software tick picks it up itself
+void SigmaDeltaPwm::update()
+{
+    if(_pwm < 0) return;
+
+    int v= is_inverting() ? PID_PWM_MAX - 1 - _pwm : _pwm;
+    if(hwpwm != nullptr) {
+        hwpwm->set(v / (float)(PID_PWM_MAX - 1));
+    } else if(dma) {
+        GpioDma::set(get_gpioport(), get_gpiopin(), v, PID_PWM_MAX - 1);
+    }
+}
+
+// this is called on every PID update, the DMA pattern is only rebuilt when the duty actually changes
 void SigmaDeltaPwm::pwm(int new_pwm)
 {
-    _pwm = confine(new_pwm, 0, _max);
+    new_pwm = confine(new_pwm, 0, _max);
+    if(new_pwm == _pwm) return;
+    _pwm = new_pwm;
+    update();
 }
 
 void SigmaDeltaPwm::max_pwm(int new_max)
 {
     _max = confine(new_max, 0, PID_PWM_MAX - 1);
-    _pwm = confine(   _pwm, 0, _max);
+    int new_pwm = confine(_pwm, 0, _max);
+    if(new_pwm == _pwm) return;
+    _pwm = new_pwm;
+    update();
 }
 
 int SigmaDeltaPwm::max_pwm()
@@ -61,14 +151,22 @@ int SigmaDeltaPwm::max_pwm()
 void SigmaDeltaPwm::set(bool value)
 {
     _pwm = -1;
+    // also set the pin directly so it is right before the DMA starts, a hardware PWM pin ignores it
     Pin::set(value);
+
+    bool on= value ^ is_inverting();
+    if(hwpwm != nullptr) {
+        hwpwm->set(on ? 1.0F : 0.0F);
+    } else if(dma) {
+        GpioDma::set(get_gpioport(), get_gpiopin(), on ? 1 : 0, 1);
+    }
 }
 
 // static
 void SigmaDeltaPwm::global_tick(void)
 {
     for(auto s : instances) {
-        s->on_tick();
+        if(!s->dma) s->on_tick();
     }
 }
 
@@ -4,11 +4,22 @@
 
 #include <set>
 
+class Pwm;
+
 class SigmaDeltaPwm : public Pin {
 public:
     SigmaDeltaPwm(const char *);
     virtual ~SigmaDeltaPwm();
 
+    // SOFTWARE toggles the pins from the FastTicker, DMA has GpioDma write a precomputed pattern to the port,
+    // HARDWARE uses the PWM timer channel on the pin if it has one that is free otherwise DMA
+    enum MODE { SOFTWARE, DMA, HARDWARE };
+    // must be set before any are created
+    static void set_mode(MODE m) { mode = m; }
+    static bool mode_from_string(const char *s, MODE& m);
+    // starts the DMA, any that were to use it fall back to software if it fails, call after all modules are configured
+    static bool post_config_setup();
+
     void     max_pwm(int);
     int      max_pwm(void);
 
@@ -19,9 +30,14 @@ public:
 private:
     static std::set<SigmaDeltaPwm*> instances;
     static void global_tick(void);
+    static bool attach_ticker();
     void on_tick(void);
+    void update();
 
     static int fastticker;
+    static MODE mode;
+    Pwm *hwpwm{nullptr};
+    bool dma{false};
     int  _max;
     int  _pwm;
     int  _sd_accumulator;
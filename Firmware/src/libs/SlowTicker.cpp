@@ -11,8 +11,10 @@
 
 SlowTicker *SlowTicker::instance= nullptr;
 
-// This module uses FreeRTOS Timers to periodically call registered callbacks
+// This module uses a single one shot FreeRTOS Timer to periodically call registered callbacks
 // Modules register with a function ( callback ) and a frequency
+// The callbacks are kept in a TimerWheel which tells us when the next one is due, the timer is then rearmed for that time
+// so the timer task only wakes up when there is something to do, and callbacks that are due at the same time share a wakeup
 
 SlowTicker *SlowTicker::getInstance()
 {
@@ -25,61 +27,66 @@ SlowTicker *SlowTicker::getInstance()
 
 void SlowTicker::deleteInstance()
 {
-    if(instance != nullptr) {
-        for (size_t i = 0; i < instance->timers.size(); ++i) {
-            instance->detach(i);
-        }
-    }
     delete instance;
     instance= nullptr;
 }
 
 void SlowTicker::timer_handler(TimerHandle_t xTimer)
 {
-    int idx= (int)pvTimerGetTimerID(xTimer);
-    auto& cb= instance->callbacks[idx];
-    if(cb) {
-        cb();
-    }
+    TickType_t next= instance->wheel.run(xTaskGetTickCount());
+    if(next == UINT32_MAX) return; // nothing attached
+
+    // we are in the timer task so do not block
+    xTimerChangePeriod(xTimer, next == 0 ? 1 : next, 0);
 }
 
 SlowTicker::SlowTicker()
 {}
 
 SlowTicker::~SlowTicker()
-{}
+{
+    if(timer != nullptr) {
+        xTimerDelete(timer, 1000);
+    }
+}
 
 bool SlowTicker::start()
 {
-    // start all timers
-    for(auto i : timers) {
-        if(xTimerStart(i, 1000) != pdPASS ) {
+    if(timer == nullptr) {
+        timer= xTimerCreate("SlowTicker", 1, pdFALSE, nullptr, timer_handler);
+        if(timer == NULL) {
+            printf("ERROR: SlowTicker failed to create timer\n");
+            return false;
+        }
+    }
+
+    TickType_t first= wheel.start(xTaskGetTickCount());
+    if(first != UINT32_MAX) {
+        // changing the period also starts the timer
+        if(xTimerChangePeriod(timer, first, 1000) != pdPASS ) {
             // The timer could not be set into the Active state
-            printf("ERROR: Failed to start the timer: %s\n", pcTimerGetName(i));
+            printf("ERROR: Failed to start the timer: %s\n", pcTimerGetName(timer));
             return false;
         }
     }
+
+    printf("DEBUG: SlowTicker started with %u periods\n", wheel.get_slot_count());
     started= true;
     return true;
 }
 
 bool SlowTicker::stop()
 {
-    int cnt= 0;
-    for(auto i : timers) {
-        ++cnt;
-        if(xTimerStop(i, 1000) != pdPASS ) {
-            // The timer could not be set into the Active state
-            printf("ERROR: Failed to stop the timer: %s\n", pcTimerGetName(i));
-            return false;
-        }
+    if(timer != nullptr && xTimerStop(timer, 1000) != pdPASS ) {
+        printf("ERROR: Failed to stop the timer: %s\n", pcTimerGetName(timer));
+        return false;
     }
     started= false;
     return true;
 }
 
 // WARNING attach can only be called when timers have not yet been started
-// TODO if we need to do this then we need to make sure a timer cannot fire while we update callbacks and timers
+// TODO if we need to do this then we need to make sure the timer cannot fire while we update the wheel
 int SlowTicker::attach(uint32_t frequency, std::function<void(void)> cb)
 {
     if(started) {
@@ -87,19 +94,15 @@ int SlowTicker::attach(uint32_t frequency, std::function<void(void)> cb)
         return -1;
     }
 
-    uint32_t interval= 1000/frequency;
-    uint32_t n= callbacks.size();
-    char buf[32];
-    snprintf(buf, sizeof(buf), "SlowTicker%lu", n);
-    TimerHandle_t timer_handle= xTimerCreate(buf, pdMS_TO_TICKS(interval), pdTRUE, (void *)n, timer_handler);
-    if(timer_handle == NULL) {
-        printf("ERROR: SlowTicker failed to create timer\n");
+    if(frequency == 0 || frequency > MAX_FREQUENCY) {
+        printf("ERROR: SlowTicker frequency %luHz out of range\n", frequency);
         return -1;
     }
-    timers.push_back(timer_handle);
-    callbacks.push_back(cb);
 
-    printf("DEBUG: SlowTicker %lu added freq: %luHz, period: %lums\n", n, frequency, interval);
+    uint32_t interval= 1000/frequency;
+    int n= wheel.add(pdMS_TO_TICKS(interval), cb);
+
+    printf("DEBUG: SlowTicker %d added freq: %luHz, period: %lums\n", n, frequency, interval);
 
     // return the index it is in
     return n;
@@ -107,20 +110,10 @@ int SlowTicker::attach(uint32_t frequency, std::function<void(void)> cb)
 
 void SlowTicker::detach(int n)
 {
-    // TODO need to remove it but that would change all the indexes
-    // For now we just zero the handle
+    // the callback is just cleared so the indexes do not change
     if(started) {
         printf("WARNING: Cannot deattach a slowtimer when timers are running\n");
-
     }
 
-    TimerHandle_t timer_handle= timers[n];
-    if(timer_handle != nullptr) {
-        if(xTimerStop(timer_handle, 1000) != pdPASS) {
-            printf("ERROR: Failed to stop the timer %d\n", n);
-        }
-        xTimerDelete(timer_handle, 1000);
-        timers[n]= nullptr;
-        callbacks[n]= nullptr;
-    }
+    wheel.remove(n);
 }
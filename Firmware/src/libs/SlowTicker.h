@@ -5,6 +5,8 @@
 #include <functional>
 #include <cstdint>
 
+#include "TimerWheel.h"
+
 class SlowTicker
 {
     public:
@@ -28,7 +30,7 @@ class SlowTicker
         SlowTicker();
         virtual ~SlowTicker();
         static void timer_handler(void *xTimer);
-        std::vector<void *> timers;
-        std::vector<std::function<void(void)>> callbacks;
+        void *timer{nullptr};
+        TimerWheel wheel;
         bool started{false};
 };
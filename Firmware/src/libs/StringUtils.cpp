@@ -130,4 +130,32 @@ std::string get_command_arguments(std::string& line )
     line = line.substr( pos + 1);
     return t.substr(0, pos);
 }
+
+// decode base64 into out, stops at the first = or end of string, returns number of bytes or -1 if invalid or too long
+int base64_decode(const char *in, uint8_t *out, size_t max)
+{
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (const char *p = in; *p != '\0' && *p != '='; ++p) {
+        int v;
+        char c = *p;
+        if(c >= 'A' && c <= 'Z') v = c - 'A';
+        else if(c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if(c >= '0' && c <= '9') v = c - '0' + 52;
+        else if(c == '+') v = 62;
+        else if(c == '/') v = 63;
+        else return -1;
+
+        acc = (acc << 6) | v;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            if(n >= max) return -1;
+            out[n++] = (acc >> bits) & 0xFF;
+        }
+    }
+
+    return n;
+}
 }
@@ -1,5 +1,6 @@
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 namespace stringutils {
     std::vector<std::string> split(const char *str, const char *sep);
@@ -11,4 +12,5 @@ namespace stringutils {
     std::string toUpper(std::string str);
     std::string trim(const std::string &s);
     std::string get_command_arguments(std::string& line);
+    int base64_decode(const char *in, uint8_t *out, size_t max);
 }
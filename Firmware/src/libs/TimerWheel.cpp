@@ -0,0 +1,60 @@
+#include "TimerWheel.h"
+
+int TimerWheel::add(uint32_t period, callback_t cb)
+{
+    if(period == 0) period = 1;
+
+    int id = callbacks.size();
+    callbacks.push_back(cb);
+
+    for(auto& s : slots) {
+        if(s.period == period) {
+            s.ids.push_back(id);
+            return id;
+        }
+    }
+
+    slots.push_back({period, period, {id}});
+    return id;
+}
+
+void TimerWheel::remove(int id)
+{
+    // the ids must not change so just clear the callback
+    if(id >= 0 && id < (int)callbacks.size()) {
+        callbacks[id] = nullptr;
+    }
+}
+
+uint32_t TimerWheel::start(uint32_t now)
+{
+    uint32_t next = UINT32_MAX;
+    for(auto& s : slots) {
+        s.due = now + s.period;
+        if(s.period < next) next = s.period;
+    }
+    return next;
+}
+
+uint32_t TimerWheel::run(uint32_t now)
+{
+    uint32_t next = UINT32_MAX;
+    for(auto& s : slots) {
+        if((int32_t)(now - s.due) >= 0) {
+            for(int id : s.ids) {
+                if(callbacks[id]) callbacks[id]();
+            }
+
+            s.due += s.period;
+            if((int32_t)(now - s.due) >= 0) {
+                // we were late by more than a period, skip the ones we missed but stay aligned with the other slots
+                s.due += ((now - s.due) / s.period + 1) * s.period;
+            }
+        }
+
+        uint32_t d = s.due - now;
+        if(d < next) next = d;
+    }
+
+    return next;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Runs periodic callbacks from a single timer.
+// Callbacks with the same period share a slot and are run together, and as all the slots start together callbacks
+// whose periods are multiples of each other are also run on the same wakeup.
+// run() is called when the timer fires and returns how long until it is next needed, so the timer only wakes when
+// something is due rather than ticking at the fastest rate.
+// Times are in whatever units the caller uses (eg RTOS ticks), it has no RTOS dependencies so it can be tested on the host.
+class TimerWheel
+{
+public:
+    using callback_t = std::function<void(void)>;
+
+    // returns the id of the callback
+    int add(uint32_t period, callback_t cb);
+    void remove(int id);
+
+    // all slots are aligned to now, returns the time until the first is due
+    uint32_t start(uint32_t now);
+    // runs all the callbacks that are due, returns the time until the next is due or UINT32_MAX if there are none
+    uint32_t run(uint32_t now);
+
+    size_t get_slot_count() const { return slots.size(); }
+
+private:
+    using slot_t = struct {
+        uint32_t period;
+        uint32_t due;
+        std::vector<int> ids;
+    };
+    std::vector<slot_t> slots;
+    std::vector<callback_t> callbacks;
+};
@@ -1242,7 +1242,7 @@ int main(const char *infile, const char *outfile, std::function<void(char)> outf
 		return 1;
 	}
 
-	const size_t bufsz= 132;
+	const size_t bufsz= 128; // must be a power of two
 	char *buffer= (char *)malloc(bufsz);
 	inbuf.allocate(buffer, bufsz);
 	if(!inbuf.is_ok()) {
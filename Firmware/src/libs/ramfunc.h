@@ -0,0 +1,4 @@
+#pragma once
+
+// places a function in ram so it runs without flash wait states, used for the code called from the step ISR
+#define _ramfunc_ __attribute__ ((section(".ramfunctions"),long_call,noinline))
@@ -0,0 +1,42 @@
+#include "ringbuffer_c.h"
+#include "RingBuffer.h"
+
+struct ringbuffer_c {
+    RingBuffer<uint8_t> rb;
+    uint8_t *buffer;
+};
+
+RingBuffer_t *CreateRingBuffer(size_t size)
+{
+    RingBuffer_t *r = new RingBuffer_t;
+    r->buffer = (uint8_t *)malloc(size);
+    r->rb.allocate(r->buffer, size);
+    return r;
+}
+
+void DeleteRingBuffer(RingBuffer_t *r)
+{
+    r->rb.deallocate();
+    free(r->buffer);
+    delete r;
+}
+
+bool RingBufferEmpty(RingBuffer_t *r)
+{
+    return r->rb.empty();
+}
+
+bool RingBufferFull(RingBuffer_t *r)
+{
+    return r->rb.full();
+}
+
+bool RingBufferPut(RingBuffer_t *r, uint8_t value)
+{
+    return r->rb.push(value);
+}
+
+bool RingBufferGet(RingBuffer_t *r, uint8_t *value)
+{
+    return r->rb.pop(*value);
+}
@@ -4,11 +4,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
-typedef struct {
-    size_t size;
-    uint8_t *buffer;
-    size_t rindex, windex;
-} RingBuffer_t;
+// C interface to a RingBuffer<uint8_t>, see RingBuffer.h
+// size is rounded down to a power of two
+typedef struct ringbuffer_c RingBuffer_t;
 
 #ifdef __cplusplus
  extern "C" {
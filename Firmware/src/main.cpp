@@ -13,6 +13,7 @@
 #include "FastTicker.h"
 #include "GCode.h"
 #include "GCodeProcessor.h"
+#include "KVStore.h"
 #include "KillButton.h"
 #include "Laser.h"
 #include "MessageQueue.h"
@@ -23,8 +24,10 @@
 #include "Planner.h"
 #include "Player.h"
 #include "Pwm.h"
+#include "QSPIFlash.h"
 #include "RingBuffer.h"
 #include "Robot.h"
+#include "SigmaDeltaPwm.h"
 #include "SlowTicker.h"
 #include "StepTicker.h"
 #include "StringUtils.h"
@@ -40,6 +43,7 @@
 #include "semphr.h"
 
 #include "uart_debug.h"
+#include "sd_cache.h"
 #include "benchmark_timer.h"
 
 #include <stdio.h>
@@ -197,6 +201,26 @@ extern "C" bool setup_sdmmc();
 static FATFS fatfs; /* File system object */
 extern bool config_override;
 
+KVStore *kvstore = nullptr;
+
+// values saved in the store as config:section.key override the ones in config.ini
+static void config_overrides(const char *section, ConfigReader::section_map_t& config)
+{
+    std::string prefix = std::string("config:") + section + ".";
+    std::vector<std::string> keys;
+    kvstore->for_each([&keys, &prefix](const std::string& key, uint32_t len) {
+        if(key.compare(0, prefix.size(), prefix) == 0) keys.push_back(key);
+        return true;
+    });
+
+    for(auto& k : keys) {
+        std::string v;
+        if(kvstore->get(k.c_str(), v)) {
+            config[k.substr(prefix.size())] = v;
+        }
+    }
+}
+
 static void smoothie_startup(void *)
 {
     printf("INFO: Smoothie V2 Build for %s - starting up\n", BUILD_TARGET);
@@ -229,6 +253,22 @@ static void smoothie_startup(void *)
     bool ok = false;
     bool adcok= false;
 
+#ifndef BOARD_NUCLEO
+    {
+        // the key/value store is mounted first as it can override the config
+        static QSPIFlash qspi_kv(QSPI_KV_START);
+        kvstore = new KVStore(qspi_kv, QSPI_SECTOR_SIZE, QSPI_KV_SECTORS);
+        if(kvstore->mount()) {
+            printf("INFO: qspi key/value store mounted with %lu keys\n", kvstore->get_key_count());
+            ConfigReader::set_override(config_overrides);
+        } else {
+            printf("WARNING: qspi key/value store could not be mounted\n");
+            delete kvstore;
+            kvstore = nullptr;
+        }
+    }
+#endif
+
     // open the config file
     do {
         if(!setup_sdmmc()) {
@@ -244,6 +284,9 @@ static void smoothie_startup(void *)
             break;
         }
 
+        // line the read ahead cache up with the clusters
+        sd_cache_set_geometry(&sd_cache, fatfs.database, fatfs.csize, 0);
+
         std::fstream fs;
         fs.open("/sd/config.ini", std::fstream::in);
         if(!fs.is_open()) {
@@ -280,6 +323,13 @@ static void smoothie_startup(void *)
                     printf("INFO: Step pulse set to %d us\n", unsteptime);
                 }
 
+                if(cr.get_bool(sm, "adaptive_step_frequency", false)) {
+                    float minf = cr.get_float(sm, "min_step_frequency", 10000);
+                    if(step_ticker->set_adaptive(true, minf)) {
+                        printf("INFO: Adaptive step frequency enabled, %1.0f Hz to %1.0f Hz\n", minf, step_ticker->get_frequency());
+                    }
+                }
+
                 std::string p = cr.get_string(sm, "aux_play_led", "nc");
                 aux_play_led = new Pin(p.c_str(), Pin::AS_OUTPUT);
                 if(!aux_play_led->connected()) {
@@ -288,6 +338,19 @@ static void smoothie_startup(void *)
                 } else {
                     printf("INFO: auxilliary play led set to %s\n", aux_play_led->to_string().c_str());
                 }
+                int ovs = cr.get_int(sm, "adc_oversample", 8);
+                if(Adc::set_oversample(ovs)) {
+                    printf("INFO: ADC oversample set to %d\n", ovs);
+                }
+                std::string sdm = cr.get_string(sm, "sigma_delta_mode", "software");
+                SigmaDeltaPwm::MODE sdmode;
+                if(SigmaDeltaPwm::mode_from_string(sdm.c_str(), sdmode)) {
+                    SigmaDeltaPwm::set_mode(sdmode);
+                    printf("INFO: sigma delta mode is %s\n", sdm.c_str());
+                } else {
+                    printf("WARNING: unknown sigma_delta_mode %s, using software\n", sdm.c_str());
+                }
+
                 flash_on_boot = cr.get_bool(sm, "flash_on_boot", true);
                 printf("INFO: flash on boot is %s\n", flash_on_boot ? "enabled" : "disabled");
                 bool enable_dfu = cr.get_bool(sm, "dfu_enable", false);
@@ -450,6 +513,11 @@ static void smoothie_startup(void *)
             printf("ERROR: Pwm::post_config_setup failed\n");
         }
 
+        // start the DMA for any sigma delta outputs using it, must be before the FastTicker is started
+        if(!SigmaDeltaPwm::post_config_setup()) {
+            printf("ERROR: SigmaDeltaPwm::post_config_setup failed\n");
+        }
+
         {
             // setup fet enable
             // global enable pin for all fets
@@ -568,7 +636,7 @@ static void smoothie_startup(void *)
     if(ok && config_override) {
         OutputStream os(&std::cout);
         if(load_config_override(os)) {
-            os.printf("INFO: configuration override %s loaded\n", DEFAULT_OVERRIDE_FILE);
+            os.printf("INFO: configuration override %s loaded\n", get_config_override_location());
 
         } else {
             os.printf("INFO: No saved configuration override\n");
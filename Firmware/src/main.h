@@ -4,6 +4,7 @@
 #include <cstdint>
 
 class OutputStream;
+class KVStore;
 
 using StartupFunc_t = std::function<void()>;
 void register_startup(StartupFunc_t sf);
@@ -17,4 +18,7 @@ float get_voltage_monitor(const char* name);
 int get_voltage_monitor_names(const char *names[]);
 extern uint8_t board_id;
 
+// the key/value store in qspi flash, nullptr if there is not one
+extern KVStore *kvstore;
+
 #define TICKS2MS( xTicks ) ( ((xTicks) * 1000.0F) / configTICK_RATE_HZ )
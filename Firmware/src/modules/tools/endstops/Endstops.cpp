@@ -27,6 +27,7 @@
 #define scara_homing_key "scara_homing"
 
 #define debounce_ms_key "debounce_ms"
+#define stallguard_blank_ms_key "stallguard_blank_ms"
 
 #define home_z_first_key "home_z_first"
 #define homing_order_key "homing_order"
@@ -45,6 +46,7 @@
 #define max_travel_key "max_travel"
 #define retract_key "retract"
 #define limit_key "limit_enable"
+#define stallguard_threshold_key "stallguard_threshold"
 
 #define STEPPER Robot::getInstance()->actuators
 #define STEPS_PER_MM(a) (STEPPER[a]->get_steps_per_mm())
@@ -140,11 +142,24 @@ bool Endstops::load_endstops(ConfigReader& cr)
         if(!cr.get_bool(mm, "enable", false)) continue;
 
         endstop_info_t *pin_info = new endstop_info_t;
-        if(!pin_info->pin.from_string(cr.get_string(mm, pin_key, "nc")) || !pin_info->pin.as_input() || !pin_info->pin.connected()) {
+        std::string pin = cr.get_string(mm, pin_key, "nc");
+        if(pin == "stallguard") {
+            // a virtual endstop that triggers when the StallGuard value read from the driver drops to the threshold, it falls as the load rises
+#ifdef DRIVER_TMC
+            pin_info->stallguard = true;
+            pin_info->stall_threshold = cr.get_int(mm, stallguard_threshold_key, 50);
+#else
+            printf("ERROR: configure-endstop: stallguard needs TMC drivers for %s\n", name.c_str());
+            delete pin_info;
+            continue;
+#endif
+        } else if(!pin_info->pin.from_string(pin) || !pin_info->pin.as_input() || !pin_info->pin.connected()) {
             // no pin defined try next
             printf("ERROR: configure-endstop: no pin defined or illegal pin for %s\n", name.c_str());
             delete pin_info;
             continue;
+        } else {
+            pin_info->stallguard = false;
         }
 
         std::string axis = cr.get_string(mm, axis_key, "");
@@ -175,9 +190,17 @@ bool Endstops::load_endstops(ConfigReader& cr)
         pin_info->axis_index = a;
         pin_info->home = false;
 
+        pin_info->moving_ms = 0;
+
         // are limits enabled
         pin_info->limit_enable = cr.get_bool(mm, limit_key, false);
+        if(pin_info->stallguard && pin_info->limit_enable) {
+            // the load is only read quickly enough while homing
+            printf("WARNING: configure-endstop: %s is stallguard so cannot be a limit\n", name.c_str());
+            pin_info->limit_enable = false;
+        }
         limit_enabled |= pin_info->limit_enable;
+        stallguard_enabled |= pin_info->stallguard;
 
         // enter into endstop array
         endstops.push_back(pin_info);
@@ -289,6 +312,7 @@ bool Endstops::load_endstops(ConfigReader& cr)
         auto& mm = s->second; // map of common endstop config settings
 
         this->debounce_ms = cr.get_float(mm, debounce_ms_key, 0); // 0 means no debounce
+        this->stallguard_blank_ms = cr.get_int(mm, stallguard_blank_ms_key, 100);
 
         this->is_corexy = cr.get_bool(mm, corexy_homing_key, false);
         this->is_delta =  cr.get_bool(mm, delta_homing_key, false);
@@ -326,6 +350,7 @@ bool Endstops::load_endstops(ConfigReader& cr)
         printf("WARNING: configure-endstop: no common settings found. Using defaults\n");
         // set defaults
         this->debounce_ms = 0;
+        this->stallguard_blank_ms = 100;
         this->is_corexy = false;
         this->is_delta =  false;
         this->is_rdelta = false;
@@ -357,8 +382,14 @@ void Endstops::read_endstops()
         if(is_corexy && (m == X_AXIS || m == Y_AXIS) && !axis_to_home[m]) continue;
 
         if(STEPPER[m]->is_moving()) {
+            if(e.pin_info->stallguard && e.pin_info->moving_ms < stallguard_blank_ms) {
+                // the load reads high until the motor is up to speed so it is ignored at the start of the move
+                e.pin_info->moving_ms += 10;
+                continue;
+            }
+
             // if it is moving then we check the associated endstop, and debounce it
-            if(e.pin_info->pin.get()) {
+            if(get_endstop(e.pin_info)) {
                 if(e.pin_info->debounce < debounce_ms) {
                     e.pin_info->debounce += 10; // as each iteration is 10ms
 
@@ -384,12 +415,34 @@ void Endstops::read_endstops()
                 // The endstop was not hit yet
                 e.pin_info->debounce = 0;
             }
+
+        } else {
+            e.pin_info->moving_ms = 0;
         }
     }
 
+#ifdef DRIVER_TMC
+    // read the load of all the drivers in the background ready for the next time
+    if(stallguard_enabled && StepperMotor::get_vmot()) StepperMotor::poll_drivers();
+#endif
+
     return;
 }
 
+// returns true if the endstop is triggered, for stallguard this is when the StallGuard value is at or under the threshold
+bool Endstops::get_endstop(endstop_info_t *e)
+{
+    if(!e->stallguard) return e->pin.get();
+
+#ifdef DRIVER_TMC
+    // the StallGuard2 value goes down as the load goes up
+    int load = STEPPER[e->axis_index]->get_load();
+    return load >= 0 && load <= e->stall_threshold;
+#else
+    return false;
+#endif
+}
+
 // this is called from read endstops every 10ms if limits are enabled
 void Endstops::check_limits()
 {
@@ -548,6 +601,7 @@ void Endstops::home(axis_bitmap_t a)
     // reset debounce counts for all endstops
     for(auto& e : endstops) {
         e->debounce = 0;
+        e->moving_ms = 0;
         e->triggered = false;
     }
 
@@ -999,14 +1053,18 @@ bool Endstops::handle_mcode(GCode& gcode, OutputStream& os)
                 if(h.pin_info == nullptr) continue; // not a configured homing endstop
                 std::string name;
                 name.append(1, h.axis).append(h.home_direction ? "_min" : "_max");
-                os.printf("%s:%d ", name.c_str(), h.pin_info->pin.get());
+                os.printf("%s:%d ", name.c_str(), get_endstop(h.pin_info));
             }
             os.printf("pins- ");
             for(auto& p : endstops) {
                 std::string str(1, p->axis);
                 if(p->home) str.append(":H");
                 if(p->limit_enable) str.append(":L");
-                os.printf("(%s)%s ", str.c_str(), p->pin.to_string().c_str());
+                if(p->stallguard) {
+                    os.printf("(%s)stallguard:%d ", str.c_str(), p->stall_threshold);
+                } else {
+                    os.printf("(%s)%s ", str.c_str(), p->pin.to_string().c_str());
+                }
             }
         }
         break;
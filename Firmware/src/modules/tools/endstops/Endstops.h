@@ -40,14 +40,18 @@ class Endstops : public Module
 
         // global settings
         uint32_t debounce_ms;
+        uint16_t stallguard_blank_ms;
         axis_bitmap_t axis_to_home;
 
         float trim_mm[3];
         bool limit_enabled{false};
+        bool stallguard_enabled{false};
 
         // per endstop settings
         using endstop_info_t = struct {
             Pin pin;
+            uint16_t stall_threshold; // StallGuard2 value at or below which it is triggered
+            uint16_t moving_ms; // how long the motor has been moving for, the load is not checked until it is up to speed
             struct {
                 uint16_t debounce:16;
                 char axis:8; // one of XYZABC
@@ -55,6 +59,7 @@ class Endstops : public Module
                 bool limit_enable:1;
                 bool triggered:1;
                 bool home:1;
+                bool stallguard:1; // a virtual endstop triggered by the motor load rather than a pin
             };
         };
 
@@ -76,6 +81,8 @@ class Endstops : public Module
             };
         };
 
+        bool get_endstop(endstop_info_t *e);
+
         // array of endstops
         std::vector<endstop_info_t *> endstops;
 
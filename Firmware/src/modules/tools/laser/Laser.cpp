@@ -12,8 +12,13 @@
 #include "GCode.h"
 #include "OutputStream.h"
 #include "StringUtils.h"
+#include "Planner.h"
+#include "main.h"
+#include "MessageQueue.h"
+#include "ramfunc.h"
 
 #include <algorithm>
+#include <math.h>
 
 #define enable_key "enable"
 #define pwm_pin_key "pwm_pin"
@@ -24,6 +29,12 @@
 #define maximum_s_value_key "maximum_s_value"
 #define default_power_key "default_power"
 #define proportional_power_key "proportional_power"
+#define raster_buffers_key "raster_buffers"
+#define power_update_interval_key "power_update_interval"
+
+// maximum number of pixels in a single G7 raster line, lines from the consoles and the player are all limited to
+// MAX_LINE_LENGTH - 1 characters, so after the "G7 D" and base64 encoding (4 characters for 3 pixels) about 90 pixels fit
+#define MAX_RASTER_PIXELS (((MAX_LINE_LENGTH - 4) / 4) * 3)
 
 REGISTER_MODULE(Laser, Laser::create)
 
@@ -94,20 +105,45 @@ bool Laser::configure(ConfigReader& cr)
     Robot::getInstance()->set_s_value(cr.get_float(m, default_power_key, 0.8F));
     disable_auto_power= !cr.get_bool(m, proportional_power_key, true);
 
+    // update the power from the step ticker as the speed changes, 0 polls at the rate below instead
+    float power_update_interval = cr.get_float(m, power_update_interval_key, 0); // microseconds, off by default
+    step_sync = power_update_interval > 0;
+    if(step_sync) {
+        StepTicker::getInstance()->set_speed_update_interval(power_update_interval);
+        StepTicker::getInstance()->speed_fnc = std::bind(&Laser::set_speed_power, this, std::placeholders::_1);
+    }
+
     set_laser_power(0);
 
+    // buffers for the raster lines that are queued, each raster line uses one until it has been executed
+    n_rasters = cr.get_int(m, raster_buffers_key, 8);
+    if(n_rasters > 0) {
+        rasters = new RasterData[n_rasters];
+        raster_pixels = new uint8_t[MAX_RASTER_PIXELS];
+        for (int i = 0; i < n_rasters; ++i) {
+            rasters[i].pulse = new uint16_t[MAX_RASTER_PIXELS];
+            rasters[i].len = 0;
+            rasters[i].in_use = false;
+        }
+        StepTicker::getInstance()->raster_fnc = std::bind(&Laser::set_raster_power, this, std::placeholders::_1);
+    }
+
     // register command handlers
     using std::placeholders::_1;
     using std::placeholders::_2;
 
     THEDISPATCHER->add_handler( "fire", std::bind( &Laser::handle_fire_cmd, this, _1, _2) );
+    if(n_rasters > 0) {
+        // G7 violates the gcode spec so is handled as a command, see Consoles
+        THEDISPATCHER->add_handler( "g7", std::bind( &Laser::handle_raster_cmd, this, _1, _2) );
+    }
     THEDISPATCHER->add_handler(Dispatcher::MCODE_HANDLER, 221, std::bind(&Laser::handle_M221, this, _1, _2));
 
     // no point in updating the power more than the PWM frequency, but no more than 1KHz
     uint32_t pwm_freq = pwm_pin->get_frequency();
     uint32_t f = std::min(1000UL, pwm_freq);
     if(f >= FastTicker::get_min_frequency()) {
-        if(FastTicker::getInstance()->attach(f, std::bind(&Laser::set_proportional_power, this)) < 0) {
+        if(FastTicker::getInstance()->attach(f, std::bind(&Laser::set_proportional_power, this), "laser_power", FastTicker::PRIO_HIGH) < 0) {
             printf("ERROR: configure-laser: Fast Ticker was not set (Too slow?)\n");
             return false;
         }
@@ -184,6 +220,128 @@ bool Laser::handle_fire_cmd( std::string& params, OutputStream& os )
     return true;
 }
 
+// G7 [X..] [Y..] [F..] [S..] D<base64 pixels>
+// a raster line, a G1 move with the laser power set for each pixel as it is reached, pixels are 0-255 scaled by S
+bool Laser::handle_raster_cmd( std::string& params, OutputStream& os )
+{
+    HELP("G7 [X Y F S] Dbase64 - raster move with a power for each pixel, the whole line must fit in 131 characters");
+
+    if(Module::is_halted()) {
+        os.printf("ignored while in ALARM state\n");
+        return true;
+    }
+
+    // the move is passed on as a G1 with everything except the pixel data
+    GCode gc;
+    gc.set_command('G', 1);
+    const char *pixels = nullptr;
+    std::vector<std::string> args = stringutils::split(params.c_str(), ' ');
+    for(auto& a : args) {
+        if(a.size() < 2) continue;
+        char c = toupper(a[0]);
+        if(c == 'D') {
+            pixels = a.c_str() + 1;
+        } else if(c >= 'A' && c <= 'Z') {
+            gc.add_arg(c, strtof(a.c_str() + 1, nullptr));
+        }
+    }
+
+    if(pixels == nullptr) {
+        os.printf("error:G7 needs D pixel data\n");
+        return true;
+    }
+
+    RasterData *r = get_raster_buffer();
+    if(r == nullptr) return true; // halted while waiting
+
+    int n = stringutils::base64_decode(pixels, raster_pixels, MAX_RASTER_PIXELS);
+    if(n <= 0) {
+        r->in_use = false;
+        os.printf("error:G7 pixel data is invalid or more than %d pixels\n", MAX_RASTER_PIXELS);
+        return true;
+    }
+
+    // work out the PWM pulse for each pixel now so the step ISR only has to set it
+    // S is the one the G1 will use, rounded to the 1.11 fixed point the block stores it in
+    float s = gc.has_arg('S') ? gc.get_arg('S') : Robot::getInstance()->get_s_value();
+    s = (float)((uint16_t)roundf(s * (1 << 11)) & 0x0FFF) / (1 << 11);
+    float gain = (s / laser_maximum_s_value) * scale / 255.0F;
+    uint32_t period = pwm_pin->get_period();
+    for (int i = 0; i < n; ++i) {
+        uint16_t pulse = 0;
+        if(raster_pixels[i] > 0) {
+            float power = ((laser_maximum_power - laser_minimum_power) * gain * raster_pixels[i]) + laser_minimum_power;
+            if(power > 1) power = 1;
+            if(power > 0.00001F) pulse = std::max(1L, lroundf(period * power));
+        }
+        r->pulse[i] = pulse;
+    }
+    r->len = n;
+
+    // the planner attaches it to the block for this move
+    Planner::getInstance()->set_raster(r);
+    THEDISPATCHER->dispatch(gc, os, false);
+
+    if(Planner::getInstance()->get_raster() == r) {
+        // no move was queued
+        Planner::getInstance()->set_raster(nullptr);
+        r->in_use = false;
+    }
+
+    return true;
+}
+
+// find a free raster buffer, if they are all queued wait for one to finish
+RasterData *Laser::get_raster_buffer()
+{
+    while(!Module::is_halted()) {
+        for (int i = 0; i < n_rasters; ++i) {
+            if(!rasters[i].in_use) {
+                rasters[i].in_use = true;
+                return &rasters[i];
+            }
+        }
+        safe_sleep(1);
+    }
+
+    return nullptr;
+}
+
+// called from the step ISR when a raster move reaches the next pixel, the pulse was worked out in handle_raster_cmd()
+_ramfunc_ void Laser::set_raster_power(uint16_t pulse)
+{
+    if(manual_fire) return;
+
+    uint32_t period = pwm_pin->get_period();
+    if(pulse > 0) {
+        pwm_pin->set_pulse(this->pwm_inverting ? period - pulse : pulse);
+        if(!laser_on && this->ttl_used) this->ttl_pin->set(true);
+        laser_on = true;
+
+    } else {
+        pwm_pin->set_pulse(this->pwm_inverting ? period : 0);
+        if (this->ttl_used) this->ttl_pin->set(false);
+        laser_on = false;
+    }
+}
+
+// called from the step ISR when the speed changes with the speed as a fraction of the nominal speed in 16.16 fixed point
+_ramfunc_ void Laser::set_speed_power(uint32_t ratio)
+{
+    if(manual_fire) return;
+
+    const Block *block = StepTicker::getInstance()->get_current_block();
+    if(block == nullptr || !block->is_g123) {
+        if(laser_on) set_laser_power(0);
+        return;
+    }
+
+    float requested_power = ((float)block->s_value / (1 << 11)) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
+    float power = requested_power * scale;
+    if(!disable_auto_power) power *= (ratio / 65536.0F);
+    set_laser_power(( (this->laser_maximum_power - this->laser_minimum_power) * power ) + this->laser_minimum_power);
+}
+
 // returns instance
 bool Laser::request(const char *key, void *value)
 {
@@ -222,20 +380,9 @@ bool Laser::handle_M221(GCode& gcode, OutputStream& os)
 // calculates the current speed ratio from the currently executing block
 float Laser::current_speed_ratio(const Block *block) const
 {
-    // find the primary moving actuator (the one with the most steps)
-    size_t pm = 0;
-    uint32_t max_steps = 0;
-    for (size_t i = 0; i < Robot::getInstance()->get_number_registered_motors(); i++) {
-        // find the motor with the most steps
-        if(block->steps[i] > max_steps) {
-            max_steps = block->steps[i];
-            pm = i;
-        }
-    }
-
-    // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
+    // figure out the ratio of the speed of the primary motor (the one with the most steps), from 0 to 1 based on where it is on the trapezoid,
     // this is based on the fraction it is of the requested rate (nominal rate)
-    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
+    float ratio = block->get_trapezoid_rate(block->primary_motor) / block->nominal_rate;
 
     return ratio;
 }
@@ -247,7 +394,7 @@ bool Laser::get_laser_power(float& power) const
 
     // Note to avoid a race condition where the block is being cleared we check the is_ready flag which gets cleared first,
     // as this is an interrupt if that flag is not clear then it cannot be cleared while this is running and the block will still be valid (albeit it may have finished)
-    if(block != nullptr && block->is_ready && block->is_g123) {
+    if(block != nullptr && block->is_ready && block->is_g123 && block->raster == nullptr) {
         float requested_power = ((float)block->s_value / (1 << 11)) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
         float ratio = 1.0F;
         if(!disable_auto_power) { // true to disable auto power
@@ -279,6 +426,11 @@ void Laser::set_proportional_power(void)
         return;
     }
 
+    // the step ISR sets the power when it is synchronized and for raster moves
+    if(step_sync) return;
+    const Block *block = StepTicker::getInstance()->get_current_block();
+    if(block != nullptr && block->is_ready && block->raster != nullptr) return;
+
     float power;
     if(get_laser_power(power)) {
         // adjust power to maximum power and actual velocity
@@ -317,6 +469,11 @@ void Laser::on_halt(bool flg)
     if(flg) {
         set_laser_power(0);
         manual_fire = false;
+        // the queue is flushed so none of the raster data is in use anymore
+        Planner::getInstance()->set_raster(nullptr);
+        for (int i = 0; i < n_rasters; ++i) {
+            rasters[i].in_use = false;
+        }
     }
 }
 
@@ -11,6 +11,7 @@ class Block;
 class ConfigReader;
 class GCode;
 class OutputStream;
+struct RasterData;
 
 class Laser : public Module
 {
@@ -31,6 +32,10 @@ class Laser : public Module
         void on_halt(bool flg);
         bool handle_M221(GCode& gcode, OutputStream& os);
         bool handle_fire_cmd( std::string& params, OutputStream& os );
+        bool handle_raster_cmd( std::string& params, OutputStream& os );
+        RasterData *get_raster_buffer();
+        void set_raster_power(uint16_t pulse);
+        void set_speed_power(uint32_t ratio);
 
         void set_proportional_power(void);
         bool get_laser_power(float& power) const;
@@ -44,6 +49,9 @@ class Laser : public Module
         float scale;
         int32_t fire_duration; // manual fire command duration
         int32_t ms_per_tick; // ms between calls to set_proportional_power
+        RasterData *rasters{nullptr}; // raster lines waiting in the planner queue
+        uint8_t *raster_pixels{nullptr}; // the decoded G7 pixels before they are turned into PWM pulses
+        uint8_t n_rasters{0};
 
         struct {
             bool laser_on:1;      // set if the laser is on
@@ -52,5 +60,6 @@ class Laser : public Module
             bool ttl_inverting:1;   // stores whether the TTL output should be inverted
             bool manual_fire:1;     // set when manually firing
             bool disable_auto_power:1; // true to disable auto power
+            bool step_sync:1;       // set when the power is updated from the step ISR
         };
 };
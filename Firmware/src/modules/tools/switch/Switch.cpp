@@ -484,6 +484,17 @@ bool Switch::request(const char *key, void *value)
 
     } else if(strcmp(key, "is_output") == 0) {
         return is_output();
+
+    } else if(strcmp(key, "fraction") == 0) {
+        // how much the output is on 0-1, eg fan speed
+        if(!is_output()) return false;
+        float f = switch_state ? 1.0F : 0.0F;
+        if(output_type == SIGMADELTA && sigmadelta_pin->get_pwm() >= 0) {
+            f = sigmadelta_pin->get_pwm() / 255.0F;
+        } else if (output_type == HWPWM) {
+            f = pwm_pin->get();
+        }
+        *(float*)value = f;
     }
 
     return true;
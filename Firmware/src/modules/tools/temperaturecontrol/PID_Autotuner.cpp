@@ -1,5 +1,6 @@
 #include "PID_Autotuner.h"
 #include "TemperatureControl.h"
+#include "ThermalModel.h"
 #include "SigmaDeltaPwm.h"
 #include "OutputStream.h"
 #include "GCode.h"
@@ -47,6 +48,13 @@ void PID_Autotuner::start(GCode& gcode, OutputStream& os)
                 nLookBack = gcode.get_arg('L') * 20;
             }
 
+            // A1 fits the thermal model for model predictive control instead
+            if (gcode.has_arg('A') && gcode.get_int_arg('A') == 1) {
+                os.printf("%s: Starting thermal model fit, control X aborts\n", temp_control->get_designator());
+                this->run_model(os, target);
+                return;
+            }
+
             os.printf("%s: Starting PID Autotune, %d max cycles, control X aborts\n", temp_control->get_designator(), ncycles);
 
             this->run_auto_pid(os, target, ncycles);
@@ -198,6 +206,180 @@ void PID_Autotuner::run_auto_pid(OutputStream& os, float target, int ncycles)
 }
 
 
+/**
+ * Fits the thermal model, first from a full power heat up to the target, then the losses are refined from the average
+ * power needed to hold the target, and then again with the fan on if there is one.
+ */
+void PID_Autotuner::run_model(OutputStream& os, float target)
+{
+    ThermalModel *model = temp_control->model;
+    ThermalModel::params_t old_params = model->get_params();
+    bool old_use_mpc = temp_control->use_mpc;
+    float power = old_params.heater_power;
+    if(power <= 0) {
+        os.printf("ERROR: mpc_heater_power must be set to the heater wattage to fit the thermal model\n");
+        abort();
+        return;
+    }
+
+    float ambient = temp_control->get_temperature();
+    if(std::isinf(ambient) || std::isnan(ambient) || ambient >= target - 20) {
+        os.printf("ERROR: Heater must start cool, at least 20°C below the target\n");
+        abort();
+        return;
+    }
+
+    temp_control->use_mpc = false;
+    temp_control->heater_pin->set(false);
+    temp_control->target_temperature = 0.0;
+
+    // heat up at full power recording the temperature, if the buffer fills every other sample is dropped
+    const int max_samples = 2048;
+    float *temps = new float[max_samples];
+    int n = 0;
+    int every = 5; // 4 times a second
+    uint32_t start = xTaskGetTickCount();
+    uint32_t last = start;
+    temps[n++] = ambient;
+
+    os.printf("// Heating to %5.1f at full power\n", target);
+    temp_control->heater_pin->pwm(temp_control->heater_pin->max_pwm());
+    tickCnt = 0;
+    bool ok = false;
+    while(true) {
+        safe_sleep(50);
+        tickCnt += 50;
+
+        if(temp_control->is_halted()) {
+            os.printf("Thermal model fit aborted\n");
+            break;
+        }
+
+        float t = temp_control->get_temperature();
+        if(std::isinf(t) || std::isnan(t)) {
+            os.printf("ERROR: Bad temperature\n");
+            break;
+        }
+
+        if((tickCnt / 50) % every == 0) {
+            if(n == max_samples) {
+                for (int i = 0; i < n / 2; ++i) temps[i] = temps[i * 2];
+                n /= 2;
+                every *= 2;
+            }
+            temps[n++] = t;
+            last = xTaskGetTickCount();
+        }
+
+        if(t >= target) {
+            ok = true;
+            break;
+        }
+
+        if ((tickCnt % 5000) == 0) {
+            os.printf("// Thermal model fit - %5.1f/%5.1f\n", t, target);
+        }
+
+        if(tickCnt > 30 * 60 * 1000) {
+            os.printf("ERROR: Target was not reached in 30 minutes\n");
+            break;
+        }
+    }
+    temp_control->heater_pin->set(false);
+
+    // the heat up was at max_pwm which may not be full power
+    ThermalModel::params_t p = old_params;
+    float dt = TICKS2MS(last - start) / 1000.0F / (n - 1);
+    if(ok) {
+        ok = ThermalModel::fit_heatup(temps, n, dt, power * temp_control->heater_pin->max_pwm() / 255.0F, p);
+        if(!ok) os.printf("ERROR: Unable to fit the heat up, check the heater and sensor\n");
+    }
+    delete[] temps;
+
+    if(ok) {
+        p.heater_power = power;
+        p.fan_loss = 0;
+        os.printf("// Heat up fitted, heat capacity %1.3f, holding temperature to measure the losses\n", p.heat_capacity);
+
+        // hold the target with the model to get the power needed to hold it
+        model->set_params(p);
+        model->set_fan(0);
+        temp_control->use_mpc = true;
+        temp_control->set_desired_temperature(target);
+        float output, temperature;
+        ok = hold(os, 90, output, temperature);
+        if(ok) {
+            p.ambient_loss = ThermalModel::steady_loss(p, output, temperature);
+
+            Module *fan = temp_control->fan_module;
+            if(fan != nullptr) {
+                bool on = true;
+                fan->request("set-state", &on);
+                os.printf("// Holding temperature with the fan on to measure the fan loss\n");
+                model->set_params(p);
+                float fraction = 0;
+                ok = hold(os, 90, output, temperature) && fan->request("fraction", &fraction);
+                on = false;
+                fan->request("set-state", &on);
+                if(ok && fraction > 0) {
+                    p.fan_loss = (ThermalModel::steady_loss(p, output, temperature) - p.ambient_loss) / fraction;
+                    if(p.fan_loss < 0) p.fan_loss = 0;
+                }
+            }
+        }
+    }
+
+    if(!ok) {
+        model->set_params(old_params);
+        temp_control->use_mpc = old_use_mpc;
+        abort();
+        return;
+    }
+
+    model->set_params(p);
+    os.printf("\tHeater power: %1.1f W\n\tHeat capacity: %1.3f J/K\n\tAmbient loss: %1.4f W/K\n\tFan loss: %1.4f W/K\n\tSensor lag: %1.2f s\n",
+              p.heater_power, p.heat_capacity, p.ambient_loss, p.fan_loss, p.sensor_lag);
+    os.printf("\tM306 S%d P%1.4f C%1.4f H%1.4f F%1.4f L%1.4f E1\n", temp_control->tool_id, p.heater_power, p.heat_capacity, p.ambient_loss, p.fan_loss, p.sensor_lag);
+    os.printf("Thermal model fit complete! Model predictive control is now in use, the settings above have been loaded into memory, but not written to your config file.\n");
+
+    abort();
+}
+
+// holds the target for secs seconds and returns the average heater output and temperature over the last third
+bool PID_Autotuner::hold(OutputStream& os, int secs, float& output, float& temperature)
+{
+    int n = secs * 20;
+    int cnt = 0;
+    float sum_o = 0, sum_t = 0;
+    for (int i = 0; i < n; ++i) {
+        safe_sleep(50);
+        if(temp_control->is_halted() || temp_control->target_temperature <= 0) {
+            os.printf("Thermal model fit aborted\n");
+            return false;
+        }
+
+        float t = temp_control->get_temperature();
+        if(std::isinf(t) || std::isnan(t)) {
+            os.printf("ERROR: Bad temperature\n");
+            return false;
+        }
+
+        if(i >= n * 2 / 3) {
+            sum_o += temp_control->o / 255.0F;
+            sum_t += t;
+            ++cnt;
+        }
+
+        if((i % 100) == 0) {
+            os.printf("// Thermal model fit - %5.1f/%5.1f @%d\n", t, temp_control->target_temperature, temp_control->o);
+        }
+    }
+
+    output = sum_o / cnt;
+    temperature = sum_t / cnt;
+    return true;
+}
+
 void PID_Autotuner::finishUp(OutputStream& os)
 {
     //we can generate tuning parameters!
@@ -18,6 +18,8 @@ public:
 
 private:
     void run_auto_pid(OutputStream& os, float target, int ncycles);
+    void run_model(OutputStream& os, float target);
+    bool hold(OutputStream& os, int secs, float& output, float& temperature);
     void finishUp(OutputStream& os);
     void abort();
 
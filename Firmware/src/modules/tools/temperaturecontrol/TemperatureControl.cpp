@@ -9,6 +9,7 @@
 #include "Dispatcher.h"
 #include "main.h"
 #include "PID_Autotuner.h"
+#include "ThermalModel.h"
 #include "Consoles.h"
 
 #include <math.h>
@@ -42,6 +43,15 @@
 #define d_factor_key "d_factor"
 #define ponm_key "use_ponm"
 
+#define mpc_key "use_mpc"
+#define mpc_heater_power_key "mpc_heater_power"
+#define mpc_heat_capacity_key "mpc_heat_capacity"
+#define mpc_ambient_loss_key "mpc_ambient_loss"
+#define mpc_fan_loss_key "mpc_fan_loss"
+#define mpc_sensor_lag_key "mpc_sensor_lag"
+#define mpc_horizon_key "mpc_horizon"
+#define mpc_fan_switch_key "mpc_fan_switch"
+
 #define i_max_key "i_max"
 #define windup_key "windup"
 
@@ -59,12 +69,14 @@ TemperatureControl::TemperatureControl(const char *name) : Module("temperature c
     sensor = nullptr;
     readonly = false;
     active = false;
+    use_mpc = false;
 }
 
 TemperatureControl::~TemperatureControl()
 {
     delete sensor;
     delete heater_pin;
+    delete model;
 }
 
 bool TemperatureControl::load_controls(ConfigReader& cr)
@@ -214,8 +226,8 @@ bool TemperatureControl::configure(ConfigReader& cr, ConfigReader::section_map_t
     // runaway timer
     SlowTicker::getInstance()->attach(1, std::bind(&TemperatureControl::check_runaway, this));
 
-    // sensor reading tick, needs to be ISR based as it is critical
-    FastTicker::getInstance()->attach(this->readings_per_second, std::bind(&TemperatureControl::thermistor_read_tick, this));
+    // sensor reading tick, needs to be ISR based as it is critical, but being slow it can wait a tick if others are busy
+    FastTicker::getInstance()->attach(this->readings_per_second, std::bind(&TemperatureControl::thermistor_read_tick, this), get_instance_name(), FastTicker::PRIO_LOW);
     this->PIDdt = 1.0 / this->readings_per_second;
 
     // PID
@@ -228,6 +240,23 @@ bool TemperatureControl::configure(ConfigReader& cr, ConfigReader::section_map_t
     if(!this->readonly) {
         // set to the same as max_pwm by default
         this->i_max = cr.get_float(m, i_max_key, this->heater_pin->max_pwm());
+
+        // thermal model for model predictive control, the heater power must be given, the rest is fitted by M303 A1
+        model = new ThermalModel();
+        ThermalModel::params_t p = model->get_params();
+        p.heater_power = cr.get_float(m, mpc_heater_power_key, 0);
+        p.heat_capacity = cr.get_float(m, mpc_heat_capacity_key, 0);
+        p.ambient_loss = cr.get_float(m, mpc_ambient_loss_key, 0);
+        p.fan_loss = cr.get_float(m, mpc_fan_loss_key, 0);
+        p.sensor_lag = cr.get_float(m, mpc_sensor_lag_key, 0);
+        model->set_params(p);
+        model->set_horizon(cr.get_float(m, mpc_horizon_key, 2));
+        // the switch that controls the part cooling fan, so its cooling can be allowed for
+        fan_switch = cr.get_string(m, mpc_fan_switch_key, "");
+        use_mpc = cr.get_bool(m, mpc_key, false);
+        if(use_mpc && !model->is_valid()) {
+            printf("WARNING: configure-temperature: %s thermal model is not set, using PID until it is fitted with M303 A1\n", name);
+        }
     }
 
     this->iTerm = 0.0;
@@ -247,6 +276,7 @@ bool TemperatureControl::configure(ConfigReader& cr, ConfigReader::section_map_t
         Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, 143, std::bind(&TemperatureControl::handle_mcode, this, _1, _2));
         Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, 301, std::bind(&TemperatureControl::handle_mcode, this, _1, _2));
         Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, 303, std::bind(&TemperatureControl::handle_autopid, this, _1, _2));
+        Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, 306, std::bind(&TemperatureControl::handle_mcode, this, _1, _2));
         Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, 500, std::bind(&TemperatureControl::handle_mcode, this, _1, _2));
 
         Dispatcher::getInstance()->add_handler(Dispatcher::MCODE_HANDLER, set_m_code, std::bind(&TemperatureControl::handle_mcode, this, _1, _2));
@@ -338,7 +368,7 @@ bool TemperatureControl::handle_mcode(GCode & gcode, OutputStream & os)
             return true;
 
         } else if(!gcode.has_arg('S')) {
-            os.printf("%s(S%d): using %s - active: %d", this->designator.c_str(), this->tool_id, this->readonly ? "Readonly" : this->use_bangbang ? "Bangbang" : "PID", active);
+            os.printf("%s(S%d): using %s - active: %d", this->designator.c_str(), this->tool_id, this->readonly ? "Readonly" : this->use_bangbang ? "Bangbang" : (use_mpc && model->is_valid()) ? "MPC" : "PID", active);
             if(!readonly) {
                 os.printf(", %s\n", heater_pin->to_string().c_str());
             } else {
@@ -399,11 +429,47 @@ bool TemperatureControl::handle_mcode(GCode & gcode, OutputStream & os)
 
         return true;
 
+    } else if (gcode.get_code() == 306) {
+        ThermalModel::params_t& p = model->get_params();
+        if (gcode.has_arg('S') && (gcode.get_int_arg('S') == this->tool_id)) {
+            if (gcode.has_arg('P'))
+                p.heater_power = gcode.get_arg('P');
+            if (gcode.has_arg('C'))
+                p.heat_capacity = gcode.get_arg('C');
+            if (gcode.has_arg('H'))
+                p.ambient_loss = gcode.get_arg('H');
+            if (gcode.has_arg('F'))
+                p.fan_loss = gcode.get_arg('F');
+            if (gcode.has_arg('L'))
+                p.sensor_lag = gcode.get_arg('L');
+            if (gcode.has_arg('R'))
+                model->set_horizon(gcode.get_arg('R'));
+            if (gcode.has_arg('E')) {
+                bool e = gcode.get_arg('E') == 1;
+                if(e && !use_mpc) model->reset(last_reading);
+                use_mpc = e;
+            }
+            if(use_mpc && !model->is_valid()) {
+                os.printf("WARNING: thermal model is not set, using PID until it is fitted with M303 A1\n");
+            }
+
+        } else if(!gcode.has_arg('S')) {
+            os.printf("%s(S%d): MPC: %d P(power): %g C(capacity): %g H(ambient loss): %g F(fan loss): %g L(sensor lag): %g R(horizon): %g ambient: %g\n",
+                      this->designator.c_str(), this->tool_id, this->use_mpc, p.heater_power, p.heat_capacity, p.ambient_loss, p.fan_loss, p.sensor_lag, model->get_horizon(), model->get_ambient());
+        }
+
+        return true;
+
     } else if (gcode.get_code() == 500) { // M500 saves some volatile settings to config override file
         os.printf(";PID settings, i_max, max_pwm, PonM:\nM301 S%d P%1.4f I%1.4f D%1.4f X%1.4f Y%d Z%d\n", this->tool_id, this->p_factor, this->i_factor / this->PIDdt, this->d_factor * this->PIDdt, this->i_max, this->heater_pin->max_pwm(), this->ponm);
 
         os.printf(";Max temperature setting:\nM143 S%d P%1.4f\n", this->tool_id, this->max_temp);
 
+        if(model->is_valid()) {
+            const ThermalModel::params_t& p = model->get_params();
+            os.printf(";Thermal model, enable:\nM306 S%d P%1.4f C%1.4f H%1.4f F%1.4f L%1.4f R%1.4f E%d\n", this->tool_id, p.heater_power, p.heat_capacity, p.ambient_loss, p.fan_loss, p.sensor_lag, model->get_horizon(), this->use_mpc);
+        }
+
         if(this->sensor_settings) {
             // get or save any sensor specific optional values
             TempSensor::sensor_options_t options;
@@ -515,6 +581,7 @@ void TemperatureControl::set_desired_temperature(float desired_temperature)
 
     } else if(last_target_temperature <= 0.0F) {
         // if it was off and we are now turning it on we need to initialize
+        if(model != nullptr) model->reset(last_reading);
         this->lastInput = last_reading;
         // set to whatever the output currently is See http://brettbeauregard.com/blog/2011/04/improving-the-beginner%E2%80%99s-pid-initialization/
         this->iTerm = this->o;
@@ -579,6 +646,11 @@ void TemperatureControl::pid_process(float temperature)
         return;
     }
 
+    if(use_mpc && model->is_valid()) {
+        mpc_process(temperature);
+        return;
+    }
+
     // PID control
     if(ponm) {
         // Proportional on Measurement from http://brettbeauregard.com/blog/2017/06/introducing-proportional-on-measurement/
@@ -629,11 +701,34 @@ void TemperatureControl::pid_process(float temperature)
     }
 }
 
+// model predictive control, the cost is the same every tick
+void TemperatureControl::mpc_process(float temperature)
+{
+    if(fan_module != nullptr) {
+        float f;
+        if(fan_module->request("fraction", &f)) model->set_fan(f);
+    }
+
+    model->set_max_output(heater_pin->max_pwm() / 255.0F);
+    float u = model->control(temperature, target_temperature, PIDdt);
+    this->o = lroundf(u * 255);
+    heater_pin->pwm(this->o);
+}
+
 // called every second
 void TemperatureControl::check_runaway()
 {
     if(is_halted()) return;
 
+    if(!fan_switch.empty() && fan_module == nullptr) {
+        // switches are created after us so find the fan here
+        fan_module = Module::lookup("switch", fan_switch.c_str());
+        if(fan_module == nullptr) {
+            printf("WARNING: %s mpc_fan_switch %s not found\n", designator.c_str(), fan_switch.c_str());
+            fan_switch.clear();
+        }
+    }
+
     if(temp_violated) {
         char error_msg[132];
         snprintf(error_msg, sizeof(error_msg), "ERROR: MINTEMP or MAXTEMP triggered on %s. Check your temperature sensors!\nHALT asserted - reset or M999 required\n", designator.c_str());
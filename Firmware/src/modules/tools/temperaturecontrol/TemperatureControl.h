@@ -10,6 +10,7 @@ class SigmaDeltaPwm;
 class GCode;
 class OutputStream;
 class Pin;
+class ThermalModel;
 
 class TemperatureControl : public Module
 {
@@ -42,6 +43,7 @@ private:
 
     void thermistor_read_tick(void);
     void pid_process(float);
+    void mpc_process(float);
     void setPIDp(float p);
     void setPIDi(float i);
     void setPIDd(float d);
@@ -74,6 +76,10 @@ private:
     float d_factor;
     float PIDdt;
 
+    // model predictive control
+    ThermalModel *model{nullptr};
+    std::string fan_switch;
+    Module *fan_module{nullptr};
 
     enum RUNAWAY_TYPE {NOT_HEATING, HEATING_UP, COOLING_DOWN, TARGET_TEMPERATURE_REACHED};
 
@@ -99,6 +105,7 @@ private:
         bool windup: 1;
         bool sensor_settings: 1;
         bool ponm:1;
+        bool use_mpc:1;
     };
 };
 
@@ -0,0 +1,137 @@
+#include "ThermalModel.h"
+
+#include <math.h>
+
+// how much of the difference between the measured and modeled temperature is corrected each tick
+#define OBSERVER_GAIN 0.1F
+// how fast (per second) the correction is moved into the ambient temperature when holding, to remove any steady state error
+#define AMBIENT_RATE 0.2F
+// the model is restarted from the measured temperature if it is out by more than this
+#define RESYNC_ERROR 10.0F
+
+ThermalModel::ThermalModel()
+{
+    params = {0, 0, 0, 0, 0, 25};
+    horizon = 2;
+    ambient = params.ambient_temp;
+    fan = 0;
+    max_output = 1;
+    reset(ambient);
+}
+
+void ThermalModel::reset(float temperature)
+{
+    block = sensor = temperature;
+    last_output = 0;
+}
+
+void ThermalModel::step(float& tb, float& ts, float u, float dt) const
+{
+    float loss = (params.ambient_loss + params.fan_loss * fan) * (tb - ambient);
+    tb += (params.heater_power * u - loss) * dt / params.heat_capacity;
+    if(params.sensor_lag > dt) {
+        ts += (tb - ts) * dt / params.sensor_lag;
+    } else {
+        ts = tb;
+    }
+}
+
+// NOTE this is called from an ISR
+float ThermalModel::control(float measured, float target, float dt)
+{
+    // predict where we should be now from the last output, then correct the model by what was measured
+    step(block, sensor, last_output, dt);
+    float k = params.ambient_loss + params.fan_loss * fan;
+    float err = measured - sensor;
+    if(fabsf(err) > RESYNC_ERROR) {
+        block = sensor = measured;
+
+    } else {
+        float c = err * OBSERVER_GAIN;
+        block += c;
+        sensor += c;
+        // when holding temperature the correction is down to the losses being wrong,
+        // so move the ambient temperature by what would have caused it
+        if(k > 0 && last_output > 0 && last_output < max_output && fabsf(target - measured) < 1.0F) {
+            ambient += c * params.heat_capacity * AMBIENT_RATE / k;
+        }
+    }
+
+    // the power needed for the block to reach the target by the end of the horizon
+    float u;
+    if(k > 0) {
+        float e = expf(-horizon * k / params.heat_capacity);
+        float tss = (target - block * e) / (1.0F - e);
+        u = k * (tss - ambient) / params.heater_power;
+    } else {
+        u = params.heat_capacity * (target - block) / (horizon * params.heater_power);
+    }
+
+    if(u > max_output) u = max_output;
+    else if(u < 0.0F) u = 0.0F;
+
+    last_output = u;
+    return u;
+}
+
+bool ThermalModel::fit_heatup(const float *temps, int n, float dt, float heater_power, params_t& p)
+{
+    if(dt <= 0 || heater_power <= 0) return false;
+
+    // slopes are taken over a one second window to reduce the noise
+    int w = lroundf(0.5F / dt);
+    if(w < 1) w = 1;
+    if(n < 8 * w) return false;
+
+    // find the maximum slope, the heater is then fully heating the sensor
+    float smax = 0;
+    int imax = 0;
+    for (int i = w; i < n - w; ++i) {
+        float s = (temps[i + w] - temps[i - w]) / (2 * w * dt);
+        if(s > smax) {
+            smax = s;
+            imax = i;
+        }
+    }
+    if(smax <= 0) return false;
+
+    // the sensor lag is where the tangent at the maximum slope crosses the starting temperature
+    float ambient = temps[0];
+    float lag = imax * dt - (temps[imax] - ambient) / smax;
+    if(lag < 0) lag = 0;
+
+    // from there on fit slope = a - b (Tb - Ta) with the block temperature estimated from the lagging sensor
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int cnt = 0;
+    for (int i = imax; i < n - w; ++i) {
+        float s = (temps[i + w] - temps[i - w]) / (2 * w * dt);
+        float x = temps[i] + lag * s - ambient;
+        sx += x;
+        sy += s;
+        sxx += x * x;
+        sxy += x * s;
+        ++cnt;
+    }
+
+    double var = cnt * sxx - sx * sx;
+    if(cnt < 2 * w || var <= 0) return false;
+
+    double b = -(cnt * sxy - sx * sy) / var;
+    double a = (sy + b * sx) / cnt;
+    if(a <= 0) return false;
+    if(b < 0) b = 0;
+
+    p.heater_power = heater_power;
+    p.heat_capacity = heater_power / a;
+    p.ambient_loss = b * p.heat_capacity;
+    p.sensor_lag = lag;
+    p.ambient_temp = ambient;
+    return true;
+}
+
+float ThermalModel::steady_loss(const params_t& p, float output, float temperature)
+{
+    float d = temperature - p.ambient_temp;
+    if(d <= 0) return 0;
+    return p.heater_power * output / d;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Thermal model of a heater used for model predictive control.
+//
+// The heater block is modeled as a single heat capacity
+//     C dTb/dt = P u - (H + F fan) (Tb - Ta)
+// and the sensor lags behind the block with a first order lag
+//     dTs/dt = (Tb - Ts) / L
+// where u is the heater output (0-1) and fan is the part cooling fan speed (0-1).
+//
+// Each tick the model is advanced and corrected by the measured temperature, then the heater power is chosen
+// so the estimated block temperature will reach the target at the end of the horizon, which does not overshoot
+// as the block does not have to wait for the sensor to catch up. The cost is the same every tick.
+// It has no hardware dependencies so it can be tested on the host against a simulated heater.
+class ThermalModel
+{
+public:
+    using params_t = struct {
+        float heater_power;     // W at full output
+        float heat_capacity;    // J/K
+        float ambient_loss;     // W/K
+        float fan_loss;         // extra W/K with the fan at full speed
+        float sensor_lag;       // seconds
+        float ambient_temp;     // °C
+    };
+
+    ThermalModel();
+
+    void set_params(const params_t& p) { params = p; ambient = p.ambient_temp; }
+    const params_t& get_params() const { return params; }
+    params_t& get_params() { return params; }
+    bool is_valid() const { return params.heater_power > 0 && params.heat_capacity > 0 && params.ambient_loss >= 0; }
+
+    void set_horizon(float h) { horizon = h; }
+    float get_horizon() const { return horizon; }
+    void set_fan(float f) { fan = f; }
+    // limits the heater output, eg when max_pwm is less than full power
+    void set_max_output(float m) { max_output = m; }
+    float get_ambient() const { return ambient; }
+    float get_block_temperature() const { return block; }
+
+    // start tracking from the given temperature with the heater off
+    void reset(float temperature);
+    // called each tick with the measured temperature, returns the heater output 0-1
+    float control(float measured, float target, float dt);
+    // advances block and sensor temperature by dt with heater output u, used to simulate the heater too
+    void step(float& tb, float& ts, float u, float dt) const;
+
+    // fits the model from a full power heat up sampled every dt seconds, starting at ambient
+    // heater_power is needed to scale the results, returns false if the data can not be fitted
+    static bool fit_heatup(const float *temps, int n, float dt, float heater_power, params_t& p);
+    // the loss in W/K to hold temperature with the given average heater output
+    static float steady_loss(const params_t& p, float output, float temperature);
+
+private:
+    params_t params;
+    float horizon;
+    float block, sensor;
+    float ambient;          // adapted to remove steady state error
+    float fan;
+    float max_output;
+    float last_output;
+};
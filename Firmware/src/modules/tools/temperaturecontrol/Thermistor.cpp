@@ -25,6 +25,8 @@
 #define rt_curve_key       "rt_curve"
 #define coefficients_key   "coefficients"
 #define use_beta_table_key "use_beta_table"
+#define adc_filter_key     "adc_filter"
+#define adc_alpha_key      "adc_filter_alpha"
 
 
 Thermistor::Thermistor()
@@ -123,6 +125,15 @@ bool Thermistor::configure(ConfigReader& cr, ConfigReader::section_map_t& m, con
         return false;
     }
 
+    // how the ADC samples are filtered, median rejects spikes, iir smooths more
+    std::string filter = cr.get_string(m, adc_filter_key, "average");
+    AdcFilter::TYPE ft;
+    if(!AdcFilter::type_from_string(filter.c_str(), ft)) {
+        printf("WARNING: config-thermistor: unknown adc_filter %s, using average\n", filter.c_str());
+        ft = AdcFilter::AVERAGE;
+    }
+    thermistor_pin->set_filter(ft, cr.get_float(m, adc_alpha_key, 0.1F));
+
     // specify the three Steinhart-Hart coefficients
     // specified as three comma separated floats, no spaces
     std::string coef = cr.get_string(m, coefficients_key, "");
@@ -55,12 +55,24 @@
         before_probe_gcode M280
         after_probe_gcode M281
 
+    With an analog distance sensor (eg an inductive or eddy current sensor with a voltage output) the bed can be scanned
+    continuously instead of probing each point. The probe is moved along a serpentine path at probe_height while the
+    sensor is sampled against the current position of the motors, the samples are accumulated into a dense height map which
+    is then resampled into the grid.
+        scan_adc_pin       ADC1_2   # the ADC the sensor is connected to, enables continuous scanning
+        scan_mm_per_volt   1.0      # change in distance to the bed per volt, negative if the voltage rises as the bed gets closer
+        scan_resolution    2        # size in mm of each cell of the dense height map
+        scan_feedrate      50       # speed in mm/sec of the scan moves
+        scan_line_spacing  0        # distance between scan lines in Y, 0 is one scan line through each row of grid points
+        continuous_scan    false    # set to true to make G32 scan by default
+
     Usage
     -----
     G29 test probes a rectangle which defaults to the width and height, can be overidden with Xnnn and Ynnn
 
     G32 probes the grid and turns the compensation on, this will remain in effect until reset or M561/M370
         optional parameters {{Xn}} {{Yn}} sets the size for this rectangular probe, which gets saved with M375
+        S1 scans the bed continuously, S0 probes each point
 
 
     M370 clears the grid and turns off compensation
@@ -68,6 +80,7 @@
     M374.1 delete /sd/cartesian.grid
     M375 Load the grid from /sd/cartesian.grid and enable compensation
     M375.1 display the current grid
+    M375.2 Load the grid from QSPI flash (flashed with qspi flash /sd/cartesian.grid) and enable compensation
     M561 clears the grid and turns off compensation
     M565 defines the probe offsets from the nozzle or tool head
 
@@ -89,10 +102,18 @@
 #include "StringUtils.h"
 #include "OutputStream.h"
 #include "Consoles.h"
+#include "FastTicker.h"
+#include "HeightMap.h"
+#include "Adc.h"
+#include "ActuatorCoordinates.h"
+#include "MeshFile.h"
+#include "MemoryPool.h"
+#include "qspi.h"
 
 #include <string>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <math.h>
 
@@ -111,6 +132,12 @@
 #define dampening_start_key "dampening_start"
 #define before_probe_gcode_key "before_probe_gcode"
 #define after_probe_gcode_key "after_probe_gcode"
+#define scan_adc_pin_key "scan_adc_pin"
+#define scan_mm_per_volt_key "scan_mm_per_volt"
+#define scan_resolution_key "scan_resolution"
+#define scan_feedrate_key "scan_feedrate"
+#define scan_line_spacing_key "scan_line_spacing"
+#define continuous_scan_key "continuous_scan"
 
 #define GRIDFILE "/sd/cartesian.grid"
 
@@ -125,7 +152,11 @@ CartGridStrategy::CartGridStrategy(ZProbe *zprb) : ZProbeStrategy(zprb)
 
 CartGridStrategy::~CartGridStrategy()
 {
-    if(grid != nullptr) free(grid);
+    if(grid != nullptr) {
+        if(_SRAM_1->has(grid)) DeallocSRAM_1(grid);
+        else free(grid);
+    }
+    delete scan_adc;
 }
 
 bool CartGridStrategy::configure(ConfigReader& cr)
@@ -136,8 +167,12 @@ bool CartGridStrategy::configure(ConfigReader& cr)
         return false;
     }
 
-    this->current_grid_x_size = this->configured_grid_x_size = cr.get_float(m, grid_x_size_key, 7);
-    this->current_grid_y_size = this->configured_grid_y_size = cr.get_float(m, grid_y_size_key, 7);
+    this->current_grid_x_size = this->configured_grid_x_size = cr.get_int(m, grid_x_size_key, 7);
+    this->current_grid_y_size = this->configured_grid_y_size = cr.get_int(m, grid_y_size_key, 7);
+    if(configured_grid_x_size < 2 || configured_grid_y_size < 2) {
+        printf("configure-cart-grid: Invalid config, grid_x_size and grid_y_size must be at least 2\n");
+        return false;
+    }
     tolerance = cr.get_float(m, tolerance_key, 0.03F);
     save = cr.get_bool(m, save_key, false);
     do_home = cr.get_bool(m, do_home_key, true);
@@ -178,8 +213,34 @@ bool CartGridStrategy::configure(ConfigReader& cr)
     this->before_probe = cr.get_string(m, before_probe_gcode_key, "");
     this->after_probe = cr.get_string(m, after_probe_gcode_key, "");
 
-    // allocate
-    grid = (float *)malloc(configured_grid_x_size * configured_grid_y_size * sizeof(float));
+    // an analog distance sensor allows the bed to be scanned continuously
+    std::string scan_pin = cr.get_string(m, scan_adc_pin_key, "nc");
+    if(scan_pin != "nc") {
+        scan_adc = new Adc(scan_pin.c_str());
+        if(!scan_adc->is_valid()) {
+            printf("ERROR: configure-cart-grid: scan ADC channel is invalid: %s\n", scan_pin.c_str());
+            delete scan_adc;
+            scan_adc = nullptr;
+
+        } else {
+            // sample the sensor at the current position while scanning
+            if(FastTicker::getInstance()->attach(1000, std::bind(&CartGridStrategy::sample_scan, this), "bed_scan") < 0) {
+                printf("ERROR: configure-cart-grid: Fast Ticker was not set\n");
+                delete scan_adc;
+                scan_adc = nullptr;
+            }
+        }
+    }
+    this->scan_mm_per_volt = cr.get_float(m, scan_mm_per_volt_key, 1.0F);
+    this->scan_resolution = cr.get_float(m, scan_resolution_key, 2.0F);
+    this->scan_feedrate = cr.get_float(m, scan_feedrate_key, 50.0F);
+    this->scan_line_spacing = cr.get_float(m, scan_line_spacing_key, 0);
+    this->continuous_scan = scan_adc != nullptr && cr.get_bool(m, continuous_scan_key, false);
+
+    // allocate, large grids go in SRAM_1 so they do not use up the main heap
+    size_t grid_bytes = configured_grid_x_size * configured_grid_y_size * sizeof(float);
+    grid = (float *)AllocSRAM_1(grid_bytes);
+    if(grid == nullptr) grid = (float *)malloc(grid_bytes);
 
     if(grid == nullptr) {
         printf("configure-cart-grid: Not enough memory\n");
@@ -225,45 +286,33 @@ void CartGridStrategy::save_grid(OutputStream& os)
         os.printf("error:Failed to open grid file %s\n", GRIDFILE);
         return;
     }
-    uint8_t tmp_configured_grid_size = configured_grid_x_size;
-    if(fwrite(&tmp_configured_grid_size, sizeof(uint8_t), 1, fp) != 1) {
-        os.printf("error:Failed to write grid x size\n");
+
+    MeshHeader hdr;
+    meshfile::init_header(hdr, MESH_TYPE_CARTESIAN, configured_grid_x_size, configured_grid_y_size, x_start, y_start, x_size, y_size);
+    if(!meshfile::write(fp, hdr, grid)) {
+        os.printf("error:Failed to write grid\n");
         fclose(fp);
         return;
     }
 
-    tmp_configured_grid_size = configured_grid_y_size;
-    if(configured_grid_y_size != configured_grid_x_size){
-        if(fwrite(&tmp_configured_grid_size, sizeof(uint8_t), 1, fp) != 1) {
-            os.printf("error:Failed to write grid y size\n");
-            fclose(fp);
-            return;
-        }
-    }
+    os.printf("grid saved to %s\n", GRIDFILE);
+    fclose(fp);
+}
 
-    if(fwrite(&x_size, sizeof(float), 1, fp) != 1)  {
-        os.printf("error:Failed to write x_size\n");
-        fclose(fp);
-        return;
+// check a saved grid matches the current configuration
+bool CartGridStrategy::check_grid(uint16_t load_x_size, uint16_t load_y_size, float x, float y, OutputStream& os)
+{
+    if(load_x_size != configured_grid_x_size || load_y_size != configured_grid_y_size) {
+        os.printf("error:grid size is different read %d x %d - config %d x %d\n", load_x_size, load_y_size, configured_grid_x_size, configured_grid_y_size);
+        return false;
     }
 
-    if(fwrite(&y_size, sizeof(float), 1, fp) != 1)  {
-        os.printf("error:Failed to write y_size\n");
-        fclose(fp);
-        return;
+    if(x != x_size || y != y_size) {
+        os.printf("error:bed dimensions changed read (%f, %f) - config (%f,%f)\n", x, y, x_size, y_size);
+        return false;
     }
 
-    for (int y = 0; y < configured_grid_y_size; y++) {
-        for (int x = 0; x < configured_grid_x_size; x++) {
-            if(fwrite(&grid[x + (configured_grid_x_size * y)], sizeof(float), 1, fp) != 1) {
-                os.printf("error:Failed to write grid\n");
-                fclose(fp);
-                return;
-            }
-        }
-    }
-    os.printf("grid saved to %s\n", GRIDFILE);
-    fclose(fp);
+    return true;
 }
 
 bool CartGridStrategy::load_grid(OutputStream& os)
@@ -279,66 +328,66 @@ bool CartGridStrategy::load_grid(OutputStream& os)
         return false;
     }
 
-    uint8_t load_grid_x_size, load_grid_y_size;
-    float x, y;
-
-    if(fread(&load_grid_x_size, sizeof(uint8_t), 1, fp) != 1) {
-        os.printf("error:Failed to read grid size\n");
+    // read into a temporary buffer and check it there, the grid is only changed if it is valid
+    // like the grid it goes in SRAM_1 if it fits so a large grid does not need the same again from the main heap
+    size_t len = meshfile::size(configured_grid_x_size * configured_grid_y_size);
+    void *buf = AllocSRAM_1(len);
+    if(buf == nullptr) buf = malloc(len);
+    if(buf == nullptr) {
         fclose(fp);
+        os.printf("error:Not enough memory to load grid\n");
         return false;
     }
 
-    if(load_grid_x_size != configured_grid_x_size) {
-        os.printf("error:grid size x is different read %d - config %d\n", load_grid_x_size, configured_grid_x_size);
-        fclose(fp);
-        return false;
+    MeshHeader hdr;
+    const float *data = meshfile::read(fp, buf, len, hdr);
+    fclose(fp);
+    bool ok = false;
+    if(data == nullptr) {
+        os.printf("error:%s is not a valid grid or is corrupt, it needs to be probed and saved again\n", GRIDFILE);
+
+    } else if(hdr.type == MESH_TYPE_CARTESIAN && check_grid(hdr.x_points, hdr.y_points, hdr.x_size, hdr.y_size, os)) {
+        memcpy(grid, data, hdr.x_points * hdr.y_points * sizeof(float));
+        ok = true;
     }
 
-    load_grid_y_size = load_grid_x_size;
+    if(_SRAM_1->has(buf)) DeallocSRAM_1(buf);
+    else free(buf);
+    if(!ok) return false;
 
-    if(configured_grid_x_size != configured_grid_y_size){
-        if(fread(&load_grid_y_size, sizeof(uint8_t), 1, fp) != 1) {
-            os.printf("error:Failed to read grid size\n");
-            fclose(fp);
-            return false;
-        }
-
-        if(load_grid_y_size != configured_grid_y_size) {
-            os.printf("error:grid size y is different read %d - config %d\n", load_grid_y_size, configured_grid_x_size);
-            fclose(fp);
-            return false;
-        }
-    }
+    current_grid_x_size = hdr.x_points;
+    current_grid_y_size = hdr.y_points;
+    os.printf("grid loaded, grid: (%f, %f), size: %d x %d\n", x_size, y_size, current_grid_x_size, current_grid_y_size);
+    return true;
+}
 
-    if(fread(&x, sizeof(float), 1, fp) != 1) {
-        os.printf("error:Failed to read grid x size\n");
-        fclose(fp);
+// load the grid from QSPI flash where it was flashed with qspi flash /sd/cartesian.grid
+bool CartGridStrategy::load_grid_qspi(OutputStream& os)
+{
+    if(only_by_two_corners){
+        os.printf("error:Unable to load grid in only_by_two_corners mode\n");
         return false;
     }
 
-    if(fread(&y, sizeof(float), 1, fp) != 1) {
-        os.printf("error:Failed to read grid y size\n");
-        fclose(fp);
+    if(!qspi_mount()) {
+        os.printf("error:Failed to mount qspi\n");
         return false;
     }
 
-    if(x != x_size || y != y_size) {
-        os.printf("error:bed dimensions changed read (%f, %f) - config (%f,%f)\n", x, y, x_size, y_size);
-        fclose(fp);
+    MeshHeader hdr;
+    // it is flashed at the start of the qspi so must be below the job cache
+    const float *data = meshfile::check((const void *)QSPI_MAPPED_BASE, QSPI_JOB_START, hdr);
+    if(data == nullptr || hdr.type != MESH_TYPE_CARTESIAN) {
+        os.printf("error:No valid grid in qspi\n");
         return false;
     }
 
-    for (int yy = 0; yy < configured_grid_y_size; yy++) {
-        for (int xx = 0; xx < configured_grid_x_size; xx++) {
-            if(fread(&grid[xx + (configured_grid_x_size * yy)], sizeof(float), 1, fp) != 1) {
-                os.printf("error:Failed to read grid\n");
-                fclose(fp);
-                return false;
-            }
-        }
-    }
-    os.printf("grid loaded, grid: (%f, %f), size: %d x %d\n", x_size, y_size, load_grid_x_size, load_grid_y_size);
-    fclose(fp);
+    if(!check_grid(hdr.x_points, hdr.y_points, hdr.x_size, hdr.y_size, os)) return false;
+
+    memcpy(grid, data, hdr.x_points * hdr.y_points * sizeof(float));
+    current_grid_x_size = hdr.x_points;
+    current_grid_y_size = hdr.y_points;
+    os.printf("grid loaded from qspi, grid: (%f, %f), size: %d x %d\n", x_size, y_size, current_grid_x_size, current_grid_y_size);
     return true;
 }
 
@@ -477,6 +526,8 @@ bool CartGridStrategy::handle_mcode(GCode& gcode, OutputStream& os)
     } else if(gcode.get_code() == 375) { // M375: load grid, M375.1 display grid
         if(gcode.get_subcode() == 1) {
             print_bed_level(os);
+        } else if(gcode.get_subcode() == 2) {
+            if(load_grid_qspi(os)) setAdjustFunction(true);
         } else {
             if(load_grid(os)) setAdjustFunction(true);
         }
@@ -580,6 +631,13 @@ bool CartGridStrategy::doProbe(GCode& gcode, OutputStream& os)
         return false;
     }
 
+    bool scan = continuous_scan;
+    if(gcode.has_arg('S')) scan = gcode.get_int_arg('S') == 1;
+    if(scan && scan_adc == nullptr) {
+        os.printf("ERROR: Continuous scan needs a scan_adc_pin\n");
+        return false;
+    }
+
     setAdjustFunction(false);
     reset_bed_level();
 
@@ -601,6 +659,8 @@ bool CartGridStrategy::doProbe(GCode& gcode, OutputStream& os)
 
     os.printf("Probe start ht: %0.3f mm, start MCS x,y: %0.3f,%0.3f, rectangular bed width,height in mm: %0.3f,%0.3f, grid size: %dx%d\n", zprobe->getProbeHeight(), x_start, y_start, x_size, y_size, current_grid_x_size, current_grid_y_size);
 
+    if(scan) return doScan(os);
+
     // do first probe at start point
     float mm;
     if(!zprobe->doProbeAt(mm, this->x_start - X_PROBE_OFFSET_FROM_EXTRUDER, this->y_start - Y_PROBE_OFFSET_FROM_EXTRUDER)) return false;
@@ -632,7 +692,11 @@ bool CartGridStrategy::doProbe(GCode& gcode, OutputStream& os)
             }
 
             float measured_z = zprobe->getProbeHeight() - mm - z_reference; // this is the delta z from bed at 0,0
-            os.printf("DEBUG: X%1.3f, Y%1.3f, Z%1.3f\n", xProbe, yProbe, measured_z);
+            if(zprobe->getLastSampleCount() > 1) {
+                os.printf("DEBUG: X%1.3f, Y%1.3f, Z%1.3f, samples %d, sd %1.4f\n", xProbe, yProbe, measured_z, zprobe->getLastSampleCount(), zprobe->getLastDeviation());
+            } else {
+                os.printf("DEBUG: X%1.3f, Y%1.3f, Z%1.3f\n", xProbe, yProbe, measured_z);
+            }
             grid[xCount + (this->current_grid_x_size * yCount)] = measured_z;
             if(fabs(measured_z) > max_delta) max_delta= fabs(measured_z);
         }
@@ -645,6 +709,96 @@ bool CartGridStrategy::doProbe(GCode& gcode, OutputStream& os)
     return true;
 }
 
+// scan the bed continuously with an analog distance sensor, the probe is at probe_height above the bed at the start point
+bool CartGridStrategy::doScan(OutputStream& os)
+{
+    if(x_size < 0 || y_size < 0) {
+        os.printf("ERROR: Continuous scan needs a positive probe size\n");
+        return false;
+    }
+
+    HeightMap map;
+    if(!map.init(x_start, y_start, x_size, y_size, scan_resolution)) {
+        os.printf("ERROR: Not enough memory for a scan resolution of %1.3f mm\n", scan_resolution);
+        return false;
+    }
+
+    // one scan line through each row of grid points, or closer if a line spacing is set
+    float row_spacing = y_size / (current_grid_y_size - 1);
+    int lines = current_grid_y_size;
+    if(scan_line_spacing > 0 && scan_line_spacing < row_spacing) {
+        lines = ceilf(y_size / scan_line_spacing) + 1;
+    }
+    float line_spacing = y_size / (lines - 1);
+
+    // heights are relative to the start point which is where the reading is zero
+    scan_reference = read_scan_distance();
+    os.printf("Scanning %d lines at %1.1f mm/sec, reference distance %1.3f mm\n", lines, scan_feedrate, scan_reference);
+
+    // the ISR only looks at scan_map and scan_reference once it sees scanning set, so it is set last
+    scan_map = &map;
+    scanning.store(true, std::memory_order_release);
+
+    // serpentine path, the moves are queued so the probe moves continuously
+    for (int i = 0; i < lines && !Module::is_halted(); ++i) {
+        float y = y_start + line_spacing * i;
+        float xs = (i % 2) ? x_start + x_size : x_start;
+        float xe = (i % 2) ? x_start : x_start + x_size;
+        zprobe->move_xy(xs - X_PROBE_OFFSET_FROM_EXTRUDER, y - Y_PROBE_OFFSET_FROM_EXTRUDER, scan_feedrate, false, false);
+        zprobe->move_xy(xe - X_PROBE_OFFSET_FROM_EXTRUDER, y - Y_PROBE_OFFSET_FROM_EXTRUDER, scan_feedrate, false, false);
+    }
+    Conveyor::getInstance()->wait_for_idle();
+
+    scanning.store(false, std::memory_order_release);
+    scan_map = nullptr;
+
+    if(Module::is_halted()) return false;
+
+    // each grid point is from a linear fit of the samples around it
+    float radius = std::max(scan_resolution, line_spacing) * 0.75F;
+    int missing = map.resample(grid, current_grid_x_size, current_grid_y_size, radius);
+    os.printf("Scanned %lu samples into %dx%d bins\n", map.get_sample_count(), map.get_x_bins(), map.get_y_bins());
+    if(missing > 0) {
+        os.printf("ERROR: %d grid points have no samples, try a slower scan_feedrate\n", missing);
+        reset_bed_level();
+        return false;
+    }
+
+    float max_delta = 0;
+    for (int i = 0; i < current_grid_x_size * current_grid_y_size; ++i) {
+        if(fabs(grid[i]) > max_delta) max_delta = fabs(grid[i]);
+    }
+
+    print_bed_level(os);
+    os.printf("Maximum delta: %1.3f\n", max_delta);
+    setAdjustFunction(true);
+
+    return true;
+}
+
+float CartGridStrategy::read_scan_distance() const
+{
+    return scan_adc->read_voltage() * scan_mm_per_volt;
+}
+
+// called in an ISR context, adds a sample at the current probe position while scanning
+void CartGridStrategy::sample_scan()
+{
+    if(!scanning.load(std::memory_order_acquire)) return;
+
+    // the position the motors are actually at, not the position at the end of the move
+    Robot *robot = Robot::getInstance();
+    ActuatorCoordinates ac;
+    for (size_t i = X_AXIS; i <= Z_AXIS; i++) {
+        ac[i] = robot->actuators[i]->get_current_position();
+    }
+    float pos[3];
+    robot->arm_solution->actuator_to_cartesian(ac, pos);
+
+    // a higher bed is a shorter distance
+    scan_map->add_sample(pos[X_AXIS] + X_PROBE_OFFSET_FROM_EXTRUDER, pos[Y_AXIS] + Y_PROBE_OFFSET_FROM_EXTRUDER, scan_reference - read_scan_distance());
+}
+
 void CartGridStrategy::doCompensation(float *target, bool inverse)
 {
     // Adjust print surface height by linear interpolation over the bed_level array.
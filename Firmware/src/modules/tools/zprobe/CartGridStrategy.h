@@ -5,10 +5,13 @@
 #include <string>
 #include <tuple>
 #include <cstdint>
+#include <atomic>
 
 class OutputStream;
 class GCode;
 class ConfigReader;
+class Adc;
+class HeightMap;
 
 class CartGridStrategy : public ZProbeStrategy
 {
@@ -22,6 +25,9 @@ private:
     bool handle_mcode(GCode& gcode, OutputStream& os);
 
     bool doProbe(GCode& gcode, OutputStream& os);
+    bool doScan(OutputStream& os);
+    void sample_scan();
+    float read_scan_distance() const;
     bool findBed(float x, float y);
     void setAdjustFunction(bool on);
     void print_bed_level(OutputStream& os);
@@ -29,6 +35,8 @@ private:
     void reset_bed_level();
     void save_grid(OutputStream& os);
     bool load_grid(OutputStream& os);
+    bool load_grid_qspi(OutputStream& os);
+    bool check_grid(uint16_t load_x_size, uint16_t load_y_size, float x, float y, OutputStream& os);
     bool scan_bed(GCode& gcode, OutputStream& os);
 
     float initial_height;
@@ -39,19 +47,31 @@ private:
     float damping_interval;
     std::string before_probe, after_probe;
 
+    // continuous scanning with an analog distance sensor
+    Adc *scan_adc{nullptr};
+    HeightMap *scan_map{nullptr};
+    float scan_mm_per_volt;
+    float scan_resolution;
+    float scan_feedrate;
+    float scan_line_spacing;
+    float scan_reference;
+    std::atomic<bool> scanning{false};
+
     float *grid;
     std::tuple<float, float, float> probe_offsets;
     float x_start,y_start;
     float x_size,y_size;
 
+    uint16_t configured_grid_x_size;
+    uint16_t configured_grid_y_size;
+    uint16_t current_grid_x_size;
+    uint16_t current_grid_y_size;
+
     struct {
-        uint8_t configured_grid_x_size:8;
-        uint8_t configured_grid_y_size:8;
-        uint8_t current_grid_x_size:8;
-        uint8_t current_grid_y_size:8;
         bool save:1;
         bool do_home:1;
         bool only_by_two_corners:1;
         bool human_readable:1;
+        bool continuous_scan:1;
     };
 };
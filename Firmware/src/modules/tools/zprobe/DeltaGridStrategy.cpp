@@ -54,6 +54,7 @@
     M374.1 delete /sd/delta.grid
     M375 Load the grid from /sd/delta.grid and enable compensation
     M375.1 display the current grid
+    M375.2 Load the grid from QSPI flash (flashed with qspi flash /sd/delta.grid) and enable compensation
     M561 clears the grid and turns off compensation
     M565 defines the probe offsets from the nozzle or tool head
 
@@ -74,10 +75,14 @@
 #include "BaseSolution.h"
 #include "StringUtils.h"
 #include "OutputStream.h"
+#include "MeshFile.h"
+#include "MemoryPool.h"
+#include "qspi.h"
 
 #include <string>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <math.h>
 
@@ -98,7 +103,10 @@ DeltaGridStrategy::DeltaGridStrategy(ZProbe *zprb) : ZProbeStrategy(zprb)
 
 DeltaGridStrategy::~DeltaGridStrategy()
 {
-    if(grid != nullptr) free(grid);
+    if(grid != nullptr) {
+        if(_SRAM_1->has(grid)) DeallocSRAM_1(grid);
+        else free(grid);
+    }
 }
 
 bool DeltaGridStrategy::configure(ConfigReader& cr)
@@ -109,7 +117,7 @@ bool DeltaGridStrategy::configure(ConfigReader& cr)
         return false;
     }
 
-    grid_size = cr.get_float(m, grid_size_key, 7);
+    grid_size = cr.get_int(m, grid_size_key, 7);
     tolerance = cr.get_float(m, tolerance_key, 0.03F);
     save = cr.get_bool(m, save_key, false);
     do_home = cr.get_bool(m, do_home_key, true);
@@ -128,8 +136,10 @@ bool DeltaGridStrategy::configure(ConfigReader& cr)
         }
     }
 
-    // allocate memory
-    grid = (float *)malloc(grid_size * grid_size * sizeof(float));
+    // allocate memory, large grids go in SRAM_1 so they do not use up the main heap
+    size_t grid_bytes = grid_size * grid_size * sizeof(float);
+    grid = (float *)AllocSRAM_1(grid_bytes);
+    if(grid == nullptr) grid = (float *)malloc(grid_bytes);
 
     if(grid == nullptr) {
         printf("ERROR: config-deltagrid: Not enough memory for grid\n");
@@ -169,27 +179,14 @@ void DeltaGridStrategy::save_grid(OutputStream& os)
         return;
     }
 
-    if(fwrite(&grid_size, sizeof(uint8_t), 1, fp) != 1) {
-        os.printf("error:Failed to write grid size\n");
-        fclose(fp);
-        return;
-    }
-
-    if(fwrite(&grid_radius, sizeof(float), 1, fp) != 1) {
-        os.printf("error:Failed to write grid radius\n");
+    MeshHeader hdr;
+    meshfile::init_header(hdr, MESH_TYPE_DELTA, grid_size, grid_size, 0, 0, grid_radius, grid_radius);
+    if(!meshfile::write(fp, hdr, grid)) {
+        os.printf("error:Failed to write grid\n");
         fclose(fp);
         return;
     }
 
-    for (int y = 0; y < grid_size; y++) {
-        for (int x = 0; x < grid_size; x++) {
-            if(fwrite(&grid[x + (grid_size * y)], sizeof(float), 1, fp) != 1) {
-                os.printf("error:Failed to write grid\n");
-                fclose(fp);
-                return;
-            }
-        }
-    }
     os.printf("grid saved to %s\n", GRIDFILE);
     fclose(fp);
 }
@@ -202,43 +199,71 @@ bool DeltaGridStrategy::load_grid(OutputStream& os)
         return false;
     }
 
-    uint8_t size;
-    float radius;
-
-    if(fread(&size, sizeof(uint8_t), 1, fp) != 1) {
-        os.printf("error:Failed to read grid size\n");
+    // read into a temporary buffer and check it there, the grid is only changed if it is valid
+    // like the grid it goes in SRAM_1 if it fits so a large grid does not need the same again from the main heap
+    size_t len = meshfile::size(grid_size * grid_size);
+    void *buf = AllocSRAM_1(len);
+    if(buf == nullptr) buf = malloc(len);
+    if(buf == nullptr) {
         fclose(fp);
+        os.printf("error:Not enough memory to load grid\n");
         return false;
     }
 
-    if(size != grid_size) {
-        os.printf("error:grid size is different read %d - config %d\n", size, grid_size);
-        fclose(fp);
+    MeshHeader hdr;
+    const float *data = meshfile::read(fp, buf, len, hdr);
+    fclose(fp);
+    bool ok = false;
+    if(data == nullptr || hdr.type != MESH_TYPE_DELTA || hdr.x_points != grid_size || hdr.y_points != grid_size) {
+        if(data != nullptr) os.printf("error:grid size is different read %d - config %d\n", hdr.x_points, grid_size);
+        else os.printf("error:%s is not a valid grid or is corrupt, it needs to be probed and saved again\n", GRIDFILE);
+
+    } else {
+        memcpy(grid, data, grid_size * grid_size * sizeof(float));
+        ok = true;
+    }
+
+    if(_SRAM_1->has(buf)) DeallocSRAM_1(buf);
+    else free(buf);
+    if(!ok) return false;
+
+    if(hdr.x_size != grid_radius) {
+        os.printf("warning:grid radius is different read %f - config %f, overriding config\n", hdr.x_size, grid_radius);
+        grid_radius = hdr.x_size;
+    }
+
+    os.printf("grid loaded, radius: %f, size: %d\n", grid_radius, grid_size);
+    return true;
+}
+
+// load the grid from QSPI flash where it was flashed with qspi flash /sd/delta.grid
+bool DeltaGridStrategy::load_grid_qspi(OutputStream& os)
+{
+    if(!qspi_mount()) {
+        os.printf("error:Failed to mount qspi\n");
         return false;
     }
 
-    if(fread(&radius, sizeof(float), 1, fp) != 1) {
-        os.printf("error:Failed to read grid radius\n");
-        fclose(fp);
+    MeshHeader hdr;
+    // it is flashed at the start of the qspi so must be below the job cache
+    const float *data = meshfile::check((const void *)QSPI_MAPPED_BASE, QSPI_JOB_START, hdr);
+    if(data == nullptr || hdr.type != MESH_TYPE_DELTA) {
+        os.printf("error:No valid grid in qspi\n");
         return false;
     }
 
-    if(radius != grid_radius) {
-        os.printf("warning:grid radius is different read %f - config %f, overriding config\n", radius, grid_radius);
-        grid_radius = radius;
+    if(hdr.x_points != grid_size || hdr.y_points != grid_size) {
+        os.printf("error:grid size is different read %d - config %d\n", hdr.x_points, grid_size);
+        return false;
     }
 
-    for (int y = 0; y < grid_size; y++) {
-        for (int x = 0; x < grid_size; x++) {
-            if(fread(&grid[x + (grid_size * y)], sizeof(float), 1, fp) != 1) {
-                os.printf("error:Failed to read grid\n");
-                fclose(fp);
-                return false;
-            }
-        }
+    if(hdr.x_size != grid_radius) {
+        os.printf("warning:grid radius is different read %f - config %f, overriding config\n", hdr.x_size, grid_radius);
+        grid_radius = hdr.x_size;
     }
-    os.printf("grid loaded, radius: %f, size: %d\n", grid_radius, grid_size);
-    fclose(fp);
+
+    memcpy(grid, data, grid_size * grid_size * sizeof(float));
+    os.printf("grid loaded from qspi, radius: %f, size: %d\n", grid_radius, grid_size);
     return true;
 }
 
@@ -367,6 +392,8 @@ bool DeltaGridStrategy::handle_mcode(GCode & gcode, OutputStream & os)
     } else if(gcode.get_code() == 375) { // M375: load grid, M375.1 display grid
         if(gcode.get_subcode() == 1) {
             print_bed_level(os);
+        } else if(gcode.get_subcode() == 2) {
+            if(load_grid_qspi(os)) setAdjustFunction(true);
         } else {
             if(load_grid(os)) setAdjustFunction(true);
         }
@@ -489,7 +516,11 @@ bool DeltaGridStrategy::doProbe(GCode& gcode, OutputStream& os)
 
             if(!zprobe->doProbeAt(mm, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER)) return false;
             float measured_z = zprobe->getProbeHeight() - mm - z_reference; // this is the delta z from bed at 0,0
-            os.printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", xProbe, yProbe, measured_z);
+            if(zprobe->getLastSampleCount() > 1) {
+                os.printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f, samples %d, sd %1.4f\n", xProbe, yProbe, measured_z, zprobe->getLastSampleCount(), zprobe->getLastDeviation());
+            } else {
+                os.printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", xProbe, yProbe, measured_z);
+            }
             grid[xCount + (grid_size * yCount)] = measured_z;
         }
     }
@@ -29,6 +29,7 @@ private:
     void reset_bed_level();
     void save_grid(OutputStream& os);
     bool load_grid(OutputStream& os);
+    bool load_grid_qspi(OutputStream& os);
     bool probe_spiral(int n, float radius, OutputStream& os);
     bool probe_grid(int n, float radius, OutputStream& os);
 
@@ -38,7 +39,7 @@ private:
     float *grid;
     float grid_radius;
     std::tuple<float, float, float> probe_offsets;
-    uint8_t grid_size;
+    uint16_t grid_size;
 
     struct {
         bool save:1;
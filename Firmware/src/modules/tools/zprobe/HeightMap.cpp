@@ -0,0 +1,145 @@
+#include "HeightMap.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+HeightMap::~HeightMap()
+{
+    free(sum);
+    free(count);
+}
+
+bool HeightMap::init(float xs, float ys, float xsz, float ysz, float res)
+{
+    free(sum);
+    free(count);
+    sum = nullptr;
+    count = nullptr;
+    x_bins = y_bins = 0;
+
+    if(xsz <= 0 || ysz <= 0 || res <= 0) return false;
+
+    x_start = xs;
+    y_start = ys;
+    x_size = xsz;
+    y_size = ysz;
+    resolution = res;
+
+    // bin i is centered on start + i * resolution
+    x_bins = lroundf(x_size / resolution) + 1;
+    y_bins = lroundf(y_size / resolution) + 1;
+    size_t n = x_bins * y_bins;
+    sum = (float *)malloc(n * sizeof(float));
+    count = (uint16_t *)malloc(n * sizeof(uint16_t));
+    if(sum == nullptr || count == nullptr) {
+        free(sum);
+        free(count);
+        sum = nullptr;
+        count = nullptr;
+        x_bins = y_bins = 0;
+        return false;
+    }
+
+    clear();
+    return true;
+}
+
+void HeightMap::clear()
+{
+    if(sum == nullptr) return;
+    memset(sum, 0, x_bins * y_bins * sizeof(float));
+    memset(count, 0, x_bins * y_bins * sizeof(uint16_t));
+    sample_count = 0;
+}
+
+void HeightMap::add_sample(float x, float y, float z)
+{
+    if(sum == nullptr || std::isnan(z)) return;
+
+    int xi = lroundf((x - x_start) / resolution);
+    int yi = lroundf((y - y_start) / resolution);
+    if(xi < 0 || xi >= x_bins || yi < 0 || yi >= y_bins) return;
+
+    int i = xi + yi * x_bins;
+    if(count[i] == UINT16_MAX) return;
+    sum[i] += z;
+    ++count[i];
+    ++sample_count;
+}
+
+int HeightMap::resample(float *grid, int nx, int ny, float radius) const
+{
+    int missing = 0;
+    int r = (int)ceilf(radius / resolution);
+    float r2 = radius * radius;
+
+    for (int gy = 0; gy < ny; ++gy) {
+        float y = ny > 1 ? y_start + (y_size / (ny - 1)) * gy : y_start;
+        int cy = lroundf((y - y_start) / resolution);
+
+        for (int gx = 0; gx < nx; ++gx) {
+            float x = nx > 1 ? x_start + (x_size / (nx - 1)) * gx : x_start;
+            int cx = lroundf((x - x_start) / resolution);
+
+            // fit z = a + b*dx + c*dy to the bins whose center is within radius of the grid point, weighted by the samples in each bin
+            float sw = 0, sx = 0, sy = 0, sz = 0, sxx = 0, syy = 0, sxy = 0, sxz = 0, syz = 0;
+            for (int yi = std::max(0, cy - r); yi <= std::min(y_bins - 1, cy + r); ++yi) {
+                float dy = y_start + yi * resolution - y;
+                for (int xi = std::max(0, cx - r); xi <= std::min(x_bins - 1, cx + r); ++xi) {
+                    float dx = x_start + xi * resolution - x;
+                    int i = xi + yi * x_bins;
+                    if(count[i] == 0 || dx * dx + dy * dy > r2) continue;
+                    float w = count[i];
+                    float z = sum[i] / w;
+                    sw += w;
+                    sx += w * dx;
+                    sy += w * dy;
+                    sz += w * z;
+                    sxx += w * dx * dx;
+                    syy += w * dy * dy;
+                    sxy += w * dx * dy;
+                    sxz += w * dx * z;
+                    syz += w * dy * z;
+                }
+            }
+
+            if(sw == 0) {
+                grid[gx + gy * nx] = NAN;
+                ++missing;
+                continue;
+            }
+
+            // covariances about the mean, a direction with no spread (eg a single scan line) is not fitted
+            float mx = sx / sw, my = sy / sw, mz = sz / sw;
+            float vxx = sxx / sw - mx * mx, vyy = syy / sw - my * my, vxy = sxy / sw - mx * my;
+            float vxz = sxz / sw - mx * mz, vyz = syz / sw - my * mz;
+            float eps = resolution * resolution * 0.01F;
+            bool fit_x = vxx > eps, fit_y = vyy > eps;
+            float b = 0, c = 0;
+            if(fit_x && fit_y) {
+                float det = vxx * vyy - vxy * vxy;
+                if(det > eps * eps) {
+                    b = (vxz * vyy - vyz * vxy) / det;
+                    c = (vyz * vxx - vxz * vxy) / det;
+                } else if(vxx >= vyy) {
+                    b = vxz / vxx;
+                } else {
+                    c = vyz / vyy;
+                }
+
+            } else if(fit_x) {
+                b = vxz / vxx;
+
+            } else if(fit_y) {
+                c = vyz / vyy;
+            }
+
+            // the value of the fit at the grid point
+            grid[gx + gy * nx] = mz - b * mx - c * my;
+        }
+    }
+
+    return missing;
+}
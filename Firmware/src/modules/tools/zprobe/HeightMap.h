@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// A dense height map built from samples taken while the probe moves over the bed.
+// Each sample is accumulated into the bin it falls in, the bins are then resampled into the leveling grid.
+// It has no hardware dependencies so it can be tested on the host with synthetic data.
+class HeightMap
+{
+public:
+    HeightMap() {}
+    ~HeightMap();
+
+    // sets the area covered and the size of each bin in mm, returns false if out of memory
+    bool init(float x_start, float y_start, float x_size, float y_size, float resolution);
+    void clear();
+
+    // adds a height sample, samples outside the area are ignored. Called from an ISR so does not allocate
+    void add_sample(float x, float y, float z);
+
+    // sets each of the nx by ny grid points spanning the area from a linear fit of the bins within radius mm of it,
+    // a fit rather than an average so the points at the edges are not biased by a sloping bed.
+    // returns the number of grid points with no samples within radius, those are set to NAN
+    int resample(float *grid, int nx, int ny, float radius) const;
+
+    uint32_t get_sample_count() const { return sample_count; }
+    int get_x_bins() const { return x_bins; }
+    int get_y_bins() const { return y_bins; }
+
+private:
+    float *sum{nullptr};
+    uint16_t *count{nullptr};
+    float x_start, y_start;
+    float x_size, y_size;
+    float resolution;
+    int x_bins{0}, y_bins{0};
+    volatile uint32_t sample_count{0};
+};
@@ -0,0 +1,81 @@
+#include "MeshFile.h"
+
+#include <cstring>
+
+static_assert(sizeof(MeshHeader) == 32, "MeshHeader must not have padding");
+
+namespace meshfile
+{
+
+// standard CRC-32 (as zip), bitwise as it is only used when loading and saving
+uint32_t crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while(len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+void init_header(MeshHeader& hdr, MESH_TYPE type, uint16_t x_points, uint16_t y_points, float x_start, float y_start, float x_size, float y_size)
+{
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = MESH_MAGIC;
+    hdr.version = MESH_VERSION;
+    hdr.type = type;
+    hdr.x_points = x_points;
+    hdr.y_points = y_points;
+    hdr.x_start = x_start;
+    hdr.y_start = y_start;
+    hdr.x_size = x_size;
+    hdr.y_size = y_size;
+}
+
+uint32_t calc_crc(const MeshHeader& hdr, const float *grid)
+{
+    MeshHeader h = hdr;
+    h.crc = 0;
+    uint32_t crc = crc32(0, &h, sizeof(h));
+    return crc32(crc, grid, hdr.x_points * hdr.y_points * sizeof(float));
+}
+
+static bool valid_header(const MeshHeader& hdr)
+{
+    return hdr.magic == MESH_MAGIC && hdr.version == MESH_VERSION && hdr.x_points > 0 && hdr.y_points > 0;
+}
+
+bool write(FILE *fp, MeshHeader& hdr, const float *grid)
+{
+    hdr.crc = calc_crc(hdr, grid);
+    size_t n = hdr.x_points * hdr.y_points;
+    if(fwrite(&hdr, sizeof(hdr), 1, fp) != 1) return false;
+    return fwrite(grid, sizeof(float), n, fp) == n;
+}
+
+const float *read(FILE *fp, void *buf, size_t len, MeshHeader& hdr)
+{
+    size_t n = fread(buf, 1, len, fp);
+    return check(buf, n, hdr);
+}
+
+const float *check(const void *mem, size_t len, MeshHeader& hdr)
+{
+    if(len < sizeof(hdr)) return nullptr;
+    memcpy(&hdr, mem, sizeof(hdr));
+    if(!valid_header(hdr)) return nullptr;
+
+    // the dimensions come from the header so make sure they fit before reading that much
+    size_t n = (size_t)hdr.x_points * hdr.y_points;
+    if(n > (len - sizeof(hdr)) / sizeof(float)) return nullptr;
+
+    const float *grid = (const float *)((const uint8_t *)mem + sizeof(hdr));
+    if(calc_crc(hdr, grid) != hdr.crc) return nullptr;
+
+    return grid;
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+// Binary file format the grid leveling strategies save their grid in.
+// A fixed size header followed by the x_points * y_points floats of the grid in row order.
+// The crc covers the header (with the crc set to 0) and the grid, so a truncated or corrupt file is never loaded.
+// The file can also be flashed into QSPI and checked and read from there while it is memory mapped.
+#define MESH_MAGIC 0x4853454DUL // "MESH"
+#define MESH_VERSION 1
+
+enum MESH_TYPE {
+    MESH_TYPE_CARTESIAN = 1,
+    MESH_TYPE_DELTA = 2
+};
+
+struct MeshHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;          // MESH_TYPE
+    uint16_t x_points;
+    uint16_t y_points;
+    float x_start, y_start;
+    float x_size, y_size;   // for delta x_size is the grid radius
+    uint32_t crc;
+};
+
+namespace meshfile
+{
+    // sets up a header for a grid, the crc is set by write()
+    void init_header(MeshHeader& hdr, MESH_TYPE type, uint16_t x_points, uint16_t y_points, float x_start, float y_start, float x_size, float y_size);
+    uint32_t calc_crc(const MeshHeader& hdr, const float *grid);
+
+    bool write(FILE *fp, MeshHeader& hdr, const float *grid);
+    // reads upto len bytes of the file into buf and checks it, returns a pointer to the grid in buf or nullptr if not valid
+    const float *read(FILE *fp, void *buf, size_t len, MeshHeader& hdr);
+    // checks a mesh in memory (eg memory mapped QSPI) of at most len bytes, returns a pointer to the grid or nullptr if not valid
+    // the grid size in the header is checked against len before the crc is run over it
+    const float *check(const void *mem, size_t len, MeshHeader& hdr);
+
+    uint32_t crc32(uint32_t crc, const void *data, size_t len);
+    // the bytes needed for a file or buffer holding a grid of n points
+    inline size_t size(size_t n) { return sizeof(MeshHeader) + n * sizeof(float); }
+}
@@ -0,0 +1,83 @@
+#include "ProbeSamples.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool ProbeSamples::add(float v)
+{
+    if(n >= max_samples) return false;
+    samples[n++] = v;
+    return true;
+}
+
+float ProbeSamples::median() const
+{
+    if(n == 0) return 0;
+
+    float s[max_samples];
+    std::copy(samples, samples + n, s);
+    std::sort(s, s + n);
+    return (n % 2) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+}
+
+int ProbeSamples::inliers(float tolerance) const
+{
+    float m = median();
+    int c = 0;
+    for (int i = 0; i < n; ++i) {
+        if(fabsf(samples[i] - m) <= tolerance) ++c;
+    }
+    return c;
+}
+
+bool ProbeSamples::is_done(float tolerance) const
+{
+    if(n < 2) return false;
+
+    // at least two samples within tolerance of the median and of each other
+    float m = median();
+    float lo = m, hi = m;
+    int c = 0;
+    for (int i = 0; i < n; ++i) {
+        if(fabsf(samples[i] - m) <= tolerance) {
+            lo = std::min(lo, samples[i]);
+            hi = std::max(hi, samples[i]);
+            ++c;
+        }
+    }
+
+    return c >= 2 && (hi - lo) <= tolerance;
+}
+
+float ProbeSamples::result(float tolerance) const
+{
+    float m = median();
+    float sum = 0;
+    int c = 0;
+    for (int i = 0; i < n; ++i) {
+        if(fabsf(samples[i] - m) <= tolerance) {
+            sum += samples[i];
+            ++c;
+        }
+    }
+
+    // with no agreement the median is the best guess
+    return c > 0 ? sum / c : m;
+}
+
+float ProbeSamples::deviation(float tolerance) const
+{
+    float m = median();
+    float mean = result(tolerance);
+    float sum = 0;
+    int c = 0;
+    for (int i = 0; i < n; ++i) {
+        if(fabsf(samples[i] - m) <= tolerance) {
+            float d = samples[i] - mean;
+            sum += d * d;
+            ++c;
+        }
+    }
+
+    return c > 1 ? sqrtf(sum / (c - 1)) : 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Collects repeated probe readings at one point and decides when there are enough.
+// Samples further than the tolerance from the median are rejected as outliers, the result is the mean of the rest.
+// It has no hardware dependencies so it can be tested on the host.
+class ProbeSamples
+{
+public:
+    static const int max_samples = 16;
+
+    ProbeSamples() {}
+    void clear() { n = 0; }
+    bool add(float v);
+
+    // true when at least two samples agree within tolerance
+    bool is_done(float tolerance) const;
+
+    float median() const;
+    // mean of the samples within tolerance of the median
+    float result(float tolerance) const;
+    // standard deviation of the samples within tolerance of the median
+    float deviation(float tolerance) const;
+    // number of samples within tolerance of the median
+    int inliers(float tolerance) const;
+    int size() const { return n; }
+
+private:
+    float samples[max_samples];
+    int n{0};
+};
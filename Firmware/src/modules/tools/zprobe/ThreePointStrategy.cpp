@@ -311,7 +311,11 @@ bool ThreePointStrategy::doProbing(OutputStream& os)
         if(!zprobe->doProbeAt(z, x - std::get<X_AXIS>(this->probe_offsets), y - std::get<Y_AXIS>(this->probe_offsets))) return false;
 
         z = zprobe->getProbeHeight() - z; // relative distance between the probe points, lower is negative z
-        os.printf("DEBUG: P%d:%1.4f\n", i, z);
+        if(zprobe->getLastSampleCount() > 1) {
+            os.printf("DEBUG: P%d:%1.4f samples %d, sd %1.4f\n", i, z, zprobe->getLastSampleCount(), zprobe->getLastDeviation());
+        } else {
+            os.printf("DEBUG: P%d:%1.4f\n", i, z);
+        }
         v[i] = Vector3(x, y, z);
     }
 
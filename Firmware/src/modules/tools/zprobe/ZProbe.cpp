@@ -14,6 +14,8 @@
 #include "Dispatcher.h"
 #include "OutputStream.h"
 
+#include <algorithm>
+
 // strategies we know about
 #include "ThreePointStrategy.h"
 #include "DeltaCalibrationStrategy.h"
@@ -33,6 +35,10 @@
 #define dwell_before_probing_key "dwell_before_probing"
 #define leveling_key "leveling"
 #define calibration_key "calibration"
+#define samples_key "samples"
+#define sample_tolerance_key "sample_tolerance"
+#define sample_retract_key "sample_retract"
+#define approach_feedrate_key "approach_feedrate"
 
 
 #define STEPPER Robot::getInstance()->actuators
@@ -140,6 +146,12 @@ bool ZProbe::configure(ConfigReader& cr)
 
     this->dwell_before_probing = cr.get_float(m, dwell_before_probing_key, 0); // dwell time in seconds before probing
 
+    // each point probed by a strategy can be sampled until the readings agree
+    this->max_samples = std::min(std::max(cr.get_int(m, samples_key, 1), 1), (int)ProbeSamples::max_samples); // maximum samples per point
+    this->sample_tolerance = cr.get_float(m, sample_tolerance_key, 0.005F); // mm the samples must agree within
+    this->sample_retract = cr.get_float(m, sample_retract_key, 1.0F); // mm to back off between samples
+    this->approach_feedrate = cr.get_float(m, approach_feedrate_key, 0); // feedrate in mm/sec for the first touch, 0 uses slow_feedrate
+
     // register gcodes and mcodes
     using std::placeholders::_1;
     using std::placeholders::_2;
@@ -159,7 +171,7 @@ bool ZProbe::configure(ConfigReader& cr)
     // strategies may handle their own mcodes but we need to register them from the strategy themselves
 
     // we read the probe in this timer, faster makes it more accurate
-    FastTicker::getInstance()->attach(1000, std::bind(&ZProbe::read_probe, this));
+    FastTicker::getInstance()->attach(1000, std::bind(&ZProbe::read_probe, this), "zprobe", FastTicker::PRIO_HIGH);
 
     return true;
 }
@@ -246,7 +258,14 @@ bool ZProbe::run_probe_return(float& mm, float feedrate, float max_dist, bool re
 
     bool ok = run_probe(mm, feedrate, max_dist, reverse);
 
-    // move probe back to where it was
+    // absolute move back to saved starting position
+    move_z(save_z_pos, get_return_feedrate(), false);
+
+    return ok;
+}
+
+float ZProbe::get_return_feedrate() const
+{
     float fr;
     if(this->return_feedrate != 0) { // use return_feedrate if set
         fr = this->return_feedrate;
@@ -254,11 +273,50 @@ bool ZProbe::run_probe_return(float& mm, float feedrate, float max_dist, bool re
         fr = this->slow_feedrate * 2; // nominally twice slow feedrate
         if(fr > this->fast_feedrate) fr = this->fast_feedrate; // unless that is greater than fast feedrate
     }
+    return fr;
+}
+
+// probe the current position until the samples agree within tolerance or max_samples have been taken,
+// then return to the start position. The first touch can be made at the faster approach_feedrate, it then only
+// finds the bed and the samples are taken at the slow feedrate from sample_retract above it.
+bool ZProbe::run_probe_samples(float& mm)
+{
+    float save_z_pos = Robot::getInstance()->get_axis_position(Z_AXIS);
+    float fr = get_return_feedrate();
+    float up = reverse_z ? -sample_retract : sample_retract;
+
+    last_samples.clear();
+
+    // distance below the start position, each sample is where the probe triggered
+    float pos;
+    bool ok;
+    if(approach_feedrate > 0) {
+        ok = run_probe(pos, approach_feedrate);
+    } else {
+        ok = run_probe(pos, slow_feedrate);
+        if(ok) last_samples.add(pos);
+    }
+
+    while(ok && last_samples.size() < max_samples && !last_samples.is_done(sample_tolerance)) {
+        // back off and touch again slowly
+        move_z(up, fr, true);
+        pos -= sample_retract;
+
+        float m;
+        ok = run_probe(m, slow_feedrate, sample_retract * 2);
+        pos += m;
+        if(ok) last_samples.add(pos);
+    }
 
-    // absolute move back to saved starting position
     move_z(save_z_pos, fr, false);
+    if(!ok) return false;
 
-    return ok;
+    if(last_samples.size() > 1 && !last_samples.is_done(sample_tolerance)) {
+        printf("WARNING: zprobe: %d samples did not agree within %1.4f mm, using the median\n", last_samples.size(), sample_tolerance);
+    }
+
+    mm = last_samples.result(sample_tolerance);
+    return true;
 }
 
 bool ZProbe::doProbeAt(float &mm, float x, float y)
@@ -267,7 +325,14 @@ bool ZProbe::doProbeAt(float &mm, float x, float y)
     move_xy(x, y, getFastFeedrate());
     if(Module::is_halted()) return false;
 
-    return run_probe_return(mm, slow_feedrate);
+    if(max_samples > 1 || approach_feedrate > 0) {
+        return run_probe_samples(mm);
+    }
+
+    last_samples.clear();
+    if(!run_probe_return(mm, slow_feedrate)) return false;
+    last_samples.add(mm);
+    return true;
 }
 
 bool ZProbe::handle_gcode(GCode& gcode, OutputStream& os)
@@ -442,11 +507,17 @@ bool ZProbe::handle_mcode(GCode& gcode, OutputStream& os)
                 pin.set_inverting(pin.is_inverting() != invert_override); // XOR so inverted pin is not inverted and vice versa
             }
             if (gcode.has_arg('D')) this->dwell_before_probing = gcode.get_arg('D');
+            if (gcode.has_arg('C')) this->max_samples = std::min(std::max(gcode.get_int_arg('C'), 1), (int)ProbeSamples::max_samples);
+            if (gcode.has_arg('U')) this->sample_tolerance = gcode.get_arg('U');
+            if (gcode.has_arg('A')) this->approach_feedrate = gcode.get_arg('A');
+            if (gcode.has_arg('B')) this->sample_retract = gcode.get_arg('B');
             break;
 
         case 500: // save settings
             os.printf(";Probe feedrates Slow/fast(K)/Return (mm/sec) max_travel (mm) height (mm) dwell (s):\nM670 S%1.2f K%1.2f R%1.2f Z%1.2f H%1.2f D%1.2f\n",
                       this->slow_feedrate, this->fast_feedrate, this->return_feedrate, this->max_travel, this->probe_height, this->dwell_before_probing);
+            os.printf(";Probe samples per point (C), tolerance mm (U), approach feedrate mm/sec (A), back off between samples mm (B):\nM670 C%d U%1.4f A%1.2f B%1.2f\n",
+                      this->max_samples, this->sample_tolerance, this->approach_feedrate, this->sample_retract);
             break;
 
         default:
@@ -513,7 +584,8 @@ void ZProbe::probe_XYZ(GCode& gcode, OutputStream& os, uint8_t axismask)
 }
 
 // issue a coordinated move in xy, and return when done
-void ZProbe::move_xy(float x, float y, float feedrate, bool relative)
+// if wait is false the move is queued and this returns once it is in the planner queue
+void ZProbe::move_xy(float x, float y, float feedrate, bool relative, bool wait)
 {
     Robot::getInstance()->push_state();
     if(relative) {
@@ -524,7 +596,7 @@ void ZProbe::move_xy(float x, float y, float feedrate, bool relative)
     }
     OutputStream nullos;
     THEDISPATCHER->dispatch(nullos, 'G', 1, 'X', x, 'Y', y, 'F', feedrate*60, 0);
-    Conveyor::getInstance()->wait_for_idle();
+    if(wait) Conveyor::getInstance()->wait_for_idle();
     Robot::getInstance()->pop_state();
 }
 
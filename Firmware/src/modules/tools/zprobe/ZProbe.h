@@ -2,6 +2,7 @@
 
 #include "Module.h"
 #include "Pin.h"
+#include "ProbeSamples.h"
 
 // defined here as they are used in multiple files
 #define leveling_strategy_key "leveling-strategy"
@@ -26,7 +27,7 @@ public:
     bool run_probe_return(float& mm, float feedrate, float max_dist= -1, bool reverse= false);
     bool doProbeAt(float &mm, float x, float y);
 
-    void move_xy(float x, float y, float feedrate, bool relative=false);
+    void move_xy(float x, float y, float feedrate, bool relative=false, bool wait=true);
     void move_x(float x, float feedrate, bool relative=false);
     void move_y(float y, float feedrate, bool relative=false);
     void move_z(float z, float feedrate, bool relative=false);
@@ -36,12 +37,17 @@ public:
     float getSlowFeedrate() const { return slow_feedrate; }
     float getFastFeedrate() const { return fast_feedrate; }
     float getProbeHeight() const { return probe_height; }
+    // number of samples and their deviation for the last doProbeAt
+    int getLastSampleCount() const { return last_samples.size(); }
+    float getLastDeviation() const { return last_samples.deviation(sample_tolerance); }
 
 private:
     bool handle_gcode(GCode& gcode, OutputStream& os);
     bool handle_mcode(GCode& gcode, OutputStream& os);
     void probe_XYZ(GCode& gc, OutputStream& os, uint8_t axismask);
     void read_probe(void);
+    bool run_probe_samples(float& mm);
+    float get_return_feedrate() const;
 
     float slow_feedrate;
     float fast_feedrate;
@@ -50,6 +56,13 @@ private:
     float max_travel;
     float dwell_before_probing;
 
+    // repeated probing at each point
+    ProbeSamples last_samples;
+    float sample_tolerance;
+    float sample_retract;
+    float approach_feedrate;
+    uint8_t max_samples;
+
     Pin pin;
     ZProbeStrategy *leveling_strategy{nullptr};
     ZProbeStrategy *calibration_strategy{nullptr};
@@ -16,10 +16,16 @@
 #include "FreeRTOS_TCP_server.h"
 #include "FreeRTOS_DHCP.h"
 
+#include "ftp_writer.h"
+
 
 #define network_enable_key "enable"
 #define shell_enable_key "shell_enable"
+#define shell_tx_buffer_key "shell_tx_buffer"
+#define shell_overflow_key "shell_overflow"
 #define ftp_enable_key "ftp_enable"
+#define ftp_fast_mode_key "ftp_fast_mode"
+#define ftp_write_buffers_key "ftp_write_buffers"
 #define webserver_enable_key "webserver_enable"
 #define ntp_enable_key "ntp_enable"
 #define ip_address_key  "ip_address"
@@ -145,7 +151,11 @@ bool Network::configure(ConfigReader& cr)
     }
 
     enable_shell = cr.get_bool(m, shell_enable_key, false);
+    shell_tx_buffer = cr.get_int(m, shell_tx_buffer_key, 4096);
+    shell_overflow = cr.get_string(m, shell_overflow_key, "drop");
     enable_ftpd = cr.get_bool(m, ftp_enable_key, false);
+    ftp_fast_mode = cr.get_bool(m, ftp_fast_mode_key, false);
+    ftp_write_buffers = cr.get_int(m, ftp_write_buffers_key, 4);
     enable_httpd = cr.get_bool(m, webserver_enable_key, false);
     enable_ntp = cr.get_bool(m, ntp_enable_key, true);
     ntp_server = cr.get_string(m, ntp_server_key, "pool.ntp.org");
@@ -168,7 +178,7 @@ extern "C" void netstat(OutputStream&);
 #define HELP(m) if(params == "-h") { os.printf("%s\n", m); return true; }
 bool Network::handle_net_cmd( std::string& params, OutputStream& os )
 {
-    HELP("net - show network status, -n also shows netstat, -k shuts down network");
+    HELP("net - show network status, -n also shows netstat, -s shows shell connection stats, -k shuts down network");
 
     if(abort_network) {
         os.printf("Network has been shutdown\n");
@@ -194,10 +204,12 @@ bool Network::handle_net_cmd( std::string& params, OutputStream& os )
 
     bool bnetstat = false;
     bool bkill = false;
+    bool bshell = false;
     while(!params.empty()) {
         std::string s = stringutils::shift_parameter( params );
         if(s == "-n") bnetstat = true;
         else if(s == "-k") bkill = true;
+        else if(s == "-s") bshell = true;
     }
 
     if(bnetstat) {
@@ -205,6 +217,10 @@ bool Network::handle_net_cmd( std::string& params, OutputStream& os )
         os.puts("\nNetstat...\n");
         netstat(os);
     }
+    if(bshell && enable_shell) {
+        extern void shell_stats(OutputStream&);
+        shell_stats(os);
+    }
     if(bkill) {
         set_abort();
     }
@@ -382,7 +398,12 @@ void Network::network_thread()
         xServerConfiguration[ns].xBackLog = 12;
         xServerConfiguration[ns].pcRootDir = "";
         ++ns;
-        printf("Network: FTPD started\n");
+        // uploads are written to the sdcard by their own task with bigger TCP windows
+        if(ftp_fast_mode && ftp_writer_init(ftp_write_buffers)) {
+            printf("Network: FTPD started in fast mode\n");
+        } else {
+            printf("Network: FTPD started\n");
+        }
     }
 #endif
 
@@ -394,8 +415,8 @@ void Network::network_thread()
 
     /* Initialize application(s) */
     if(enable_shell) {
-        extern void shell_init(void);
-        shell_init();
+        extern void shell_init(size_t tx_size, const std::string& overflow);
+        shell_init(shell_tx_buffer, shell_overflow);
     }
 
     if(enable_ntp) {
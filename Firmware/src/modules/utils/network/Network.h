@@ -35,11 +35,15 @@ class Network : public Module {
         int timezone{0};
         std::string hostname;
         std::string ntp_server;
+        std::string shell_overflow;
+        uint32_t shell_tx_buffer;
+        uint32_t ftp_write_buffers;
 
         volatile bool abort_network{false};
         bool enable_shell{false};
         bool enable_httpd{false};
         bool enable_ftpd{false};
+        bool ftp_fast_mode{false};
         bool enable_ntp{true};
         bool use_dhcp;
 };
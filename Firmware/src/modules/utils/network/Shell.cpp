@@ -3,6 +3,7 @@
 #include "RingBuffer.h"
 #include "MessageQueue.h"
 #include "Consoles.h"
+#include "Lock.h"
 
 #include "FreeRTOS.h"
 #include "timers.h"
@@ -14,10 +15,19 @@
 
 #include <set>
 #include <vector>
+#include <string>
 
 #define MAX_SERV 3
 #define BUFSIZE 256
 #define MAGIC 0x6013D852
+// how long a write waits for room before the overflow policy is applied
+#define TX_GRACE_MS 100
+
+// what to do with output when a client is not reading it fast enough
+enum overflow_policy_t { OVERFLOW_DROP, OVERFLOW_DISCONNECT, OVERFLOW_BLOCK };
+static overflow_policy_t overflow_policy = OVERFLOW_DROP;
+static size_t tx_buffer_size = 4096;
+
 struct shell_state_t {
     Socket_t socket;
     SocketSet_t ss;
@@ -28,18 +38,35 @@ struct shell_state_t {
     size_t cnt;
     bool discard;
     uint32_t magic;
+
+    // output waiting to be sent, only the command thread adds to it and only the shell thread sends it
+    RingBuffer<char> txq;
+    char *txbuf;
+    bool want_write;        // the socket is in the select set for write
+    volatile bool stalled;  // the client is not keeping up, writes do not wait for room until it has caught up
+    volatile bool kill;     // the overflow policy wants it disconnected
+
+    // stats
+    uint32_t id;
+    uint32_t tx_queued;
+    uint32_t tx_sent;
+    uint32_t tx_dropped;
+    uint32_t tx_overflows;
+    uint32_t tx_max;
 };
 using shell_t = struct shell_state_t;
 static std::set<shell_t*> shells;
+// protects shells while it is read by the command thread for the stats
+static SemaphoreHandle_t shells_mutex;
+static uint32_t next_id = 1;
 
-// Stores OutputStreams that need to be deleted when done
-using gc_t = OutputStream*;
-static RingBuffer<gc_t, MAX_SERV * 2> gc;
+// Stores shells that need to be deleted when their OutputStream is done
+using gc_t = shell_t*;
+static StaticRingBuffer<gc_t, 8> gc;
 
 // callback from command thread to write data to the socket
-// we can write it here, however only one thread can write to a socket
-// this should be ok as it should only be the command thread
-// this blocks until all data is written
+// only the shell thread writes to the socket, this just queues the data and wakes it up so a slow client
+// does not hold up the command thread, if the queue is full the overflow policy decides what happens
 static int write_back(shell_t *p_shell, const char *rbuf, size_t len)
 {
     if(p_shell->magic != MAGIC) {
@@ -47,23 +74,123 @@ static int write_back(shell_t *p_shell, const char *rbuf, size_t len)
         printf("ERROR: shell: write_back() magic was bad\n");
         return 0;
     }
-    size_t sz = len;
-    while(sz > 0) {
-        if(p_shell->os->is_closed()) return 0;
-        BaseType_t n = FreeRTOS_send(p_shell->socket, rbuf, sz, 0);
-        if(n < 0) {
-            printf("DEBUG: shell: error writing: %ld\n", n);
-            // send signal to quit this socket
-            FreeRTOS_SignalSocket(p_shell->socket);
-            return 0;
+
+    if(p_shell->os->is_closed() || p_shell->kill) return 0;
+
+    // while it is stalled drop whole writes rather than leave part of a line
+    size_t space = p_shell->txq.get_free();
+    if(p_shell->stalled && overflow_policy == OVERFLOW_DROP && space < len) {
+        p_shell->tx_dropped += len;
+        return len;
+    }
+
+    // when dropping only whole writes are queued, so the first overflow does not leave part of a line either,
+    // unless it is bigger than the whole queue
+    bool whole = overflow_policy == OVERFLOW_DROP && len <= p_shell->txq.get_capacity();
+    size_t n = 0;
+    TickType_t start = xTaskGetTickCount();
+    while(true) {
+        if(!whole || p_shell->txq.get_free() >= len) {
+            n += p_shell->txq.push(&rbuf[n], len - n);
+        }
+
+        // wakes up the shell thread to send it
+        FreeRTOS_SignalSocket(p_shell->socket);
+
+        if(n == len) break;
+
+        if(p_shell->os->is_closed() || p_shell->kill) return 0;
+
+        // full, wait for it to drain a bit
+        if(overflow_policy == OVERFLOW_BLOCK || (!p_shell->stalled && xTaskGetTickCount() - start < pdMS_TO_TICKS(TX_GRACE_MS))) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+
+        // the client is not keeping up
+        p_shell->stalled = true;
+        ++p_shell->tx_overflows;
+        if(overflow_policy == OVERFLOW_DROP) {
+            p_shell->tx_dropped += len - n;
+            break;
         }
 
-        sz -= n;
-        rbuf += n;
+        printf("WARNING: shell: client %lu is not reading its output, disconnecting\n", p_shell->id);
+        p_shell->kill = true;
+        return 0;
     }
+
+    p_shell->tx_queued += n;
+    size_t sz = p_shell->txq.get_size();
+    if(sz > p_shell->tx_max) p_shell->tx_max = sz;
     return len;
 }
 
+// sends as much of the queued output as the socket will take without blocking
+// returns false if the socket had an error
+static bool send_queued(shell_t *p_shell)
+{
+    char buf[BUFSIZE];
+    while(!p_shell->txq.empty()) {
+        BaseType_t space = FreeRTOS_maywrite(p_shell->socket);
+        if(space <= 0) break;
+
+        size_t n = p_shell->txq.pop(buf, (size_t)space < sizeof(buf) ? (size_t)space : sizeof(buf));
+
+        BaseType_t r = FreeRTOS_send(p_shell->socket, buf, n, FREERTOS_MSG_DONTWAIT);
+        if(r < 0) {
+            FreeRTOS_printf( ("shell: error writing: %ld\n", r) );
+            return false;
+        }
+        p_shell->tx_sent += r;
+        // should not happen as maywrite said there was room
+        p_shell->tx_dropped += n - r;
+    }
+
+    // have select wake us when there is room for the rest
+    bool ww = !p_shell->txq.empty();
+    if(ww != p_shell->want_write) {
+        p_shell->want_write = ww;
+        if(ww) {
+            FreeRTOS_FD_SET(p_shell->socket, p_shell->ss, eSELECT_WRITE);
+        } else {
+            FreeRTOS_FD_CLR(p_shell->socket, p_shell->ss, eSELECT_WRITE);
+        }
+    }
+
+    if(!ww) p_shell->stalled = false;
+
+    return true;
+}
+
+void shell_stats(OutputStream& os)
+{
+    struct stats_t { uint32_t id, queued, sent, dropped, overflows, max, pending; };
+    std::vector<stats_t> v;
+    {
+        // copied so the lock is not held while it is output, which could be to one of the shells
+        AutoLock l(shells_mutex);
+        for (auto p : shells) {
+            v.push_back({p->id, p->tx_queued, p->tx_sent, p->tx_dropped, p->tx_overflows, p->tx_max, (uint32_t)p->txq.get_size()});
+        }
+    }
+
+    static const char *policies[] = {"drop", "disconnect", "block"};
+    os.printf("Shell connections: %u, tx buffer %u, overflow %s\n", v.size(), tx_buffer_size, policies[overflow_policy]);
+    for(auto& s : v) {
+        os.printf("  %lu: queued %lu, sent %lu, pending %lu, max %lu, dropped %lu, overflows %lu\n",
+                  s.id, s.queued, s.sent, s.pending, s.max, s.dropped, s.overflows);
+    }
+}
+
+static void delete_shell(shell_t *p_shell)
+{
+    delete p_shell->os;
+    p_shell->txq.deallocate();
+    free(p_shell->txbuf);
+    delete p_shell;
+}
+
 /**************************************************************
  * Close the socket and remove this shell_t from the list.
  **************************************************************/
@@ -76,38 +203,39 @@ static void close_shell(shell_t *p_shell)
     FreeRTOS_FD_CLR(p_shell->socket, p_shell->ss, eSELECT_ALL);
     FreeRTOS_closesocket(p_shell->socket);
 
+    {
+        AutoLock l(shells_mutex);
+        if(shells.erase(p_shell) != 1) {
+            printf("DEBUG: shell: erasing shell not found\n");
+        }
+    }
+
     // if we delete the OutputStream now and command thread is still outputting stuff we will crash
     // it needs to stick around until the command has completed
-    // this is also true of the tx_queue
+    // this is also true of the tx_queue, so the whole shell state is kept until then
+    p_shell->os->set_closed();
     if(p_shell->os->is_done()) {
         FreeRTOS_printf( ("shell: releasing output stream: %p\n", p_shell->os) );
-        delete p_shell->os;
+        delete_shell(p_shell);
 
     } else {
         FreeRTOS_printf( ("shell: delaying releasing output stream: %p\n", p_shell->os) );
-        p_shell->os->set_closed();
-        gc.push_back(p_shell->os);
+        gc.push_back(p_shell);
     }
-
-    // Free shell state
-    if(shells.erase(p_shell) != 1) {
-        printf("DEBUG: shell: erasing shell not found\n");
-    }
-    free(p_shell);
 }
 
-// This will delete any OutputStreams that are done
+// This will delete any shells whose OutputStreams are done
 // we need to do this so that we don't crash when an OutputStream is deleted before it is done
 // ditto with the tx_queue
 static void os_garbage_collector( TimerHandle_t xTimer )
 {
     while(!gc.empty()) {
         // we only check the oldest, presuming it will be done before newer ones
-        OutputStream *os = gc.peek_front();
-        if(os->is_done()) {
-            os = gc.pop_front();
-            delete os;
-            FreeRTOS_printf( ("shell: releasing output stream: %p\n", os) );
+        shell_t *p_shell = gc.peek_front();
+        if(p_shell->os->is_done()) {
+            gc.pop_front();
+            FreeRTOS_printf( ("shell: releasing output stream: %p\n", p_shell->os) );
+            delete_shell(p_shell);
         } else {
             // if this is not done then we presume the newer ones aren't either
             break;
@@ -188,22 +316,37 @@ static void shell_thread(void *arg)
         // At least one descriptor is ready
         if (FreeRTOS_FD_ISSET(listenfd, socketset)) {
             // We have a new connection request create a new shell
-            shell_t *p_shell = (shell_t *)malloc(sizeof(shell_t));
-            if(p_shell != nullptr) {
+            shell_t *p_shell = new shell_t;
+            char *txbuf = (char *)malloc(tx_buffer_size);
+            if(p_shell != nullptr && txbuf != nullptr) {
                 p_shell->socket = FreeRTOS_accept(listenfd, &p_shell->cliaddr, &p_shell->clilen);
                 if (p_shell->socket == FREERTOS_INVALID_SOCKET) {
-                    free(p_shell);
+                    delete p_shell;
+                    free(txbuf);
                     printf("shell: accept socket error\n");
 
                 } else {
-                    // add shell state to our set of shells
-                    shells.insert(p_shell);
-
                     FreeRTOS_printf( ("shell: accepted shell connection: %p\n", p_shell->socket) );
 
                     // initialise command buffer state
                     p_shell->cnt = 0;
                     p_shell->discard = false;
+
+                    // initialise the output queue
+                    p_shell->txbuf = txbuf;
+                    p_shell->txq.allocate(txbuf, tx_buffer_size);
+                    p_shell->want_write = false;
+                    p_shell->stalled = false;
+                    p_shell->kill = false;
+                    p_shell->id = next_id++;
+                    p_shell->tx_queued = p_shell->tx_sent = p_shell->tx_dropped = p_shell->tx_overflows = p_shell->tx_max = 0;
+
+                    // add shell state to our set of shells
+                    {
+                        AutoLock l(shells_mutex);
+                        shells.insert(p_shell);
+                    }
+
                     p_shell->os = new OutputStream([p_shell](const char *ibuf, size_t ilen) { return write_back(p_shell, ibuf, ilen); });
 
                     // we need it to know this so it can clr itself on close
@@ -222,6 +365,9 @@ static void shell_thread(void *arg)
                 }
 
             } else {
+                delete p_shell;
+                free(txbuf);
+
                 /* No memory to accept connection. Just accept and then close */
                 Socket_t sock;
                 struct freertos_sockaddr cliaddr;
@@ -235,9 +381,17 @@ static void shell_thread(void *arg)
             }
         }
 
-        // check for read requests
-        for (auto p_shell : shells) {
-            if (FreeRTOS_FD_ISSET(p_shell->socket, p_shell->ss)) {
+        // close_shell() removes it from the set so go through a copy
+        std::vector<shell_t*> ready(shells.begin(), shells.end());
+        for (auto p_shell : ready) {
+            if(p_shell->kill) {
+                // the overflow policy wanted it disconnected
+                close_shell(p_shell);
+                continue;
+            }
+
+            // check for read requests
+            if (FreeRTOS_FD_ISSET(p_shell->socket, p_shell->ss) & (eSELECT_READ | eSELECT_EXCEPT)) {
                 FreeRTOS_printf( ("DEBUG: shell: pshell %p was SET: %02lX\n", p_shell, FreeRTOS_FD_ISSET(p_shell->socket, p_shell->ss)) );
                 char buf[BUFSIZE];
                 // This socket is ready for reading.
@@ -257,23 +411,35 @@ static void shell_thread(void *arg)
                     // so tell it to not wait, and if it returns false it means it had no room
                     if(!process_command_buffer(n, buf, p_shell->os, p_shell->line, p_shell->cnt, p_shell->discard, false)) {
                         // and keep trying to resubmit
+                        bool closed = false;
                         while(!send_message_queue(p_shell->line, p_shell->os, false)) {
                             vTaskDelay(pdMS_TO_TICKS(100));
+                            // keep sending output while we wait, the command thread may be waiting for room
+                            for (auto s : shells) {
+                                send_queued(s);
+                            }
                             // make sure we are still connected
                             if(FreeRTOS_issocketconnected(p_shell->socket) != pdTRUE) {
                                 printf("DEBUG: shell: socket disconnected while waiting for command thread\n");
                                 close_shell(p_shell);
+                                closed = true;
                                 break;
                             }
                         }
+                        if(closed) continue;
                     }
 
                 } else if(n < 0) {
                     FreeRTOS_printf( ("shell: got error on read: %d\n", n) );
                     close_shell(p_shell);
-                    break;
+                    continue;
                 }
             }
+
+            // send any output that is waiting
+            if(!send_queued(p_shell)) {
+                close_shell(p_shell);
+            }
         }
     }
 
@@ -294,10 +460,26 @@ static void shell_thread(void *arg)
     vTaskDelete(NULL);
 }
 
-void shell_init(void)
+void shell_init(size_t tx_size, const std::string& overflow)
 {
+    // the queue uses a power of two
+    tx_buffer_size = BUFSIZE;
+    while(tx_buffer_size * 2 <= tx_size) tx_buffer_size *= 2;
+    if(overflow == "drop") {
+        overflow_policy = OVERFLOW_DROP;
+    } else if(overflow == "disconnect") {
+        overflow_policy = OVERFLOW_DISCONNECT;
+    } else if(overflow == "block") {
+        overflow_policy = OVERFLOW_BLOCK;
+    } else {
+        printf("WARNING: shell: unknown overflow policy %s, using drop\n", overflow.c_str());
+        overflow_policy = OVERFLOW_DROP;
+    }
+
+    if(shells_mutex == nullptr) shells_mutex = xSemaphoreCreateMutex();
+
     // make same priority as other comms threads
-    xTaskCreate(shell_thread, "shell_thread", 350, NULL, tskIDLE_PRIORITY + COMMS_PRI, NULL);
+    xTaskCreate(shell_thread, "shell_thread", 450, NULL, tskIDLE_PRIORITY + COMMS_PRI, NULL);
 }
 
 void shell_deinit()
@@ -11,6 +11,11 @@
 #include "main.h"
 #include "MessageQueue.h"
 #include "Consoles.h"
+#include "Planner.h"
+#include "StepperMotor.h"
+#include "ConfigReader.h"
+#include "qspi.h"
+#include "ff.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -21,6 +26,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <tuple>
+#include <fstream>
+#include <memory>
 
 #define on_boot_gcode_key "on_boot_gcode"
 #define on_boot_gcode_enable_key "on_boot_gcode_enable"
@@ -28,6 +35,20 @@
 #define before_resume_gcode_key "before_resume_gcode"
 #define leave_heaters_on_suspend_key "leave_heaters_on_suspend"
 
+// the index is decimated to this many entries when loaded
+#define MAX_TIME_INDEX_ENTRIES 1000
+
+// The job cache in qspi, a header page describing the file that was copied followed by the file itself
+#define JOB_MAGIC 0x31424F4AUL // "JOB1"
+struct Player::job_header_t {
+    uint32_t magic;
+    uint32_t size;
+    // the date and time of the file on the sdcard, a changed file is not played from the cache
+    uint16_t fdate;
+    uint16_t ftime;
+    char name[244];
+};
+
 #define HELP(m) if(params == "-h") { os.printf("%s\n", m); return true; }
 
 Player *Player::instance = nullptr;
@@ -57,6 +78,7 @@ Player::Player() : Module("player")
     this->current_os = nullptr;
     this->suspended = false;
     this->suspend_loops = 0;
+    this->estimated_time = 0;
     abort_thread = false;
     abort_flg = false;
     play_thread_exited = false;
@@ -103,6 +125,8 @@ bool Player::configure(ConfigReader& cr)
     THEDISPATCHER->add_handler( "abort", std::bind( &Player::abort_command, this, _1, _2) );
     THEDISPATCHER->add_handler( "suspend", std::bind( &Player::suspend_command, this, _1, _2) );
     THEDISPATCHER->add_handler( "resume", std::bind( &Player::resume_command, this, _1, _2) );
+    THEDISPATCHER->add_handler( "estimate", std::bind( &Player::estimate_command, this, _1, _2) );
+    THEDISPATCHER->add_handler( "cache", std::bind( &Player::cache_command, this, _1, _2) );
 
     // set this so the command ctx call back gets called
     want_command_ctx = true;
@@ -134,7 +158,7 @@ bool Player::handle_m23(std::string& params, OutputStream& os)
     cmd.append(" -p"); // starts paused
     play_command(cmd, nullos);
 
-    if(this->current_file_handler == nullptr) {
+    if(!is_loaded()) {
         os.printf("file.open failed: %s\n", params.c_str());
 
     } else {
@@ -155,7 +179,7 @@ bool Player::handle_m32(std::string& params, OutputStream& os)
     play_command(f, nullos);
 
     // we need to send back different messages for M32
-    if(this->current_file_handler == nullptr) {
+    if(!is_loaded()) {
         os.printf("file.open failed: %s\n", params.c_str());
     }
 
@@ -171,7 +195,7 @@ bool Player::handle_gcode(GCode& gcode, OutputStream& os)
                 break;
 
             case 24: // start print
-                if (this->current_file_handler != NULL) {
+                if (is_loaded()) {
                     this->playing_file = true;
                     this->reply_os = &os;
                 }
@@ -182,7 +206,7 @@ bool Player::handle_gcode(GCode& gcode, OutputStream& os)
                 break;
 
             case 26: // Reset print. Slightly different than M26 in Marlin and the rest
-                if(this->current_file_handler != nullptr) {
+                if(is_loaded()) {
                     std::string currentfn = this->filename.c_str();
 
                     // abort the print
@@ -192,7 +216,7 @@ bool Player::handle_gcode(GCode& gcode, OutputStream& os)
                     if(!currentfn.empty()) {
                         play_command(currentfn, nullos);
 
-                        if(this->current_file_handler == nullptr) {
+                        if(!is_loaded()) {
                             os.printf("file.open failed: %s\n", currentfn.c_str());
                         }
                     }
@@ -265,17 +289,32 @@ bool Player::play_command( std::string& params, OutputStream& os )
     // Get filename which is the entire parameter line upto any options found or entire line
     this->filename = params;
 
-    if(this->current_file_handler != nullptr) { // must have been a paused print
-        fclose(this->current_file_handler);
+    // must have been a paused print
+    close_job();
+
+    // play it from the job cache if it is the one in there and it has not changed since it was cached
+    const job_header_t *job = get_cached_job();
+    if(job != nullptr && filename == job->name) {
+        FILINFO fno;
+        FRESULT res = f_stat(filename.c_str(), &fno);
+        if(res != FR_OK || (fno.fsize == job->size && fno.fdate == job->fdate && fno.ftime == job->ftime)) {
+            // it must stay memory mapped while it is played from there
+            qspi_hold_mapped(true);
+            this->cached_job = (const char *)job + sizeof(job_header_t);
+        } else {
+            os.printf("  %s has changed since it was cached, playing from the sdcard\n", this->filename.c_str());
+        }
     }
 
-    this->current_file_handler = fopen( this->filename.c_str(), "r");
-    if(this->current_file_handler == nullptr) {
-        os.printf("File not found: %s\n", this->filename.c_str());
-        return true;
+    if(this->cached_job == nullptr) {
+        this->current_file_handler = fopen( this->filename.c_str(), "r");
+        if(this->current_file_handler == nullptr) {
+            os.printf("File not found: %s\n", this->filename.c_str());
+            return true;
+        }
     }
 
-    os.printf("Playing %s\n", this->filename.c_str());
+    os.printf("Playing %s%s\n", this->filename.c_str(), this->cached_job != nullptr ? " from the qspi cache" : "");
 
     if( options.find_first_of("Pp") == std::string::npos ) {
         this->playing_file = true;
@@ -293,7 +332,10 @@ bool Player::play_command( std::string& params, OutputStream& os )
 
     // get size of file
     struct stat buf;
-    if (stat(filename.c_str(), &buf) >= 0) {
+    if(this->cached_job != nullptr) {
+        file_size = job->size;
+        os.printf("  File size %ld\n", file_size);
+    } else if (stat(filename.c_str(), &buf) >= 0) {
         file_size = buf.st_size;
         os.printf("  File size %ld\n", file_size);
     } else {
@@ -303,6 +345,9 @@ bool Player::play_command( std::string& params, OutputStream& os )
 
     this->played_cnt = 0;
 
+    // use the estimated time index if there is one
+    load_time_index(os);
+
     // start play thread
     play_thread_exited = false;
 
@@ -323,7 +368,7 @@ bool Player::progress_command( std::string& params, OutputStream& os )
     std::string options = stringutils::shift_parameter( params );
     bool sdprinting = options.find_first_of("Bb") != std::string::npos;
 
-    if(!playing_file && current_file_handler != nullptr) {
+    if(!playing_file && is_loaded()) {
         if(sdprinting)
             os.printf("SD printing byte %lu/%lu\n", played_cnt, file_size);
         else
@@ -342,13 +387,22 @@ bool Player::progress_command( std::string& params, OutputStream& os )
     if(file_size > 0) {
         unsigned long est = 0;
         unsigned long elapsed_secs = ((xTaskGetTickCount() - start_ticks) * 1000 / configTICK_RATE_HZ) / 1000;
-        if(elapsed_secs > 10) {
-            unsigned long bytespersec = played_cnt / elapsed_secs;
-            if(bytespersec > 0)
-                est = (file_size - played_cnt) / bytespersec;
-        }
+        float pcnt;
+        if(!time_index.empty() && estimated_time > 0) {
+            // use the estimated time from the index for the lines played so far
+            float done = TimeEstimator::lookup(time_index, played_cnt);
+            est = lroundf(std::max(0.0F, estimated_time - done));
+            pcnt = done * 100.0F / estimated_time;
 
-        float pcnt = ((float)file_size - (file_size - played_cnt)) * 100.0F / file_size;
+        } else {
+            if(elapsed_secs > 10) {
+                unsigned long bytespersec = played_cnt / elapsed_secs;
+                if(bytespersec > 0)
+                    est = (file_size - played_cnt) / bytespersec;
+            }
+
+            pcnt = ((float)file_size - (file_size - played_cnt)) * 100.0F / file_size;
+        }
         // If -b or -B is passed, report in the format used by Marlin and the others.
         if (!sdprinting) {
             os.printf("file: %s, %5.1f %% complete, elapsed time: %02lu:%02lu:%02lu", this->filename.c_str(), roundf(pcnt), elapsed_secs / 3600, (elapsed_secs % 3600) / 60, elapsed_secs % 60);
@@ -367,11 +421,132 @@ bool Player::progress_command( std::string& params, OutputStream& os )
     return true;
 }
 
+// loads filename.idx if it exists, this is written by the estimate command or the host estimate tool
+// it is only used if it was made from a file of the same size and date
+bool Player::load_time_index(OutputStream& os)
+{
+    time_index.clear();
+    estimated_time = 0;
+
+    FILINFO fno;
+    if(f_stat(this->filename.c_str(), &fno) != FR_OK) return false;
+
+    std::string fn(this->filename);
+    fn.append(".idx");
+    FILE *fp = fopen(fn.c_str(), "r");
+    if(fp == nullptr) return false;
+
+    bool ok = TimeEstimator::read_index(fp, time_index, estimated_time, MAX_TIME_INDEX_ENTRIES, fno.fsize, ((uint32_t)fno.fdate << 16) | fno.ftime);
+    fclose(fp);
+    if(!ok) {
+        os.printf("WARNING - time index %s is out of date or invalid, ignored\n", fn.c_str());
+        time_index.clear();
+        estimated_time = 0;
+        return false;
+    }
+
+    unsigned long est = lroundf(estimated_time);
+    os.printf("  Estimated time %02lu:%02lu:%02lu\n", est / 3600, (est % 3600) / 60, est % 60);
+    return true;
+}
+
+// Plans the moves in the file without running them to estimate how long it will take to play
+bool Player::estimate_command( std::string& params, OutputStream& os )
+{
+    HELP("estimate file [-w] - estimate the time to play the file, -w writes the index used by progress")
+
+    // it reads the whole file so would hold up the file being played
+    if(this->playing_file || this->suspended || is_loaded()) {
+        os.printf("Currently printing, abort print first\n");
+        return true;
+    }
+
+    std::string options = extract_options(params);
+    std::string fn = params;
+
+    FILE *fp = fopen(fn.c_str(), "r");
+    if(fp == nullptr) {
+        os.printf("File not found: %s\n", fn.c_str());
+        return true;
+    }
+
+    std::unique_ptr<TimeEstimator> te(new TimeEstimator);
+
+    // take the settings from the config we booted with, then use the current values which may have been changed since
+    std::fstream fs;
+    fs.open("/sd/config.ini", std::fstream::in);
+    if(fs.is_open()) {
+        ConfigReader cr(fs);
+        te->configure(cr);
+        fs.close();
+    }
+    te->default_acceleration = Robot::getInstance()->get_default_acceleration();
+    te->feed_rate = Robot::getInstance()->get_feed_rate(1);
+    te->seek_rate = Robot::getInstance()->get_feed_rate(0);
+    te->junction_deviation = Planner::getInstance()->get_junction_deviation();
+    te->z_junction_deviation = Planner::getInstance()->get_z_junction_deviation();
+    te->minimum_planner_speed = Planner::getInstance()->get_minimum_planner_speed();
+    te->centripetal_acceleration = Planner::getInstance()->get_centripetal_acceleration();
+    te->full_vector_junction = Planner::getInstance()->is_full_vector_junction();
+    for (size_t i = 0; i < 4 && i < Robot::getInstance()->actuators.size(); ++i) {
+        te->actuator_acceleration[i] = Robot::getInstance()->actuators[i]->get_acceleration();
+    }
+    te->grbl_mode = THEDISPATCHER->is_grbl_mode();
+
+    // same line handling as the player thread
+    char buf[130];
+    uint32_t offset = 0;
+    uint32_t errors = 0;
+    bool discard = false;
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        if(Module::is_halted()) break;
+
+        int len = strlen(buf);
+        offset += len;
+        if(buf[len - 1] != '\n' && !feof(fp)) {
+            discard = true;
+            continue;
+        }
+        if(discard) {
+            discard = false;
+            continue;
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if(!te->add_line(buf, offset)) ++errors;
+
+        if((te->get_line_count() % 1000) == 0) {
+            // let other threads run
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+    fclose(fp);
+
+    float total = te->finish();
+    unsigned long est = lroundf(total);
+    os.printf("%s: %lu lines, %lu moves, %lu errors\n", fn.c_str(), te->get_line_count(), te->get_move_count(), errors);
+    os.printf("Estimated time: %02lu:%02lu:%02lu\n", est / 3600, (est % 3600) / 60, est % 60);
+
+    if( options.find_first_of("Ww") != std::string::npos ) {
+        FILINFO fno;
+        FRESULT res = f_stat(fn.c_str(), &fno);
+        fn.append(".idx");
+        FILE *ofp = res == FR_OK ? fopen(fn.c_str(), "w") : nullptr;
+        if(ofp == nullptr || !te->write_index(ofp, fno.fsize, ((uint32_t)fno.fdate << 16) | fno.ftime)) {
+            os.printf("Failed to write index %s\n", fn.c_str());
+        } else {
+            os.printf("Index written to %s\n", fn.c_str());
+        }
+        if(ofp != nullptr) fclose(ofp);
+    }
+
+    return true;
+}
+
 bool Player::abort_command( std::string& params, OutputStream& os )
 {
     HELP("abort playing file");
 
-    if(!playing_file && current_file_handler == nullptr) {
+    if(!playing_file && !is_loaded()) {
         if(suspended) {
             // clean up from suspend
             suspended = false;
@@ -449,6 +624,9 @@ void Player::in_command_ctx(bool idle)
     // clean up the play thread once it has finished normally
     if(play_thread_exited) {
         play_thread_exited = false;
+        estimated_time = 0;
+        time_index.clear();
+        time_index.shrink_to_fit();
     }
 }
 
@@ -461,7 +639,53 @@ void Player::player_thread()
     bool discard = false;
     uint32_t linecnt = 0;
 
-    while(fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
+    if(this->cached_job != nullptr) {
+        // the lines are split in place in the memory mapped qspi and sent straight to the message queue from there,
+        // nothing is read from the sdcard and the line rate does not depend on it
+        const char *p = this->cached_job;
+        const char *end = p + file_size;
+        while(p < end) {
+            while(!playing_file && !abort_thread && !Module::is_halted()) {
+                // we must be paused
+                vTaskDelay(pdMS_TO_TICKS(200)); // sleep and yield
+            }
+
+            // allows us to abort the thread
+            if(abort_thread || Module::is_halted()) {
+                abort_thread = false;
+                break;
+            }
+
+            const char *line = p;
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            p = (nl == nullptr) ? end : nl + 1;
+            played_cnt += p - line;
+
+            size_t len = (nl == nullptr ? end : nl) - line;
+            if(len > 0 && line[len - 1] == '\r') --len;
+            if(len == 0) continue; // empty line
+            if(len > sizeof(buf) - 2) {
+                if(this->current_os != nullptr) { this->current_os->printf("Warning: Discarded long line\n"); }
+                continue;
+            }
+
+            if(current_os != nullptr) {
+                current_os->printf("%.*s\n", (int)len, line);
+            }
+
+            // don't fill block queue so don't let planner stall on a full queue
+            Conveyor::getInstance()->wait_for_room();
+
+            send_message_queue_len(line, len, &nullos);
+
+            if((++linecnt % 100) == 0) {
+                // yield to some other threads every 100 lines or so
+                vTaskDelay(pdMS_TO_TICKS(1));
+            }
+        }
+    }
+
+    while(this->current_file_handler != nullptr && fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
         while(!playing_file && !abort_thread && !Module::is_halted()) {
             // we must be paused
             vTaskDelay(pdMS_TO_TICKS(200)); // sleep and yield
@@ -516,8 +740,8 @@ void Player::player_thread()
     this->filename = "";
     played_cnt = 0;
     file_size = 0;
-    fclose(this->current_file_handler);
-    current_file_handler = nullptr;
+    // the time index is freed by the command thread as it is read there
+    close_job();
     this->current_os = nullptr;
 
     if(this->reply_os != nullptr) {
@@ -532,15 +756,181 @@ void Player::player_thread()
     play_thread_exited = true;
 }
 
+void Player::close_job()
+{
+    if(this->current_file_handler != nullptr) {
+        fclose(this->current_file_handler);
+        this->current_file_handler = nullptr;
+    }
+    if(this->cached_job != nullptr) {
+        this->cached_job = nullptr;
+        qspi_hold_mapped(false);
+    }
+}
+
+// returns the header of the job in the cache if there is a valid one
+const Player::job_header_t *Player::get_cached_job()
+{
+#ifdef BOARD_NUCLEO
+    return nullptr;
+#else
+    static_assert(sizeof(job_header_t) == 256, "job header should be one page");
+    if(!qspi_mount()) return nullptr;
+    const job_header_t *h = (const job_header_t *)(QSPI_MAPPED_BASE + QSPI_JOB_START);
+    if(h->magic != JOB_MAGIC || h->size > QSPI_JOB_SIZE - sizeof(job_header_t) || memchr(h->name, '\0', sizeof(h->name)) == nullptr) {
+        return nullptr;
+    }
+    return h;
+#endif
+}
+
+// Copy a file into the job cache in qspi, playing that file will then run it from there instead of the sdcard
+bool Player::cache_command( std::string& params, OutputStream& os )
+{
+    HELP("cache [file] | [-d] - copy file to the qspi job cache, -d clears the cache, no arguments shows what is cached");
+
+#ifdef BOARD_NUCLEO
+    os.printf("NUCLEO does not have qspi\n");
+    return true;
+#else
+    if(this->playing_file || this->suspended || is_loaded()) {
+        os.printf("Currently printing, abort print first\n");
+        return true;
+    }
+
+    if(params.empty()) {
+        const job_header_t *job = get_cached_job();
+        if(job == nullptr) {
+            os.printf("No job is cached\n");
+        } else {
+            os.printf("%s is cached, size %lu\n", job->name, job->size);
+        }
+        return true;
+    }
+
+    if(params == "-d") {
+        if(!qspi_erase_sector(QSPI_JOB_START)) {
+            os.printf("ERROR: failed to erase the job cache\n");
+        } else {
+            os.printf("job cache cleared\n");
+        }
+        return true;
+    }
+
+    // check the new file can be cached before the cached job is touched
+    FILINFO fno;
+    if(f_stat(params.c_str(), &fno) != FR_OK) {
+        os.printf("File not found: %s\n", params.c_str());
+        return true;
+    }
+    if(fno.fsize > QSPI_JOB_SIZE - sizeof(job_header_t)) {
+        os.printf("ERROR: %s is too big for the job cache, max size is %lu\n", params.c_str(), (unsigned long)(QSPI_JOB_SIZE - sizeof(job_header_t)));
+        return true;
+    }
+    if(params.size() >= sizeof(job_header_t::name)) {
+        os.printf("ERROR: file name is too long\n");
+        return true;
+    }
+
+    FILE *fp = fopen(params.c_str(), "r");
+    if(fp == nullptr) {
+        os.printf("File not found: %s\n", params.c_str());
+        return true;
+    }
+
+    const uint32_t bufsize = 4096;
+    char *buf = (char *)malloc(bufsize);
+    if(buf == nullptr) {
+        fclose(fp);
+        os.printf("ERROR: not enough memory\n");
+        return true;
+    }
+
+    // invalidate it first so a job that was only partly written is never played
+    if(!qspi_erase_sector(QSPI_JOB_START)) {
+        free(buf);
+        fclose(fp);
+        os.printf("ERROR: failed to erase the job cache\n");
+        return true;
+    }
+
+    uint32_t start = xTaskGetTickCount();
+    uint32_t size = fno.fsize;
+    uint32_t data_start = QSPI_JOB_START + sizeof(job_header_t);
+    bool ok = true;
+
+    // the first sector was erased above
+    for (uint32_t a = QSPI_JOB_START + QSPI_SECTOR_SIZE; a < data_start + size; a += QSPI_SECTOR_SIZE) {
+        if(!qspi_erase_sector(a)) {
+            ok = false;
+            break;
+        }
+    }
+
+    uint32_t n = 0;
+    while(ok && n < size) {
+        size_t l = fread(buf, 1, bufsize, fp);
+        if(l == 0) {
+            ok = false;
+            break;
+        }
+        if(n + l > size) l = size - n;
+        if(!qspi_write(data_start + n, buf, l)) ok = false;
+        n += l;
+    }
+
+    // check it against the file before the header is written to make it valid
+    if(ok && qspi_mount()) {
+        rewind(fp);
+        n = 0;
+        while(ok && n < size) {
+            size_t l = fread(buf, 1, bufsize, fp);
+            if(l == 0 || memcmp(buf, (const void *)(QSPI_MAPPED_BASE + data_start + n), std::min((uint32_t)l, size - n)) != 0) ok = false;
+            n += l;
+        }
+    } else {
+        ok = false;
+    }
+
+    free(buf);
+    fclose(fp);
+
+    if(ok) {
+        job_header_t h;
+        memset(&h, 0, sizeof(h));
+        h.magic = JOB_MAGIC;
+        h.size = size;
+        h.fdate = fno.fdate;
+        h.ftime = fno.ftime;
+        strcpy(h.name, params.c_str());
+        ok = qspi_write(QSPI_JOB_START, &h, sizeof(h)) && get_cached_job() != nullptr;
+    }
+
+    if(!ok) {
+        qspi_erase_sector(QSPI_JOB_START);
+        os.printf("ERROR: failed to cache %s\n", params.c_str());
+        return true;
+    }
+
+    uint32_t ms = (xTaskGetTickCount() - start) * 1000 / configTICK_RATE_HZ;
+    os.printf("cached %s, %lu bytes in %lu ms\n", params.c_str(), size, ms);
+    return true;
+#endif
+}
+
 bool Player::request(const char *key, void *value)
 {
     if(strcmp("is_playing", key) == 0) {
         unsigned long elapsed_secs = 0;
         unsigned char pcnt = 0;
-        bool playing = (this->playing_file || this->current_file_handler);
+        bool playing = (this->playing_file || is_loaded());
         if(playing) {
             elapsed_secs = ((xTaskGetTickCount() - start_ticks) * 1000 / configTICK_RATE_HZ) / 1000;
-            pcnt = roundf(((float)file_size - (file_size - played_cnt)) * 100.0F / file_size);
+            if(!time_index.empty() && estimated_time > 0) {
+                pcnt = roundf(TimeEstimator::lookup(time_index, played_cnt) * 100.0F / estimated_time);
+            } else {
+                pcnt = roundf(((float)file_size - (file_size - played_cnt)) * 100.0F / file_size);
+            }
         }
         std::tuple<bool, unsigned long, unsigned char> r = std::make_tuple(playing, elapsed_secs, pcnt);
         memcpy(value, &r, sizeof(r));
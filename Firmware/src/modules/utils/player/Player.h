@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Module.h"
+#include "TimeEstimator.h"
 
 #include <string>
 #include <map>
@@ -30,6 +31,13 @@ class Player : public Module {
         bool abort_command( std::string& parameters, OutputStream& os );
         bool suspend_command( std::string& parameters, OutputStream& os );
         bool resume_command( std::string& parameters, OutputStream& os );
+        bool estimate_command( std::string& parameters, OutputStream& os );
+        bool cache_command( std::string& parameters, OutputStream& os );
+        struct job_header_t;
+        const job_header_t *get_cached_job();
+        bool is_loaded() const { return current_file_handler != nullptr || cached_job != nullptr; }
+        void close_job();
+        bool load_time_index(OutputStream& os);
         std::string extract_options(std::string& args);
         void suspend_part2();
         static void play_thread(void *);
@@ -44,10 +52,13 @@ class Player : public Module {
         OutputStream *reply_os;
 
         FILE* current_file_handler;
+        const char *cached_job{nullptr}; // playing from the job cache in the memory mapped qspi rather than the file
         long file_size;
         unsigned long played_cnt;
         unsigned long start_ticks;
         float saved_position[3]; // only saves XYZ
+        TimeEstimator::index_t time_index; // estimated time at file offsets, if the file has an index
+        float estimated_time;
         std::map<Module*, float> saved_temperatures;
 
         volatile bool abort_thread;
@@ -1,7 +1,6 @@
 #include "Block.h"
 #include "AxisDefns.h"
 #include "StepTicker.h"
-#include "MemoryPool.h"
 
 uint8_t Block::n_actuators = 0;
 
@@ -12,17 +11,9 @@ uint8_t Block::n_actuators = 0;
 
 Block::Block()
 {
-    tick_info = nullptr;
     clear();
 }
 
-Block::~Block()
-{
-    if(tick_info != nullptr) {
-        delete [] tick_info;
-    }
-}
-
 void Block::init(uint8_t n)
 {
     n_actuators = n;
@@ -52,26 +43,24 @@ void Block::clear()
     is_g123             = false;
     locked              = false;
     s_value             = 0.0F;
+    raster              = nullptr;
+    primary_motor       = 0;
+    speed_ratio_scale   = 0;
 
     total_move_ticks = 0;
-    if(tick_info == nullptr) {
-        // we create this once for this block
-        tick_info = new(*_DTCMRAM) tickinfo_t[n_actuators]; //(tickinfo_t *)malloc(sizeof(tickinfo_t) * n_actuators);
-        if(tick_info == nullptr) {
-            // if we ran out of memory just stop here
-            abort();
-        }
-    }
+    tick_period = 0;
+    tick_frequency = 0.0F;
 
-    for(int i = 0; i < n_actuators; ++i) {
-        tick_info[i].steps_per_tick = 0;
-        tick_info[i].counter = 0;
-        tick_info[i].acceleration_change = 0;
-        tick_info[i].deceleration_change = 0;
-        tick_info[i].plateau_rate = 0;
-        tick_info[i].steps_to_move = 0;
-        tick_info[i].step_count = 0;
-        tick_info[i].next_accel_event = 0;
+    // clear all of them not just n_actuators as the stepticker iterates over all of them
+    for(auto& ti : tick_info) {
+        ti.steps_per_tick = 0;
+        ti.counter = 0;
+        ti.acceleration_change = 0;
+        ti.deceleration_change = 0;
+        ti.plateau_rate = 0;
+        ti.steps_to_move = 0;
+        ti.step_count = 0;
+        ti.next_accel_event = 0;
     }
 }
 
@@ -90,7 +79,7 @@ void Block::debug() const
     for (size_t i = E_AXIS; i < n_actuators; ++i) {
         printf("%c:%lu ", 'A' + i - E_AXIS, this->steps[i]);
     }
-    printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d locked:%d ticking:%d recalc:%d nomlen:%d time:%f\r\n",
+    printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d locked:%d ticking:%d recalc:%d nomlen:%d freq:%1.1f time:%f\r\n",
            steps_event_count,
            nominal_rate,
            nominal_speed,
@@ -110,7 +99,8 @@ void Block::debug() const
            is_ticking,
            recalculate_flag ? 1 : 0,
            nominal_length_flag ? 1 : 0,
-           total_move_ticks / STEP_TICKER_FREQUENCY
+           tick_frequency,
+           total_move_ticks / tick_frequency
           );
 
     // TODO dump tickinfo
@@ -121,5 +111,5 @@ float Block::get_trapezoid_rate(int i) const
 {
     // convert steps per tick from fixed point to float and convert to steps/sec
     // FIXME steps_per_tick can change at any time, potential race condition if it changes while being read here
-    return STEPTICKER_FROMFP(tick_info[i].steps_per_tick) * STEP_TICKER_FREQUENCY;
+    return STEPTICKER_FROMFP(tick_info[i].steps_per_tick) * tick_frequency;
 }
@@ -5,11 +5,18 @@
 #include <array>
 #include <bitset>
 
+// laser raster data for a move, the pixels are spread evenly along the move
+struct RasterData {
+    uint16_t *pulse;        // PWM pulse of each pixel, 0 is off, worked out when the line is queued so the ISR has no float maths to do
+    uint16_t len;           // number of pixels
+    volatile bool in_use;   // set while the block it is attached to is queued
+};
+
 class Block
 {
 public:
     Block();
-    virtual ~Block();
+    ~Block(){}
 
     Block(Block const&) = delete;             // Copy construct
     Block(Block&&) = delete;                  // Move construct
@@ -40,6 +47,8 @@ public:
     uint32_t accelerate_until;
     uint32_t decelerate_after;
     uint32_t total_move_ticks;
+    uint32_t tick_period;     // step timer period this block is ticked at in STEP_TIMER_CLOCK ticks
+    float tick_frequency;     // the tick rate for this block in Hz, the base frequency unless stepticker is adaptive
     std::bitset<k_max_actuators> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
 
     // this is the data needed to determine when each motor needs to be issued a step
@@ -55,11 +64,17 @@ public:
     };
 
     void reset(tickinfo_t *saved);
-    // need info for each active motor
-    tickinfo_t *tick_info;
+    // need info for each motor, sized at build time (axis=n) so the stepticker loops have a constant bound
+    // entries past n_actuators always have steps_to_move == 0
+    std::array<tickinfo_t, k_max_actuators> tick_info;
 
     static uint8_t n_actuators;
 
+    RasterData *raster;       // laser raster data for this move or nullptr
+    uint8_t primary_motor;    // the motor with the most steps
+    uint64_t speed_ratio_scale; // 2^46 / nominal steps per tick of the primary motor in 2.30 fixed point, see StepTicker::update_speed()
+
+
     struct {
         bool recalculate_flag: 1;            // Planner flag to recalculate trapezoids on entry junction
         bool nominal_length_flag: 1;         // Planner flag for nominal speed always reached
@@ -10,6 +10,7 @@
 #include "StepperMotor.h"
 #include "PlannerQueue.h"
 #include "main.h"
+#include "ramfunc.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -21,9 +22,6 @@
 
 #define PQUEUE (Planner::getInstance()->queue)
 
-// TODO move ramfunc define to a utils.h
-#define _ramfunc_ __attribute__ ((section(".ramfunctions"),long_call,noinline))
-
 /*
  * The conveyor manages the planner queue, and starting the executing chain of blocks
  */
@@ -10,6 +10,7 @@
 #include "main.h"
 #include "Module.h"
 #include "MemoryPool.h"
+#include "tmr-setup.h"
 
 #include <math.h>
 #include <algorithm>
@@ -19,6 +20,8 @@
 #define z_junction_deviation_key  "z_junction_deviation"
 #define minimum_planner_speed_key "minimum_planner_speed"
 #define planner_queue_size_key    "planner_queue_size"
+#define full_vector_junction_key  "full_vector_junction"
+#define centripetal_acceleration_key "centripetal_acceleration"
 
 Planner *Planner::instance= nullptr;
 
@@ -29,7 +32,7 @@ Planner *Planner::instance= nullptr;
 Planner::Planner()
 {
     memset(this->previous_unit_vec, 0, sizeof this->previous_unit_vec);
-    fp_scale = (double)STEPTICKER_FPSCALE / pow((double)STEP_TICKER_FREQUENCY, 2.0); // we scale up by fixed point offset first to avoid tiny values
+    memset(this->previous_actuator_vec, 0, sizeof this->previous_actuator_vec);
 }
 
 // Configure acceleration
@@ -41,6 +44,8 @@ bool Planner::configure(ConfigReader& cr)
         z_junction_deviation = cr.get_float(m, z_junction_deviation_key, -1);
         minimum_planner_speed = cr.get_float(m, minimum_planner_speed_key, 0.0f);
         planner_queue_size= cr.get_int(m, planner_queue_size_key, 32);
+        full_vector_junction = cr.get_bool(m, full_vector_junction_key, false);
+        centripetal_acceleration = cr.get_float(m, centripetal_acceleration_key, 0);
 
     }else{
         printf("WARNING: configure-planner: no planner section found. defaults loaded\n");
@@ -58,8 +63,23 @@ bool Planner::initialize(uint8_t n)
     return queue != nullptr;
 }
 
+Block *Planner::get_queue_head()
+{
+    return queue->get_head();
+}
+
+bool Planner::queue_head()
+{
+    return queue->queue_head();
+}
+
+bool Planner::is_queue_empty() const
+{
+    return queue->empty();
+}
+
 // Append a block to the queue, compute it's speed factors
-bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float s_value, bool g123)
+bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float *actuator_vec, float arc_radius, uint32_t arc_id, float acceleration, float s_value, bool g123)
 {
     // get the head block
     Block* block = queue->get_head();
@@ -122,6 +142,13 @@ bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors,
     // Max number of steps, for all axes
     auto mi = std::max_element(block->steps.begin(), block->steps.end());
     block->steps_event_count = *mi;
+    block->primary_motor = mi - block->steps.begin();
+
+    // attach any laser raster data to this move
+    if(pending_raster != nullptr) {
+        block->raster = pending_raster;
+        pending_raster = nullptr;
+    }
 
     block->millimeters = distance;
 
@@ -134,6 +161,15 @@ bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors,
         block->nominal_rate  = 0;
     }
 
+    // limit the speed around an arc so the centripetal acceleration v²/r is not exceeded
+    if(arc_radius > 0.0F && unit_vec != nullptr) {
+        float vmax = arc_speed_limit(arc_radius);
+        if(block->nominal_speed > vmax) {
+            block->nominal_rate *= (vmax / block->nominal_speed);
+            block->nominal_speed = vmax;
+        }
+    }
+
     // Compute the acceleration rate for the trapezoid generator. Depending on the slope of the line
     // average travel per step event changes. For a line along one axis the travel per step event
     // is equal to the travel/step in the particular axis. For a 45 degree line the steppers of both
@@ -153,34 +189,32 @@ bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors,
     // and this allows one to stop with little to no decleration in many cases. This is particualrly bad on leadscrew based systems that will skip steps.
     float vmax_junction = minimum_planner_speed; // Set default max junction speed
 
+    if(full_vector_junction) {
+        // junctions are calculated on the full actuator vector so auxiliary axis moves also corner,
+        // as long as the previous move was of the same kind
+        if(!queue->empty()) {
+            queue->start_iteration(); // reset to head
+            Block *prev_block = queue->tailward_get(); // gets block prior to head, ie last block
+            float previous_nominal_speed = (prev_block->primary_axis == block->primary_axis) ? prev_block->nominal_speed : 0;
+
+            if(centripetal_acceleration > 0.0F && arc_id != 0 && arc_id == previous_arc_id && previous_nominal_speed > 0.0F) {
+                // a join between two segments of the same arc, the curvature is already accounted for
+                // by the arc speed limit so the segment joins should not slow it down further
+                vmax_junction = std::min(previous_nominal_speed, block->nominal_speed);
+
+            } else if(junction_deviation > 0.0F && previous_nominal_speed > 0.0F) {
+                vmax_junction = junction_speed(previous_actuator_vec, actuator_vec, previous_nominal_speed, block->nominal_speed, junction_deviation);
+            }
+        }
+
     // if unit_vec was null then it was not a primary axis move so we skip the junction deviation stuff
-    if (unit_vec != nullptr && !queue->empty()) {
+    } else if (unit_vec != nullptr && !queue->empty()) {
         queue->start_iteration(); // reset to head
         Block *prev_block = queue->tailward_get(); // gets block prior to head, ie last block
         float previous_nominal_speed = prev_block->primary_axis ? prev_block->nominal_speed : 0;
 
         if (junction_deviation > 0.0F && previous_nominal_speed > 0.0F) {
-            // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
-            // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
-            float cos_theta = - this->previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
-                              - this->previous_unit_vec[Y_AXIS] * unit_vec[Y_AXIS]
-                              - this->previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS];
-            #if N_PRIMARY_AXIS > 3
-                for (int i = 3; i < N_PRIMARY_AXIS; ++i) {
-                    cos_theta -= this->previous_unit_vec[i] * unit_vec[i];
-                }
-            #endif
-
-            // Skip and use default max junction speed for 0 degree acute junction.
-            if (cos_theta <= 0.9999F) {
-                vmax_junction = std::min(previous_nominal_speed, block->nominal_speed);
-                // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
-                if (cos_theta >= -0.9999F) {
-                    // Compute maximum junction velocity based on maximum acceleration and junction deviation
-                    float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
-                    vmax_junction = std::min(vmax_junction, sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
-                }
-            }
+            vmax_junction = junction_speed(previous_unit_vec, unit_vec, N_PRIMARY_AXIS, previous_nominal_speed, block->nominal_speed, acceleration, junction_deviation, minimum_planner_speed);
         }
     }
     block->max_entry_speed = vmax_junction;
@@ -209,6 +243,8 @@ bool Planner::append_block(ActuatorCoordinates& actuator_pos, uint8_t n_motors,
     } else {
         memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
     }
+    memcpy(previous_actuator_vec, actuator_vec, sizeof(previous_actuator_vec));
+    previous_arc_id = arc_id;
 
     // Math-heavy re-computing of the whole queue to take the new
     this->recalculate();
@@ -324,6 +360,24 @@ void Planner::recalculate()
     calculate_trapezoid(current, current->entry_speed, minimum_planner_speed);
 }
 
+// Maximum speed through the junction of two moves given the displacement of every actuator per mm of path,
+// using each actuators own acceleration, extruders are zero in the vectors so their acceleration is not used
+float Planner::junction_speed(const float prev_vec[], const float vec[], float prev_speed, float speed, float junction_deviation) const
+{
+    float default_acceleration = Robot::getInstance()->get_default_acceleration();
+    float accelerations[k_max_actuators];
+    for (size_t i = 0; i < k_max_actuators; ++i) {
+        float ma = i < Robot::getInstance()->actuators.size() ? Robot::getInstance()->actuators[i]->get_acceleration() : 0;
+        accelerations[i] = ma > 0.0001F ? ma : default_acceleration;
+    }
+    return junction_speed(prev_vec, vec, k_max_actuators, accelerations, prev_speed, speed, junction_deviation, minimum_planner_speed);
+}
+
+float Planner::arc_speed_limit(float radius) const
+{
+    return arc_speed_limit(centripetal_acceleration, radius);
+}
+
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
 // acceleration within the allotted distance.
 float Planner::max_allowable_speed(float acceleration, float target_velocity, float distance)
@@ -363,6 +417,13 @@ void Planner::calculate_trapezoid(Block *block, float entryspeed, float exitspee
     // allowed to achieve
     block->maximum_rate = std::min(maximum_possible_rate, block->nominal_rate);
 
+    // pick the rate this block will be ticked at, this is the base step ticker frequency unless it is in adaptive mode
+    // in which case it is based on the fastest any motor will step in this block
+    StepTicker *st = StepTicker::getInstance();
+    block->tick_period = st->get_tick_period(block->maximum_rate);
+    block->tick_frequency = st->is_adaptive() ? (float)STEP_TIMER_CLOCK / block->tick_period : STEP_TICKER_FREQUENCY;
+    const float tick_frequency = block->tick_frequency;
+
     // Now figure out how long it takes to accelerate in seconds
     float time_to_accelerate = ( block->maximum_rate - initial_rate ) / acceleration_per_second;
 
@@ -400,16 +461,16 @@ void Planner::calculate_trapezoid(Block *block, float entryspeed, float exitspee
     // the exact rate we want
 
     // First off round total time, acceleration time and deceleration time in ticks
-    uint32_t acceleration_ticks = floorf( time_to_accelerate * STEP_TICKER_FREQUENCY );
-    uint32_t deceleration_ticks = floorf( time_to_decelerate * STEP_TICKER_FREQUENCY );
-    uint32_t total_move_ticks   = floorf( total_move_time    * STEP_TICKER_FREQUENCY );
+    uint32_t acceleration_ticks = floorf( time_to_accelerate * tick_frequency );
+    uint32_t deceleration_ticks = floorf( time_to_decelerate * tick_frequency );
+    uint32_t total_move_ticks   = floorf( total_move_time    * tick_frequency );
 
     // Now deduce the plateau time for those new values expressed in tick
     //uint32_t plateau_ticks = total_move_ticks - acceleration_ticks - deceleration_ticks;
 
     // Now we figure out the acceleration value to reach EXACTLY maximum_rate(steps/s) in EXACTLY acceleration_ticks(ticks) amount of time in seconds
-    float acceleration_time = acceleration_ticks / STEP_TICKER_FREQUENCY;  // This can be moved into the operation below, separated for clarity, note we need to do this instead of using time_to_accelerate(seconds) directly because time_to_accelerate(seconds) and acceleration_ticks(seconds) do not have the same value anymore due to the rounding
-    float deceleration_time = deceleration_ticks / STEP_TICKER_FREQUENCY;
+    float acceleration_time = acceleration_ticks / tick_frequency;  // This can be moved into the operation below, separated for clarity, note we need to do this instead of using time_to_accelerate(seconds) directly because time_to_accelerate(seconds) and acceleration_ticks(seconds) do not have the same value anymore due to the rounding
+    float deceleration_time = deceleration_ticks / tick_frequency;
 
     float acceleration_in_steps = (acceleration_time > 0.0F ) ? ( block->maximum_rate - initial_rate ) / acceleration_time : 0;
     float deceleration_in_steps =  (deceleration_time > 0.0F ) ? ( block->maximum_rate - final_rate ) / deceleration_time : 0;
@@ -511,6 +572,9 @@ void Planner::prepare(Block *block, float acceleration_in_steps, float decelerat
 {
 
     float inv = 1.0F / block->steps_event_count;
+    double tick_frequency = block->tick_frequency;
+    // this changes per block if stepticker is adaptive
+    double fp_scale = (double)STEPTICKER_FPSCALE / (tick_frequency * tick_frequency); // we scale up by fixed point offset first to avoid tiny values
 
     // Now figure out the acceleration PER TICK, this should ideally be held as a double as it's very critical to the block timing
     // steps/tick^2
@@ -520,14 +584,18 @@ void Planner::prepare(Block *block, float acceleration_in_steps, float decelerat
     double acceleration_per_tick = acceleration_in_steps * fp_scale; // this is now scaled to fit a 2.30 fixed point number
     double deceleration_per_tick = deceleration_in_steps * fp_scale;
 
-    for (uint8_t m = 0; m < Block::n_actuators; m++) {
+    // lets the step ticker get the speed of the primary motor as a fraction of the nominal speed without a divide
+    double nominal_per_tick = ((double)block->nominal_rate / tick_frequency) * (1 << 30); // 2.30 fixed point
+    block->speed_ratio_scale = nominal_per_tick >= 1.0 ? (uint64_t)round((double)(1LL << 46) / nominal_per_tick) : 0;
+
+    for (uint8_t m = 0; m < k_max_actuators; m++) {
         uint32_t steps = block->steps[m];
         block->tick_info[m].steps_to_move = steps;
         if(steps == 0) continue;
 
         float aratio = inv * steps;
 
-        block->tick_info[m].steps_per_tick = (int64_t)round((((double)block->initial_rate * aratio) / STEP_TICKER_FREQUENCY) * STEPTICKER_FPSCALE); // steps/sec / tick frequency to get steps per tick in 2.62 fixed point
+        block->tick_info[m].steps_per_tick = (int64_t)round((((double)block->initial_rate * aratio) / tick_frequency) * STEPTICKER_FPSCALE); // steps/sec / tick frequency to get steps per tick in 2.62 fixed point
         block->tick_info[m].counter = 0; // 2.62 fixed point
         block->tick_info[m].step_count = 0;
         block->tick_info[m].next_accel_event = block->total_move_ticks + 1;
@@ -550,7 +618,7 @@ void Planner::prepare(Block *block, float acceleration_in_steps, float decelerat
         //#define STEPTICKER_TOFP(x) ((int64_t)round((double)(x)*STEPTICKER_FPSCALE))
         block->tick_info[m].acceleration_change= (int64_t)round(acceleration_change * aratio);
         block->tick_info[m].deceleration_change= -(int64_t)round(deceleration_per_tick * aratio);
-        block->tick_info[m].plateau_rate= (int64_t)round(((block->maximum_rate * aratio) / STEP_TICKER_FREQUENCY) * STEPTICKER_FPSCALE);
+        block->tick_info[m].plateau_rate= (int64_t)round(((block->maximum_rate * aratio) / tick_frequency) * STEPTICKER_FPSCALE);
 
         #if 0
         printf("spt: %08lX %08lX, ac: %08lX %08lX, dc: %08lX %08lX, pr: %08lX %08lX\n",
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include <cmath>
 #include "ActuatorCoordinates.h"
 
@@ -14,6 +15,7 @@ class Conveyor;
 #endif
 
 class Robot;
+struct RasterData;
 
 class Planner
 {
@@ -28,29 +30,54 @@ public:
     bool configure(ConfigReader& cr);
     bool initialize(uint8_t n);
 
+    // public so the tick generation can be tested
+    void calculate_trapezoid(Block *, float entry_speed, float exit_speed );
+    // public so the junction speeds can be tested
+    float junction_speed(const float prev_vec[], const float vec[], float prev_speed, float speed, float junction_deviation) const;
+    float arc_speed_limit(float radius) const;
+    // the same calculations with everything passed in, they have no hardware dependencies so TimeEstimator uses them too
+    static float junction_speed(const float prev_unit_vec[], const float unit_vec[], size_t n, float prev_speed, float speed, float acceleration, float junction_deviation, float minimum_speed);
+    static float junction_speed(const float prev_vec[], const float vec[], size_t n, const float accelerations[], float prev_speed, float speed, float junction_deviation, float minimum_speed);
+    static float arc_speed_limit(float centripetal_acceleration, float radius);
+
+    bool is_full_vector_junction() const { return full_vector_junction; }
+    float get_junction_deviation() const { return xy_junction_deviation; }
+    float get_z_junction_deviation() const { return z_junction_deviation; }
+    float get_minimum_planner_speed() const { return minimum_planner_speed; }
+    float get_centripetal_acceleration() const { return centripetal_acceleration; }
+    // public so the step ticker can be run without the Robot, fill in the head block then queue it
+    Block *get_queue_head();
+    bool queue_head();
+    bool is_queue_empty() const;
+    // raster data to attach to the next block that is queued
+    void set_raster(RasterData *r) { pending_raster = r; }
+    RasterData *get_raster() const { return pending_raster; }
+
 private:
     static Planner *instance;
     Planner();
     float max_exit_speed(Block *);
     float max_allowable_speed( float acceleration, float target_velocity, float distance);
 
-    void calculate_trapezoid(Block *, float entry_speed, float exit_speed );
     float reverse_pass(Block *, float exit_speed);
     float forward_pass(Block *, float next_entry_speed);
     void prepare(Block *, float acceleration_in_steps, float deceleration_in_steps);
 
-    bool append_block(ActuatorCoordinates& target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float s_value, bool g123);
+    bool append_block(ActuatorCoordinates& target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float actuator_vec[], float arc_radius, uint32_t arc_id, float accleration, float s_value, bool g123);
     void recalculate();
 
-    double fp_scale; // optimize to store this as it does not change
-
     PlannerQueue *queue{nullptr};
+    RasterData *pending_raster{nullptr};
     float previous_unit_vec[N_PRIMARY_AXIS];
+    float previous_actuator_vec[k_max_actuators];
+    uint32_t previous_arc_id{0};
 
     float xy_junction_deviation{0.05F};    // Setting
     float z_junction_deviation{-1};  // Setting
     float minimum_planner_speed{0.0F}; // Setting
     int planner_queue_size{32}; // setting
+    float centripetal_acceleration{0}; // setting, mm/sec² allowed around arcs, 0 disables
+    bool full_vector_junction{false}; // setting, corner using every actuator and its own acceleration
 
     // FIXME should really just make getters and setters or handle the set/get gcode here
     friend Robot;
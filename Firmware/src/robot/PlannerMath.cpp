@@ -0,0 +1,90 @@
+#include "Planner.h"
+
+#include <algorithm>
+#include <cassert>
+
+// The junction and arc speed calculations used by the planner. They have no hardware dependencies so the
+// TimeEstimator, which also builds on the host, plans with exactly the same math.
+
+// Junction speed for the primary axis using the unit vectors of the two moves, this is the centripetal
+// acceleration approximation described in Planner::append_block()
+float Planner::junction_speed(const float prev_unit_vec[], const float unit_vec[], size_t n, float prev_speed, float speed, float acceleration, float junction_deviation, float minimum_speed)
+{
+    // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
+    // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
+    float cos_theta = 0;
+    for (size_t i = 0; i < n; ++i) {
+        cos_theta -= prev_unit_vec[i] * unit_vec[i];
+    }
+
+    // Skip and use default max junction speed for 0 degree acute junction.
+    if (cos_theta > 0.9999F) return minimum_speed;
+
+    float vmax_junction = std::min(prev_speed, speed);
+    // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
+    if (cos_theta < -0.9999F) return vmax_junction;
+
+    // Compute maximum junction velocity based on maximum acceleration and junction deviation
+    float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
+    return std::min(vmax_junction, sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
+}
+
+// Maximum speed through the junction of two moves given the displacement of every actuator per mm of path,
+// extruders are left out as their mm are not path mm.
+// Same junction deviation approximation as for the primary axis, but the angle is taken over all the actuators
+// and the acceleration used is the highest that keeps each actuator within its own acceleration
+// in the direction the velocity changes.
+float Planner::junction_speed(const float prev_vec[], const float vec[], size_t n, const float accelerations[], float prev_speed, float speed, float junction_deviation, float minimum_speed)
+{
+    float prev_len = 0, len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        prev_len += prev_vec[i] * prev_vec[i];
+        len += vec[i] * vec[i];
+    }
+    if(prev_len == 0.0F || len == 0.0F) return minimum_speed;
+    prev_len = 1.0F / sqrtf(prev_len);
+    len = 1.0F / sqrtf(len);
+
+    // cosine of the angle between previous and current path (previous is negated)
+    float cos_theta = 0;
+    for (size_t i = 0; i < n; ++i) {
+        cos_theta -= (prev_vec[i] * prev_len) * (vec[i] * len);
+    }
+
+    // 0 degree acute junction, a reversal, use the default junction speed
+    if (cos_theta > 0.9999F) return minimum_speed;
+
+    float vmax_junction = std::min(prev_speed, speed);
+    // straight through junction, limited by the nominal speeds
+    if (cos_theta < -0.9999F) return vmax_junction;
+
+    // the change in direction, the acceleration at the junction is along this vector
+    assert(n <= k_max_actuators);
+    float change[k_max_actuators];
+    float change_len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        change[i] = vec[i] * len - prev_vec[i] * prev_len;
+        change_len += change[i] * change[i];
+    }
+    change_len = sqrtf(change_len);
+
+    // find the acceleration that does not exceed any actuators acceleration along that vector
+    float acceleration = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float c = fabsf(change[i]) / change_len;
+        if(c < 0.0001F) continue; // this actuator does not change direction
+        float a = accelerations[i] / c;
+        if(acceleration == 0 || a < acceleration) acceleration = a;
+    }
+    if(acceleration == 0) return vmax_junction;
+
+    float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
+    return std::min(vmax_junction, sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
+}
+
+// the maximum speed around an arc of the given radius that keeps within the centripetal acceleration
+float Planner::arc_speed_limit(float centripetal_acceleration, float radius)
+{
+    if(centripetal_acceleration <= 0.0F || radius <= 0.0F) return INFINITY;
+    return sqrtf(centripetal_acceleration * radius);
+}
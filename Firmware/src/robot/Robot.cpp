@@ -23,6 +23,9 @@
 #include "OutputStream.h"
 #include "ActuatorCoordinates.h"
 
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include <math.h>
 #include <string>
 #include <algorithm>
@@ -72,6 +75,7 @@
 #define motors_enable_pin_key           "motors_enable_pin"
 #define check_driver_errors_key         "check_driver_errors"
 #define halt_on_driver_alarm_key        "halt_on_driver_alarm"
+#define driver_poll_frequency_key       "driver_poll_frequency"
 
 // arm solutions
 #define  arm_solution_key               "arm_solution"
@@ -419,6 +423,7 @@ bool Robot::configure(ConfigReader& cr)
 #if defined(DRIVER_TMC)
         check_driver_errors = cr.get_bool(mm, check_driver_errors_key, true);
         halt_on_driver_alarm = cr.get_bool(mm, halt_on_driver_alarm_key, false);
+        driver_poll_frequency = cr.get_int(mm, driver_poll_frequency_key, 20);
         const char *default_motor_enn = "PH13!"; // inverted as it is a not enable pin, but we want to set true to enable
 #else
         const char *default_motor_enn = "nc";
@@ -472,6 +477,16 @@ bool Robot::configure(ConfigReader& cr)
     // also will check driver errors and standstill current reduction if enabled
     periodic_checks();
     SlowTicker::getInstance()->attach(1, std::bind(&Robot::periodic_checks, this));
+    if(check_driver_errors && driver_poll_frequency > 0) {
+        // poll the driver status in the background so periodic_checks does not have to read each one over SPI,
+        // errors seen between the checks are latched so are not missed
+        SlowTicker::getInstance()->attach(driver_poll_frequency, [this]() {
+            if(StepperMotor::get_vmot()) {
+                StepperMotor::poll_drivers();
+                record_load();
+            }
+        });
+    }
 #endif
 
     // register gcodes and mcodes
@@ -545,6 +560,7 @@ bool Robot::configure(ConfigReader& cr)
     THEDISPATCHER->add_handler(Dispatcher::MCODE_HANDLER, 909, std::bind(&Robot::handle_M909, this, _1, _2));
     THEDISPATCHER->add_handler(Dispatcher::MCODE_HANDLER, 911, std::bind(&Robot::handle_M911, this, _1, _2));
     THEDISPATCHER->add_handler( "setregs", std::bind( &Robot::handle_setregs_cmd, this, _1, _2) );
+    THEDISPATCHER->add_handler( "motorload", std::bind( &Robot::handle_load_cmd, this, _1, _2) );
 #endif
     return true;
 }
@@ -1462,6 +1478,85 @@ bool Robot::handle_setregs_cmd( std::string& params, OutputStream& os )
     return true;
 }
 
+// called from the timer task each time the drivers are polled, so the load is from the previous poll
+void Robot::record_load()
+{
+    if(!load_logging) return;
+
+    // only the command thread reads it so if it is full the new sample is dropped rather than overwriting the oldest
+    if(load_log->full()) {
+        ++load_log_dropped;
+        return;
+    }
+
+    load_sample_t s;
+    s.time = xTaskGetTickCount();
+    for (int i = 0; i < k_max_actuators; ++i) {
+        s.load[i] = i < n_motors ? actuators[i]->get_load() : -1;
+    }
+    load_log->push_back(s);
+}
+
+bool Robot::handle_load_cmd( std::string& params, OutputStream& os )
+{
+    HELP("motorload [-e|-d|-q] - read the recorded motor loads, -e enable recording, -d disable, -q current load\n");
+    std::string str = stringutils::shift_parameter( params );
+
+    if(str == "-q") {
+        for (int i = 0; i < n_motors; ++i) {
+            os.printf("%d:%d ", i, actuators[i]->get_load());
+        }
+        os.printf("\n");
+        return true;
+    }
+
+    if(str == "-e") {
+        if(!check_driver_errors || driver_poll_frequency == 0) {
+            os.printf("the drivers are not being polled, check_driver_errors and driver_poll_frequency need to be set\n");
+            return true;
+        }
+        if(load_log == nullptr) {
+            // only allocated when it is used, it is never freed as the timer task may be writing to it
+            load_log = new RingBuffer<load_sample_t, 512>;
+        }
+        // stop the timer task adding to it while it is emptied
+        load_logging = false;
+        load_log->flush();
+        load_log_dropped = 0;
+        load_logging = true;
+        os.printf("recording load at %d Hz\n", driver_poll_frequency);
+        return true;
+    }
+
+    if(str == "-d") {
+        load_logging = false;
+        os.printf("load recording disabled\n");
+        return true;
+    }
+
+    if(load_log == nullptr) {
+        os.printf("load recording has not been enabled\n");
+        return true;
+    }
+
+    // each line is the time in ms then the StallGuard2 value of each motor, lower is more load, it is removed once read
+    // so calling this repeatedly during a job streams it
+    while(!load_log->empty()) {
+        load_sample_t s = load_log->pop_front();
+        os.printf("%lu", s.time * (1000 / configTICK_RATE_HZ));
+        for (int i = 0; i < n_motors; ++i) {
+            os.printf(",%d", s.load[i]);
+        }
+        os.printf("\n");
+    }
+    if(load_log_dropped > 0) {
+        os.printf("// %lu samples dropped\n", load_log_dropped);
+        load_log_dropped = 0;
+    }
+
+    return true;
+}
+
 #endif // ifdef DRIVER_TMC
 
 bool Robot::handle_M500(GCode& gcode, OutputStream& os)
@@ -2028,8 +2123,9 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
             }
 
             // adjust acceleration to lowest found, for now just primary axis unless it is an auxiliary move
+            // or the planner is using the full actuator vector, in which case all but the extruders limit it
             // TODO we may need to do all of them, check E won't limit XYZ.. it does on long E moves, but not checking it could exceed the E acceleration.
-            if(auxilliary_move || actuator < N_PRIMARY_AXIS) {
+            if(auxilliary_move || actuator < N_PRIMARY_AXIS || (Planner::getInstance()->is_full_vector_junction() && !actuators[actuator]->is_extruder())) {
                 float ma =  actuators[actuator]->get_acceleration(); // in mm/sec²
                 if(ma > 0.0001F) {  // if axis does not have acceleration set then it uses the default_acceleration
                     float ca = fabsf((d / distance) * acceleration);
@@ -2049,13 +2145,24 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
     //     if(halted) return false;
     // }
 
+    // the displacement of each actuator per mm of path, the planner uses this for full vector cornering
+    // extruders are not in it as E mm are not path mm and would mix units
+    float actuator_vec[k_max_actuators];
+    for (size_t i = 0; i < k_max_actuators; i++) {
+        if(i >= n_motors || (i >= A_AXIS && get_slaved_to(i) >= 0) || !actuators[i]->is_selected() || actuators[i]->is_extruder()) {
+            actuator_vec[i] = 0;
+        } else {
+            actuator_vec[i] = (actuator_pos[i] - actuators[i]->get_last_milestone()) / distance;
+        }
+    }
+
     // make sure the motors are enabled
     enable_all_motors(true);
 
     // Append the block to the planner
     // NOTE that distance here should be either the distance travelled by the XYZ axis, or the E mm travel if a solo E move
     // NOTE this call will block until there is room in the block queue
-    if(Planner::getInstance()->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_value, is_g123)) {
+    if(Planner::getInstance()->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, actuator_vec, arc_radius, arc_id, acceleration, s_value, is_g123)) {
         // this is the new compensated machine position
         memcpy(this->compensated_machine_position, transformed_target, n_motors * sizeof(float));
         return true;
@@ -2141,6 +2248,10 @@ bool Robot::append_line(GCode & gcode, const float target[], float rate_mm_s, fl
     if(this->disable_segmentation || (!segment_z_moves && !gcode.has_arg('X') && !gcode.has_arg('Y'))) {
         segments = 1;
 
+    } else if(Planner::getInstance()->get_raster() != nullptr) {
+        // a G7 raster line has its pixels spread over one block so it can't be segmented
+        segments = 1;
+
     } else if(this->delta_segments_per_second > 1.0F) {
         // enabled if set to something > 1, it is set to 0.0 by default
         // segment based on current speed and requested segments per second
@@ -2297,8 +2408,13 @@ bool Robot::append_arc(GCode &  gcode, const float target[], const float offset[
     arc_target[this->plane_axis_2] = this->machine_position[this->plane_axis_2];
 
     bool moved = false;
+    // lets the planner limit the speed along the arc and treat the joins between segments as part of the curve
+    // each arc gets its own id so only joins between segments of the same arc are treated that way
+    this->arc_radius = radius;
+    if(++this->last_arc_id == 0) this->last_arc_id = 1;
+    this->arc_id = this->last_arc_id;
     for (i = 1; i < segments; i++) { // Increment (segments-1)
-        if(halted) return false; // don't queue any more segments
+        if(halted) { this->arc_radius = 0; this->arc_id = 0; return false; } // don't queue any more segments
 
         if (count < this->arc_correction ) {
             // Apply vector rotation matrix
@@ -2332,6 +2448,8 @@ bool Robot::append_arc(GCode &  gcode, const float target[], const float offset[
 
     // Ensure last segment arrives at target location.
     if(this->append_milestone(target, rate_mm_s)) moved = true;
+    this->arc_radius = 0;
+    this->arc_id = 0;
 
     return moved;
 }
@@ -8,6 +8,7 @@
 #include "Module.h"
 #include "ActuatorCoordinates.h"
 #include "AxisDefns.h"
+#include "RingBuffer.h"
 
 class GCode;
 class BaseSolution;
@@ -129,6 +130,8 @@ private:
     bool handle_M909(GCode&, OutputStream&);
     bool handle_M911(GCode&, OutputStream&);
     bool handle_setregs_cmd( std::string& params, OutputStream& os );
+    bool handle_load_cmd( std::string& params, OutputStream& os );
+    void record_load();
     #endif
 
     bool append_milestone(const float target[], float rate_mm_s);
@@ -146,6 +149,14 @@ private:
 
     std::array<wcs_t, MAX_WCS> wcs_offsets; // these are persistent once saved with M500
     uint8_t current_wcs{0}; // 0 means G54 is enabled this is persistent once saved with M500
+    uint16_t driver_poll_frequency{20}; // Hz, 0 reads the driver status over SPI when it is checked
+    #ifdef DRIVER_TMC
+    // the load of each motor recorded each time the drivers are polled, read out by the load command
+    using load_sample_t = struct { uint32_t time; int16_t load[k_max_actuators]; };
+    RingBuffer<load_sample_t, 512> *load_log{nullptr};
+    volatile bool load_logging{false};
+    uint32_t load_log_dropped{0};
+    #endif
     wcs_t g92_offset;
     wcs_t tool_offset; // used for multiple extruders, sets the tool offset for the current extruder applied first
     std::tuple<float, float, float, uint8_t> last_probe_position{0, 0, 0, 0};
@@ -165,6 +176,9 @@ private:
     float seconds_per_minute;                            // for realtime speed change
     float default_acceleration;                          // the defualt accleration if not set for each axis
     float s_value{0.8};                                  // modal S value
+    float arc_radius{0};                                 // radius of the arc currently being segmented, 0 if not in an arc
+    uint32_t arc_id{0};                                  // identifies the arc currently being segmented, 0 if not in an arc
+    uint32_t last_arc_id{0};                             // the id given to the last arc
 
     // Number of arc generation iterations by small angle approximation before exact arc trajectory
     // correction. This parameter may be decreased if there are issues with the accuracy of the arc
@@ -6,11 +6,15 @@
 #include "Conveyor.h"
 #include "Module.h"
 #include "tmr-setup.h"
+#include "IsrProfile.h"
+#include "benchmark_timer.h"
+#include "ramfunc.h"
 
 #include <fcntl.h>
 #include <errno.h>
 
 #include <math.h>
+#include <algorithm>
 
 #include "MemoryPool.h"
 
@@ -23,13 +27,13 @@ Pin stepticker_debug_pin(STEPTICKER_DEBUG_PIN, Pin::AS_OUTPUT);
 #define SET_STEPTICKER_DEBUG_PIN(n)
 #endif
 
-// TODO move ramfunc define to a utils.h
-#define _ramfunc_ __attribute__ ((section(".ramfunctions"),long_call,noinline))
-//#define _ramfunc_
-
 StepTicker *StepTicker::instance= nullptr;
 bool StepTicker::started= false;
 
+// cycle counts for the step and unstep ISRs, shown with the isr command
+static IsrProfile step_profile("step_tick");
+static IsrProfile unstep_profile("unstep_tick");
+
 StepTicker *StepTicker::getInstance()
 {
     if(instance == nullptr) {
@@ -58,13 +62,17 @@ StepTicker::~StepTicker()
 // ISR callbacks from timer
 _ramfunc_ void StepTicker::step_timer_handler(void)
 {
+    uint32_t st = benchmark_timer_start();
     StepTicker::getInstance()->step_tick();
+    step_profile.record(benchmark_timer_elapsed(st));
 }
 
 // ISR callbacks from timer
 _ramfunc_ void StepTicker::unstep_timer_handler(void)
 {
+    uint32_t st = benchmark_timer_start();
     StepTicker::getInstance()->unstep_tick();
+    unstep_profile.record(benchmark_timer_elapsed(st));
 }
 
 bool StepTicker::start()
@@ -78,6 +86,12 @@ bool StepTicker::start()
             return false;
         }
         started = true;
+        current_period = STEP_TIMER_CLOCK / frequency;
+
+        // both ISRs must complete within one step period, the shortest if adaptive
+        uint32_t period = SystemCoreClock / frequency;
+        step_profile.set_period(period);
+        unstep_profile.set_period(period);
     }
 
     current_tick = 0;
@@ -89,6 +103,8 @@ bool StepTicker::stop()
 {
     if(started) {
         steptimer_stop();
+        // the timers are deinitialized so start() has to set them up again
+        started = false;
     }
     return true;
 }
@@ -105,6 +121,52 @@ void StepTicker::set_frequency( float freq )
     this->frequency = floorf(freq);
 }
 
+// Enable ticking each block at a rate suited to its maximum step rate rather than always at the base frequency
+// The base frequency becomes the maximum, and min_frequency the slowest a block will be ticked at
+// can only be set before it is started
+bool StepTicker::set_adaptive( bool flg, float min_frequency )
+{
+    if(started) {
+        printf("ERROR: cannot set stepticker adaptive mode after it has been started\n");
+        return false;
+    }
+
+    if(flg) {
+        // the step timer is 16 bits
+        uint32_t p = floorf(STEP_TIMER_CLOCK / min_frequency);
+        if(min_frequency <= 0 || p > 65535 || min_frequency > frequency) {
+            printf("ERROR: stepticker min frequency %f is out of range\n", min_frequency);
+            return false;
+        }
+        max_period = p;
+    }
+
+    adaptive = flg;
+    return true;
+}
+
+// Pick the tick period to use for a block given its maximum step rate (steps/sec)
+// this is the base period unless adaptive mode is on
+uint32_t StepTicker::get_tick_period(float max_step_rate) const
+{
+    uint32_t min_period = STEP_TIMER_CLOCK / frequency;
+    if(!adaptive) return min_period;
+    return calc_tick_period(max_step_rate, min_period, max_period);
+}
+
+// We tick at least this many times faster than the fastest motor steps
+// so the step timing jitter is at most 1/8 of a step period
+#define ADAPTIVE_OVERSAMPLE 8
+
+uint32_t StepTicker::calc_tick_period(float max_step_rate, uint32_t min_period, uint32_t max_period)
+{
+    float f = max_step_rate * ADAPTIVE_OVERSAMPLE;
+    if(f <= 0 || (STEP_TIMER_CLOCK / f) >= max_period) return max_period;
+    uint32_t p = floorf(STEP_TIMER_CLOCK / f);
+    if(p < min_period) return min_period;
+    return p;
+}
+
 // Set the reset delay, must be called before started
 void StepTicker::set_unstep_time( float microseconds )
 {
@@ -175,7 +237,9 @@ _ramfunc_  void StepTicker::step_tick (void)
 
     bool still_moving = false;
     // foreach motor, if it is active see if time to issue a step to that motor
-    for (uint8_t m = 0; m < num_motors; m++) {
+    // the loop bound is the compiled in number of actuators so it can be unrolled, unused ones never have steps_to_move set
+    #pragma GCC unroll k_max_actuators
+    for (uint8_t m = 0; m < k_max_actuators; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue; // not active
 
         current_block->tick_info[m].steps_per_tick += current_block->tick_info[m].acceleration_change;
@@ -225,6 +289,14 @@ _ramfunc_  void StepTicker::step_tick (void)
         if(motor[m]->is_moving()) still_moving = true;
     }
 
+    // laser raster move, update the power as the primary motor reaches the next pixel
+    if(current_block->raster != nullptr && current_block->tick_info[current_block->primary_motor].step_count >= next_pixel_step) {
+        next_raster_pixel();
+
+    } else if(current_tick >= next_speed_update && speed_fnc) {
+        update_speed();
+    }
+
     // do this after so we start at tick 0
     ++current_tick; // count number of ticks
 
@@ -242,6 +314,12 @@ _ramfunc_  void StepTicker::step_tick (void)
         // all moves finished
         current_tick = 0;
 
+        if(current_block->raster != nullptr) {
+            // end of the raster line, the raster data can be reused
+            if(raster_fnc) raster_fnc(0);
+            current_block->raster->in_use = false;
+        }
+
         // get next block
         // do it here so there is no delay in ticks
         conveyor->block_finished();
@@ -252,6 +330,7 @@ _ramfunc_  void StepTicker::step_tick (void)
         } else {
             current_block = nullptr;
             running = false;
+            if(speed_fnc) speed_fnc(0); // nothing is moving
         }
 
         // all moves finished
@@ -268,7 +347,7 @@ _ramfunc_ bool StepTicker::start_next_block()
 
     bool ok = false;
     // need to prepare each active motor
-    for (uint8_t m = 0; m < num_motors; m++) {
+    for (uint8_t m = 0; m < k_max_actuators; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue;
 
         ok = true; // mark at least one motor is moving
@@ -281,8 +360,25 @@ _ramfunc_ bool StepTicker::start_next_block()
 
     current_tick = 0;
 
+    // each block may be ticked at a different rate
+    if(ok && adaptive && current_block->tick_period != current_period && current_block->tick_period != 0) {
+        current_period = current_block->tick_period;
+        steptimer_set_period(current_period);
+    }
+
     if(ok) {
         //SET_STEPTICKER_DEBUG_PIN(1);
+        if(current_block->raster != nullptr) {
+            // first pixel, the rest are set as the primary motor reaches them
+            raster_pixel = 0;
+            next_pixel_step = (uint64_t)current_block->steps_event_count / current_block->raster->len;
+            if(raster_fnc) raster_fnc(current_block->raster->pulse[0]);
+
+        } else if(speed_fnc) {
+            // the interval is converted to ticks of this block as the tick rate may change per block
+            speed_update_ticks = std::max(1UL, (unsigned long)lroundf(speed_update_interval * current_block->tick_frequency));
+            update_speed();
+        }
         return true;
 
     } else {
@@ -295,6 +391,56 @@ _ramfunc_ bool StepTicker::start_next_block()
 }
 
 
+// pixel i covers the primary motor steps from i*steps/len up to (i+1)*steps/len
+// only called from the step tick ISR
+_ramfunc_ void StepTicker::next_raster_pixel()
+{
+    const RasterData *r = current_block->raster;
+    uint32_t step_count = current_block->tick_info[current_block->primary_motor].step_count;
+
+    // pixels may be smaller than a step so some can be skipped
+    while(step_count >= next_pixel_step && raster_pixel + 1U < r->len) {
+        ++raster_pixel;
+        next_pixel_step = ((uint64_t)(raster_pixel + 1) * current_block->steps_event_count) / r->len;
+    }
+    if(raster_pixel + 1U >= r->len) next_pixel_step = UINT32_MAX; // on the last pixel
+
+    if(raster_fnc) raster_fnc(r->pulse[raster_pixel]);
+}
+
+// send the current speed of the primary motor as a fraction of the nominal speed, and schedule the next update
+// only called from the step tick ISR
+_ramfunc_ void StepTicker::update_speed()
+{
+    if(!current_block->is_g123) {
+        // not a feed move so the speed is of no interest
+        next_speed_update = UINT32_MAX;
+        speed_fnc(0);
+        return;
+    }
+
+    const Block::tickinfo_t& ti = current_block->tick_info[current_block->primary_motor];
+
+    // steps per tick 2.62 -> 2.30 times 2^46/nominal in 2.30 gives the ratio in 16.16 fixed point
+    uint32_t ratio = ((uint64_t)(ti.steps_per_tick >> 32) * current_block->speed_ratio_scale) >> 30;
+    if(ratio > 65536) ratio = 65536; // rounding
+
+    if(ti.acceleration_change != 0) {
+        // on a ramp, update regularly and also exactly at the end of the ramp
+        next_speed_update = current_tick + speed_update_ticks;
+        if(ti.next_accel_event > current_tick && ti.next_accel_event < next_speed_update) next_speed_update = ti.next_accel_event;
+
+    } else if(ti.next_accel_event > current_tick) {
+        // cruising, nothing changes until the next acceleration event
+        next_speed_update = ti.next_accel_event;
+
+    } else {
+        next_speed_update = UINT32_MAX;
+    }
+
+    speed_fnc(ratio);
+}
+
 // returns index of the stepper motor in the array and bitset
 int StepTicker::register_actuator(StepperMotor* m)
 {
@@ -30,15 +30,27 @@ public:
 
     void set_frequency( float frequency );
     void set_unstep_time( float microseconds );
+    bool set_adaptive( bool flg, float min_frequency );
+    void set_speed_update_interval( float microseconds ) { speed_update_interval = microseconds / 1e6F; }
+    bool is_adaptive() const { return adaptive; }
+    uint32_t get_tick_period(float max_step_rate) const;
+    static uint32_t calc_tick_period(float max_step_rate, uint32_t min_period, uint32_t max_period);
     int register_actuator(StepperMotor* motor);
     float get_frequency() const { return frequency; }
     const Block *get_current_block() const { return current_block; }
+    uint32_t get_missed_unsteps() const { return missed_unsteps; }
 
     bool start();
     bool stop();
+    bool is_started() const { return started; }
 
     // whatever setup the block should register this to know when it is done
     std::function<void()> finished_fnc{nullptr};
+    // called from the step ISR with the PWM pulse of the pixel as a raster move reaches each pixel
+    std::function<void(uint16_t)> raster_fnc{nullptr};
+    // called from the step ISR with the speed of the primary motor as a fraction of the nominal speed in 16.16 fixed point,
+    // at the start of each block, at each acceleration event and every speed update interval while accelerating or decelerating
+    std::function<void(uint32_t)> speed_fnc{nullptr};
 
 
 private:
@@ -51,6 +63,8 @@ private:
     bool start_unstep_ticker();
     int initial_setup(const char *dev, void *timer_handler, uint32_t per);
     bool start_next_block();
+    void next_raster_pixel();
+    void update_speed();
 
     static void step_timer_handler(void);
     static void unstep_timer_handler(void);
@@ -66,8 +80,22 @@ private:
     uint32_t frequency{100000}; // 100KHz
     uint32_t delay{1}; //microseconds
 
+    // when adaptive each block is ticked at a rate suited to its maximum step rate
+    uint32_t max_period{0}; // longest tick period in STEP_TIMER_CLOCK ticks (ie min frequency)
+    uint32_t current_period{0}; // period the step timer is currently running at
+    bool adaptive{false};
+
     uint32_t current_tick{0};
 
+    // current pixel of a raster move and the primary motor step count the next one starts at
+    uint32_t raster_pixel{0};
+    uint32_t next_pixel_step{0};
+
+    // tick of the next call to speed_fnc and the ticks between calls while on a ramp
+    uint32_t next_speed_update{0};
+    uint32_t speed_update_ticks{1};
+    float speed_update_interval{0.0001F}; // seconds
+
     uint8_t num_motors{0};
 
     volatile bool running{false};
@@ -93,6 +93,7 @@ void StepperMotor::manual_step(bool dir)
 // prime has TMC2590 or TMC2660 drivers so this handles the setup of those drivers
 #include "TMC2590.h"
 #include "TMC26X.h"
+#include "Spi.h"
 
 bool StepperMotor::vmot= false;
 bool StepperMotor::setup_tmc(ConfigReader& cr, const char *actuator_name, uint32_t type)
@@ -221,6 +222,24 @@ bool StepperMotor::check_driver_error()
     return tmc->check_errors();
 }
 
+int StepperMotor::get_load() const
+{
+    if(tmc == nullptr) return -1;
+    return tmc->get_load();
+}
+
+// static
+void StepperMotor::poll_drivers()
+{
+    // the drivers add themselves to the queue of the SPI channel they are on
+    for (int i = 0; i < SPI::get_n_channels(); ++i) {
+        SPI *spi = SPI::spi_channel[i];
+        if(spi != nullptr && spi->valid()) {
+            spi->run_queue();
+        }
+    }
+}
+
 #else
 
 // Mini has enable pins on the drivers
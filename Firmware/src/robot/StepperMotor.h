@@ -85,6 +85,10 @@ class StepperMotor
         void set_raw_register(OutputStream& os, uint32_t reg, uint32_t val);
         bool set_options(GCode& gcode);
         bool check_driver_error();
+        // the StallGuard2 value from the last poll, lower is more load, -1 if there is not one
+        int get_load() const;
+        // starts a batch read of the status of all the drivers by DMA, used by the next check_driver_error()
+        static void poll_drivers();
         static bool set_vmot(bool state) { bool last= vmot; vmot= state; return last; }
         static bool get_vmot() { return vmot; }
         void set_vmot_lost() { vmot_lost= true; }
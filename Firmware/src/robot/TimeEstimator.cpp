@@ -0,0 +1,552 @@
+#include "TimeEstimator.h"
+#include "ConfigReader.h"
+#include "GCode.h"
+#include "AxisDefns.h"
+#include "Planner.h"
+
+#include <cmath>
+#include <cstring>
+#include <ctype.h>
+#include <algorithm>
+
+// these are the same keys as used by Robot and Planner
+#define motion_control_section         "motion control"
+#define planner_section                "planner"
+#define default_seek_rate_key          "default_seek_rate"
+#define default_feed_rate_key          "default_feed_rate"
+#define compliant_seek_rate_key        "compliant_seek_rate"
+#define default_acceleration_key       "default_acceleration"
+#define mm_per_arc_segment_key         "mm_per_arc_segment"
+#define mm_max_arc_error_key           "mm_max_arc_error"
+#define x_axis_max_speed_key           "x_axis_max_speed"
+#define y_axis_max_speed_key           "y_axis_max_speed"
+#define z_axis_max_speed_key           "z_axis_max_speed"
+#define max_speed_key                  "max_speed"
+#define max_rate_key                   "max_rate"
+#define acceleration_key               "acceleration"
+#define junction_deviation_key         "junction_deviation"
+#define z_junction_deviation_key       "z_junction_deviation"
+#define minimum_planner_speed_key      "minimum_planner_speed"
+#define planner_queue_size_key         "planner_queue_size"
+#define centripetal_acceleration_key   "centripetal_acceleration"
+#define full_vector_junction_key       "full_vector_junction"
+
+#define ARC_ANGULAR_TRAVEL_EPSILON 5E-7F // Float (radians)
+#define PI 3.14159265358979323846F // force to be float, do not use M_PI
+
+enum MOTION_MODE_T { NONE, SEEK, LINEAR, CW_ARC, CCW_ARC };
+
+static const char* const actuator_keys[] = { "alpha", "beta", "gamma" };
+
+TimeEstimator::TimeEstimator()
+{
+    max_speeds[X_AXIS] = max_speeds[Y_AXIS] = 60000.0F / 60.0F;
+    max_speeds[Z_AXIS] = 300.0F / 60.0F;
+    for (int i = 0; i < 3; ++i) {
+        actuator_max_rate[i] = 30000.0F / 60.0F;
+        actuator_acceleration[i] = -1;
+    }
+    actuator_acceleration[3] = -1;
+    reset();
+}
+
+bool TimeEstimator::configure(ConfigReader& cr)
+{
+    ConfigReader::section_map_t m;
+    if(cr.get_section("general", m)) {
+        grbl_mode = cr.get_bool(m, "grbl_mode", false);
+    }
+
+    m.clear();
+    if(cr.get_section(motion_control_section, m)) {
+        feed_rate = cr.get_float(m, default_feed_rate_key, 4000.0F);
+        seek_rate = cr.get_float(m, default_seek_rate_key, 4000.0F);
+        compliant_seek_rate = cr.get_bool(m, compliant_seek_rate_key, false);
+        mm_per_arc_segment = cr.get_float(m, mm_per_arc_segment_key, 0.0F);
+        mm_max_arc_error = cr.get_float(m, mm_max_arc_error_key, 0.01F);
+        max_speeds[X_AXIS] = cr.get_float(m, x_axis_max_speed_key, 60000.0F) / 60.0F;
+        max_speeds[Y_AXIS] = cr.get_float(m, y_axis_max_speed_key, 60000.0F) / 60.0F;
+        max_speeds[Z_AXIS] = cr.get_float(m, z_axis_max_speed_key, 300.0F) / 60.0F;
+        max_speed = cr.get_float(m, max_speed_key, 0) / 60.0F;
+        default_acceleration = cr.get_float(m, default_acceleration_key, 100.0F);
+    } else {
+        printf("WARNING: time-estimator: no motion control section found, defaults used\n");
+    }
+
+    m.clear();
+    if(cr.get_section(planner_section, m)) {
+        junction_deviation = cr.get_float(m, junction_deviation_key, 0.05F);
+        z_junction_deviation = cr.get_float(m, z_junction_deviation_key, -1);
+        minimum_planner_speed = cr.get_float(m, minimum_planner_speed_key, 0.0F);
+        queue_size = cr.get_int(m, planner_queue_size_key, 32);
+        centripetal_acceleration = cr.get_float(m, centripetal_acceleration_key, 0);
+        full_vector_junction = cr.get_bool(m, full_vector_junction_key, false);
+    }
+
+    ConfigReader::sub_section_map_t ssm;
+    if(cr.get_sub_sections("actuator", ssm)) {
+        for (int i = 0; i < 3; ++i) {
+            auto s = ssm.find(actuator_keys[i]);
+            if(s == ssm.end()) continue;
+            auto& mm = s->second;
+            actuator_max_rate[i] = cr.get_float(mm, max_rate_key, 30000.0F) / 60.0F;
+            actuator_acceleration[i] = cr.get_float(mm, acceleration_key, -1);
+        }
+    }
+
+    if(queue_size < 2) queue_size = 2;
+
+    return true;
+}
+
+void TimeEstimator::reset()
+{
+    queue.clear();
+    index.clear();
+    memset(position, 0, sizeof(position));
+    memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+    memset(previous_actuator_vec, 0, sizeof(previous_actuator_vec));
+    total_time = 0;
+    seconds_per_minute = 60.0F;
+    current_offset = 0;
+    line_count = 0;
+    move_count = 0;
+    arc_id = 0;
+    last_arc_id = 0;
+    previous_arc_id = 0;
+    arc_radius = 0;
+    motion_mode = NONE;
+    plane_axis_0 = X_AXIS;
+    plane_axis_1 = Y_AXIS;
+    plane_axis_2 = Z_AXIS;
+    absolute_mode = true;
+    e_absolute_mode = true;
+    inch_mode = false;
+}
+
+bool TimeEstimator::add_line(const char *line, uint32_t offset)
+{
+    current_offset = offset;
+    ++line_count;
+
+    // skip anything that is not gcode, like console commands
+    while(isspace(*line)) ++line;
+    char c = toupper(*line);
+    if(c == 0 || c == ';' || c == '(') return true;
+    if(!(c == 'G' || c == 'M' || c == 'T' || c == 'N' || c == 'X' || c == 'Y' || c == 'Z' || c == 'E' || c == 'F' || c == 'I' || c == 'J')) return true;
+
+    GCodeProcessor::GCodes_t gcodes;
+    if(!gp.parse(line, gcodes)) return false;
+
+    for(auto& g : gcodes) {
+        if(g.has_error()) return false;
+        handle_gcode(g);
+    }
+
+    return true;
+}
+
+float TimeEstimator::finish()
+{
+    flush();
+    return total_time;
+}
+
+bool TimeEstimator::handle_gcode(GCode& gcode)
+{
+    if(gcode.has_g()) {
+        switch(gcode.get_code()) {
+            case 0: case 1: case 2: case 3:
+                process_move(gcode, gcode.get_code() + 1);
+                break;
+
+            case 4: { // dwell, waits for the queue to empty
+                flush();
+                float delay_ms = 0;
+                if (gcode.has_arg('P')) {
+                    // in grbl mode P is decimal seconds, in reprap it is milliseconds
+                    delay_ms = gcode.get_arg('P') * (grbl_mode ? 1000.0F : 1.0F);
+                }
+                if (gcode.has_arg('S')) {
+                    delay_ms += gcode.get_arg('S') * 1000.0F;
+                }
+                total_time += delay_ms / 1000.0F;
+                index.push_back({current_offset, total_time});
+            }
+            break;
+
+            case 17: plane_axis_0 = X_AXIS; plane_axis_1 = Y_AXIS; plane_axis_2 = Z_AXIS; break;
+            case 18: plane_axis_0 = Z_AXIS; plane_axis_1 = X_AXIS; plane_axis_2 = Y_AXIS; break;
+            case 19: plane_axis_0 = Y_AXIS; plane_axis_1 = Z_AXIS; plane_axis_2 = X_AXIS; break;
+            case 20: inch_mode = true; break;
+            case 21: inch_mode = false; break;
+            case 90: absolute_mode = true; e_absolute_mode = true; break;
+            case 91: absolute_mode = false; e_absolute_mode = false; break;
+            case 92:
+                if(gcode.get_subcode() == 0) {
+                    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+                        if(gcode.has_arg('X' + i)) position[i] = gcode.get_arg('X' + i) * (inch_mode ? 25.4F : 1.0F);
+                    }
+                    if(gcode.has_arg('E')) position[3] = gcode.get_arg('E');
+                }
+                break;
+
+            // the time taken to home or probe can not be known
+            default: break;
+        }
+
+    } else if(gcode.has_m()) {
+        switch(gcode.get_code()) {
+            case 82: e_absolute_mode = true; break;
+            case 83: e_absolute_mode = false; break;
+            case 204: if(gcode.has_arg('S')) default_acceleration = gcode.get_arg('S'); break;
+            case 205:
+                if(gcode.has_arg('X')) junction_deviation = gcode.get_arg('X');
+                if(gcode.has_arg('Z')) z_junction_deviation = gcode.get_arg('Z');
+                if(gcode.has_arg('S')) minimum_planner_speed = gcode.get_arg('S');
+                break;
+            case 220:
+                if(gcode.has_arg('S')) {
+                    float factor = gcode.get_arg('S');
+                    if(factor < 10.0F) factor = 10.0F;
+                    if(factor > 1000.0F) factor = 1000.0F;
+                    seconds_per_minute = 6000.0F / factor;
+                }
+                break;
+            case 400: flush(); break; // wait for the queue to empty
+            default: break;
+        }
+    }
+
+    return true;
+}
+
+void TimeEstimator::process_move(GCode& gcode, uint8_t mode)
+{
+    motion_mode = mode;
+    float scale = inch_mode ? 25.4F : 1.0F;
+
+    float target[4];
+    memcpy(target, position, sizeof(target));
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        char letter = 'X' + i;
+        if(gcode.has_arg(letter)) {
+            float p = gcode.get_arg(letter) * scale;
+            target[i] = absolute_mode ? p : position[i] + p;
+        }
+    }
+    if(gcode.has_arg('E')) {
+        float e = gcode.get_arg('E');
+        target[3] = e_absolute_mode ? e : position[3] + e;
+    }
+
+    if(gcode.has_arg('F')) {
+        if(mode == SEEK && !compliant_seek_rate) {
+            seek_rate = gcode.get_arg('F') * scale;
+        } else {
+            feed_rate = gcode.get_arg('F') * scale;
+        }
+    }
+
+    if(mode == CW_ARC || mode == CCW_ARC) {
+        float offset[3]{0, 0, 0};
+        for (int i = 0; i < 3; ++i) {
+            char letter = 'I' + i;
+            if(gcode.has_arg(letter)) offset[i] = gcode.get_arg(letter) * scale;
+        }
+        append_arc(target, offset, mode == CW_ARC);
+
+    } else {
+        append_milestone(target, mode == SEEK ? seek_rate / (compliant_seek_rate ? 60 : seconds_per_minute) : feed_rate / seconds_per_minute);
+    }
+}
+
+// same segmentation as Robot::append_arc() so the junctions are the same
+void TimeEstimator::append_arc(const float target[], const float offset[], bool is_clockwise)
+{
+    float rate_mm_s = feed_rate / seconds_per_minute;
+    float radius = hypotf(offset[plane_axis_0], offset[plane_axis_1]);
+    float center_axis0 = position[plane_axis_0] + offset[plane_axis_0];
+    float center_axis1 = position[plane_axis_1] + offset[plane_axis_1];
+    float linear_travel = target[plane_axis_2] - position[plane_axis_2];
+    float r_axis0 = -offset[plane_axis_0];
+    float r_axis1 = -offset[plane_axis_1];
+    float rt_axis0 = target[plane_axis_0] - center_axis0;
+    float rt_axis1 = target[plane_axis_1] - center_axis1;
+
+    float angular_travel = atan2f(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
+    if (is_clockwise) {
+        if (angular_travel >= -ARC_ANGULAR_TRAVEL_EPSILON) { angular_travel -= (2 * PI); }
+    } else {
+        if (angular_travel <= ARC_ANGULAR_TRAVEL_EPSILON) { angular_travel += (2 * PI); }
+    }
+
+    float millimeters_of_travel = hypotf(angular_travel * radius, fabsf(linear_travel));
+    if(millimeters_of_travel < 0.00001F) return;
+
+    float arc_segment = mm_per_arc_segment;
+    if ((mm_max_arc_error > 0) && (2 * radius > mm_max_arc_error)) {
+        float min_err_segment = 2 * sqrtf((mm_max_arc_error * (2 * radius - mm_max_arc_error)));
+        if (mm_per_arc_segment < min_err_segment) {
+            arc_segment = min_err_segment;
+        }
+    }
+    uint16_t segments = arc_segment > 0 ? ceilf(millimeters_of_travel / arc_segment) : 1;
+    if(segments == 0) segments = 1;
+
+    float theta_per_segment = angular_travel / segments;
+    float linear_per_segment = linear_travel / segments;
+    float e_per_segment = (target[3] - position[3]) / segments;
+
+    float arc_target[4];
+    memcpy(arc_target, position, sizeof(arc_target));
+    arc_radius = radius;
+    if(++last_arc_id == 0) last_arc_id = 1;
+    arc_id = last_arc_id;
+    for (uint16_t i = 1; i < segments; i++) {
+        float cos_Ti = cosf(i * theta_per_segment);
+        float sin_Ti = sinf(i * theta_per_segment);
+        arc_target[plane_axis_0] = center_axis0 + r_axis0 * cos_Ti - r_axis1 * sin_Ti;
+        arc_target[plane_axis_1] = center_axis1 + r_axis0 * sin_Ti + r_axis1 * cos_Ti;
+        arc_target[plane_axis_2] += linear_per_segment;
+        arc_target[3] += e_per_segment;
+        append_milestone(arc_target, rate_mm_s);
+    }
+
+    append_milestone(target, rate_mm_s);
+    arc_id = 0;
+    arc_radius = 0;
+}
+
+// same speed and acceleration limits as Robot::append_milestone() for a cartesian machine
+void TimeEstimator::append_milestone(const float target[], float rate_mm_s)
+{
+    float deltas[3];
+    float sos = 0;
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        deltas[i] = target[i] - position[i];
+        sos += deltas[i] * deltas[i];
+    }
+    float delta_e = target[3] - position[3];
+    memcpy(position, target, sizeof(position));
+
+    if(rate_mm_s <= 0.0F) return;
+
+    float distance = sqrtf(sos);
+    bool auxilliary_move = distance < 0.00001F;
+    float acceleration = default_acceleration;
+
+    if(auxilliary_move) {
+        // E only move
+        distance = fabsf(delta_e);
+        if(distance < 0.00001F) return;
+        float ma = actuator_acceleration[3];
+        if(ma > 0.0001F) acceleration = ma;
+        // E is not part of the actuator vector so this never corners
+        float actuator_vec[3]{0, 0, 0};
+        append_block(distance, nullptr, actuator_vec, rate_mm_s, acceleration, false);
+        return;
+    }
+
+    float unit_vec[3];
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        unit_vec[i] = deltas[i] / distance;
+        if (max_speeds[i] > 0) {
+            float axis_speed = fabsf(unit_vec[i] * rate_mm_s);
+            if (axis_speed > max_speeds[i]) rate_mm_s *= (max_speeds[i] / axis_speed);
+        }
+    }
+    if(max_speed > 0.1F && rate_mm_s > max_speed) rate_mm_s = max_speed;
+
+    // the displacement of each actuator per mm of path, E is left out as in Robot::append_milestone()
+    float actuator_vec[3]{unit_vec[X_AXIS], unit_vec[Y_AXIS], unit_vec[Z_AXIS]};
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        float d = fabsf(unit_vec[i]);
+        if(d == 0) continue;
+        float actuator_rate = d * rate_mm_s;
+        if (actuator_rate > actuator_max_rate[i]) {
+            rate_mm_s *= (actuator_max_rate[i] / actuator_rate);
+        }
+    }
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        float d = fabsf(actuator_vec[i]);
+        float ma = actuator_acceleration[i];
+        if(d > 0 && ma > 0.0001F) {
+            float ca = d * acceleration;
+            if (ca > ma) acceleration *= (ma / ca);
+        }
+    }
+
+    append_block(distance, unit_vec, actuator_vec, rate_mm_s, acceleration, deltas[X_AXIS] == 0 && deltas[Y_AXIS] == 0);
+}
+
+// junction speed as in Planner::append_block(), using the same calculations
+void TimeEstimator::append_block(float distance, const float unit_vec[], const float actuator_vec[], float rate_mm_s, float acceleration, bool z_only)
+{
+    float jd = junction_deviation;
+    if(z_only && z_junction_deviation >= 0.0F) jd = z_junction_deviation;
+    bool primary_axis = unit_vec != nullptr;
+
+    // limit the speed around an arc so the centripetal acceleration is not exceeded
+    if(arc_radius > 0.0F && unit_vec != nullptr) {
+        rate_mm_s = std::min(rate_mm_s, Planner::arc_speed_limit(centripetal_acceleration, arc_radius));
+    }
+
+    float vmax_junction = minimum_planner_speed;
+    if(full_vector_junction) {
+        float previous_nominal_speed = (!queue.empty() && queue.back().primary_axis == primary_axis) ? queue.back().nominal_speed : 0;
+        if(centripetal_acceleration > 0.0F && arc_id != 0 && arc_id == previous_arc_id && previous_nominal_speed > 0.0F) {
+            // a join between segments of the same arc
+            vmax_junction = std::min(previous_nominal_speed, rate_mm_s);
+
+        } else if(jd > 0.0F && previous_nominal_speed > 0.0F) {
+            float accelerations[3];
+            for (int i = 0; i < 3; ++i) {
+                accelerations[i] = actuator_acceleration[i] > 0.0001F ? actuator_acceleration[i] : default_acceleration;
+            }
+            vmax_junction = Planner::junction_speed(previous_actuator_vec, actuator_vec, 3, accelerations, previous_nominal_speed, rate_mm_s, jd, minimum_planner_speed);
+        }
+
+    } else if(unit_vec != nullptr && !queue.empty()) {
+        float previous_nominal_speed = queue.back().primary_axis ? queue.back().nominal_speed : 0;
+        if(jd > 0.0F && previous_nominal_speed > 0.0F) {
+            vmax_junction = Planner::junction_speed(previous_unit_vec, unit_vec, 3, previous_nominal_speed, rate_mm_s, acceleration, jd, minimum_planner_speed);
+        }
+    }
+
+    block_t b;
+    b.millimeters = distance;
+    b.nominal_speed = rate_mm_s;
+    b.acceleration = acceleration;
+    b.max_entry_speed = vmax_junction;
+    b.entry_speed = std::min(vmax_junction, sqrtf(minimum_planner_speed * minimum_planner_speed + 2.0F * acceleration * distance));
+    b.offset = current_offset;
+    b.primary_axis = primary_axis;
+
+    if(unit_vec != nullptr) {
+        memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec));
+    } else {
+        memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+    }
+    memcpy(previous_actuator_vec, actuator_vec, sizeof(previous_actuator_vec));
+    previous_arc_id = arc_id;
+
+    // the planner can only look ahead as far as its queue, so the oldest block is now fixed
+    if(queue.size() >= (size_t)queue_size) retire_block();
+
+    queue.push_back(b);
+    ++move_count;
+    recalculate();
+}
+
+// the reverse and forward passes of Planner::recalculate(), the last block always plans to stop
+void TimeEstimator::recalculate()
+{
+    // the first block is being executed so its entry speed can not change
+    float exit_speed = minimum_planner_speed;
+    for (auto b = queue.rbegin(); b != queue.rend() - 1; ++b) {
+        float max_entry = sqrtf(exit_speed * exit_speed + 2.0F * b->acceleration * b->millimeters);
+        b->entry_speed = std::min(b->max_entry_speed, max_entry);
+        exit_speed = b->entry_speed;
+    }
+
+    float entry_speed = queue.front().entry_speed;
+    for (auto b = queue.begin(); b != queue.end(); ++b) {
+        if(b != queue.begin()) {
+            b->entry_speed = std::min(b->entry_speed, entry_speed);
+        }
+        entry_speed = std::min(b->nominal_speed, sqrtf(b->entry_speed * b->entry_speed + 2.0F * b->acceleration * b->millimeters));
+    }
+}
+
+void TimeEstimator::retire_block()
+{
+    const block_t& b = queue.front();
+    float exit_speed = queue.size() > 1 ? queue[1].entry_speed : minimum_planner_speed;
+    total_time += block_time(b, b.entry_speed, exit_speed);
+
+    if(index.empty() || index_resolution <= 0 || total_time - index.back().time >= index_resolution) {
+        index.push_back({b.offset, total_time});
+    } else if(index.back().offset == b.offset) {
+        index.back().time = total_time;
+    }
+
+    queue.pop_front();
+}
+
+void TimeEstimator::flush()
+{
+    while(!queue.empty()) {
+        retire_block();
+    }
+    if(!index.empty() && index.back().offset < current_offset) {
+        index.push_back({current_offset, total_time});
+    }
+}
+
+// time for a trapezoid, or a triangle if the nominal speed is not reached
+float TimeEstimator::block_time(const block_t& b, float entry_speed, float exit_speed)
+{
+    float a = b.acceleration;
+    float vn = b.nominal_speed;
+    if(a <= 0.0F) return b.millimeters / vn;
+
+    float accel_distance = (vn * vn - entry_speed * entry_speed) / (2.0F * a);
+    float decel_distance = (vn * vn - exit_speed * exit_speed) / (2.0F * a);
+    if(accel_distance + decel_distance <= b.millimeters) {
+        return (vn - entry_speed) / a + (vn - exit_speed) / a + (b.millimeters - accel_distance - decel_distance) / vn;
+    }
+
+    float vp = sqrtf((2.0F * a * b.millimeters + entry_speed * entry_speed + exit_speed * exit_speed) / 2.0F);
+    return std::max(0.0F, vp - entry_speed) / a + std::max(0.0F, vp - exit_speed) / a;
+}
+
+// the index file is text, a header with the total time and the number of entries then offset and time per line
+bool TimeEstimator::write_index(FILE *fp, uint32_t file_size, uint32_t file_date) const
+{
+    if(fprintf(fp, "; time index %f %u %lu %lu\n", total_time, (unsigned)index.size(), (unsigned long)file_size, (unsigned long)file_date) < 0) return false;
+    for(auto& i : index) {
+        if(fprintf(fp, "%lu %1.3f\n", (unsigned long)i.offset, i.time) < 0) return false;
+    }
+    return true;
+}
+
+// reads an index file, if it has more than max_entries then entries are skipped evenly to fit
+bool TimeEstimator::read_index(FILE *fp, index_t& idx, float& total, size_t max_entries, uint32_t file_size, uint32_t file_date)
+{
+    unsigned n;
+    unsigned long size, date;
+    idx.clear();
+    if(fscanf(fp, "; time index %f %u %lu %lu\n", &total, &n, &size, &date) != 4) return false;
+    // the file has been changed since the index was made
+    if(size != file_size || (date != 0 && date != file_date)) return false;
+
+    size_t stride = (max_entries > 0 && n > max_entries) ? (n + max_entries - 1) / max_entries : 1;
+    idx.reserve(n / stride + 1);
+
+    unsigned long offset;
+    float t;
+    size_t cnt = 0;
+    while(fscanf(fp, "%lu %f\n", &offset, &t) == 2) {
+        if((cnt++ % stride) == 0 || cnt == n) {
+            idx.push_back({(uint32_t)offset, t});
+        }
+    }
+
+    return !idx.empty();
+}
+
+// estimated time at which the given file offset has been executed, interpolated between entries
+float TimeEstimator::lookup(const index_t& idx, uint32_t offset)
+{
+    if(idx.empty()) return 0;
+
+    // first entry past the offset, the one before it is the last one at or before the offset
+    auto it = std::upper_bound(idx.begin(), idx.end(), offset, [](uint32_t o, const index_entry_t& e) { return o < e.offset; });
+    if(it == idx.end()) return idx.back().time;
+    if(it == idx.begin()) return it->time * offset / it->offset;
+
+    auto prev = it - 1;
+    if(prev->offset == offset) return prev->time;
+    return prev->time + (it->time - prev->time) * (offset - prev->offset) / (it->offset - prev->offset);
+}
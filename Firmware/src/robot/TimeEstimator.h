@@ -0,0 +1,112 @@
+#pragma once
+
+#include "GCodeProcessor.h"
+
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <stdio.h>
+
+class ConfigReader;
+
+// Estimates how long a gcode file will take to run, the moves are planned with the same
+// acceleration, junction deviation and speed limits as Robot and Planner but no steps are generated.
+// It has no hardware dependencies so it also builds on the host, see tools/estimate
+class TimeEstimator
+{
+public:
+    TimeEstimator();
+
+    // reads the same [motion control], [planner] and [actuator] settings as Robot and Planner
+    bool configure(ConfigReader& cr);
+    void reset();
+
+    // process one line of gcode, offset is the file offset just after the end of the line
+    bool add_line(const char *line, uint32_t offset);
+    // plans the remaining moves to a stop, returns the total time in seconds
+    float finish();
+
+    float get_total_time() const { return total_time; }
+    uint32_t get_line_count() const { return line_count; }
+    uint32_t get_move_count() const { return move_count; }
+
+    // maps a file offset to the time by which everything before it has been executed
+    struct index_entry_t {
+        uint32_t offset;
+        float time;
+    };
+    using index_t = std::vector<index_entry_t>;
+    const index_t& get_index() const { return index; }
+    // minimum time between index entries, 0 is an entry for every move
+    void set_index_resolution(float secs) { index_resolution = secs; }
+
+    // the index has the size and FAT date of the gcode file (fdate << 16 | ftime) so a stale one is not used,
+    // a date of 0 is not checked as the host tool can not know the date the file will have on the sdcard
+    bool write_index(FILE *fp, uint32_t file_size, uint32_t file_date) const;
+    // false if it is invalid or was not made from a file of this size and date
+    static bool read_index(FILE *fp, index_t& index, float& total, size_t max_entries, uint32_t file_size, uint32_t file_date);
+    static float lookup(const index_t& index, uint32_t offset);
+
+    // settings, these can be overridden with the current values from Robot and Planner
+    float default_acceleration{100.0F};  // mm/sec²
+    float junction_deviation{0.05F};
+    float z_junction_deviation{-1};
+    float minimum_planner_speed{0};
+    float feed_rate{4000.0F};             // mm/min
+    float seek_rate{4000.0F};             // mm/min
+    float max_speeds[3];                  // mm/sec for XYZ
+    float max_speed{0};                   // mm/sec 0 disables
+    float actuator_max_rate[3];           // mm/sec
+    float actuator_acceleration[4];       // mm/sec² for XYZE, <= 0 uses default_acceleration
+    float centripetal_acceleration{0};    // mm/sec² 0 disables
+    float mm_per_arc_segment{0};
+    float mm_max_arc_error{0.01F};
+    int queue_size{32};
+    bool compliant_seek_rate{false};
+    bool grbl_mode{false};
+    bool full_vector_junction{false};
+
+private:
+    struct block_t {
+        float millimeters;
+        float nominal_speed;
+        float acceleration;
+        float max_entry_speed;
+        float entry_speed;
+        uint32_t offset;
+        bool primary_axis;
+    };
+
+    bool handle_gcode(GCode& gcode);
+    void process_move(GCode& gcode, uint8_t mode);
+    void append_arc(const float target[], const float offset[], bool is_clockwise);
+    void append_milestone(const float target[], float rate_mm_s);
+    void append_block(float distance, const float unit_vec[], const float actuator_vec[], float rate_mm_s, float acceleration, bool z_only);
+    void recalculate();
+    void retire_block();
+    void flush();
+    static float block_time(const block_t& b, float entry_speed, float exit_speed);
+
+    GCodeProcessor gp{false}; // does not touch the modal state of the real gcode processor
+    std::deque<block_t> queue;
+    index_t index;
+
+    float position[4];  // XYZE in mm
+    float previous_unit_vec[3];
+    float previous_actuator_vec[3]; // XYZ
+    float total_time;
+    float seconds_per_minute;
+    float index_resolution{1.0F};
+    uint32_t current_offset;
+    uint32_t line_count;
+    uint32_t move_count;
+    uint32_t arc_id;            // the arc being segmented, 0 if not in an arc
+    uint32_t last_arc_id;
+    uint32_t previous_arc_id;
+    float arc_radius;
+    uint8_t motion_mode;
+    uint8_t plane_axis_0, plane_axis_1, plane_axis_2;
+    bool absolute_mode;
+    bool e_absolute_mode;
+    bool inch_mode;
+};
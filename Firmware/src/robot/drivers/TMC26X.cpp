@@ -33,6 +33,7 @@
 #include "Robot.h"
 #include "StepperMotor.h"
 #include "Spi.h"
+#include "SpiQueue.h"
 #include "Pin.h"
 #include "ConfigReader.h"
 #include "StringUtils.h"
@@ -146,6 +147,8 @@
 #define STATUS_OPEN_LOAD_A               0x00020ul
 #define STATUS_OPEN_LOAD_B               0x00040ul
 #define STATUS_STAND_STILL               0x00080ul
+// the flags that are errors, these are latched between checks when the status is polled
+#define STATUS_ERROR_FLAGS               0x0007Eul
 #define READOUT_VALUE_PATTERN            0xFFC00ul
 
 // config keys
@@ -275,6 +278,36 @@ bool TMC26X::config(ConfigReader& cr, const char *actuator_name)
         }
     }
 
+    // add this driver to the batch that polls the status of all of them by DMA
+    SpiQueue *q = spi->get_queue();
+    if(q != nullptr) {
+        q->add(
+            // sending the driver configuration reads back the status, it is not sent until the driver has been started
+            // the poll always selects the StallGuard2 readout, the status flags are in every readout
+            [this](uint8_t *tx) {
+                if(!started) return 0UL;
+                uint32_t d = (driver_configuration_register_value & ~READ_SELECTION_PATTERN) | READ_STALL_GUARD_READING;
+                tx[0] = d >> 16; tx[1] = d >> 8; tx[2] = d & 0xff;
+                // the bus is held for the whole batch so nothing else can change the readout before this is sent
+                poll_readout = chip_readout;
+                chip_readout = READ_STALL_GUARD_READING;
+                return 3UL;
+            },
+            [this](bool sel) { spi_cs->set(!sel); },
+            [this](const uint8_t *rx, bool ok) {
+                if(!ok) return;
+                uint32_t v = ((rx[0] << 16) | (rx[1] << 8) | rx[2]) >> 4;
+                // the all flags readout has a different layout so is not used, and bits 8 and 9 set is a bad response
+                if(poll_readout == READ_ALL_FLAGS || (v & 0x00300) != 0) return;
+                if(poll_readout == READ_STALL_GUARD_READING) {
+                    polled_load = v >> 10;
+                }
+                polled_status = poll_readout == READ_MICROSTEP_POSITION ? v : (v & ~READOUT_VALUE_PATTERN);
+                polled_flags |= v & STATUS_ERROR_FLAGS;
+                ++poll_count;
+            });
+    }
+
     // setup some default values
     #if 0
         //set to a conservative start value
@@ -905,7 +938,6 @@ bool TMC26X::isEnabled()
  */
 void TMC26X::readStatus(enum READOUT read_value)
 {
-    unsigned long old_driver_configuration_register_value = driver_configuration_register_value;
     //reset the readout configuration
     driver_configuration_register_value &= ~(READ_SELECTION_PATTERN);
     //this now equals TMC26X_READOUT_POSITION - so we just have to check the other two options
@@ -927,7 +959,8 @@ void TMC26X::readStatus(enum READOUT read_value)
 
     // FIXME this needs to be atomic as a readStatus in between the two could change the results read back
     //check if the readout is configured for the value we are interested in
-    if (driver_configuration_register_value != old_driver_configuration_register_value) {
+    // the async poll also changes the readout so check what the chip is set to rather than what was last asked for
+    if ((driver_configuration_register_value & READ_SELECTION_PATTERN) != chip_readout) {
         //because then we need to write the value twice - one time for configuring, second time to get the value, see below
         send262(driver_configuration_register_value);
     }
@@ -1093,6 +1126,8 @@ void TMC26X::dump_status(OutputStream& stream, bool readable)
         stream.printf("designator %c, actuator %s, Chip type TMC2660\n", designator, name.c_str());
 
         check_error_status_bits(stream);
+        // the above may have used the polled status which does not have the position
+        readStatus(TMC26X_READOUT_POSITION);
 
         if (this->isStallGuardReached()) {
             stream.printf("Stall Guard level reached!\n");
@@ -1261,7 +1296,16 @@ const std::array<TMC26X::e_t, 6> TMC26X::tests {{
 bool TMC26X::check_error_status_bits(OutputStream& stream)
 {
     bool error = false;
-    readStatus(TMC26X_READOUT_POSITION); // get the status bits
+    if(poll_count != last_poll_count) {
+        // use the status read by the last poll rather than reading it now, along with any errors seen since the last check
+        taskENTER_CRITICAL();
+        driver_status_result = polled_status | polled_flags;
+        polled_flags = 0;
+        last_poll_count = poll_count;
+        taskEXIT_CRITICAL();
+    } else {
+        readStatus(TMC26X_READOUT_POSITION); // get the status bits
+    }
 
     // test the flags are ok
     if((driver_status_result & 0x00300) != 0){
@@ -1421,6 +1465,8 @@ int TMC26X::sendSPI(uint8_t *b, int cnt, uint8_t *r)
 {
     // lock the SPI bus for this transaction
     if(!spi->begin_transaction()) return false;
+    // keep track of the readout selected in the chip, this is done with the bus held as the poll also changes it
+    if((b[0] & (DRIVER_CONFIG_REGISTER >> 16)) == (DRIVER_CONFIG_REGISTER >> 16)) chip_readout = b[2] & READ_SELECTION_PATTERN;
     spi_cs->set(false);
     bool stat= spi->write_read(b, r, cnt);
     spi_cs->set(true);
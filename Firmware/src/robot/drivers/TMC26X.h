@@ -130,6 +130,7 @@ public:
     virtual void dump_status(OutputStream& stream, bool readable= true);
     virtual bool set_options(const GCode& gcode);
     virtual uint32_t get_status() const;
+    virtual int get_load() const { return polled_load; }
     virtual void lock(bool flg);
 
 private:
@@ -475,6 +476,16 @@ private:
     unsigned long driver_configuration_register_value;
     //the driver status result
     unsigned long driver_status_result;
+    // the status read by the async poll, written from the ISR
+    volatile uint32_t polled_status{0};
+    volatile uint32_t polled_flags{0};
+    volatile uint32_t poll_count{0};
+    uint32_t last_poll_count{0};
+    // the StallGuard2 value from the last poll, -1 until there is one
+    volatile int16_t polled_load{-1};
+    // the readout the chip is set to, and what it was set to when the poll was sent as that is what it reads back
+    volatile uint32_t chip_readout{0xFFFFFFFF};
+    uint32_t poll_readout{0xFFFFFFFF};
 
     //status values
     int microsteps; //the current number of micro steps
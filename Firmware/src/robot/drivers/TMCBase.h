@@ -22,6 +22,8 @@ public:
     virtual void dump_status(OutputStream& stream, bool readable = true)=0;
 	virtual bool set_options(const GCode& gcode)=0;
 	virtual uint32_t get_status() const { return 0; }
+	// the StallGuard2 value read by the last poll, -1 if not available
+	virtual int get_load() const { return -1; }
     virtual void lock(bool) {}
 
     // bit masks for status bits returned in get_status
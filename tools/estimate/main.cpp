@@ -0,0 +1,120 @@
+// Estimates how long a gcode file will take to run on the machine described by the config file
+// usage: estimate [-c config.ini] [-i] [-r secs] [-v] file.gcode
+//   -c the config.ini to take the speeds, accelerations and junction deviation from
+//   -i writes file.gcode.idx which the player uses to show the progress and time remaining
+//   -r the minimum time between index entries (default 1 second)
+//   -v prints the time at each index entry
+
+#include "TimeEstimator.h"
+#include "ConfigReader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-c config.ini] [-i] [-r secs] [-v] file.gcode\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *config = nullptr;
+    bool write_index = false;
+    bool verbose = false;
+    float resolution = 1.0F;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:ir:v")) != -1) {
+        switch (c) {
+            case 'c': config = optarg; break;
+            case 'i': write_index = true; break;
+            case 'r': resolution = strtof(optarg, nullptr); break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind >= argc) usage(argv[0]);
+    const char *fn = argv[optind];
+
+    TimeEstimator te;
+    if(config != nullptr) {
+        std::ifstream ifs(config);
+        if(!ifs.is_open()) {
+            fprintf(stderr, "Could not open config file: %s\n", config);
+            return 1;
+        }
+        ConfigReader cr(ifs);
+        te.configure(cr);
+    } else {
+        printf("No config file given, using the firmware defaults\n");
+    }
+    te.set_index_resolution(resolution);
+
+    FILE *fp = fopen(fn, "r");
+    if(fp == nullptr) {
+        fprintf(stderr, "File not found: %s\n", fn);
+        return 1;
+    }
+
+    // same line handling as the Player
+    char buf[130];
+    uint32_t offset = 0;
+    uint32_t errors = 0;
+    bool discard = false;
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        int len = strlen(buf);
+        offset += len;
+        if(buf[len - 1] != '\n' && !feof(fp)) {
+            discard = true; // lines longer than 128 characters are discarded
+            continue;
+        }
+        if(discard) {
+            discard = false;
+            continue;
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if(!te.add_line(buf, offset)) {
+            if(verbose) printf("Error in line %u: %s\n", te.get_line_count(), buf);
+            ++errors;
+        }
+    }
+    fclose(fp);
+
+    float total = te.finish();
+
+    if(verbose) {
+        for(auto& i : te.get_index()) {
+            printf("%8u %10.3f\n", i.offset, i.time);
+        }
+    }
+
+    unsigned long secs = lroundf(total);
+    printf("%s: %u lines, %u moves, %u errors\n", fn, te.get_line_count(), te.get_move_count(), errors);
+    printf("Estimated time: %02lu:%02lu:%02lu (%1.1f secs)\n", secs / 3600, (secs % 3600) / 60, secs % 60, total);
+
+    if(write_index) {
+        std::string idx(fn);
+        idx.append(".idx");
+        FILE *ofp = fopen(idx.c_str(), "w");
+        // the date the file will have on the sdcard is not known so only the size is checked
+        struct stat st;
+        uint32_t size = stat(fn, &st) == 0 ? st.st_size : 0;
+        if(ofp == nullptr || !te.write_index(ofp, size, 0)) {
+            fprintf(stderr, "Could not write index file: %s\n", idx.c_str());
+            if(ofp != nullptr) fclose(ofp);
+            return 1;
+        }
+        fclose(ofp);
+        printf("Wrote %u index entries to %s\n", (unsigned)te.get_index().size(), idx.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Stress test for the lock free rings in Firmware/src/libs/RingBuffer.h using host threads, which really run at the
+// same time on different cores rather than being switched by the scheduler like the TEST_ringbuffer tasks.
+// Build with make tsan to run it under ThreadSanitizer, which checks the memory ordering of head and tail as well.
+// usage: ringbuffer-stress [count]
+
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static bool spsc(uint32_t count)
+{
+    RingBuffer<uint32_t, 64> rb;
+
+    std::thread producer([&rb, count]() {
+        // mix single and bulk pushes of odd sizes so they go round the end at different places
+        uint32_t buf[13];
+        uint32_t next = 0;
+        while(next < count) {
+            if((next & 7) == 0) {
+                if(rb.push(next)) ++next;
+                else std::this_thread::yield();
+                continue;
+            }
+            uint32_t n = 1 + next % 13;
+            if(n > count - next) n = count - next;
+            for (uint32_t i = 0; i < n; ++i) buf[i] = next + i;
+            uint32_t done = rb.push(buf, n);
+            next += done;
+            if(done < n) std::this_thread::yield();
+        }
+    });
+
+    uint32_t expect = 0;
+    uint32_t buf[17];
+    bool ok = true;
+    while(expect < count) {
+        uint32_t n;
+        if(expect & 1) {
+            n = rb.pop(buf, 1 + expect % 17);
+        } else {
+            n = rb.pop(buf[0]) ? 1 : 0;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            if(buf[i] != expect++) ok = false;
+        }
+        if(n == 0) std::this_thread::yield();
+    }
+    producer.join();
+
+    printf("spsc: %u values %s\n", count, ok && rb.empty() ? "ok" : "FAILED");
+    return ok && rb.empty();
+}
+
+static bool mpsc(uint32_t count, uint32_t producers)
+{
+    MPSCRingBuffer<uint32_t, 16> rb;
+
+    std::vector<std::thread> threads;
+    for (uint32_t id = 0; id < producers; ++id) {
+        threads.emplace_back([&rb, id, count]() {
+            for (uint32_t i = 0; i < count; ++i) {
+                while(!rb.push((id << 24) | i)) std::this_thread::yield();
+            }
+        });
+    }
+
+    // each producer's values must come out in the order it pushed them
+    std::vector<uint32_t> expect(producers, 0);
+    uint32_t total = 0;
+    bool ok = true;
+    while(total < producers * count) {
+        uint32_t v;
+        if(!rb.pop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t id = v >> 24;
+        if(id >= producers || (v & 0x00FFFFFF) != expect[id]) {
+            ok = false;
+        } else {
+            ++expect[id];
+        }
+        ++total;
+    }
+    for(auto& t : threads) t.join();
+
+    printf("mpsc: %u producers of %u values %s\n", producers, count, ok && rb.empty() ? "ok" : "FAILED");
+    return ok && rb.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    if(count == 0 || count > 0x00FFFFFF) {
+        fprintf(stderr, "usage: %s [count], count is 1 to %u\n", argv[0], 0x00FFFFFF);
+        return 1;
+    }
+
+    bool ok = spsc(count);
+    ok = mpsc(count / 4, 4) && ok;
+    return ok ? 0 : 1;
+}